@@ -2,12 +2,24 @@
 // Created by WireWhiz on 10/22/2024.
 //
 
+#include <algorithm>
+#include <cctype>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <optional>
 #include <string>
 #include "parser/documentParser.h"
 #include <string_view>
+#include <vector>
+#include "compiler/compiler.h"
+#include "ir/linker.h"
+#include "ir/moduleFormat.h"
+#include "ir/profileData.h"
+#include "optimizer/passManager.h"
+#ifdef BS_HAS_LLVM
+#include "jit/aot.h"
+#endif
 
 #include "../parser/tree_sitter_branescript.h"
 #include "tree_sitter/api.h"
@@ -67,30 +79,233 @@ void print_tree(TSNode node, std::string_view source, int currentDepth = 0)
     }
 }
 
+std::optional<std::string> read_file(const std::filesystem::path& path)
+{
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if(!f.is_open())
+        return std::nullopt;
+    std::string source_code;
+    auto count = f.tellg();
+
+    source_code.resize(count);
+    f.seekg(0);
+    f.read(source_code.data(), count);
+    return source_code;
+}
+
+void print_usage()
+{
+    std::cout << "Usage:\n"
+                 "  BraneScriptCli <file>                      Print the syntax tree and modules of a file\n"
+                 "  BraneScriptCli build [options] <paths...>  Compile .bscript files and directories, link them with\n"
+                 "                                             any .bsm modules given and write native code\n"
+                 "\n"
+                 "Build options:\n"
+                 "  -o <file>          Output object file, static library if it ends in .a or .lib, or a module to\n"
+                 "                     link into later builds if it ends in .bsm\n"
+                 "  --entry <name>     Keep the function, repeatable. If given, functions that no pipeline or entry\n"
+                 "                     point calls are dropped, otherwise every function is kept\n"
+                 "  --header <file>    Also write a C header declaring the exported entry points\n"
+                 "  -O0, -O1, -O2, -O3 Optimization level, -O2 by default\n"
+                 "  --target <triple>  Target triple, the host by default\n"
+                 "  --cpu <name>       Target CPU\n"
+                 "  --features <list>  Target features, for example +avx2\n"
+                 "  --profile <file>   Guide inlining with counters recorded by a profiling VM\n";
+}
+
+int build(int argc, char* argv[])
+{
+#ifdef BS_HAS_LLVM
+    BraneScript::NativeTargetOptions options;
+    std::filesystem::path output;
+    std::optional<std::filesystem::path> headerPath;
+    std::optional<std::filesystem::path> profilePath;
+    std::vector<std::filesystem::path> sources;
+    std::vector<std::string> entryPoints;
+    for(int i = 0; i < argc; i++)
+    {
+        std::string_view arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if(arg == "-o" && hasValue)
+            output = argv[++i];
+        else if(arg == "--header" && hasValue)
+            headerPath = argv[++i];
+        else if(arg == "--target" && hasValue)
+            options.triple = argv[++i];
+        else if(arg == "--cpu" && hasValue)
+            options.cpu = argv[++i];
+        else if(arg == "--features" && hasValue)
+            options.features = argv[++i];
+        else if(arg == "--profile" && hasValue)
+            profilePath = argv[++i];
+        else if(arg == "--entry" && hasValue)
+            entryPoints.emplace_back(argv[++i]);
+        else if(arg.size() == 3 && arg.starts_with("-O") && arg[2] >= '0' && arg[2] <= '3')
+            options.optLevel = (BraneScript::NativeOptLevel)(arg[2] - '0');
+        else if(arg.starts_with("-"))
+        {
+            std::cout << "Unknown option " << arg << std::endl;
+            print_usage();
+            return 1;
+        }
+        else
+            sources.emplace_back(arg);
+    }
+    if(output.empty() || sources.empty())
+    {
+        print_usage();
+        return 1;
+    }
+
+    // A workspace is every .bscript file under the given directories, plus any files given directly. Modules built
+    // earlier are linked with the ones compiled from it.
+    std::vector<std::filesystem::path> files;
+    std::vector<std::filesystem::path> prebuilt;
+    for(auto& source : sources)
+    {
+        if(!std::filesystem::is_directory(source))
+        {
+            (source.extension() == ".bsm" ? prebuilt : files).push_back(source);
+            continue;
+        }
+        for(auto& entry : std::filesystem::recursive_directory_iterator(source))
+        {
+            if(entry.is_regular_file() && entry.path().extension() == ".bscript")
+                files.push_back(entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    std::sort(prebuilt.begin(), prebuilt.end());
+
+    std::vector<std::shared_ptr<BraneScript::ParsedDocument>> documents;
+    for(auto& file : files)
+    {
+        auto source = read_file(file);
+        if(!source)
+        {
+            std::cout << "File \"" << file.string() << "\" does not exist!" << std::endl;
+            return 1;
+        }
+        documents.push_back(std::make_shared<BraneScript::ParsedDocument>(file, std::move(*source)));
+    }
+
+    BraneScript::Compiler compiler;
+    auto result = compiler.compile(documents);
+    bool failed = false;
+    for(auto& message : result.messages)
+    {
+        auto& source = std::get<BraneScript::CompilerFileSource>(message.source);
+        std::cout << source.path;
+        if(source.range)
+            std::cout << ":" << source.range->start_point.row + 1 << ":" << source.range->start_point.column + 1;
+        std::cout << ": " << message.message << std::endl;
+        failed |= message.type <= BraneScript::CompilerMessageType::Error;
+    }
+    if(failed)
+        return 1;
+
+    std::vector<BraneScript::BSModule> modules = std::move(result.modules);
+    for(auto& path : prebuilt)
+    {
+        auto mapped = BraneScript::MappedFile::open(path);
+        if(!mapped)
+        {
+            std::cout << mapped.error() << std::endl;
+            return 1;
+        }
+        auto view = BraneScript::ModuleView::open(mapped->data());
+        if(!view)
+        {
+            std::cout << path.string() << ": " << view.error() << std::endl;
+            return 1;
+        }
+        modules.push_back(view->toModule());
+    }
+
+    BraneScript::LinkOptions linkOptions;
+    linkOptions.name = output.stem().string();
+    linkOptions.entryPoints = entryPoints;
+    linkOptions.keepUnreferenced = entryPoints.empty();
+    auto linked = BraneScript::linkModules(modules, linkOptions);
+    if(!linked)
+    {
+        std::cout << linked.error() << std::endl;
+        return 1;
+    }
+
+    std::optional<BraneScript::ProfileData> profile;
+    if(profilePath)
+    {
+        auto loaded = BraneScript::readProfileFile(*profilePath);
+        if(!loaded)
+        {
+            std::cout << loaded.error() << std::endl;
+            return 1;
+        }
+        profile = std::move(*loaded);
+    }
+
+    auto passes = BraneScript::PassManager::defaultPipeline();
+    if(profile)
+        passes.setProfile(&*profile);
+    passes.run(*linked);
+
+    auto image = std::span<const BraneScript::BSModule>(&*linked, 1);
+    auto extension = output.extension();
+    std::expected<void, std::string> written;
+    if(extension == ".bsm")
+        written = BraneScript::writeModuleFile(output, *linked);
+    else if(extension == ".a" || extension == ".lib")
+        written = BraneScript::writeNativeLibrary(image, output, options);
+    else
+        written = BraneScript::writeNativeObject(image, output, options);
+    if(!written)
+    {
+        std::cout << written.error() << std::endl;
+        return 1;
+    }
+    if(headerPath)
+    {
+        std::string guard = "BRANESCRIPT_" + headerPath->stem().string() + "_H";
+        for(auto& c : guard)
+            c = std::isalnum((unsigned char)c) ? (char)std::toupper((unsigned char)c) : '_';
+        std::ofstream header(*headerPath, std::ios::binary);
+        header << BraneScript::generateNativeHeader(image, guard);
+        if(!header)
+        {
+            std::cout << "Failed to write " << headerPath->string() << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+#else
+    std::cout << "BraneScriptCli was built without the LLVM backend, native builds are unavailable" << std::endl;
+    return 1;
+#endif
+}
+
 int main(int argc, char* argv[])
 {
+    if(argc >= 2 && std::string_view(argv[1]) == "build")
+        return build(argc - 2, argv + 2);
+
     std::cout << "Hello world!" << std::endl;
     std::cout << "Running in dir: " << std::filesystem::current_path() << std::endl;
 
     if(argc < 2)
     {
         std::cout << "Must provide file to parse!" << std::endl;
+        print_usage();
         return 1;
     }
 
-    std::ifstream f(argv[1], std::ios::binary | std::ios::ate);
-    if(!f.is_open())
+    auto source = read_file(argv[1]);
+    if(!source)
     {
         std::cout << "File \"" << argv[1] << "\" does not exist!" << std::endl;
         return 1;
     }
-    std::string source_code;
-    auto count = f.tellg();
-
-    source_code.resize(count);
-    f.seekg(0);
-    f.read(source_code.data(), count);
-    f.close();
+    std::string source_code = std::move(*source);
 
     std::cout << "Parsing: \n" << source_code << std::endl;
     TSParser* parser = ts_parser_new();
@@ -108,9 +323,7 @@ int main(int argc, char* argv[])
     print_tree(root_node, source_code);
 
     printf("Parsing DocumentContext...\n");
-    auto bs_parser = std::make_shared<BraneScript::BraneScriptParser>();
-
-    BraneScript::ParsedDocument doc(argv[1], source_code, bs_parser);
+    BraneScript::ParsedDocument doc(argv[1], source_code);
 
     auto parseRes = doc.getDocumentContext();
 
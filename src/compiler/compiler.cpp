@@ -1,121 +1,625 @@
 #include "compiler.h"
 
-#include <expected>
+#include <algorithm>
+#include <cassert>
+#include <format>
+#include <functional>
+#include <set>
 #include <tree_sitter/api.h>
+#include "../ir/typeTable.h"
 
-void Compiler::recordMessage(CompilerMessage message)
+namespace BraneScript
 {
-    _result.messages.push_back(std::move(message));
-}
+    template<class... Ts>
+    struct overloads : Ts...
+    {
+        using Ts::operator()...;
+    };
 
+    namespace
+    {
+        std::optional<BSBaseType> baseTypeFromName(std::string_view name)
+        {
+            static const std::unordered_map<std::string_view, BSBaseType> baseTypes = {
+                {"u8", BSBaseType::U8},
+                {"i8", BSBaseType::I8},
+                {"u16", BSBaseType::U16},
+                {"i16", BSBaseType::I16},
+                {"u32", BSBaseType::U32},
+                {"i32", BSBaseType::I32},
+                {"f32", BSBaseType::F32},
+                {"u64", BSBaseType::U64},
+                {"i64", BSBaseType::I64},
+                {"f64", BSBaseType::F64},
+                {"u128", BSBaseType::U128},
+                {"i128", BSBaseType::I128},
+            };
+            auto type = baseTypes.find(name);
+            if(type == baseTypes.end())
+                return std::nullopt;
+            return type->second;
+        }
 
-CompileResult Compiler::compile(const std::vector<std::shared_ptr<ParsedDocument>>& documents)
-{
-    _result = CompileResult();
-    _identifers.clear();
-    _modules.clear();
-
-    _sources.clear();
-    for(auto& source: documents)
-        _sources.emplace(source->source(), source);
-
-    auto globalMod = std::make_shared<Module>("global");
-    _identifers.insert({"global", globalMod});
-    _modules.insert({"global", globalMod});
-
-    indexSymbolsPass();
-    generateModulesPass();
-    
-    for(auto& mod: _modules)
-        _result.modules.push_back(std::move(*mod.second));
-    return std::move(_result);
-}
-
-std::expected<ScopedIdentifier, CompilerMessage> parseScopedIdentifier(TSNode idRoot, const ParsedDocument& doc)
-{
-    ScopedIdentifier id;
+        /// Interned into the module's table, which jobs of the same module share
+        TypeId resolveType(TypeTable& types, const TypeContext& typeCtx)
+        {
+            std::string name;
+            for(auto& segment : typeCtx.baseType->scopes)
+            {
+                if(!name.empty())
+                    name += "::";
+                name += std::get<Node<Identifier>>(segment)->text;
+            }
 
-    while(!ts_node_is_null(idRoot))
-    {
-        TSNode idNameNode = ts_node_child_by_field_name(idRoot, "id", 2);
-        std::optional<std::vector<TemplateArg>> templateArgs;
+            TypeId type;
+            if(auto base = baseTypeFromName(name))
+                type = TypeTable::base(*base);
+            else
+                type = types.structType(std::move(name));
+
+            for(auto modifier : typeCtx.modifiers)
+                type = types.ref(type, modifier == TypeModifiers::MutRef);
+            return type;
+        }
+
+        using MessageCallback = std::function<void(CompilerMessageType, TSRange, std::string)>;
+
+        /// Lowers the expressions of a single pipeline stage or function body into IR operations
+        struct CodeGenerator
+        {
+            std::vector<TypeId>& localVars;
+            InstructionList& operations;
+            TypeTable& types;
+            MessageCallback message;
+            std::unordered_map<std::string, IRValue> namedValues;
+
+            CodeGenerator(std::vector<TypeId>& localVars,
+                          InstructionList& operations,
+                          TypeTable& types,
+                          MessageCallback message)
+                : localVars(localVars), operations(operations), types(types), message(std::move(message))
+            {}
+
+            IRValue newValue(TypeId type)
+            {
+                localVars.push_back(type);
+                return IRValue{(uint32_t)(localVars.size() - 1)};
+            }
+
+            IRValue defineValue(const ValueContext& value, TypeId fallbackType)
+            {
+                auto id = newValue(value.type ? resolveType(types, *value.type.value()) : fallbackType);
+                if(value.label)
+                    namedValues.insert_or_assign(value.label.value()->text, id);
+                return id;
+            }
+
+            IRValue binaryOp(OpCode op, IRValue left, IRValue right, TypeId resultType)
+            {
+                auto out = newValue(resultType);
+                operations.binary(op, left, right, out);
+                return out;
+            }
+
+            IRValue unaryOp(OpCode op, IRValue in, TypeId resultType)
+            {
+                auto out = newValue(resultType);
+                operations.unary(op, in, out);
+                return out;
+            }
+
+            std::optional<IRValue> lower(const ExpressionContextNode& expression)
+            {
+                return std::visit(overloads{
+                                      [&](const Node<ExpressionErrorContext>& error) -> std::optional<IRValue> {
+                    message(CompilerMessageType::Error, error->range, error->message);
+                    return std::nullopt;
+                },
+                                      [&](const Node<ScopeContext>& scope) { return lowerScope(*scope); },
+                                      [&](const Node<UnaryOperatorContext>& op) { return lowerUnary(*op); },
+                                      [&](const Node<BinaryOperatorContext>& op) { return lowerBinary(*op); },
+                                  },
+                                  expression);
+            }
+
+            std::optional<IRValue> lowerScope(const ScopeContext& scope)
+            {
+                for(auto& local : scope.localVariables)
+                    defineValue(*local, TypeTable::base(BSBaseType::I32));
+
+                std::optional<IRValue> last;
+                for(auto& expression : scope.expressions)
+                    last = lower(expression);
+                return last;
+            }
+
+            std::optional<IRValue> lowerUnary(const UnaryOperatorContext& op)
+            {
+                auto in = lower(op.arg);
+                if(!in)
+                    return std::nullopt;
+                TypeId type = localVars[in->id];
+                switch(op.opType)
+                {
+                    case UnaryOperator::LogicNot:
+                        return unaryOp(OpCode::LogicNot, *in, type);
+                    case UnaryOperator::BitwiseNot:
+                        return unaryOp(OpCode::BitNot, *in, type);
+                    default:
+                        message(CompilerMessageType::Error, op.range, "Unary operator not supported by IR yet");
+                        return std::nullopt;
+                }
+            }
+
+            std::optional<IRValue> lowerBinary(const BinaryOperatorContext& op)
+            {
+                auto left = lower(op.left);
+                auto right = lower(op.right);
+                if(!left || !right)
+                    return std::nullopt;
+
+                TypeId type =
+                    op.returnType.type ? resolveType(types, *op.returnType.type.value()) : localVars[left->id];
+                switch(op.opType)
+                {
+                    case BinaryOperator::Add:
+                        return binaryOp(OpCode::Add, *left, *right, type);
+                    case BinaryOperator::Sub:
+                        return binaryOp(OpCode::Sub, *left, *right, type);
+                    case BinaryOperator::Mul:
+                        return binaryOp(OpCode::Mul, *left, *right, type);
+                    case BinaryOperator::Div:
+                        return binaryOp(OpCode::Div, *left, *right, type);
+                    case BinaryOperator::Mod:
+                        return binaryOp(OpCode::Mod, *left, *right, type);
+                    case BinaryOperator::Equal:
+                        return binaryOp(OpCode::Eq, *left, *right, type);
+                    case BinaryOperator::NotEqual:
+                        return binaryOp(OpCode::Ne, *left, *right, type);
+                    case BinaryOperator::Greater:
+                        return binaryOp(OpCode::Gt, *left, *right, type);
+                    case BinaryOperator::GreaterEqual:
+                        return binaryOp(OpCode::Ge, *left, *right, type);
+                    // Less than comparisons are expressed as greater than comparisons with swapped arguments
+                    case BinaryOperator::Less:
+                        return binaryOp(OpCode::Gt, *right, *left, type);
+                    case BinaryOperator::LessEqual:
+                        return binaryOp(OpCode::Ge, *right, *left, type);
+                    case BinaryOperator::LogicAnd:
+                        return binaryOp(OpCode::LogicAnd, *left, *right, type);
+                    case BinaryOperator::LogicOr:
+                        return binaryOp(OpCode::LogicOr, *left, *right, type);
+                    case BinaryOperator::BitwiseAnd:
+                        return binaryOp(OpCode::BitAnd, *left, *right, type);
+                    case BinaryOperator::BitwiseOr:
+                        return binaryOp(OpCode::BitOr, *left, *right, type);
+                    case BinaryOperator::BitwiseXOr:
+                        return binaryOp(OpCode::BitXor, *left, *right, type);
+                    default:
+                        message(CompilerMessageType::Error, op.range, "Binary operator not supported by IR yet");
+                        return std::nullopt;
+                }
+            }
+        };
+
+        /// Refers to structs by index instead of by name, the module's own by their place in its structs and any other
+        /// through its imports, so the module can be compiled on its own and linked with the modules that declare them
+        void importStructs(BSModule& module)
+        {
+            std::unordered_map<std::string, int32_t> indices;
+            for(size_t s = 0; s < module.structs.size(); ++s)
+                indices.emplace(module.structs[s]->id, (int32_t)s + 1);
+
+            // Imports are sorted by name, so they don't depend on which job happened to intern a type first
+            auto& types = module.types;
+            std::set<std::string> external;
+            for(size_t id = 0; id < types.size(); ++id)
+            {
+                auto* structType = std::get_if<IRNode<BSStructType>>(&types.type((TypeId)id));
+                auto* name = structType ? std::get_if<std::string>(&(*structType)->structId) : nullptr;
+                if(name && !indices.contains(*name))
+                    external.insert(*name);
+            }
+            for(auto& name : external)
+            {
+                module.imports.push_back(name);
+                indices.emplace(name, -(int32_t)module.imports.size());
+            }
+
+            // A ref is always interned after the type it refers to, so that type has already been moved
+            TypeTable relocated;
+            std::vector<TypeId> moved(types.size());
+            for(size_t id = 0; id < types.size(); ++id)
+            {
+                auto type = (TypeId)id;
+                if(TypeTable::baseType(type))
+                    moved[id] = type;
+                else if(types.isRef(type))
+                    moved[id] = relocated.ref(moved[(size_t)types.dereferenced(type)], types.isMutableRef(type));
+                else
+                {
+                    auto& structId = std::get<IRNode<BSStructType>>(types.type(type))->structId;
+                    auto* name = std::get_if<std::string>(&structId);
+                    moved[id] = relocated.structType(name ? IDRef{indices.at(*name)} : structId);
+                }
+            }
 
-        // TODO actually parse templateArgs
+            auto move = [&](std::vector<TypeId>& ids) {
+                for(auto& id : ids)
+                    id = moved[(size_t)id];
+            };
+            for(auto& structDef : module.structs)
+                move(structDef->members);
+            for(auto& function : module.functions)
+            {
+                move(function->localVars);
+                move(function->inputs);
+                move(function->outputs);
+            }
+            for(auto& pipeline : module.pipelines)
+            {
+                move(pipeline->inputs);
+                move(pipeline->outputs);
+                if(!pipeline->stages)
+                    continue;
+                for(auto& stage : *pipeline->stages)
+                {
+                    move(stage.localVars);
+                    for(auto& op : stage.asyncOps)
+                        move(std::get<BSAsyncCall>(op).outputs);
+                }
+            }
+            types = std::move(relocated);
+        }
 
-        id.scopes.emplace_back(doc.nodeToString(idNameNode), templateArgs);
-        idRoot = ts_node_child_by_field_name(idRoot, "child", 5);
+        CompilerMessageType toCompilerMessageType(MessageType type)
+        {
+            switch(type)
+            {
+                case MessageType::Error:
+                    return CompilerMessageType::Error;
+                case MessageType::Warning:
+                    return CompilerMessageType::Warning;
+                case MessageType::Log:
+                    return CompilerMessageType::Log;
+                case MessageType::Verbose:
+                default:
+                    return CompilerMessageType::Verbose;
+            }
+        }
+    } // namespace
+
+    Compiler::Compiler(std::optional<EnvDefs> env,
+                       std::shared_ptr<TaskScheduler> scheduler,
+                       std::shared_ptr<CompilerCache> cache)
+        : _env(std::move(env)), _scheduler(std::move(scheduler)), _cache(std::move(cache))
+    {
+        if(!_cache)
+            _cache = std::make_shared<CompilerCache>();
     }
 
-    return id;
-}
+    const std::shared_ptr<CompilerCache>& Compiler::cache() const { return _cache; }
 
-void Compiler::indexSymbolsPass()
-{
-    for(auto& [path, doc]: _sources)
+    void Compiler::CompileContext::recordMessage(CompilerMessage message)
     {
-        TSNode root = doc->docRoot();
-        
-        ScopedIdentifier currentScope;
-        indexSymbolsPass_recursive(root, currentScope, *doc);
+        result.messages.push_back(std::move(message));
     }
-}
 
-void Compiler::indexSymbolsPass_recursive(TSNode node, ScopedIdentifier& currentScope, const ParsedDocument& doc)
-{
-    size_t parentScopeLength = currentScope.scopes.size();
+    CompileResult Compiler::compile(const std::vector<std::shared_ptr<ParsedDocument>>& documents) const
+    {
+        CompileContext ctx;
 
-    NodeType nodeType;
-    if(_lut.tryToNodeType(ts_node_symbol(node), nodeType))
+        std::map<std::string, std::shared_ptr<ParsedDocument>> sortedDocuments;
+        for(auto& source : documents)
+            sortedDocuments.emplace(source->path().string(), source);
+        for(auto& [path, doc] : sortedDocuments)
+            ctx.documents.emplace_back(path, doc->getDocumentContext());
+
+        indexSymbolsPass(ctx);
+        generateIRPass(ctx);
+
+        for(auto& mod : ctx.modules)
+        {
+            importStructs(*mod.second);
+            ctx.result.modules.push_back(std::move(*mod.second));
+        }
+        return std::move(ctx.result);
+    }
+
+    void Compiler::indexSymbolsPass(CompileContext& ctx) const
     {
-        switch(nodeType)
+        // Standard documents were parsed once up front, their symbols are visible but their IR is not regenerated
+        for(auto& standardDoc : _cache->standardDocuments())
         {
-            case NodeType::Pipeline:
-                {
-                    auto pipe = std::make_shared<Pipeline>();
+            if(standardDoc->parsed.document)
+                indexDocument(ctx, standardDoc->path, *standardDoc->parsed.document, false);
+        }
 
-                    TSNode idNode = ts_node_child_by_field_name(node, "id", 2);
-                    Identifier identifier{
-                        doc.nodeToString(idNode)
-                    };
-                    
-                    pipe->name = identifier.name;
+        for(auto& [path, parsed] : ctx.documents)
+        {
+            for(auto& message : parsed.messages)
+                ctx.recordMessage(
+                    {toCompilerMessageType(message.type), CompilerFileSource{path, message.range}, message.message});
+            if(parsed.document)
+                indexDocument(ctx, path, *parsed.document, true);
+        }
+    }
+
+    void Compiler::indexDocument(CompileContext& ctx,
+                                 const std::string& path,
+                                 const DocumentContext& doc,
+                                 bool generateIR) const
+    {
+        auto& strings = _cache->strings();
+        std::map<std::string, Node<ModuleContext>> sortedModules(doc.modules.begin(), doc.modules.end());
+        for(auto& [modName, modCtx] : sortedModules)
+        {
+            std::shared_ptr<BSModule> mod;
+            if(generateIR)
+            {
+                auto& slot = ctx.modules[modName];
+                if(!slot)
+                {
+                    slot = std::make_shared<BSModule>();
+                    slot->name = modName;
+                }
+                mod = slot;
+            }
+            ctx.identifiers.insert({strings.intern(modName), modCtx});
 
-                    std::get<std::shared_ptr<Module>>(_identifers["global"])->pipelines.insert({identifier.name, pipe});
-                    currentScope.scopes.push_back(std::move(identifier));
+            for(auto& pipeCtx : modCtx->pipelines)
+            {
+                auto longId = strings.intern(pipeCtx->longId());
+                if(ctx.identifiers.contains(longId))
+                {
+                    ctx.recordMessage({CompilerMessageType::Error,
+                                       CompilerFileSource{path, pipeCtx->range},
+                                       std::format("Redefinition of \"{}\"", longId)});
+                    continue;
+                }
+                ctx.identifiers.insert({longId, pipeCtx});
+                if(!generateIR)
+                    continue;
 
-                    _identifers.insert({currentScope.longName(), pipe});
+                // Reserve the output slot now so that module contents are ordered by declaration, not by which IR
+                // task happens to finish first
+                mod->pipelines.emplace_back();
+                ctx.irJobs.push_back({mod, mod->pipelines.size() - 1, path, pipeCtx, {}, {}});
+            }
 
-                    break;
+            for(auto& funcCtx : modCtx->functions)
+            {
+                auto longId = strings.intern(funcCtx->longId());
+                if(ctx.identifiers.contains(longId))
+                {
+                    ctx.recordMessage({CompilerMessageType::Error,
+                                       CompilerFileSource{path, funcCtx->range},
+                                       std::format("Redefinition of \"{}\"", longId)});
+                    continue;
                 }
-            default:
-                break;
+                ctx.identifiers.insert({longId, funcCtx});
+                if(!generateIR)
+                    continue;
+
+                mod->functions.emplace_back();
+                ctx.irJobs.push_back({mod, mod->functions.size() - 1, path, funcCtx, {}, {}});
+            }
         }
     }
 
-    for (int i = 0; i < ts_node_named_child_count(node); i++) {
-        indexSymbolsPass_recursive(ts_node_named_child(node, i), currentScope, doc);
+    void Compiler::generateIRPass(CompileContext& ctx) const
+    {
+        if(!_scheduler)
+        {
+            for(auto& job : ctx.irJobs)
+                generateJob(job);
+        }
+        else
+        {
+            // Jobs only read from the symbol index and write to their own reserved slot and type table, so each one
+            // can be lowered as an independent task. Dependency edges are only needed once a job has to see the IR of
+            // another, such as when inlining or instantiating generics.
+            TaskGraph graph;
+            for(auto& job : ctx.irJobs)
+                graph.addTask([this, &job]() { generateJob(job); });
+            _scheduler->run(graph);
+        }
+
+        // Messages and types are merged in job order to keep output identical to a single threaded run
+        for(auto& job : ctx.irJobs)
+        {
+            for(auto& message : job.messages)
+                ctx.recordMessage(std::move(message));
+            mergeTypes(job);
+        }
     }
-    currentScope.scopes.resize(parentScopeLength);
-}
 
-void Compiler::generateIRPass()
-{
-    for(auto& [modId, mod]: _modules)
+    void Compiler::mergeTypes(IRJob& job)
     {
-        
-        // GeneratePipelines defined in our sources
-        for(auto& [pipeId, pipe]: mod->pipelines)
+        auto& types = job.module->types;
+        std::vector<TypeId> moved(job.types.size());
+        for(size_t id = 0; id < moved.size(); ++id)
+            moved[id] = types.intern(job.types, (TypeId)id);
+        auto move = [&](std::vector<TypeId>& ids) {
+            for(auto& id : ids)
+                id = moved[(size_t)id];
+        };
+
+        if(std::holds_alternative<Node<FunctionContext>>(job.context))
+        {
+            auto& function = job.module->functions[job.index];
+            move(function->localVars);
+            move(function->inputs);
+            move(function->outputs);
+            return;
+        }
+        auto& pipeline = job.module->pipelines[job.index];
+        move(pipeline->inputs);
+        move(pipeline->outputs);
+        if(!pipeline->stages)
+            return;
+        for(auto& stage : *pipeline->stages)
+        {
+            move(stage.localVars);
+            for(auto& op : stage.asyncOps)
+                move(std::get<BSAsyncCall>(op).outputs);
+        }
+    }
+
+    void Compiler::generateJob(IRJob& job) const
+    {
+        if(std::holds_alternative<Node<FunctionContext>>(job.context))
+            generateFunction(job);
+        else
+            generatePipeline(job);
+    }
+
+    void Compiler::generateFunction(IRJob& job) const
+    {
+        auto& funcCtx = std::get<Node<FunctionContext>>(job.context);
+        auto& description = funcCtx->description;
+        auto func = std::make_shared<BSFunction>();
+        func->id = funcCtx->longId();
+
+        auto message = [&job](CompilerMessageType type, TSRange range, std::string text) {
+            job.messages.push_back({type, CompilerFileSource{job.path, range}, std::move(text)});
+        };
+
+        auto& types = job.types;
+        CodeGenerator generator(func->localVars, func->operations, types, message);
+        if(description.sources)
+        {
+            for(auto& source : description.sources->defs)
+            {
+                if(!source->type)
+                {
+                    message(CompilerMessageType::Error, source->range, "Function input is missing a type");
+                    continue;
+                }
+                func->inputs.push_back(resolveType(types, *source->type.value()));
+                auto value = generator.newValue(func->inputs.back());
+                if(source->label)
+                    generator.namedValues.insert({source->label.value()->text, value});
+            }
+        }
+
+        // Outputs take the local vars right after the inputs, their types are only known once the body is lowered
+        std::vector<IRValue> outputSlots;
+        if(description.sinks)
         {
-            if (!pipe->debugInfo.has_value())
-                continue;
-            if (!_sources.contains(pipe->name))
-                continue;
-            
+            for(size_t i = 0; i < description.sinks->values.size(); ++i)
+                outputSlots.push_back(generator.newValue(TypeTable::base(BSBaseType::I32)));
+        }
+
+        if(funcCtx->body)
+            generator.lowerScope(*funcCtx->body);
 
+        for(size_t i = 0; i < outputSlots.size(); ++i)
+        {
+            auto& sink = description.sinks->values[i];
+            auto value = generator.namedValues.find(sink->id->text);
+            if(value == generator.namedValues.end())
+                message(CompilerMessageType::Error,
+                        sink->range,
+                        std::format("Function output \"{}\" does not name a value", sink->id->text));
+            else
+            {
+                func->localVars[outputSlots[i].id] = func->localVars[value->second.id];
+                func->operations.mov(value->second, outputSlots[i]);
+            }
+            func->outputs.push_back(func->localVars[outputSlots[i].id]);
         }
 
+        job.module->functions[job.index] = std::move(func);
     }
-}
 
+    void Compiler::generatePipeline(IRJob& job) const
+    {
+        auto& pipeCtx = std::get<Node<PipelineContext>>(job.context);
+        auto pipe = std::make_shared<BSPipeline>();
+        pipe->id = pipeCtx->longId();
 
+        auto message = [&job](CompilerMessageType type, TSRange range, std::string text) {
+            job.messages.push_back({type, CompilerFileSource{job.path, range}, std::move(text)});
+        };
+
+        auto& types = job.types;
+        std::vector<std::string> inputNames;
+        if(pipeCtx->sources)
+        {
+            for(auto& source : pipeCtx->sources->defs)
+            {
+                if(!source->type)
+                {
+                    message(CompilerMessageType::Error, source->range, "Pipeline input is missing a type");
+                    continue;
+                }
+                pipe->inputs.push_back(resolveType(types, *source->type.value()));
+                inputNames.push_back(source->label ? source->label.value()->text : "");
+            }
+        }
+
+        pipe->stages.emplace();
+        std::unordered_map<std::string, IRValue> lastStageValues;
+        for(auto& stageCtx : pipeCtx->stages)
+        {
+            auto& stages = *pipe->stages;
+            stages.emplace_back();
+            auto& stage = stages.back();
+            CodeGenerator generator(stage.localVars, stage.operations, types, message);
 
+            if(stages.size() == 1)
+            {
+                for(size_t i = 0; i < pipe->inputs.size(); ++i)
+                {
+                    auto value = generator.newValue(pipe->inputs[i]);
+                    if(!inputNames[i].empty())
+                        generator.namedValues.insert({inputNames[i], value});
+                }
+            }
+            else
+            {
+                // Every named value of the previous stage is passed on, sorted so the stage signature is stable
+                auto& previous = stages[stages.size() - 2];
+                std::vector<std::pair<std::string, IRValue>> carried(lastStageValues.begin(), lastStageValues.end());
+                std::sort(carried.begin(), carried.end(), [](auto& a, auto& b) { return a.first < b.first; });
+                for(auto& [name, value] : carried)
+                {
+                    previous.outputs.push_back(value);
+                    generator.namedValues.insert({name, generator.newValue(previous.localVars[value.id])});
+                }
+            }
+
+            for(auto& local : stageCtx->localVariables)
+                generator.defineValue(*local, TypeTable::base(BSBaseType::I32));
+            for(auto& expression : stageCtx->expressions)
+                generator.lower(expression);
+            lastStageValues = std::move(generator.namedValues);
+
+            if(!stageCtx->asyncExpressions.empty())
+                message(CompilerMessageType::Warning,
+                        stageCtx->range,
+                        "Async operations are not lowered to IR yet and will be ignored");
+        }
+
+        if(pipeCtx->sinks)
+        {
+            for(auto& sink : pipeCtx->sinks->values)
+            {
+                auto value = lastStageValues.find(sink->id->text);
+                if(value == lastStageValues.end() || pipe->stages->empty())
+                {
+                    message(CompilerMessageType::Error,
+                            sink->range,
+                            std::format("Pipeline output \"{}\" does not name a value", sink->id->text));
+                    continue;
+                }
+                auto& lastStage = pipe->stages->back();
+                lastStage.outputs.push_back(value->second);
+                pipe->outputs.push_back(lastStage.localVars[value->second.id]);
+            }
+        }
+
+        job.module->pipelines[job.index] = std::move(pipe);
+    }
+} // namespace BraneScript
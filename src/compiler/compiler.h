@@ -1,73 +1,115 @@
 #ifndef BRANESCRIPT_COMPILER_H
 #define BRANESCRIPT_COMPILER_H
 
+#include <map>
+#include <memory>
 #include <vector>
 #include "../ir/ir.h"
 #include "../parser/documentParser.h"
+#include "../util/taskScheduler.h"
+#include "compilerCache.h"
 #include <unordered_map>
 
-/// List of pipelines and functions provided by the runtime that we are compiling for
-struct EnvDefs
+namespace BraneScript
 {
-    std::unordered_map<std::string, void*> pipelines;
-    std::unordered_map<std::string, void*> functions;
-};
-
-enum class CompilerMessageType
-{
-    Critical = 0,
-    Error = 1,
-    Warning = 2,
-    Log = 3,
-    Verbose = 4,
-};
-
-struct CompilerFileSource 
-{
-    std::string path;
-    std::optional<TSRange> range;
-};
-
-using CompilerSource = std::variant<CompilerFileSource>;
-
-struct CompilerMessage
-{
-    CompilerMessageType type;
-    CompilerSource source;
-    std::string message;
-};
-
-struct CompileResult
-{
-    std::vector<Module> modules;
-    std::vector<CompilerMessage> messages;
-};
-
-
-using Identifiable = std::variant<std::shared_ptr<Module>, std::shared_ptr<Pipeline>, std::shared_ptr<Function>, std::shared_ptr<PipelineStage>>;
-
-class Compiler
-{
-    SymbolLookupTable _lut;
-    std::optional<EnvDefs> _env;
-    std::unordered_map<std::string, std::shared_ptr<ParsedDocument>> _sources;
-    std::unordered_map<std::string, std::shared_ptr<Module>> _modules;
-    std::unordered_map<std::string, Identifiable> _identifers;
-
-
-    void indexSymbolsPass_recursive(TSNode node, ScopedIdentifier& currentScope, const ParsedDocument& doc);
-
-    void indexSymbolsPass();
-    void constructGenericsPass();
-    void generateIRPass();
-
-    void generatePipeline(std::shared_ptr<Pipeline> pipe);
-
-    void recordMessage(CompilerMessage message);
-public:
-
-    Compiler(SymbolLookupTable lut);
-    CompileResult compile(const std::vector<std::shared_ptr<ParsedDocument>>& documents);
-};
+    /// List of pipelines and functions provided by the runtime that we are compiling for
+    struct EnvDefs
+    {
+        std::unordered_map<std::string, void*> pipelines;
+        std::unordered_map<std::string, void*> functions;
+    };
+
+    enum class CompilerMessageType
+    {
+        Critical = 0,
+        Error = 1,
+        Warning = 2,
+        Log = 3,
+        Verbose = 4,
+    };
+
+    struct CompilerFileSource
+    {
+        std::string path;
+        std::optional<TSRange> range;
+    };
+
+    using CompilerSource = std::variant<CompilerFileSource>;
+
+    struct CompilerMessage
+    {
+        CompilerMessageType type;
+        CompilerSource source;
+        std::string message;
+    };
+
+    struct CompileResult
+    {
+        /// One per script module. Structs a module uses but doesn't declare are imports, linkModules resolves them
+        /// against the modules that do, such as ones declaring host types.
+        std::vector<BSModule> modules;
+        std::vector<CompilerMessage> messages;
+    };
+
+    using Identifiable = std::variant<Node<ModuleContext>, Node<PipelineContext>, Node<FunctionContext>>;
+
+    class Compiler
+    {
+        /// A pipeline or function that is lowered to IR as its own task during generateIRPass
+        struct IRJob
+        {
+            std::shared_ptr<BSModule> module;
+            /// Reserved slot in the module's functions or pipelines, depending on which the context is
+            size_t index;
+            std::string path;
+            Identifiable context;
+            std::vector<CompilerMessage> messages;
+            /// Types the job's IR refers to, merged into the module's table once every job has finished
+            TypeTable types;
+        };
+
+        /// State owned by a single call to compile()
+        struct CompileContext
+        {
+            CompileResult result;
+            // Ordered containers so that output does not depend on hash order or on which thread finished first
+            std::vector<std::pair<std::string, ParserResult<DocumentContext>>> documents;
+            std::map<std::string, std::shared_ptr<BSModule>> modules;
+            std::unordered_map<std::string_view, Identifiable> identifiers;
+            std::vector<IRJob> irJobs;
+
+            void recordMessage(CompilerMessage message);
+        };
+
+        std::optional<EnvDefs> _env;
+        std::shared_ptr<TaskScheduler> _scheduler;
+        std::shared_ptr<CompilerCache> _cache;
+
+        void indexSymbolsPass(CompileContext& ctx) const;
+        void indexDocument(CompileContext& ctx,
+                           const std::string& path,
+                           const DocumentContext& doc,
+                           bool generateIR) const;
+        void generateIRPass(CompileContext& ctx) const;
+
+        /// Moves a job's IR from its own type table to its module's
+        static void mergeTypes(IRJob& job);
+        void generateJob(IRJob& job) const;
+        void generateFunction(IRJob& job) const;
+        void generatePipeline(IRJob& job) const;
+
+      public:
+        /// Compilers created without a scheduler generate IR on the calling thread. Compilers that share a cache
+        /// share its interned strings and standard documents.
+        Compiler(std::optional<EnvDefs> env = std::nullopt,
+                 std::shared_ptr<TaskScheduler> scheduler = nullptr,
+                 std::shared_ptr<CompilerCache> cache = nullptr);
+
+        /// Safe to call concurrently from multiple threads, all per invocation state lives on the caller's stack
+        CompileResult compile(const std::vector<std::shared_ptr<ParsedDocument>>& documents) const;
+
+        const std::shared_ptr<CompilerCache>& cache() const;
+    };
+} // namespace BraneScript
 
 #endif
@@ -0,0 +1,46 @@
+#include "compilerCache.h"
+
+#include <mutex>
+
+namespace BraneScript
+{
+    std::string_view StringInterner::intern(std::string_view str)
+    {
+        {
+            std::shared_lock lock(_lock);
+            auto existing = _strings.find(str);
+            if(existing != _strings.end())
+                return *existing;
+        }
+        std::unique_lock lock(_lock);
+        return *_strings.emplace(str).first;
+    }
+
+    size_t StringInterner::size() const
+    {
+        std::shared_lock lock(_lock);
+        return _strings.size();
+    }
+
+    StringInterner& CompilerCache::strings() { return _strings; }
+
+    void CompilerCache::addStandardDocument(std::shared_ptr<ParsedDocument> document)
+    {
+        auto standardDoc = std::make_shared<StandardDocument>();
+        standardDoc->path = document->path().string();
+        standardDoc->parsed = document->getDocumentContext();
+
+        std::unique_lock lock(_standardLock);
+        _standardDocuments.insert_or_assign(standardDoc->path, std::move(standardDoc));
+    }
+
+    std::vector<std::shared_ptr<const StandardDocument>> CompilerCache::standardDocuments() const
+    {
+        std::shared_lock lock(_standardLock);
+        std::vector<std::shared_ptr<const StandardDocument>> docs;
+        docs.reserve(_standardDocuments.size());
+        for(auto& [path, doc] : _standardDocuments)
+            docs.push_back(doc);
+        return docs;
+    }
+} // namespace BraneScript
@@ -0,0 +1,58 @@
+#ifndef BRANESCRIPT_COMPILERCACHE_H
+#define BRANESCRIPT_COMPILERCACHE_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include "../parser/documentParser.h"
+
+namespace BraneScript
+{
+    /// Thread safe string pool, interned strings stay valid for the lifetime of the interner
+    class StringInterner
+    {
+        struct Hash
+        {
+            using is_transparent = void;
+
+            size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+        };
+
+        mutable std::shared_mutex _lock;
+        std::unordered_set<std::string, Hash, std::equal_to<>> _strings;
+
+      public:
+        std::string_view intern(std::string_view str);
+        size_t size() const;
+    };
+
+    /// A document whose parse result is shared by every compile that uses the cache
+    struct StandardDocument
+    {
+        std::string path;
+        ParserResult<DocumentContext> parsed;
+    };
+
+    /// State that is immutable once created and can be shared between compiler invocations running on different
+    /// threads. Every method is thread safe.
+    class CompilerCache
+    {
+        StringInterner _strings;
+
+        mutable std::shared_mutex _standardLock;
+        std::map<std::string, std::shared_ptr<const StandardDocument>> _standardDocuments;
+
+      public:
+        StringInterner& strings();
+
+        /// Parse a document once and include it in every compile that uses this cache
+        void addStandardDocument(std::shared_ptr<ParsedDocument> document);
+        std::vector<std::shared_ptr<const StandardDocument>> standardDocuments() const;
+    };
+} // namespace BraneScript
+
+#endif
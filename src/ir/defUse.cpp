@@ -0,0 +1,189 @@
+#include "defUse.h"
+
+#include <cassert>
+
+namespace BraneScript
+{
+    DefUseChains::DefUseChains(InstructionList& code, size_t valueCount, std::span<IRValue> external)
+        : _code(&code), _external(external), _uses(valueCount), _defs(valueCount), _externalPositions(external.size())
+    {
+        for(uint32_t i = 0; i < external.size(); ++i)
+            link(external[i].id, {OperandRef::external, i}, false);
+        indexNewInstructions();
+    }
+
+    template<class F>
+    void DefUseChains::forEachOperand(uint32_t instruction, bool defs, F&& f)
+    {
+        auto& inst = _code->instructions[instruction];
+        auto visit = [&](uint32_t& value) {
+            uint32_t operand;
+            if(&value == &inst.a)
+                operand = 0;
+            else if(&value == &inst.b)
+                operand = 1;
+            else if(&value == &inst.c)
+                operand = 2;
+            else
+                operand = 3 + (uint32_t)(&value - _code->callOperands.data());
+            f(value, OperandRef{instruction, operand});
+        };
+        if(defs)
+            _code->forEachDef(inst, visit);
+        else
+            _code->forEachUse(inst, visit);
+    }
+
+    uint32_t& DefUseChains::position(OperandRef ref)
+    {
+        if(ref.isExternal())
+            return _externalPositions[ref.operand];
+        if(ref.operand < 3)
+            return _fieldPositions[ref.instruction][ref.operand];
+        return _callPositions[ref.operand - 3];
+    }
+
+    void DefUseChains::link(uint32_t value, OperandRef ref, bool def)
+    {
+        assert(value < _uses.size() && "Value out of range");
+        auto& list = (def ? _defs : _uses)[value];
+        position(ref) = (uint32_t)list.size();
+        list.push_back(ref);
+    }
+
+    void DefUseChains::unlink(uint32_t value, OperandRef ref, bool def)
+    {
+        auto& list = (def ? _defs : _uses)[value];
+        uint32_t index = position(ref);
+        assert(index < list.size() && list[index] == ref && "Operand is not linked to the value it holds");
+        list[index] = list.back();
+        position(list[index]) = index;
+        list.pop_back();
+    }
+
+    size_t DefUseChains::valueCount() const { return _uses.size(); }
+
+    uint32_t DefUseChains::addValue()
+    {
+        _uses.emplace_back();
+        _defs.emplace_back();
+        return (uint32_t)_uses.size() - 1;
+    }
+
+    void DefUseChains::indexNewInstructions()
+    {
+        _removed.resize(_code->instructions.size(), false);
+        _fieldPositions.resize(_code->instructions.size());
+        _callPositions.resize(_code->callOperands.size());
+        for(auto i = (uint32_t)_indexed; i < _code->instructions.size(); ++i)
+        {
+            forEachOperand(i, false, [&](uint32_t value, OperandRef ref) { link(value, ref, false); });
+            forEachOperand(i, true, [&](uint32_t value, OperandRef ref) { link(value, ref, true); });
+        }
+        _indexed = _code->instructions.size();
+    }
+
+    std::span<const OperandRef> DefUseChains::uses(uint32_t value) const { return _uses[value]; }
+
+    std::span<const OperandRef> DefUseChains::definitions(uint32_t value) const { return _defs[value]; }
+
+    std::optional<uint32_t> DefUseChains::definingInstruction(uint32_t value) const
+    {
+        if(_defs[value].size() != 1)
+            return std::nullopt;
+        return _defs[value].front().instruction;
+    }
+
+    bool DefUseChains::unused(uint32_t value) const { return _uses[value].empty(); }
+
+    uint32_t& DefUseChains::operand(OperandRef ref)
+    {
+        if(ref.isExternal())
+            return _external[ref.operand].id;
+        auto& inst = _code->instructions[ref.instruction];
+        switch(ref.operand)
+        {
+            case 0:
+                return inst.a;
+            case 1:
+                return inst.b;
+            case 2:
+                return inst.c;
+            default:
+                return _code->callOperands[ref.operand - 3];
+        }
+    }
+
+    uint32_t DefUseChains::operand(OperandRef ref) const { return const_cast<DefUseChains*>(this)->operand(ref); }
+
+    void DefUseChains::setOperand(OperandRef ref, uint32_t value)
+    {
+        auto& current = operand(ref);
+        auto& defs = _defs[current];
+        uint32_t index = position(ref);
+        bool def = index < defs.size() && defs[index] == ref;
+        unlink(current, ref, def);
+        current = value;
+        link(value, ref, def);
+    }
+
+    void DefUseChains::replaceAllUses(uint32_t from, uint32_t to)
+    {
+        if(from == to)
+            return;
+        auto uses = std::move(_uses[from]);
+        _uses[from].clear();
+        for(auto ref : uses)
+        {
+            operand(ref) = to;
+            link(to, ref, false);
+        }
+    }
+
+    void DefUseChains::renameValue(uint32_t from, uint32_t to)
+    {
+        if(from == to)
+            return;
+        replaceAllUses(from, to);
+        auto defs = std::move(_defs[from]);
+        _defs[from].clear();
+        for(auto ref : defs)
+        {
+            operand(ref) = to;
+            link(to, ref, true);
+        }
+    }
+
+    void DefUseChains::removeInstruction(uint32_t instruction)
+    {
+        if(_removed[instruction])
+            return;
+        forEachOperand(instruction, false, [&](uint32_t value, OperandRef ref) { unlink(value, ref, false); });
+        forEachOperand(instruction, true, [&](uint32_t value, OperandRef ref) { unlink(value, ref, true); });
+        _removed[instruction] = true;
+        _removedCount++;
+    }
+
+    bool DefUseChains::removed(uint32_t instruction) const { return _removed[instruction]; }
+
+    bool DefUseChains::hasRemovals() const { return _removedCount != 0; }
+
+    bool DefUseChains::compact()
+    {
+        if(!_removedCount)
+            return false;
+        removeInstructions(*_code, _removed);
+
+        size_t valueCount = _uses.size();
+        _uses.assign(valueCount, {});
+        _defs.assign(valueCount, {});
+        _removed.clear();
+        _fieldPositions.clear();
+        _removedCount = 0;
+        _indexed = 0;
+        for(uint32_t i = 0; i < _external.size(); ++i)
+            link(_external[i].id, {OperandRef::external, i}, false);
+        indexNewInstructions();
+        return true;
+    }
+} // namespace BraneScript
@@ -0,0 +1,94 @@
+#ifndef BRANESCRIPT_DEFUSE_H
+#define BRANESCRIPT_DEFUSE_H
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+#include "ir.h"
+
+namespace BraneScript
+{
+    /// Where a value is read or written. Operands 0 to 2 are an instruction's a, b and c fields, higher operands are
+    /// entries of the call operand table starting from 3. External operands are values read after the code has run,
+    /// such as outputs, and index the span of them the chains were built with.
+    struct OperandRef
+    {
+        static constexpr uint32_t external = UINT32_MAX;
+
+        uint32_t instruction = 0;
+        uint32_t operand = 0;
+
+        bool isExternal() const { return instruction == external; }
+
+        bool operator==(const OperandRef&) const = default;
+    };
+
+    /// Def-use and use-def chains for the values of an InstructionList. The chains are built in one sweep, and then
+    /// kept up to date by the mutation functions, so that replacing every use of a value or asking whether a value is
+    /// still read costs time in the number of its uses rather than the length of the code.
+    ///
+    /// Instructions appended to the code with the InstructionList builders are picked up by indexNewInstructions().
+    /// Removed instructions are only marked until compact(), so the indices held in OperandRefs stay valid until then.
+    /// Operands must only be changed through the chains while they are in use.
+    class DefUseChains
+    {
+        InstructionList* _code;
+        std::span<IRValue> _external;
+        std::vector<std::vector<OperandRef>> _uses;
+        std::vector<std::vector<OperandRef>> _defs;
+        /// Index of each operand within the use or def list of the value it holds, so it can be unlinked in constant
+        /// time. Instruction fields, call operands and external uses are stored separately.
+        std::vector<std::array<uint32_t, 3>> _fieldPositions;
+        std::vector<uint32_t> _callPositions;
+        std::vector<uint32_t> _externalPositions;
+        std::vector<bool> _removed;
+        size_t _indexed = 0;
+        size_t _removedCount = 0;
+
+        template<class F>
+        void forEachOperand(uint32_t instruction, bool defs, F&& f);
+
+        uint32_t& position(OperandRef ref);
+        void link(uint32_t value, OperandRef ref, bool def);
+        void unlink(uint32_t value, OperandRef ref, bool def);
+
+      public:
+        /// external holds values that are read after the code has run, they count as uses and are rewritten along with
+        /// the others
+        DefUseChains(InstructionList& code, size_t valueCount, std::span<IRValue> external = {});
+
+        size_t valueCount() const;
+        /// Makes room for a new value with no uses or definitions and returns its id
+        uint32_t addValue();
+
+        /// Indexes every instruction appended to the code since the chains were built or last caught up
+        void indexNewInstructions();
+
+        std::span<const OperandRef> uses(uint32_t value) const;
+        std::span<const OperandRef> definitions(uint32_t value) const;
+        /// The instruction writing a value, if exactly one does
+        std::optional<uint32_t> definingInstruction(uint32_t value) const;
+        bool unused(uint32_t value) const;
+
+        uint32_t& operand(OperandRef ref);
+        uint32_t operand(OperandRef ref) const;
+
+        /// Points one operand at another value
+        void setOperand(OperandRef ref, uint32_t value);
+        /// Points every use of from at to, including external ones
+        void replaceAllUses(uint32_t from, uint32_t to);
+        /// Replaces every use and definition of from with to
+        void renameValue(uint32_t from, uint32_t to);
+
+        /// Unlinks an instruction's operands and marks it for removal
+        void removeInstruction(uint32_t instruction);
+        bool removed(uint32_t instruction) const;
+        bool hasRemovals() const;
+        /// Erases removed instructions from the code and reindexes what's left. Returns true if anything was erased.
+        bool compact();
+    };
+} // namespace BraneScript
+
+#endif
@@ -1 +1,223 @@
 #include "ir.h"
+
+#include <cassert>
+
+namespace BraneScript
+{
+    template<class... Ts>
+    struct overloads : Ts...
+    {
+        using Ts::operator()...;
+    };
+
+    bool isBinaryOp(OpCode op)
+    {
+        switch(op)
+        {
+            case OpCode::Add:
+            case OpCode::Sub:
+            case OpCode::Mul:
+            case OpCode::Div:
+            case OpCode::Mod:
+            case OpCode::Eq:
+            case OpCode::Ne:
+            case OpCode::Gt:
+            case OpCode::Ge:
+            case OpCode::LogicAnd:
+            case OpCode::LogicOr:
+            case OpCode::BitAnd:
+            case OpCode::BitOr:
+            case OpCode::BitXor:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    bool isUnaryOp(OpCode op)
+    {
+        switch(op)
+        {
+            case OpCode::LogicNot:
+            case OpCode::BitNot:
+            case OpCode::I32ToF32:
+            case OpCode::U32ToF32:
+            case OpCode::F32ToI32:
+            case OpCode::F32ToU32:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    bool isConstOp(OpCode op) { return op == OpCode::ConstI32 || op == OpCode::ConstU32 || op == OpCode::ConstF32; }
+
+    namespace
+    {
+        Instruction
+        memoryInstruction(OpCode op, const std::variant<IRValue, ConstU32>& store, IRValue src, IRValue dest)
+        {
+            Instruction inst{op};
+            std::visit(overloads{[&](IRValue value) { inst.b = value.id; },
+                                 [&](ConstU32 index) {
+                inst.b = index.value;
+                inst.flags |= InstructionFlags_ConstStore;
+            }},
+                       store);
+            inst.a = src.id;
+            inst.c = dest.id;
+            return inst;
+        }
+    } // namespace
+
+    void InstructionList::mov(IRValue src, IRValue dest)
+    {
+        instructions.push_back({OpCode::Mov, 0, 0, src.id, 0, dest.id});
+    }
+
+    void InstructionList::load(std::variant<IRValue, ConstU32> store, IRValue src, IRValue dest)
+    {
+        instructions.push_back(memoryInstruction(OpCode::Load, store, src, dest));
+    }
+
+    void InstructionList::store(std::variant<IRValue, ConstU32> store, IRValue src, IRValue dest)
+    {
+        instructions.push_back(memoryInstruction(OpCode::Store, store, src, dest));
+    }
+
+    void InstructionList::binary(OpCode op, IRValue left, IRValue right, IRValue out)
+    {
+        assert(isBinaryOp(op));
+        instructions.push_back({op, 0, 0, left.id, right.id, out.id});
+    }
+
+    void InstructionList::unary(OpCode op, IRValue in, IRValue out)
+    {
+        assert(isUnaryOp(op));
+        instructions.push_back({op, 0, 0, in.id, 0, out.id});
+    }
+
+    void InstructionList::constI32(int32_t value, IRValue out)
+    {
+        instructions.push_back({OpCode::ConstI32, 0, 0, std::bit_cast<uint32_t>(value), 0, out.id});
+    }
+
+    void InstructionList::constU32(uint32_t value, IRValue out)
+    {
+        instructions.push_back({OpCode::ConstU32, 0, 0, value, 0, out.id});
+    }
+
+    void InstructionList::constF32(float value, IRValue out)
+    {
+        instructions.push_back({OpCode::ConstF32, 0, 0, std::bit_cast<uint32_t>(value), 0, out.id});
+    }
+
+    void InstructionList::call(IDRef function, std::span<const IRValue> inputs, std::span<const IRValue> outputs)
+    {
+        assert(inputs.size() <= UINT16_MAX && "Too many call inputs");
+        Instruction inst{OpCode::Call};
+        inst.a = (uint32_t)callTargets.size();
+        inst.b = (uint32_t)callOperands.size();
+        inst.count = (uint16_t)inputs.size();
+        inst.c = (uint32_t)outputs.size();
+
+        callTargets.push_back(std::move(function));
+        for(auto input : inputs)
+            callOperands.push_back(input.id);
+        for(auto output : outputs)
+            callOperands.push_back(output.id);
+        instructions.push_back(inst);
+    }
+
+    void InstructionList::append(const Operation& op)
+    {
+        std::visit(overloads{
+                       [&](const IRNode<MovOp>& o) { mov(o->src, o->dest); },
+                       [&](const IRNode<LoadOp>& o) { load(o->store, o->src, o->dest); },
+                       [&](const IRNode<StoreOp>& o) { store(o->store, o->src, o->dest); },
+                       [&](const IRNode<AddOp>& o) { binary(OpCode::Add, o->left, o->right, o->out); },
+                       [&](const IRNode<SubOp>& o) { binary(OpCode::Sub, o->left, o->right, o->out); },
+                       [&](const IRNode<MulOp>& o) { binary(OpCode::Mul, o->left, o->right, o->out); },
+                       [&](const IRNode<DivOp>& o) { binary(OpCode::Div, o->left, o->right, o->out); },
+                       [&](const IRNode<ModOp>& o) { binary(OpCode::Mod, o->left, o->right, o->out); },
+                       [&](const IRNode<EqOp>& o) { binary(OpCode::Eq, o->left, o->right, o->out); },
+                       [&](const IRNode<NeOp>& o) { binary(OpCode::Ne, o->left, o->right, o->out); },
+                       [&](const IRNode<GtOp>& o) { binary(OpCode::Gt, o->left, o->right, o->out); },
+                       [&](const IRNode<GeOp>& o) { binary(OpCode::Ge, o->left, o->right, o->out); },
+                       [&](const IRNode<LogicNotOp>& o) { unary(OpCode::LogicNot, o->in, o->out); },
+                       [&](const IRNode<LogicAndOp>& o) { binary(OpCode::LogicAnd, o->left, o->right, o->out); },
+                       [&](const IRNode<LogicOrOp>& o) { binary(OpCode::LogicOr, o->left, o->right, o->out); },
+                       [&](const IRNode<BitNotOp>& o) { unary(OpCode::BitNot, o->in, o->out); },
+                       [&](const IRNode<BitAndOp>& o) { binary(OpCode::BitAnd, o->left, o->right, o->out); },
+                       [&](const IRNode<BitOrOp>& o) { binary(OpCode::BitOr, o->left, o->right, o->out); },
+                       [&](const IRNode<BitXorOp>& o) { binary(OpCode::BitXor, o->left, o->right, o->out); },
+                       [&](const IRNode<I32ToF32>& o) { unary(OpCode::I32ToF32, o->in, o->out); },
+                       [&](const IRNode<U32ToF32>& o) { unary(OpCode::U32ToF32, o->in, o->out); },
+                       [&](const IRNode<F32ToI32>& o) { unary(OpCode::F32ToI32, o->in, o->out); },
+                       [&](const IRNode<F32ToU32>& o) { unary(OpCode::F32ToU32, o->in, o->out); },
+                   },
+                   op);
+    }
+
+    void InstructionList::append(const BSCallOp& op) { call(op.function, op.inputs, op.outputs); }
+
+    std::span<const uint32_t> InstructionList::callInputs(const Instruction& call) const
+    {
+        assert(call.op == OpCode::Call);
+        return std::span<const uint32_t>(callOperands).subspan(call.b, call.count);
+    }
+
+    std::span<const uint32_t> InstructionList::callOutputs(const Instruction& call) const
+    {
+        assert(call.op == OpCode::Call);
+        return std::span<const uint32_t>(callOperands).subspan(call.b + call.count, call.c);
+    }
+
+    const IDRef& InstructionList::callTarget(const Instruction& call) const
+    {
+        assert(call.op == OpCode::Call);
+        return callTargets[call.a];
+    }
+
+    const std::string* importedSymbol(const BSModule& module, int32_t id)
+    {
+        if(id >= 0 || (size_t)-(int64_t)id > module.imports.size())
+            return nullptr;
+        return &module.imports[(size_t)-(int64_t)id - 1];
+    }
+
+    uint32_t passedValueCount(const BSPipelineStage& stage)
+    {
+        auto count = (uint32_t)stage.outputs.size();
+        for(auto& op : stage.asyncOps)
+            count += (uint32_t)std::get<BSAsyncCall>(op).outputs.size();
+        return count;
+    }
+
+    void removeInstructions(InstructionList& code, const std::vector<bool>& removed)
+    {
+        assert(removed.size() == code.instructions.size());
+        std::vector<Instruction> instructions;
+        std::vector<uint32_t> callOperands;
+        std::vector<IDRef> callTargets;
+        instructions.reserve(code.instructions.size());
+        for(size_t i = 0; i < code.instructions.size(); ++i)
+        {
+            if(removed[i])
+                continue;
+            Instruction inst = code.instructions[i];
+            if(inst.op == OpCode::Call)
+            {
+                auto operands = std::span<const uint32_t>(code.callOperands).subspan(inst.b, inst.count + inst.c);
+                callTargets.push_back(std::move(code.callTargets[inst.a]));
+                inst.a = (uint32_t)callTargets.size() - 1;
+                inst.b = (uint32_t)callOperands.size();
+                callOperands.insert(callOperands.end(), operands.begin(), operands.end());
+            }
+            instructions.push_back(inst);
+        }
+        code.instructions = std::move(instructions);
+        code.callOperands = std::move(callOperands);
+        code.callTargets = std::move(callTargets);
+    }
+} // namespace BraneScript
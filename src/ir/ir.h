@@ -1,53 +1,20 @@
 #ifndef BRANESCRIPT_IR_H
 #define BRANESCRIPT_IR_H
 
+#include <bit>
+#include <cstdint>
 #include <memory>
 #include <optional>
+#include <span>
 #include <string>
 #include <variant>
 #include <vector>
+#include "typeTable.h"
 
 namespace BraneScript
 {
 
-    template<typename T>
-    using IRNode = std::shared_ptr<T>;
-
-
-    /// References can be stored as either full paths, or as context dependent ids, with positive ids representing local
-    /// symbols, and negative representing external symbols, and 0 being a null value
-    using IDRef = std::variant<std::string, int32_t>;
-
-    enum class BSBaseType
-    {
-        U8,
-        I8,
-        U16,
-        I16,
-        U32,
-        I32,
-        F32,
-        U64,
-        I64,
-        F64,
-        U128,
-        I128
-    };
-
-    struct BSStructType
-    {
-        IDRef structId;
-    };
-
-    struct BSRefType;
-    using BSType = std::variant<BSBaseType, IRNode<BSStructType>, IRNode<BSRefType>>;
-
-    struct BSRefType
-    {
-        BSType contained;
-        bool valueMutable;
-    };
-
+    /// Index into the localVars of the function or pipeline stage that an operation belongs to
     struct IRValue
     {
         uint32_t id;
@@ -80,13 +47,14 @@ namespace BraneScript
     struct I32ToF32;
     struct U32ToF32;
     struct F32ToI32;
-    struct U32ToF32;
+    struct F32ToU32;
 
     struct ConstI32;
     struct ConstU32;
     struct ConstF32;
 
-    struct CallOp;
+    /// Pointer based form of an instruction, only used as a convenience when building an InstructionList. Constants
+    /// have no pointer form, add them with InstructionList::constI32, constU32 or constF32.
     using Operation = std::variant<IRNode<MovOp>,
                                    IRNode<LoadOp>,
                                    IRNode<StoreOp>,
@@ -114,15 +82,20 @@ namespace BraneScript
                                    IRNode<I32ToF32>,
                                    IRNode<U32ToF32>,
                                    IRNode<F32ToI32>,
-
-                                   IRNode<ConstI32>,
-                                   IRNode<ConstU32>,
-                                   IRNode<ConstF32>>;
+                                   IRNode<F32ToU32>>;
 
 
-    using AsyncOperation = std::variant<
+    /// Calls a host function without blocking the pipeline. The call is made with the stage's values once the stage
+    /// has run, and the pipeline moves on to the next stage when it completes. Its results are passed to the next
+    /// stage after the stage's outputs.
+    struct BSAsyncCall
+    {
+        std::string function;
+        std::vector<IRValue> inputs;
+        std::vector<TypeId> outputs;
+    };
 
-        >;
+    using AsyncOperation = std::variant<BSAsyncCall>;
 
     struct ConstI32
     {
@@ -220,7 +193,7 @@ namespace BraneScript
     {
     };
 
-    struct BitNotOp : public BinaryOp
+    struct BitNotOp : public UnaryOp
     {
     };
 
@@ -259,44 +232,230 @@ namespace BraneScript
         std::vector<IRValue> outputs;
     };
 
+    enum class OpCode : uint8_t
+    {
+        Mov,
+        Load,
+        Store,
+
+        Add,
+        Sub,
+        Mul,
+        Div,
+        Mod,
+
+        Eq,
+        Ne,
+        Gt,
+        Ge,
+
+        LogicNot,
+        LogicAnd,
+        LogicOr,
+
+        BitNot,
+        BitAnd,
+        BitOr,
+        BitXor,
+
+        I32ToF32,
+        U32ToF32,
+        F32ToI32,
+        F32ToU32,
+
+        ConstI32,
+        ConstU32,
+        ConstF32,
+
+        Call
+    };
+
+    bool isBinaryOp(OpCode op);
+    bool isUnaryOp(OpCode op);
+    bool isConstOp(OpCode op);
+
+    enum InstructionFlags : uint8_t
+    {
+        InstructionFlags_None = 0,
+        /// The store operand of a Load or Store is a constant index rather than an IRValue
+        InstructionFlags_ConstStore = 1 << 0,
+    };
+
+    /// Fixed size encoding of a single operation. What the operands mean depends on the op code:
+    ///  - Binary ops: a = left, b = right, c = out
+    ///  - Unary ops and conversions: a = in, c = out
+    ///  - Mov: a = src, c = dest
+    ///  - Const ops: a = the bits of the constant, c = out
+    ///  - Load and Store: a = src, b = store, c = dest. Loads read the value at byte offset src of the store into
+    ///    dest, stores write src to byte offset dest of the store. A store is either a constant index into the memory
+    ///    regions bound to an invocation, or a value holding a pointer.
+    ///  - Call: a = index into InstructionList::callTargets, b = offset of the call's inputs followed by its
+    ///    outputs in InstructionList::callOperands, count = input count, c = output count
+    struct Instruction
+    {
+        OpCode op;
+        uint8_t flags = InstructionFlags_None;
+        uint16_t count = 0;
+        uint32_t a = 0;
+        uint32_t b = 0;
+        uint32_t c = 0;
+
+        int32_t constI32() const { return std::bit_cast<int32_t>(a); }
+
+        uint32_t constU32() const { return a; }
+
+        float constF32() const { return std::bit_cast<float>(a); }
+    };
+
+    static_assert(sizeof(Instruction) == 16, "Instructions should stay small enough to pack four to a cache line");
+
+    /// Contiguous list of instructions for a function or pipeline stage. Calls are the only variable length
+    /// instruction, their operands and targets are stored in side tables so that every Instruction is the same size.
+    struct InstructionList
+    {
+        std::vector<Instruction> instructions;
+        std::vector<uint32_t> callOperands;
+        std::vector<IDRef> callTargets;
+
+        void mov(IRValue src, IRValue dest);
+        void load(std::variant<IRValue, ConstU32> store, IRValue src, IRValue dest);
+        void store(std::variant<IRValue, ConstU32> store, IRValue src, IRValue dest);
+        void binary(OpCode op, IRValue left, IRValue right, IRValue out);
+        void unary(OpCode op, IRValue in, IRValue out);
+        void constI32(int32_t value, IRValue out);
+        void constU32(uint32_t value, IRValue out);
+        void constF32(float value, IRValue out);
+        void call(IDRef function, std::span<const IRValue> inputs, std::span<const IRValue> outputs);
+
+        void append(const Operation& op);
+        void append(const BSCallOp& op);
+
+        /// Calls f(uint32_t& value) for every value an instruction reads
+        template<class F>
+        void forEachUse(Instruction& inst, F&& f)
+        {
+            switch(inst.op)
+            {
+                case OpCode::Call:
+                    for(uint32_t i = 0; i < inst.count; ++i)
+                        f(callOperands[inst.b + i]);
+                    return;
+                case OpCode::Load:
+                case OpCode::Store:
+                    f(inst.a);
+                    if(!(inst.flags & InstructionFlags_ConstStore))
+                        f(inst.b);
+                    // Stores read the location they write to
+                    if(inst.op == OpCode::Store)
+                        f(inst.c);
+                    return;
+                case OpCode::ConstI32:
+                case OpCode::ConstU32:
+                case OpCode::ConstF32:
+                    return;
+                default:
+                    f(inst.a);
+                    if(isBinaryOp(inst.op))
+                        f(inst.b);
+                    return;
+            }
+        }
+
+        /// Calls f(uint32_t& value) for every value an instruction writes
+        template<class F>
+        void forEachDef(Instruction& inst, F&& f)
+        {
+            switch(inst.op)
+            {
+                case OpCode::Call:
+                    for(uint32_t i = 0; i < inst.c; ++i)
+                        f(callOperands[inst.b + inst.count + i]);
+                    return;
+                case OpCode::Store:
+                    return;
+                default:
+                    f(inst.c);
+                    return;
+            }
+        }
+
+        std::span<const uint32_t> callInputs(const Instruction& call) const;
+        std::span<const uint32_t> callOutputs(const Instruction& call) const;
+        const IDRef& callTarget(const Instruction& call) const;
+
+        size_t size() const { return instructions.size(); }
+
+        bool empty() const { return instructions.empty(); }
+
+        auto begin() const { return instructions.begin(); }
+
+        auto end() const { return instructions.end(); }
+
+        auto begin() { return instructions.begin(); }
+
+        auto end() { return instructions.end(); }
+    };
+
+    /// Remove every instruction with removed[i] set, keeping call side tables in sync
+    void removeInstructions(InstructionList& code, const std::vector<bool>& removed);
+
+    /// The first local vars of a stage receive the values passed into it, the pipeline's inputs for the first stage
+    /// or the previous stage's outputs for the rest
     struct BSPipelineStage
     {
-        std::vector<BSType> localVars;
-        std::vector<Operation> operations;
+        std::vector<TypeId> localVars;
+        InstructionList operations;
         std::vector<AsyncOperation> asyncOps;
+        /// Values passed on to the next stage, or the pipeline's outputs if this is the last stage
+        std::vector<IRValue> outputs;
     };
 
+    /// Number of values a stage hands to the next one, its outputs followed by the results of its async operations
+    uint32_t passedValueCount(const BSPipelineStage& stage);
+
     struct BSStruct
     {
         std::string id;
-        std::vector<BSType> members;
+        std::vector<TypeId> members;
+        /// Name of each member, or empty if the members are only known by position
+        std::vector<std::string> memberNames;
+        /// Lay members out in declaration order without padding, instead of reordering them to minimize it
+        bool packed = false;
     };
 
     struct BSPipeline
     {
         std::string id;
-        std::vector<BSType> inputs;
-        std::vector<BSType> outputs;
+        std::vector<TypeId> inputs;
+        std::vector<TypeId> outputs;
         std::optional<std::vector<BSPipelineStage>> stages;
     };
 
+    /// The first inputs.size() local vars of a function hold its inputs, and the next outputs.size() its outputs
     struct BSFunction
     {
         std::string id;
-        std::vector<BSType> localVars;
-        std::vector<BSType> inputs;
-        std::vector<BSType> outputs;
-        std::vector<Operation> operations;
+        std::vector<TypeId> localVars;
+        std::vector<TypeId> inputs;
+        std::vector<TypeId> outputs;
+        InstructionList operations;
     };
 
+    /// Types used by a module's structs, functions and pipelines are ids into the module's type table
     struct BSModule
     {
         std::string name;
+        TypeTable types;
         std::vector<std::shared_ptr<BSStruct>> structs;
         std::vector<std::shared_ptr<BSFunction>> functions;
         std::vector<std::shared_ptr<BSPipeline>> pipelines;
+        /// Names of symbols defined outside of the module, referenced by negative ids
+        std::vector<std::string> imports;
     };
 
+    /// The name a negative id refers to, or null if the module doesn't import that many symbols
+    const std::string* importedSymbol(const BSModule& module, int32_t id);
+
 } // namespace BraneScript
 
 #endif
@@ -0,0 +1,310 @@
+#include "linker.h"
+
+#include <format>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace BraneScript
+{
+    template<class... Ts>
+    struct overloads : Ts...
+    {
+        using Ts::operator()...;
+    };
+
+    namespace
+    {
+        /// Marks a function no module defines, or one that was dropped
+        constexpr uint32_t external = UINT32_MAX;
+
+        class Linker
+        {
+            std::span<const BSModule> _modules;
+            const LinkOptions& _options;
+
+            std::vector<const BSFunction*> _functions;
+            std::vector<size_t> _functionModules;
+            std::vector<uint32_t> _moduleFirstFunction;
+            std::unordered_map<std::string, uint32_t> _functionIndices;
+            std::unordered_map<std::string, uint32_t> _structIndices;
+            /// Index in the linked module of every struct each module declares
+            std::vector<std::vector<uint32_t>> _moduleStructs;
+            /// Module the struct at each index of the linked module was first declared in
+            std::vector<size_t> _structModules;
+            /// Index of every function in the linked module
+            std::vector<uint32_t> _imageIndices;
+
+            std::expected<void, std::string> buildSymbolTable()
+            {
+                std::unordered_set<std::string_view> pipelines;
+                for(size_t m = 0; m < _modules.size(); ++m)
+                {
+                    auto& module = _modules[m];
+                    _moduleFirstFunction.push_back((uint32_t)_functions.size());
+                    auto& structs = _moduleStructs.emplace_back();
+                    for(auto& function : module.functions)
+                    {
+                        if(!_functionIndices.try_emplace(function->id, (uint32_t)_functions.size()).second)
+                            return std::unexpected(std::format("Function {} is defined more than once", function->id));
+                        _functions.push_back(function.get());
+                        _functionModules.push_back(m);
+                    }
+                    // A struct declared by several modules, such as a host type each of them declares, is one
+                    // struct, link checks that the declarations match
+                    for(auto& structDef : module.structs)
+                    {
+                        uint32_t next = (uint32_t)_structModules.size();
+                        auto [index, added] = _structIndices.try_emplace(structDef->id, next);
+                        if(added)
+                            _structModules.push_back(m);
+                        structs.push_back(index->second);
+                    }
+                    for(auto& pipeline : module.pipelines)
+                    {
+                        if(!pipelines.insert(pipeline->id).second)
+                            return std::unexpected(std::format("Pipeline {} is defined more than once", pipeline->id));
+                    }
+                }
+                return {};
+            }
+
+            /// The function a call resolves to, or external along with its name if no module defines it
+            std::expected<std::pair<uint32_t, std::string_view>, std::string> resolveFunction(const IDRef& target,
+                                                                                             size_t module) const
+            {
+                auto byName = [&](const std::string& name) -> std::pair<uint32_t, std::string_view> {
+                    auto index = _functionIndices.find(name);
+                    return {index == _functionIndices.end() ? external : index->second, name};
+                };
+                if(auto* name = std::get_if<std::string>(&target))
+                    return byName(*name);
+                int32_t id = std::get<int32_t>(target);
+                if(auto* imported = importedSymbol(_modules[module], id))
+                    return byName(*imported);
+                if(id <= 0 || (size_t)id > _modules[module].functions.size())
+                    return std::unexpected(
+                        std::format("{}: call to unbound external function {}", _modules[module].name, id));
+                uint32_t index = _moduleFirstFunction[module] + (uint32_t)id - 1;
+                return std::pair<uint32_t, std::string_view>{index, _functions[index]->id};
+            }
+
+            std::expected<uint32_t, std::string> resolveStruct(const IDRef& id, size_t module) const
+            {
+                auto byName = [&](const std::string& name) -> std::expected<uint32_t, std::string> {
+                    auto index = _structIndices.find(name);
+                    if(index == _structIndices.end())
+                        return std::unexpected(std::format("Struct {} is not declared in any module", name));
+                    return index->second;
+                };
+                if(auto* name = std::get_if<std::string>(&id))
+                    return byName(*name);
+                int32_t local = std::get<int32_t>(id);
+                if(auto* imported = importedSymbol(_modules[module], local))
+                    return byName(*imported);
+                auto& structs = _moduleStructs[module];
+                if(local <= 0 || (size_t)local > structs.size())
+                    return std::unexpected(
+                        std::format("{}: struct id {} can't be resolved", _modules[module].name, local));
+                return structs[(size_t)local - 1];
+            }
+
+            /// Keeps every function reachable from a pipeline or entry point, numbering them in their original order
+            std::expected<void, std::string> markReachable()
+            {
+                std::vector<bool> kept(_functions.size(), _options.keepUnreferenced);
+                std::vector<uint32_t> worklist;
+                auto keep = [&](uint32_t function) {
+                    if(function == external || kept[function])
+                        return;
+                    kept[function] = true;
+                    worklist.push_back(function);
+                };
+                auto keepCallees = [&](const InstructionList& code, size_t module) -> std::expected<void, std::string> {
+                    for(auto& target : code.callTargets)
+                    {
+                        auto callee = resolveFunction(target, module);
+                        if(!callee)
+                            return std::unexpected(callee.error());
+                        keep(callee->first);
+                    }
+                    return {};
+                };
+
+                for(auto& entryPoint : _options.entryPoints)
+                {
+                    auto index = _functionIndices.find(entryPoint);
+                    if(index == _functionIndices.end())
+                        return std::unexpected(std::format("Entry point {} is not defined in any module", entryPoint));
+                    keep(index->second);
+                }
+                for(size_t m = 0; m < _modules.size(); ++m)
+                {
+                    for(auto& pipeline : _modules[m].pipelines)
+                    {
+                        if(!pipeline->stages)
+                            continue;
+                        for(auto& stage : *pipeline->stages)
+                        {
+                            if(auto result = keepCallees(stage.operations, m); !result)
+                                return result;
+                        }
+                    }
+                }
+                if(_options.keepUnreferenced)
+                {
+                    for(uint32_t f = 0; f < _functions.size(); ++f)
+                        worklist.push_back(f);
+                }
+                while(!worklist.empty())
+                {
+                    uint32_t function = worklist.back();
+                    worklist.pop_back();
+                    if(auto result = keepCallees(_functions[function]->operations, _functionModules[function]); !result)
+                        return result;
+                }
+
+                uint32_t next = 0;
+                _imageIndices.resize(_functions.size());
+                for(uint32_t f = 0; f < _functions.size(); ++f)
+                    _imageIndices[f] = kept[f] ? next++ : external;
+                return {};
+            }
+
+            std::expected<BSType, std::string> relocate(const BSType& type, size_t module) const
+            {
+                return std::visit(
+                    overloads{[&](BSBaseType base) -> std::expected<BSType, std::string> { return base; },
+                              [&](const IRNode<BSStructType>& structType) -> std::expected<BSType, std::string> {
+                        auto index = resolveStruct(structType->structId, module);
+                        if(!index)
+                            return std::unexpected(index.error());
+                        return std::make_shared<BSStructType>(BSStructType{(int32_t)*index + 1});
+                    },
+                              [&](const IRNode<BSRefType>& refType) -> std::expected<BSType, std::string> {
+                        auto contained = relocate(refType->contained, module);
+                        if(!contained)
+                            return std::unexpected(contained.error());
+                        return std::make_shared<BSRefType>(BSRefType{std::move(*contained), refType->valueMutable});
+                    }},
+                    type);
+            }
+
+            /// Moves types from their module's table into the linked module's
+            std::expected<void, std::string> relocate(std::vector<TypeId>& types, size_t module, TypeTable& image) const
+            {
+                for(auto& type : types)
+                {
+                    auto relocated = relocate(_modules[module].types.type(type), module);
+                    if(!relocated)
+                        return std::unexpected(relocated.error());
+                    type = image.intern(*relocated);
+                }
+                return {};
+            }
+
+            std::expected<void, std::string> relocate(InstructionList& code, size_t module) const
+            {
+                for(auto& target : code.callTargets)
+                {
+                    auto callee = resolveFunction(target, module);
+                    if(!callee)
+                        return std::unexpected(callee.error());
+                    if(callee->first == external)
+                        target = std::string(callee->second);
+                    else
+                        target = (int32_t)_imageIndices[callee->first] + 1;
+                }
+                return {};
+            }
+
+          public:
+            Linker(std::span<const BSModule> modules, const LinkOptions& options)
+                : _modules(modules), _options(options)
+            {}
+
+            std::expected<BSModule, std::string> link()
+            {
+                if(auto result = buildSymbolTable(); !result)
+                    return std::unexpected(result.error());
+                if(auto result = markReachable(); !result)
+                    return std::unexpected(result.error());
+
+                BSModule image;
+                image.name = _options.name;
+                for(size_t m = 0; m < _modules.size(); ++m)
+                {
+                    for(size_t s = 0; s < _modules[m].structs.size(); ++s)
+                    {
+                        auto copy = std::make_shared<BSStruct>(*_modules[m].structs[s]);
+                        if(auto result = relocate(copy->members, m, image.types); !result)
+                            return std::unexpected(result.error());
+                        uint32_t index = _moduleStructs[m][s];
+                        if(index == image.structs.size())
+                        {
+                            image.structs.push_back(std::move(copy));
+                            continue;
+                        }
+                        // Members were relocated into the same table, so equal declarations have equal type ids
+                        auto& declared = *image.structs[index];
+                        if(declared.members != copy->members || declared.memberNames != copy->memberNames ||
+                           declared.packed != copy->packed)
+                            return std::unexpected(std::format("Struct {} is declared differently in {} and {}",
+                                                               copy->id,
+                                                               _modules[_structModules[index]].name,
+                                                               _modules[m].name));
+                    }
+                }
+                for(uint32_t f = 0; f < _functions.size(); ++f)
+                {
+                    if(_imageIndices[f] == external)
+                        continue;
+                    size_t m = _functionModules[f];
+                    auto copy = std::make_shared<BSFunction>(*_functions[f]);
+                    for(auto* types : {&copy->localVars, &copy->inputs, &copy->outputs})
+                    {
+                        if(auto result = relocate(*types, m, image.types); !result)
+                            return std::unexpected(result.error());
+                    }
+                    if(auto result = relocate(copy->operations, m); !result)
+                        return std::unexpected(result.error());
+                    image.functions.push_back(std::move(copy));
+                }
+                for(size_t m = 0; m < _modules.size(); ++m)
+                {
+                    for(auto& pipeline : _modules[m].pipelines)
+                    {
+                        auto copy = std::make_shared<BSPipeline>(*pipeline);
+                        for(auto* types : {&copy->inputs, &copy->outputs})
+                        {
+                            if(auto result = relocate(*types, m, image.types); !result)
+                                return std::unexpected(result.error());
+                        }
+                        if(copy->stages)
+                        {
+                            for(auto& stage : *copy->stages)
+                            {
+                                if(auto result = relocate(stage.localVars, m, image.types); !result)
+                                    return std::unexpected(result.error());
+                                if(auto result = relocate(stage.operations, m); !result)
+                                    return std::unexpected(result.error());
+                                for(auto& op : stage.asyncOps)
+                                {
+                                    auto& outputs = std::get<BSAsyncCall>(op).outputs;
+                                    if(auto result = relocate(outputs, m, image.types); !result)
+                                        return std::unexpected(result.error());
+                                }
+                            }
+                        }
+                        image.pipelines.push_back(std::move(copy));
+                    }
+                }
+                return image;
+            }
+        };
+    } // namespace
+
+    std::expected<BSModule, std::string> linkModules(std::span<const BSModule> modules, const LinkOptions& options)
+    {
+        return Linker(modules, options).link();
+    }
+} // namespace BraneScript
@@ -0,0 +1,32 @@
+#ifndef BRANESCRIPT_LINKER_H
+#define BRANESCRIPT_LINKER_H
+
+#include <expected>
+#include <span>
+#include <string>
+#include <vector>
+#include "ir.h"
+
+namespace BraneScript
+{
+    struct LinkOptions
+    {
+        /// Name of the linked module
+        std::string name = "linked";
+        /// Functions kept even if nothing calls them, such as those the host calls directly. Pipelines are always kept.
+        std::vector<std::string> entryPoints;
+        /// Keep every function, not only those reachable from pipelines and entry points
+        bool keepUnreferenced = false;
+    };
+
+    /// Links separately compiled modules, such as ones loaded from a compiler cache, into a single module. Every
+    /// struct, function and pipeline goes into one symbol table by name, so function and pipeline names must be unique
+    /// across the modules. A struct may be declared by several modules as long as the declarations match, they become
+    /// one struct of the linked module. Every reference to them, by name, by index into its own module or through its
+    /// module's imports, becomes an index into the linked module, so loading it needs no lookups. References to
+    /// functions no module defines, such as host functions, are left as names for the loader to bind.
+    std::expected<BSModule, std::string> linkModules(std::span<const BSModule> modules,
+                                                     const LinkOptions& options = {});
+} // namespace BraneScript
+
+#endif
@@ -0,0 +1,791 @@
+#include "moduleFormat.h"
+
+#include <cassert>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <unordered_map>
+
+#ifdef _WIN32
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace BraneScript
+{
+    template<class... Ts>
+    struct overloads : Ts...
+    {
+        using Ts::operator()...;
+    };
+
+    using namespace ModuleFormat;
+
+    namespace
+    {
+        class ModuleWriter
+        {
+            const TypeTable& _typeTable;
+
+            std::vector<StringEntry> _stringEntries;
+            std::string _stringData;
+            std::unordered_map<std::string, uint32_t> _stringIndices;
+
+            std::vector<TypeEntry> _types;
+            std::unordered_map<std::string, uint32_t> _typeIndices;
+            /// File type index of each TypeId that has been written
+            std::unordered_map<uint32_t, uint32_t> _typeIdIndices;
+            std::vector<uint32_t> _typeLists;
+
+            std::vector<StructEntry> _structs;
+            std::vector<FunctionEntry> _functions;
+            std::vector<PipelineEntry> _pipelines;
+            std::vector<StageEntry> _stages;
+            std::vector<Instruction> _instructions;
+            std::vector<uint32_t> _callOperands;
+            std::vector<CallTargetEntry> _callTargets;
+            std::vector<uint32_t> _valueLists;
+            std::vector<AsyncOpEntry> _asyncOps;
+            std::vector<uint32_t> _imports;
+            std::vector<uint32_t> _memberNames;
+
+            template<class T>
+            static Range append(std::vector<T>& dest, std::span<const T> values)
+            {
+                Range range{(uint32_t)dest.size(), (uint32_t)values.size()};
+                dest.insert(dest.end(), values.begin(), values.end());
+                return range;
+            }
+
+            uint32_t addType(const BSType& type)
+            {
+                // Types are deduplicated by a structural key, so contained types are always written first
+                TypeEntry entry{};
+                std::string key = std::visit(
+                    overloads{[&](BSBaseType base) {
+                        entry = {TypeKind::Base, 0, 0, (uint32_t)base};
+                        return std::format("b{}", (uint32_t)base);
+                    },
+                              [&](const IRNode<BSStructType>& structType) {
+                        return std::visit(overloads{[&](const std::string& name) {
+                            entry = {TypeKind::NamedStruct, 0, 0, addString(name)};
+                            return "s" + name;
+                        },
+                                                    [&](int32_t id) {
+                            entry = {TypeKind::IndexedStruct, 0, 0, (uint32_t)id};
+                            return std::format("i{}", id);
+                        }},
+                                          structType->structId);
+                    },
+                              [&](const IRNode<BSRefType>& refType) {
+                        uint32_t contained = addType(refType->contained);
+                        entry = {TypeKind::Ref, (uint8_t)refType->valueMutable, 0, contained};
+                        return std::format("r{}{}", refType->valueMutable ? 'm' : 'c', contained);
+                    }},
+                    type);
+
+                auto existing = _typeIndices.find(key);
+                if(existing != _typeIndices.end())
+                    return existing->second;
+                uint32_t index = (uint32_t)_types.size();
+                _types.push_back(entry);
+                _typeIndices.insert({std::move(key), index});
+                return index;
+            }
+
+            Range addTypeList(const std::vector<TypeId>& types)
+            {
+                std::vector<uint32_t> indices;
+                indices.reserve(types.size());
+                for(auto type : types)
+                {
+                    auto [index, inserted] = _typeIdIndices.try_emplace((uint32_t)type);
+                    if(inserted)
+                        index->second = addType(_typeTable.type(type));
+                    indices.push_back(index->second);
+                }
+                return append<uint32_t>(_typeLists, indices);
+            }
+
+            CodeEntry addCode(const InstructionList& code)
+            {
+                CodeEntry entry;
+                entry.instructions = append<Instruction>(_instructions, code.instructions);
+                entry.callOperands = append<uint32_t>(_callOperands, code.callOperands);
+                entry.callTargets = {(uint32_t)_callTargets.size(), (uint32_t)code.callTargets.size()};
+                for(auto& target : code.callTargets)
+                {
+                    _callTargets.push_back(std::visit(
+                        overloads{[&](const std::string& name) { return CallTargetEntry{1, addString(name)}; },
+                                  [&](int32_t id) { return CallTargetEntry{0, (uint32_t)id}; }},
+                        target));
+                }
+                return entry;
+            }
+
+          public:
+            explicit ModuleWriter(const TypeTable& typeTable) : _typeTable(typeTable) {}
+
+            uint32_t addString(std::string_view str)
+            {
+                auto existing = _stringIndices.find(std::string(str));
+                if(existing != _stringIndices.end())
+                    return existing->second;
+                uint32_t index = (uint32_t)_stringEntries.size();
+                _stringEntries.push_back({(uint32_t)_stringData.size(), (uint32_t)str.size()});
+                _stringData.append(str);
+                // Null terminate so that strings can be handed to C apis in place
+                _stringData.push_back('\0');
+                _stringIndices.insert({std::string(str), index});
+                return index;
+            }
+
+            void addStruct(const BSStruct& structDef)
+            {
+                std::vector<uint32_t> names;
+                for(auto& name : structDef.memberNames)
+                    names.push_back(addString(name));
+                _structs.push_back({addString(structDef.id),
+                                    structDef.packed ? ModuleFormat::structPacked : 0,
+                                    addTypeList(structDef.members),
+                                    append<uint32_t>(_memberNames, names)});
+            }
+
+            void addFunction(const BSFunction& function)
+            {
+                FunctionEntry entry;
+                entry.id = addString(function.id);
+                entry.localVars = addTypeList(function.localVars);
+                entry.inputs = addTypeList(function.inputs);
+                entry.outputs = addTypeList(function.outputs);
+                entry.code = addCode(function.operations);
+                _functions.push_back(entry);
+            }
+
+            void addImport(std::string_view name) { _imports.push_back(addString(name)); }
+
+            void addPipeline(const BSPipeline& pipeline)
+            {
+                PipelineEntry entry;
+                entry.id = addString(pipeline.id);
+                entry.hasStages = pipeline.stages.has_value();
+                entry.inputs = addTypeList(pipeline.inputs);
+                entry.outputs = addTypeList(pipeline.outputs);
+                entry.stages = {(uint32_t)_stages.size(), 0};
+                if(pipeline.stages)
+                {
+                    for(auto& stage : *pipeline.stages)
+                    {
+                        StageEntry stageEntry;
+                        stageEntry.localVars = addTypeList(stage.localVars);
+                        stageEntry.code = addCode(stage.operations);
+                        stageEntry.asyncOps = {(uint32_t)_asyncOps.size(), (uint32_t)stage.asyncOps.size()};
+                        for(auto& op : stage.asyncOps)
+                        {
+                            auto& call = std::get<BSAsyncCall>(op);
+                            AsyncOpEntry opEntry;
+                            opEntry.function = addString(call.function);
+                            opEntry.inputs = {(uint32_t)_valueLists.size(), (uint32_t)call.inputs.size()};
+                            for(auto value : call.inputs)
+                                _valueLists.push_back(value.id);
+                            opEntry.outputs = addTypeList(call.outputs);
+                            _asyncOps.push_back(opEntry);
+                        }
+                        stageEntry.outputs = {(uint32_t)_valueLists.size(), (uint32_t)stage.outputs.size()};
+                        for(auto value : stage.outputs)
+                            _valueLists.push_back(value.id);
+                        _stages.push_back(stageEntry);
+                        entry.stages.count++;
+                    }
+                }
+                _pipelines.push_back(entry);
+            }
+
+            std::vector<std::byte> finish(uint32_t moduleName)
+            {
+                Header header{};
+                std::memcpy(header.magic, ModuleFormat::magic, sizeof(header.magic));
+                header.versionMajor = ModuleFormat::versionMajor;
+                header.versionMinor = ModuleFormat::versionMinor;
+                header.endianCheck = ModuleFormat::endianCheck;
+                header.moduleName = moduleName;
+
+                std::vector<std::byte> data(sizeof(Header));
+                auto writeSection = [&]<class T>(Section section, const T* values, size_t count) {
+                    size_t offset = (data.size() + sectionAlignment - 1) & ~(sectionAlignment - 1);
+                    size_t size = count * sizeof(T);
+                    data.resize(offset + size);
+                    if(size)
+                        std::memcpy(data.data() + offset, values, size);
+                    header.sections[(size_t)section] = {offset, size};
+                };
+
+                writeSection(Section::StringEntries, _stringEntries.data(), _stringEntries.size());
+                writeSection(Section::StringData, _stringData.data(), _stringData.size());
+                writeSection(Section::Types, _types.data(), _types.size());
+                writeSection(Section::TypeLists, _typeLists.data(), _typeLists.size());
+                writeSection(Section::Structs, _structs.data(), _structs.size());
+                writeSection(Section::Functions, _functions.data(), _functions.size());
+                writeSection(Section::Pipelines, _pipelines.data(), _pipelines.size());
+                writeSection(Section::Stages, _stages.data(), _stages.size());
+                writeSection(Section::Instructions, _instructions.data(), _instructions.size());
+                writeSection(Section::CallOperands, _callOperands.data(), _callOperands.size());
+                writeSection(Section::CallTargets, _callTargets.data(), _callTargets.size());
+                writeSection(Section::ValueLists, _valueLists.data(), _valueLists.size());
+                writeSection(Section::AsyncOps, _asyncOps.data(), _asyncOps.size());
+                writeSection(Section::Imports, _imports.data(), _imports.size());
+                writeSection(Section::MemberNames, _memberNames.data(), _memberNames.size());
+
+                header.fileSize = data.size();
+                std::memcpy(data.data(), &header, sizeof(Header));
+                return data;
+            }
+        };
+
+        template<class T>
+        bool sectionValid(const Header& header, Section section)
+        {
+            auto& entry = header.sections[(size_t)section];
+            return entry.offset % sectionAlignment == 0 && entry.offset <= header.fileSize &&
+                   entry.size <= header.fileSize - entry.offset && entry.size % sizeof(T) == 0;
+        }
+
+        bool rangeValid(Range range, size_t size) { return range.offset <= size && range.count <= size - range.offset; }
+    } // namespace
+
+    std::vector<std::byte> serializeModule(const BSModule& module)
+    {
+        ModuleWriter writer(module.types);
+        uint32_t name = writer.addString(module.name);
+        for(auto& structDef : module.structs)
+            writer.addStruct(*structDef);
+        for(auto& function : module.functions)
+            writer.addFunction(*function);
+        for(auto& pipeline : module.pipelines)
+            writer.addPipeline(*pipeline);
+        for(auto& import : module.imports)
+            writer.addImport(import);
+        return writer.finish(name);
+    }
+
+    std::expected<void, std::string> writeModuleFile(const std::filesystem::path& path, const BSModule& module)
+    {
+        auto data = serializeModule(module);
+        std::ofstream f(path, std::ios::binary | std::ios::trunc);
+        if(!f.is_open())
+            return std::unexpected(std::format("Could not open \"{}\" for writing", path.string()));
+        f.write(reinterpret_cast<const char*>(data.data()), (std::streamsize)data.size());
+        if(!f)
+            return std::unexpected(std::format("Failed to write \"{}\"", path.string()));
+        return {};
+    }
+
+    std::expected<ModuleView, std::string> ModuleView::open(std::span<const std::byte> data,
+                                                            const ModuleOpenOptions& options)
+    {
+        if(data.size() < sizeof(Header))
+            return std::unexpected("Data is too small to be a module");
+        if(reinterpret_cast<uintptr_t>(data.data()) % sectionAlignment != 0)
+            return std::unexpected("Module data must be 16 byte aligned");
+
+        ModuleView view;
+        view._data = data;
+        view._header = reinterpret_cast<const Header*>(data.data());
+        auto& header = *view._header;
+
+        if(std::memcmp(header.magic, ModuleFormat::magic, sizeof(header.magic)) != 0)
+            return std::unexpected("Not a BraneScript module");
+        if(header.endianCheck != ModuleFormat::endianCheck)
+            return std::unexpected("Module was written on a machine with different endianness");
+        if(header.versionMajor != ModuleFormat::versionMajor)
+            return std::unexpected(std::format("Unsupported module version {}.{}, expected {}.x",
+                                               header.versionMajor,
+                                               header.versionMinor,
+                                               ModuleFormat::versionMajor));
+        if(header.fileSize > data.size())
+            return std::unexpected("Module data is truncated");
+
+        if(!sectionValid<StringEntry>(header, Section::StringEntries) ||
+           !sectionValid<char>(header, Section::StringData) || !sectionValid<TypeEntry>(header, Section::Types) ||
+           !sectionValid<uint32_t>(header, Section::TypeLists) ||
+           !sectionValid<StructEntry>(header, Section::Structs) ||
+           !sectionValid<FunctionEntry>(header, Section::Functions) ||
+           !sectionValid<PipelineEntry>(header, Section::Pipelines) ||
+           !sectionValid<StageEntry>(header, Section::Stages) ||
+           !sectionValid<Instruction>(header, Section::Instructions) ||
+           !sectionValid<uint32_t>(header, Section::CallOperands) ||
+           !sectionValid<CallTargetEntry>(header, Section::CallTargets) ||
+           !sectionValid<uint32_t>(header, Section::ValueLists) ||
+           !sectionValid<AsyncOpEntry>(header, Section::AsyncOps) ||
+           !sectionValid<uint32_t>(header, Section::Imports) ||
+           !sectionValid<uint32_t>(header, Section::MemberNames))
+            return std::unexpected("Module section table is corrupt");
+
+        if(options.validateTables)
+        {
+            auto valid = view.validate();
+            if(!valid)
+                return std::unexpected(std::move(valid.error()));
+        }
+        return view;
+    }
+
+    std::expected<void, std::string> ModuleView::validate() const
+    {
+        // Validate every table entry so that accessors don't need to, instruction operands are left to whoever
+        // executes them so that validating a module doesn't touch its code pages
+        auto& header = *_header;
+        auto strings = section<StringEntry>(Section::StringEntries);
+        auto stringData = section<char>(Section::StringData);
+        for(auto& str : strings)
+        {
+            if(str.offset >= stringData.size() || str.length >= stringData.size() - str.offset ||
+               stringData[str.offset + str.length] != '\0')
+                return std::unexpected("Module string table is corrupt");
+        }
+        if(header.moduleName >= strings.size())
+            return std::unexpected("Module name is out of range");
+
+        auto types = section<TypeEntry>(Section::Types);
+        for(size_t i = 0; i < types.size(); ++i)
+        {
+            auto& type = types[i];
+            bool valid = false;
+            switch(type.kind)
+            {
+                case TypeKind::Base:
+                    valid = type.value <= (uint32_t)BSBaseType::I128;
+                    break;
+                case TypeKind::NamedStruct:
+                    valid = type.value < strings.size();
+                    break;
+                case TypeKind::IndexedStruct:
+                    valid = true;
+                    break;
+                case TypeKind::Ref:
+                    // Contained types are always written first, which also rules out cycles
+                    valid = type.value < i;
+                    break;
+            }
+            if(!valid)
+                return std::unexpected("Module type table is corrupt");
+        }
+        for(uint32_t type : section<uint32_t>(Section::TypeLists))
+        {
+            if(type >= types.size())
+                return std::unexpected("Module type list is corrupt");
+        }
+
+        size_t typeListSize = section<uint32_t>(Section::TypeLists).size();
+        size_t instructionCount = section<Instruction>(Section::Instructions).size();
+        size_t callOperandCount = section<uint32_t>(Section::CallOperands).size();
+        auto callTargets = section<CallTargetEntry>(Section::CallTargets);
+        auto codeValid = [&](const CodeEntry& code) {
+            if(!rangeValid(code.instructions, instructionCount) || !rangeValid(code.callOperands, callOperandCount) ||
+               !rangeValid(code.callTargets, callTargets.size()))
+                return false;
+            for(auto& target : callTargets.subspan(code.callTargets.offset, code.callTargets.count))
+            {
+                if(target.isString && target.value >= strings.size())
+                    return false;
+            }
+            return true;
+        };
+
+        auto memberNames = section<uint32_t>(Section::MemberNames);
+        for(uint32_t name : memberNames)
+        {
+            if(name >= strings.size())
+                return std::unexpected("Module member name table is corrupt");
+        }
+        for(auto& structDef : section<StructEntry>(Section::Structs))
+        {
+            if(structDef.id >= strings.size() || (structDef.flags & ~structPacked) ||
+               !rangeValid(structDef.members, typeListSize) || !rangeValid(structDef.memberNames, memberNames.size()) ||
+               (structDef.memberNames.count && structDef.memberNames.count != structDef.members.count))
+                return std::unexpected("Module struct table is corrupt");
+        }
+        for(auto& function : section<FunctionEntry>(Section::Functions))
+        {
+            if(function.id >= strings.size() || !rangeValid(function.localVars, typeListSize) ||
+               !rangeValid(function.inputs, typeListSize) || !rangeValid(function.outputs, typeListSize) ||
+               !codeValid(function.code))
+                return std::unexpected("Module function table is corrupt");
+        }
+        size_t valueListSize = section<uint32_t>(Section::ValueLists).size();
+        auto asyncOps = section<AsyncOpEntry>(Section::AsyncOps);
+        for(auto& op : asyncOps)
+        {
+            if(op.function >= strings.size() || !rangeValid(op.inputs, valueListSize) ||
+               !rangeValid(op.outputs, typeListSize))
+                return std::unexpected("Module async operation table is corrupt");
+        }
+        auto stages = section<StageEntry>(Section::Stages);
+        for(auto& stage : stages)
+        {
+            if(!rangeValid(stage.localVars, typeListSize) || !codeValid(stage.code) ||
+               !rangeValid(stage.asyncOps, asyncOps.size()) || !rangeValid(stage.outputs, valueListSize))
+                return std::unexpected("Module stage table is corrupt");
+        }
+        for(auto& pipeline : section<PipelineEntry>(Section::Pipelines))
+        {
+            if(pipeline.id >= strings.size() || !rangeValid(pipeline.inputs, typeListSize) ||
+               !rangeValid(pipeline.outputs, typeListSize) || !rangeValid(pipeline.stages, stages.size()))
+                return std::unexpected("Module pipeline table is corrupt");
+        }
+        for(uint32_t import : section<uint32_t>(Section::Imports))
+        {
+            if(import >= strings.size())
+                return std::unexpected("Module import table is corrupt");
+        }
+
+        return {};
+    }
+
+    std::string_view ModuleView::name() const { return string(_header->moduleName); }
+
+    std::string_view ModuleView::string(uint32_t index) const
+    {
+        auto entry = section<StringEntry>(Section::StringEntries)[index];
+        return {section<char>(Section::StringData).data() + entry.offset, entry.length};
+    }
+
+    std::span<const TypeEntry> ModuleView::types() const { return section<TypeEntry>(Section::Types); }
+
+    BSType ModuleView::type(uint32_t index) const
+    {
+        auto& entry = types()[index];
+        switch(entry.kind)
+        {
+            case TypeKind::Base:
+                return (BSBaseType)entry.value;
+            case TypeKind::NamedStruct:
+                return std::make_shared<BSStructType>(BSStructType{std::string(string(entry.value))});
+            case TypeKind::IndexedStruct:
+                return std::make_shared<BSStructType>(BSStructType{(int32_t)entry.value});
+            case TypeKind::Ref:
+            default:
+                return std::make_shared<BSRefType>(BSRefType{type(entry.value), entry.valueMutable != 0});
+        }
+    }
+
+    size_t ModuleView::structCount() const { return section<StructEntry>(Section::Structs).size(); }
+
+    StructView ModuleView::structAt(size_t index) const
+    {
+        return {this, &section<StructEntry>(Section::Structs)[index]};
+    }
+
+    size_t ModuleView::functionCount() const { return section<FunctionEntry>(Section::Functions).size(); }
+
+    FunctionView ModuleView::function(size_t index) const
+    {
+        return {this, &section<FunctionEntry>(Section::Functions)[index]};
+    }
+
+    size_t ModuleView::pipelineCount() const { return section<PipelineEntry>(Section::Pipelines).size(); }
+
+    PipelineView ModuleView::pipeline(size_t index) const
+    {
+        return {this, &section<PipelineEntry>(Section::Pipelines)[index]};
+    }
+
+    size_t ModuleView::importCount() const { return section<uint32_t>(Section::Imports).size(); }
+
+    std::string_view ModuleView::import(size_t index) const
+    {
+        return string(section<uint32_t>(Section::Imports)[index]);
+    }
+
+    BSModule ModuleView::toModule() const
+    {
+        BSModule module;
+        std::vector<std::optional<TypeId>> typeIds(types().size());
+        auto typeList = [&](std::span<const uint32_t> indices) {
+            std::vector<TypeId> list;
+            list.reserve(indices.size());
+            for(uint32_t index : indices)
+            {
+                if(!typeIds[index])
+                    typeIds[index] = module.types.intern(type(index));
+                list.push_back(*typeIds[index]);
+            }
+            return list;
+        };
+        auto code = [&](const CodeView& view) {
+            InstructionList list;
+            auto instructions = view.instructions();
+            auto callOperands = view.callOperands();
+            list.instructions.assign(instructions.begin(), instructions.end());
+            list.callOperands.assign(callOperands.begin(), callOperands.end());
+            for(uint32_t i = 0; i < view.callTargetCount(); ++i)
+                list.callTargets.push_back(view.callTarget(i));
+            return list;
+        };
+
+        module.name = name();
+        for(size_t i = 0; i < structCount(); ++i)
+        {
+            auto view = structAt(i);
+            auto structDef = std::make_shared<BSStruct>();
+            structDef->id = view.id();
+            structDef->members = typeList(view.members());
+            for(uint32_t name : view.memberNames())
+                structDef->memberNames.emplace_back(string(name));
+            structDef->packed = view.packed();
+            module.structs.push_back(std::move(structDef));
+        }
+        for(size_t i = 0; i < functionCount(); ++i)
+        {
+            auto view = function(i);
+            auto func = std::make_shared<BSFunction>();
+            func->id = view.id();
+            func->localVars = typeList(view.localVars());
+            func->inputs = typeList(view.inputs());
+            func->outputs = typeList(view.outputs());
+            func->operations = code(view.code());
+            module.functions.push_back(std::move(func));
+        }
+        for(size_t i = 0; i < pipelineCount(); ++i)
+        {
+            auto view = pipeline(i);
+            auto pipe = std::make_shared<BSPipeline>();
+            pipe->id = view.id();
+            pipe->inputs = typeList(view.inputs());
+            pipe->outputs = typeList(view.outputs());
+            if(view.hasStages())
+            {
+                pipe->stages.emplace();
+                for(size_t s = 0; s < view.stageCount(); ++s)
+                {
+                    auto stageView = view.stage(s);
+                    auto& stage = pipe->stages->emplace_back();
+                    stage.localVars = typeList(stageView.localVars());
+                    stage.operations = code(stageView.code());
+                    for(auto& op : stageView.asyncOps())
+                    {
+                        BSAsyncCall call;
+                        call.function = string(op.function);
+                        for(uint32_t value : sectionRange<uint32_t>(Section::ValueLists, op.inputs))
+                            call.inputs.push_back({value});
+                        call.outputs = typeList(sectionRange<uint32_t>(Section::TypeLists, op.outputs));
+                        stage.asyncOps.push_back(std::move(call));
+                    }
+                    for(uint32_t value : stageView.outputs())
+                        stage.outputs.push_back({value});
+                }
+            }
+            module.pipelines.push_back(std::move(pipe));
+        }
+        for(size_t i = 0; i < importCount(); ++i)
+            module.imports.emplace_back(import(i));
+        return module;
+    }
+
+    CodeView::CodeView(const ModuleView* module, const CodeEntry* entry) : _module(module), _entry(entry) {}
+
+    std::span<const Instruction> CodeView::instructions() const
+    {
+        return _module->sectionRange<Instruction>(Section::Instructions, _entry->instructions);
+    }
+
+    std::span<const uint32_t> CodeView::callOperands() const
+    {
+        return _module->sectionRange<uint32_t>(Section::CallOperands, _entry->callOperands);
+    }
+
+    size_t CodeView::callTargetCount() const { return _entry->callTargets.count; }
+
+    IDRef CodeView::callTarget(uint32_t index) const
+    {
+        auto targets = _module->sectionRange<CallTargetEntry>(Section::CallTargets, _entry->callTargets);
+        auto& target = targets[index];
+        if(target.isString)
+            return std::string(_module->string(target.value));
+        return (int32_t)target.value;
+    }
+
+    FunctionView::FunctionView(const ModuleView* module, const FunctionEntry* entry) : _module(module), _entry(entry)
+    {}
+
+    std::string_view FunctionView::id() const { return _module->string(_entry->id); }
+
+    std::span<const uint32_t> FunctionView::localVars() const
+    {
+        return _module->sectionRange<uint32_t>(Section::TypeLists, _entry->localVars);
+    }
+
+    std::span<const uint32_t> FunctionView::inputs() const
+    {
+        return _module->sectionRange<uint32_t>(Section::TypeLists, _entry->inputs);
+    }
+
+    std::span<const uint32_t> FunctionView::outputs() const
+    {
+        return _module->sectionRange<uint32_t>(Section::TypeLists, _entry->outputs);
+    }
+
+    CodeView FunctionView::code() const { return {_module, &_entry->code}; }
+
+    PipelineStageView::PipelineStageView(const ModuleView* module, const StageEntry* entry)
+        : _module(module), _entry(entry)
+    {}
+
+    std::span<const uint32_t> PipelineStageView::localVars() const
+    {
+        return _module->sectionRange<uint32_t>(Section::TypeLists, _entry->localVars);
+    }
+
+    CodeView PipelineStageView::code() const { return {_module, &_entry->code}; }
+
+    std::span<const AsyncOpEntry> PipelineStageView::asyncOps() const
+    {
+        return _module->sectionRange<AsyncOpEntry>(Section::AsyncOps, _entry->asyncOps);
+    }
+
+    std::span<const uint32_t> PipelineStageView::outputs() const
+    {
+        return _module->sectionRange<uint32_t>(Section::ValueLists, _entry->outputs);
+    }
+
+    PipelineView::PipelineView(const ModuleView* module, const PipelineEntry* entry) : _module(module), _entry(entry)
+    {}
+
+    std::string_view PipelineView::id() const { return _module->string(_entry->id); }
+
+    std::span<const uint32_t> PipelineView::inputs() const
+    {
+        return _module->sectionRange<uint32_t>(Section::TypeLists, _entry->inputs);
+    }
+
+    std::span<const uint32_t> PipelineView::outputs() const
+    {
+        return _module->sectionRange<uint32_t>(Section::TypeLists, _entry->outputs);
+    }
+
+    bool PipelineView::hasStages() const { return _entry->hasStages != 0; }
+
+    size_t PipelineView::stageCount() const { return _entry->stages.count; }
+
+    PipelineStageView PipelineView::stage(size_t index) const
+    {
+        assert(index < _entry->stages.count);
+        return {_module, &_module->section<StageEntry>(Section::Stages)[_entry->stages.offset + index]};
+    }
+
+    StructView::StructView(const ModuleView* module, const StructEntry* entry) : _module(module), _entry(entry) {}
+
+    std::string_view StructView::id() const { return _module->string(_entry->id); }
+
+    std::span<const uint32_t> StructView::members() const
+    {
+        return _module->sectionRange<uint32_t>(Section::TypeLists, _entry->members);
+    }
+
+    std::span<const uint32_t> StructView::memberNames() const
+    {
+        return _module->sectionRange<uint32_t>(Section::MemberNames, _entry->memberNames);
+    }
+
+    bool StructView::packed() const { return _entry->flags & ModuleFormat::structPacked; }
+
+    MappedFile::MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+
+    MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+    {
+        if(this == &other)
+            return *this;
+        close();
+        std::swap(_data, other._data);
+        std::swap(_size, other._size);
+#ifdef _WIN32
+        std::swap(_file, other._file);
+        std::swap(_mapping, other._mapping);
+#endif
+        return *this;
+    }
+
+    MappedFile::~MappedFile() { close(); }
+
+    std::span<const std::byte> MappedFile::data() const { return {_data, _size}; }
+
+#ifdef _WIN32
+    std::expected<MappedFile, std::string> MappedFile::open(const std::filesystem::path& path)
+    {
+        MappedFile mapped;
+        HANDLE file = CreateFileW(
+            path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(file == INVALID_HANDLE_VALUE)
+            return std::unexpected(std::format("Could not open \"{}\"", path.string()));
+        mapped._file = file;
+
+        LARGE_INTEGER size;
+        if(!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+            return std::unexpected(std::format("Could not map empty file \"{}\"", path.string()));
+
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(!mapping)
+            return std::unexpected(std::format("Could not map \"{}\"", path.string()));
+        mapped._mapping = mapping;
+
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if(!view)
+            return std::unexpected(std::format("Could not map \"{}\"", path.string()));
+        mapped._data = static_cast<const std::byte*>(view);
+        mapped._size = (size_t)size.QuadPart;
+        return mapped;
+    }
+
+    void MappedFile::close()
+    {
+        if(_data)
+            UnmapViewOfFile(_data);
+        if(_mapping)
+            CloseHandle(_mapping);
+        if(_file)
+            CloseHandle(_file);
+        _data = nullptr;
+        _mapping = nullptr;
+        _file = nullptr;
+        _size = 0;
+    }
+#else
+    std::expected<MappedFile, std::string> MappedFile::open(const std::filesystem::path& path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+            return std::unexpected(std::format("Could not open \"{}\"", path.string()));
+
+        struct stat info;
+        if(fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            ::close(fd);
+            return std::unexpected(std::format("Could not map empty file \"{}\"", path.string()));
+        }
+
+        void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        // The mapping keeps its own reference to the file
+        ::close(fd);
+        if(data == MAP_FAILED)
+            return std::unexpected(std::format("Could not map \"{}\"", path.string()));
+
+        MappedFile mapped;
+        mapped._data = static_cast<const std::byte*>(data);
+        mapped._size = (size_t)info.st_size;
+        return mapped;
+    }
+
+    void MappedFile::close()
+    {
+        if(_data)
+            munmap(const_cast<std::byte*>(_data), _size);
+        _data = nullptr;
+        _size = 0;
+    }
+#endif
+} // namespace BraneScript
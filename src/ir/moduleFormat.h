@@ -0,0 +1,336 @@
+#ifndef BRANESCRIPT_MODULEFORMAT_H
+#define BRANESCRIPT_MODULEFORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ir.h"
+
+namespace BraneScript
+{
+    /// Binary module files are a header followed by 16 byte aligned sections of fixed size records. Every offset is
+    /// relative to the start of the file, so a file can be memory mapped and read in place. Instruction records are
+    /// stored exactly as they are in memory.
+    namespace ModuleFormat
+    {
+        constexpr char magic[4] = {'B', 'S', 'M', 'D'};
+        constexpr uint16_t versionMajor = 6;
+        constexpr uint16_t versionMinor = 0;
+        constexpr uint32_t endianCheck = 0x01020304;
+        constexpr size_t sectionAlignment = 16;
+
+        enum class Section : uint32_t
+        {
+            StringEntries,
+            StringData,
+            Types,
+            TypeLists,
+            Structs,
+            Functions,
+            Pipelines,
+            Stages,
+            Instructions,
+            CallOperands,
+            CallTargets,
+            ValueLists,
+            AsyncOps,
+            /// String indices of the module's imports
+            Imports,
+            /// String indices of struct member names
+            MemberNames,
+            Count
+        };
+
+        struct SectionEntry
+        {
+            uint64_t offset = 0;
+            uint64_t size = 0;
+        };
+
+        struct Header
+        {
+            char magic[4];
+            uint16_t versionMajor;
+            uint16_t versionMinor;
+            uint32_t endianCheck;
+            uint32_t moduleName;
+            uint64_t fileSize;
+            SectionEntry sections[(size_t)Section::Count];
+        };
+
+        /// Offset and length into a section of uint32 values, or of records
+        struct Range
+        {
+            uint32_t offset = 0;
+            uint32_t count = 0;
+        };
+
+        struct StringEntry
+        {
+            uint32_t offset;
+            uint32_t length;
+        };
+
+        enum class TypeKind : uint8_t
+        {
+            Base,
+            NamedStruct,
+            IndexedStruct,
+            Ref
+        };
+
+        /// Base types store their BSBaseType, named structs a string index, indexed structs an IDRef id and refs the
+        /// index of the contained type
+        struct TypeEntry
+        {
+            TypeKind kind;
+            uint8_t valueMutable;
+            uint16_t padding = 0;
+            uint32_t value;
+        };
+
+        /// Bits of StructEntry::flags
+        constexpr uint32_t structPacked = 1;
+
+        struct StructEntry
+        {
+            uint32_t id;
+            uint32_t flags;
+            Range members;
+            /// Into MemberNames, empty if the members have no names
+            Range memberNames;
+        };
+
+        struct CodeEntry
+        {
+            Range instructions;
+            Range callOperands;
+            Range callTargets;
+        };
+
+        struct FunctionEntry
+        {
+            uint32_t id;
+            Range localVars;
+            Range inputs;
+            Range outputs;
+            CodeEntry code;
+        };
+
+        struct PipelineEntry
+        {
+            uint32_t id;
+            uint32_t hasStages;
+            Range inputs;
+            Range outputs;
+            Range stages;
+        };
+
+        struct StageEntry
+        {
+            Range localVars;
+            CodeEntry code;
+            /// Range of the AsyncOps section
+            Range asyncOps;
+            /// Range of the ValueLists section
+            Range outputs;
+        };
+
+        /// An async host call, see BSAsyncCall
+        struct AsyncOpEntry
+        {
+            uint32_t function;
+            /// Range of the ValueLists section
+            Range inputs;
+            Range outputs;
+        };
+
+        /// IDRefs stored in a call target table, strings use a string index
+        struct CallTargetEntry
+        {
+            uint32_t isString;
+            uint32_t value;
+        };
+    } // namespace ModuleFormat
+
+    class ModuleView;
+
+    /// Read only view of the code of a function or pipeline stage inside a mapped module
+    class CodeView
+    {
+        const ModuleView* _module = nullptr;
+        const ModuleFormat::CodeEntry* _entry = nullptr;
+
+      public:
+        CodeView() = default;
+        CodeView(const ModuleView* module, const ModuleFormat::CodeEntry* entry);
+
+        /// Call instructions index the call operand and call target tables of the function or stage they belong to
+        std::span<const Instruction> instructions() const;
+        std::span<const uint32_t> callOperands() const;
+        size_t callTargetCount() const;
+        IDRef callTarget(uint32_t index) const;
+    };
+
+    class FunctionView
+    {
+        const ModuleView* _module = nullptr;
+        const ModuleFormat::FunctionEntry* _entry = nullptr;
+
+      public:
+        FunctionView(const ModuleView* module, const ModuleFormat::FunctionEntry* entry);
+
+        std::string_view id() const;
+        /// Type lists are indices into the module's type table
+        std::span<const uint32_t> localVars() const;
+        std::span<const uint32_t> inputs() const;
+        std::span<const uint32_t> outputs() const;
+        CodeView code() const;
+    };
+
+    class PipelineStageView
+    {
+        const ModuleView* _module = nullptr;
+        const ModuleFormat::StageEntry* _entry = nullptr;
+
+      public:
+        PipelineStageView(const ModuleView* module, const ModuleFormat::StageEntry* entry);
+
+        std::span<const uint32_t> localVars() const;
+        CodeView code() const;
+        std::span<const ModuleFormat::AsyncOpEntry> asyncOps() const;
+        /// Local var indices passed on to the next stage
+        std::span<const uint32_t> outputs() const;
+    };
+
+    class PipelineView
+    {
+        const ModuleView* _module = nullptr;
+        const ModuleFormat::PipelineEntry* _entry = nullptr;
+
+      public:
+        PipelineView(const ModuleView* module, const ModuleFormat::PipelineEntry* entry);
+
+        std::string_view id() const;
+        std::span<const uint32_t> inputs() const;
+        std::span<const uint32_t> outputs() const;
+        bool hasStages() const;
+        size_t stageCount() const;
+        PipelineStageView stage(size_t index) const;
+    };
+
+    class StructView
+    {
+        const ModuleView* _module = nullptr;
+        const ModuleFormat::StructEntry* _entry = nullptr;
+
+      public:
+        StructView(const ModuleView* module, const ModuleFormat::StructEntry* entry);
+
+        std::string_view id() const;
+        std::span<const uint32_t> members() const;
+        /// String index of each member's name, empty if the members have no names
+        std::span<const uint32_t> memberNames() const;
+        bool packed() const;
+    };
+
+    struct ModuleOpenOptions
+    {
+        /// Check every table entry when the view is opened. This reads each table once, so its cost grows with the size
+        /// of the module, although instruction pages are never touched. Only skip it for data that was written by this
+        /// process or already validated, accessors do no bounds checks of their own.
+        bool validateTables = true;
+    };
+
+    /// Zero copy reader for a serialized module. All bounds are validated once, by default when the view is opened,
+    /// after that accessors read straight out of the underlying bytes, which must outlive the view. Views returned by
+    /// accessors point back at the ModuleView they came from, so it must not be moved while they are in use.
+    ///
+    /// Only reading a module is zero copy. Program::load, the linker and the optimizer all take BSModules, so running
+    /// a precompiled module still goes through toModule(), which copies it out and interns its types again, and the
+    /// program lowers it to bytecode like any freshly compiled module.
+    class ModuleView
+    {
+        std::span<const std::byte> _data;
+        const ModuleFormat::Header* _header = nullptr;
+
+        template<class T>
+        std::span<const T> section(ModuleFormat::Section section) const
+        {
+            auto& entry = _header->sections[(size_t)section];
+            return {reinterpret_cast<const T*>(_data.data() + entry.offset), entry.size / sizeof(T)};
+        }
+
+        template<class T>
+        std::span<const T> sectionRange(ModuleFormat::Section section, ModuleFormat::Range range) const
+        {
+            return this->section<T>(section).subspan(range.offset, range.count);
+        }
+
+        friend class CodeView;
+        friend class FunctionView;
+        friend class PipelineStageView;
+        friend class PipelineView;
+        friend class StructView;
+
+      public:
+        /// The header and section table are always checked, the tables themselves unless options say otherwise
+        static std::expected<ModuleView, std::string> open(std::span<const std::byte> data,
+                                                           const ModuleOpenOptions& options = {});
+        /// Check every table entry, for views opened without validateTables
+        std::expected<void, std::string> validate() const;
+
+        std::string_view name() const;
+        std::string_view string(uint32_t index) const;
+
+        std::span<const ModuleFormat::TypeEntry> types() const;
+        /// Rebuild a BSType from the type table
+        BSType type(uint32_t index) const;
+
+        size_t structCount() const;
+        StructView structAt(size_t index) const;
+        size_t functionCount() const;
+        FunctionView function(size_t index) const;
+        size_t pipelineCount() const;
+        PipelineView pipeline(size_t index) const;
+        size_t importCount() const;
+        std::string_view import(size_t index) const;
+
+        /// Copy the module out into its mutable in memory form, as loading, linking and optimizing need it
+        BSModule toModule() const;
+    };
+
+    std::vector<std::byte> serializeModule(const BSModule& module);
+    std::expected<void, std::string> writeModuleFile(const std::filesystem::path& path, const BSModule& module);
+
+    /// Read only memory mapping of a file
+    class MappedFile
+    {
+        const std::byte* _data = nullptr;
+        size_t _size = 0;
+#ifdef _WIN32
+        void* _file = nullptr;
+        void* _mapping = nullptr;
+#endif
+
+        void close();
+
+      public:
+        MappedFile() = default;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+        ~MappedFile();
+
+        static std::expected<MappedFile, std::string> open(const std::filesystem::path& path);
+
+        std::span<const std::byte> data() const;
+    };
+} // namespace BraneScript
+
+#endif
@@ -0,0 +1,215 @@
+#include "profileData.h"
+
+#include <charconv>
+#include <format>
+#include <fstream>
+#include <span>
+#include <sstream>
+
+namespace BraneScript
+{
+    namespace
+    {
+        constexpr std::string_view profileHeader = "BraneScriptProfile 1";
+
+        /// Splits a line into its whitespace separated fields
+        std::vector<std::string_view> fields(std::string_view line)
+        {
+            std::vector<std::string_view> result;
+            size_t pos = 0;
+            while(true)
+            {
+                pos = line.find_first_not_of(" \t\r", pos);
+                if(pos == std::string_view::npos)
+                    return result;
+                size_t end = line.find_first_of(" \t\r", pos);
+                if(end == std::string_view::npos)
+                    end = line.size();
+                result.push_back(line.substr(pos, end - pos));
+                pos = end;
+            }
+        }
+
+        template<class T>
+        bool parseNumber(std::string_view text, T& value)
+        {
+            auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+            return result.ec == std::errc() && result.ptr == text.data() + text.size();
+        }
+
+        bool parseCounters(std::span<const std::string_view> text, ProfileCounters& counters)
+        {
+            return text.size() == 3 && parseNumber(text[0], counters.invocations) &&
+                   parseNumber(text[1], counters.cycles) && parseNumber(text[2], counters.traps);
+        }
+
+        std::string formatCounters(const ProfileCounters& counters)
+        {
+            return std::format("{} {} {}", counters.invocations, counters.cycles, counters.traps);
+        }
+
+        bool inPipeline(std::string_view stage, std::string_view pipeline)
+        {
+            return stage.size() > pipeline.size() && stage.starts_with(pipeline) && stage[pipeline.size()] == '[';
+        }
+    } // namespace
+
+    void ProfileCounters::merge(const ProfileCounters& other)
+    {
+        invocations += other.invocations;
+        cycles += other.cycles;
+        traps += other.traps;
+    }
+
+    uint64_t ProfileData::callCount(std::string_view caller, std::string_view callee) const
+    {
+        uint64_t count = 0;
+        for(auto& site : callSites)
+        {
+            if(site.caller == caller && site.callee == callee)
+                count += site.counters.invocations;
+        }
+        return count;
+    }
+
+    uint64_t ProfileData::pipelineCallCount(std::string_view pipeline, std::string_view callee) const
+    {
+        uint64_t count = 0;
+        for(auto& site : callSites)
+        {
+            if(site.callee == callee && inPipeline(site.caller, pipeline))
+                count += site.counters.invocations;
+        }
+        return count;
+    }
+
+    uint64_t ProfileData::pipelineInvocations(std::string_view pipeline) const
+    {
+        auto first = stages.find(std::string(pipeline) + "[0]");
+        return first == stages.end() ? 0 : first->second.invocations;
+    }
+
+    uint64_t ProfileData::totalCalls() const
+    {
+        uint64_t count = 0;
+        for(auto& site : callSites)
+            count += site.counters.invocations;
+        return count;
+    }
+
+    void ProfileData::merge(const ProfileData& other)
+    {
+        for(auto& [id, counters] : other.functions)
+            functions[id].merge(counters);
+        for(auto& [id, counters] : other.stages)
+            stages[id].merge(counters);
+        for(auto& site : other.callSites)
+        {
+            bool merged = false;
+            for(auto& existing : callSites)
+            {
+                if(existing.caller == site.caller && existing.site == site.site && existing.callee == site.callee)
+                {
+                    existing.counters.merge(site.counters);
+                    merged = true;
+                    break;
+                }
+            }
+            if(!merged)
+                callSites.push_back(site);
+        }
+    }
+
+    std::string ProfileData::serialize() const
+    {
+        std::string text{profileHeader};
+        text += '\n';
+        for(auto& [id, counters] : functions)
+            text += std::format("function {} {}\n", id, formatCounters(counters));
+        for(auto& [id, counters] : stages)
+            text += std::format("stage {} {}\n", id, formatCounters(counters));
+        for(auto& site : callSites)
+            text += std::format(
+                "call {} {} {} {}\n", site.caller, site.site, site.callee, formatCounters(site.counters));
+        return text;
+    }
+
+    std::expected<ProfileData, std::string> ProfileData::parse(std::string_view text)
+    {
+        ProfileData profile;
+        size_t lineNumber = 0;
+        bool headerSeen = false;
+        while(!text.empty())
+        {
+            size_t end = text.find('\n');
+            std::string_view line = text.substr(0, end);
+            text = end == std::string_view::npos ? std::string_view{} : text.substr(end + 1);
+            lineNumber++;
+
+            auto parts = fields(line);
+            if(parts.empty() || parts.front().starts_with('#'))
+                continue;
+            if(!headerSeen)
+            {
+                if(parts.size() != 2 || parts[0] != "BraneScriptProfile")
+                    return std::unexpected("Not a BraneScript profile");
+                if(parts[1] != "1")
+                    return std::unexpected(std::format("Unsupported profile version {}", parts[1]));
+                headerSeen = true;
+                continue;
+            }
+
+            auto error = [&] {
+                return std::unexpected(std::format("Malformed profile record on line {}", lineNumber));
+            };
+            auto rest = std::span<const std::string_view>(parts).subspan(1);
+            if(parts[0] == "function" || parts[0] == "stage")
+            {
+                ProfileCounters counters;
+                if(rest.empty() || !parseCounters(rest.subspan(1), counters))
+                    return error();
+                auto& map = parts[0] == "function" ? profile.functions : profile.stages;
+                map[std::string(rest[0])].merge(counters);
+            }
+            else if(parts[0] == "call")
+            {
+                CallSiteProfile site;
+                if(rest.size() < 3 || !parseNumber(rest[1], site.site) ||
+                   !parseCounters(rest.subspan(3), site.counters))
+                    return error();
+                site.caller = rest[0];
+                site.callee = rest[2];
+                profile.callSites.push_back(std::move(site));
+            }
+            else
+                return error();
+        }
+        if(!headerSeen)
+            return std::unexpected("Not a BraneScript profile");
+        return profile;
+    }
+
+    std::expected<void, std::string> writeProfileFile(const std::filesystem::path& path, const ProfileData& profile)
+    {
+        std::ofstream f(path, std::ios::binary | std::ios::trunc);
+        if(!f.is_open())
+            return std::unexpected(std::format("Could not open \"{}\" for writing", path.string()));
+        f << profile.serialize();
+        if(!f)
+            return std::unexpected(std::format("Failed to write \"{}\"", path.string()));
+        return {};
+    }
+
+    std::expected<ProfileData, std::string> readProfileFile(const std::filesystem::path& path)
+    {
+        std::ifstream f(path, std::ios::binary);
+        if(!f.is_open())
+            return std::unexpected(std::format("Could not open \"{}\"", path.string()));
+        std::stringstream text;
+        text << f.rdbuf();
+        auto profile = ProfileData::parse(text.str());
+        if(!profile)
+            return std::unexpected(std::format("{}: {}", path.string(), profile.error()));
+        return profile;
+    }
+} // namespace BraneScript
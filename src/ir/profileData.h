@@ -0,0 +1,65 @@
+#ifndef BRANESCRIPT_PROFILEDATA_H
+#define BRANESCRIPT_PROFILEDATA_H
+
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace BraneScript
+{
+    struct ProfileCounters
+    {
+        uint64_t invocations = 0;
+        /// Time spent inside, including callees, in ticks of the profiling clock
+        uint64_t cycles = 0;
+        /// Invocations that ended in a trap rather than returning
+        uint64_t traps = 0;
+
+        void merge(const ProfileCounters& other);
+    };
+
+    struct CallSiteProfile
+    {
+        /// Function or stage making the call, stages are named pipeline[index]
+        std::string caller;
+        /// Index of the call among the calls of the caller's body
+        uint32_t site = 0;
+        std::string callee;
+        ProfileCounters counters;
+    };
+
+    /// Execution counts gathered by running scripts, keyed by name so they can be saved and matched back to the IR
+    /// of a later compile of the same sources
+    struct ProfileData
+    {
+        std::unordered_map<std::string, ProfileCounters> functions;
+        /// Stages by pipeline[index]
+        std::unordered_map<std::string, ProfileCounters> stages;
+        std::vector<CallSiteProfile> callSites;
+
+        /// Calls from a function to a callee, summed over every site in the function
+        uint64_t callCount(std::string_view caller, std::string_view callee) const;
+        /// Calls from any stage of a pipeline to a callee
+        uint64_t pipelineCallCount(std::string_view pipeline, std::string_view callee) const;
+        /// Invocations of a pipeline's first stage
+        uint64_t pipelineInvocations(std::string_view pipeline) const;
+        /// Calls made from anywhere
+        uint64_t totalCalls() const;
+
+        /// Adds the counts of another profile, such as one gathered by another thread or process
+        void merge(const ProfileData& other);
+
+        /// Line based text format, one record per line
+        std::string serialize() const;
+        static std::expected<ProfileData, std::string> parse(std::string_view text);
+    };
+
+    std::expected<void, std::string> writeProfileFile(const std::filesystem::path& path, const ProfileData& profile);
+    std::expected<ProfileData, std::string> readProfileFile(const std::filesystem::path& path);
+} // namespace BraneScript
+
+#endif
@@ -0,0 +1,177 @@
+#include "structLayout.h"
+
+#include <format>
+
+namespace BraneScript
+{
+    namespace
+    {
+        std::expected<uint32_t, std::string> resolveStruct(const IDRef& id,
+                                                           size_t module,
+                                                           std::span<const std::string> imports,
+                                                           const std::unordered_map<std::string, uint32_t>& indices,
+                                                           std::span<const uint32_t> moduleOffsets)
+        {
+            auto byName = [&](const std::string& name) -> std::expected<uint32_t, std::string> {
+                auto index = indices.find(name);
+                if(index == indices.end())
+                    return std::unexpected(std::format("Struct {} is not declared in any module", name));
+                return index->second;
+            };
+            if(auto* name = std::get_if<std::string>(&id))
+                return byName(*name);
+            int32_t local = std::get<int32_t>(id);
+            if(local < 0 && (size_t)-(int64_t)local <= imports.size())
+                return byName(imports[(size_t)-(int64_t)local - 1]);
+            uint32_t first = moduleOffsets[module];
+            if(local <= 0 || (uint32_t)local > moduleOffsets[module + 1] - first)
+                return std::unexpected(std::format("Struct id {} can't be resolved", local));
+            return first + (uint32_t)local - 1;
+        }
+
+        class LayoutBuilder
+        {
+            std::span<const BSModule> _modules;
+            std::vector<const BSStruct*> _structs;
+            std::vector<size_t> _structModules;
+            /// Structs being laid out further up the stack, a struct reached again contains itself
+            std::vector<bool> _inProgress;
+            std::vector<bool> _done;
+
+          public:
+            std::vector<StructLayout> layouts;
+            std::unordered_map<std::string, uint32_t> indices;
+            std::vector<uint32_t> moduleOffsets;
+
+            explicit LayoutBuilder(std::span<const BSModule> modules) : _modules(modules) {}
+
+            std::expected<void, std::string> collect()
+            {
+                for(size_t m = 0; m < _modules.size(); ++m)
+                {
+                    moduleOffsets.push_back((uint32_t)_structs.size());
+                    for(auto& structDef : _modules[m].structs)
+                    {
+                        if(!indices.try_emplace(structDef->id, (uint32_t)_structs.size()).second)
+                            return std::unexpected(std::format("Struct {} is declared more than once", structDef->id));
+                        _structs.push_back(structDef.get());
+                        _structModules.push_back(m);
+                    }
+                }
+                moduleOffsets.push_back((uint32_t)_structs.size());
+                layouts.resize(_structs.size());
+                _inProgress.resize(_structs.size());
+                _done.resize(_structs.size());
+                return {};
+            }
+
+            std::expected<TypeLayout, std::string> typeLayout(const BSType& type, size_t module)
+            {
+                if(auto* base = std::get_if<BSBaseType>(&type))
+                    return baseTypeLayout(*base);
+                if(std::holds_alternative<IRNode<BSRefType>>(type))
+                    return refLayout;
+                auto index = resolveStruct(std::get<IRNode<BSStructType>>(type)->structId,
+                                           module,
+                                           _modules[module].imports,
+                                           indices,
+                                           moduleOffsets);
+                if(!index)
+                    return std::unexpected(index.error());
+                auto laidOut = layout(*index);
+                if(!laidOut)
+                    return std::unexpected(laidOut.error());
+                return layouts[*index].type;
+            }
+
+            std::expected<void, std::string> layout(uint32_t index)
+            {
+                if(_done[index])
+                    return {};
+                auto& structDef = *_structs[index];
+                if(_inProgress[index])
+                    return std::unexpected(std::format("Struct {} contains itself by value", structDef.id));
+                _inProgress[index] = true;
+
+                std::vector<TypeLayout> members;
+                auto& module = _modules[_structModules[index]];
+                for(auto member : structDef.members)
+                {
+                    auto memberLayout = typeLayout(module.types.type(member), _structModules[index]);
+                    if(!memberLayout)
+                        return std::unexpected(std::format("{}: {}", structDef.id, memberLayout.error()));
+                    members.push_back(*memberLayout);
+                }
+                auto& result = layouts[index];
+                result.offsets.resize(members.size());
+                result.order.resize(members.size());
+                result.type = layoutMembers(members, structDef.packed, result.offsets, result.order);
+
+                _inProgress[index] = false;
+                _done[index] = true;
+                return {};
+            }
+        };
+    } // namespace
+
+    std::expected<StructLayouts, std::string> StructLayouts::compute(std::span<const BSModule> modules)
+    {
+        LayoutBuilder builder(modules);
+        auto collected = builder.collect();
+        if(!collected)
+            return std::unexpected(collected.error());
+        for(uint32_t i = 0; i < builder.layouts.size(); ++i)
+        {
+            auto laidOut = builder.layout(i);
+            if(!laidOut)
+                return std::unexpected(laidOut.error());
+        }
+
+        StructLayouts layouts;
+        layouts._layouts = std::move(builder.layouts);
+        layouts._indices = std::move(builder.indices);
+        layouts._moduleOffsets = std::move(builder.moduleOffsets);
+        for(auto& module : modules)
+            layouts._moduleImports.push_back(module.imports);
+        return layouts;
+    }
+
+    const StructLayout* StructLayouts::find(std::string_view id) const
+    {
+        auto index = _indices.find(std::string(id));
+        if(index == _indices.end())
+            return nullptr;
+        return &_layouts[index->second];
+    }
+
+    std::expected<TypeLayout, std::string> StructLayouts::typeLayout(const BSType& type, size_t module) const
+    {
+        if(auto* base = std::get_if<BSBaseType>(&type))
+            return baseTypeLayout(*base);
+        if(std::holds_alternative<IRNode<BSRefType>>(type))
+            return refLayout;
+        if(module + 1 >= _moduleOffsets.size())
+            return std::unexpected("Module index out of range");
+        auto index = resolveStruct(
+            std::get<IRNode<BSStructType>>(type)->structId, module, _moduleImports[module], _indices, _moduleOffsets);
+        if(!index)
+            return std::unexpected(index.error());
+        return _layouts[*index].type;
+    }
+
+    std::expected<void, std::string> StructLayouts::checkHostType(std::string_view id, TypeLayout host) const
+    {
+        auto* layout = find(id);
+        if(!layout)
+            return std::unexpected(std::format("Struct {} is not declared in any module", id));
+        if(layout->type.size != host.size)
+            return std::unexpected(
+                std::format("Struct {} is {} bytes but the host type is {}", id, layout->type.size, host.size));
+        if(host.alignment < layout->type.alignment)
+            return std::unexpected(std::format("Struct {} needs {} byte alignment but the host type only has {}",
+                                               id,
+                                               layout->type.alignment,
+                                               host.alignment));
+        return {};
+    }
+} // namespace BraneScript
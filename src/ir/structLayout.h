@@ -0,0 +1,155 @@
+#ifndef BRANESCRIPT_STRUCTLAYOUT_H
+#define BRANESCRIPT_STRUCTLAYOUT_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "ir.h"
+
+namespace BraneScript
+{
+    /// Size and alignment of a value in memory
+    struct TypeLayout
+    {
+        uint64_t size = 0;
+        uint64_t alignment = 1;
+
+        constexpr bool operator==(const TypeLayout&) const = default;
+    };
+
+    /// Base types are laid out like the matching C++ types, 128 bit integers like __int128
+    constexpr TypeLayout baseTypeLayout(BSBaseType type)
+    {
+        switch(type)
+        {
+            case BSBaseType::U8:
+            case BSBaseType::I8:
+                return {1, 1};
+            case BSBaseType::U16:
+            case BSBaseType::I16:
+                return {2, 2};
+            case BSBaseType::U32:
+            case BSBaseType::I32:
+            case BSBaseType::F32:
+                return {4, 4};
+            case BSBaseType::U64:
+            case BSBaseType::I64:
+            case BSBaseType::F64:
+                return {8, 8};
+            case BSBaseType::U128:
+            case BSBaseType::I128:
+                return {16, 16};
+        }
+        return {};
+    }
+
+    /// References are host pointers
+    constexpr TypeLayout refLayout = {sizeof(void*), alignof(void*)};
+
+    /// Computes the offset of each member, writing them in declaration order, and the order members are laid out in.
+    /// Packed structs keep declaration order and have no padding or alignment. Others sort members by decreasing
+    /// alignment, keeping declaration order between equal ones. Sizes are multiples of alignments, so that leaves no
+    /// padding between members, only at the end to round the size up to the struct's alignment, and keeps the
+    /// members that are accessed together in declaration order next to each other.
+    constexpr TypeLayout layoutMembers(std::span<const TypeLayout> members,
+                                       bool packed,
+                                       std::span<uint64_t> offsets,
+                                       std::span<uint32_t> order)
+    {
+        for(uint32_t i = 0; i < members.size(); ++i)
+            order[i] = i;
+        if(!packed)
+        {
+            // Insertion sort, as it is stable and constexpr
+            for(size_t i = 1; i < members.size(); ++i)
+            {
+                uint32_t member = order[i];
+                size_t j = i;
+                for(; j > 0 && members[order[j - 1]].alignment < members[member].alignment; --j)
+                    order[j] = order[j - 1];
+                order[j] = member;
+            }
+        }
+
+        TypeLayout layout;
+        for(size_t i = 0; i < members.size(); ++i)
+        {
+            auto& member = members[order[i]];
+            uint64_t alignment = packed ? 1 : member.alignment;
+            layout.size = (layout.size + alignment - 1) / alignment * alignment;
+            offsets[order[i]] = layout.size;
+            layout.size += member.size;
+            layout.alignment = std::max(layout.alignment, alignment);
+        }
+        layout.size = (layout.size + layout.alignment - 1) / layout.alignment * layout.alignment;
+        return layout;
+    }
+
+    /// Layout of a struct with a fixed set of members, for checking host structs against at compile time:
+    ///
+    ///     constexpr auto layout = structLayout<2>({baseTypeLayout(BSBaseType::U8), baseTypeLayout(BSBaseType::F64)});
+    ///     static_assert(layout.type == TypeLayout{sizeof(Particle), alignof(Particle)});
+    ///     static_assert(layout.offsets[1] == offsetof(Particle, position));
+    template<size_t N>
+    struct FixedStructLayout
+    {
+        TypeLayout type;
+        std::array<uint64_t, N> offsets{};
+        std::array<uint32_t, N> order{};
+    };
+
+    template<size_t N>
+    constexpr FixedStructLayout<N> structLayout(const std::array<TypeLayout, N>& members, bool packed = false)
+    {
+        FixedStructLayout<N> layout;
+        layout.type = layoutMembers(members, packed, layout.offsets, layout.order);
+        return layout;
+    }
+
+    struct StructLayout
+    {
+        TypeLayout type;
+        /// Byte offset of each member, in declaration order
+        std::vector<uint64_t> offsets;
+        /// Member indices in the order they're laid out in memory
+        std::vector<uint32_t> order;
+    };
+
+    /// Layouts of every struct of a set of modules, including structs nested by value in others. Structs referenced
+    /// by name may be declared in any of the modules, those referenced by positive id are the struct at index id - 1
+    /// of the referencing module.
+    class StructLayouts
+    {
+        std::vector<StructLayout> _layouts;
+        std::unordered_map<std::string, uint32_t> _indices;
+        /// Index of the first layout of each module, layouts are stored in module order
+        std::vector<uint32_t> _moduleOffsets;
+        std::vector<std::vector<std::string>> _moduleImports;
+
+      public:
+        static std::expected<StructLayouts, std::string> compute(std::span<const BSModule> modules);
+
+        const StructLayout* find(std::string_view id) const;
+
+        /// Layout of a type used in the given module of the set the layouts were computed from
+        std::expected<TypeLayout, std::string> typeLayout(const BSType& type, size_t module) const;
+
+        /// Whether a host type can be shared with scripts as the named struct without copying
+        template<class T>
+        std::expected<void, std::string> checkHostType(std::string_view id) const
+        {
+            return checkHostType(id, {sizeof(T), alignof(T)});
+        }
+
+        std::expected<void, std::string> checkHostType(std::string_view id, TypeLayout host) const;
+    };
+} // namespace BraneScript
+
+#endif
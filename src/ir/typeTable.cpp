@@ -0,0 +1,106 @@
+#include "typeTable.h"
+
+#include <cassert>
+
+namespace BraneScript
+{
+    namespace
+    {
+        enum class KeyKind : uint64_t
+        {
+            Ref = 1,
+            IndexedStruct = 2
+        };
+
+        uint64_t structuralKey(KeyKind kind, uint32_t value, bool flag = false)
+        {
+            return (uint64_t)kind << 56 | (uint64_t)flag << 48 | value;
+        }
+    } // namespace
+
+    TypeTable::TypeTable()
+    {
+        for(auto type = (uint32_t)BSBaseType::U8; type <= (uint32_t)BSBaseType::I128; ++type)
+            add((BSBaseType)type, (TypeId)type);
+    }
+
+    TypeId TypeTable::add(BSType type, TypeId contained)
+    {
+        _types.push_back(std::move(type));
+        _contained.push_back(contained);
+        return (TypeId)(_types.size() - 1);
+    }
+
+    TypeId TypeTable::structType(const IDRef& id)
+    {
+        if(auto* name = std::get_if<std::string>(&id))
+        {
+            auto existing = _named.find(*name);
+            if(existing != _named.end())
+                return existing->second;
+            auto typeId = (TypeId)_types.size();
+            add(std::make_shared<BSStructType>(BSStructType{*name}), typeId);
+            _named.emplace(*name, typeId);
+            return typeId;
+        }
+
+        int32_t index = std::get<int32_t>(id);
+        auto key = structuralKey(KeyKind::IndexedStruct, (uint32_t)index);
+        auto existing = _structural.find(key);
+        if(existing != _structural.end())
+            return existing->second;
+        auto typeId = (TypeId)_types.size();
+        add(std::make_shared<BSStructType>(BSStructType{index}), typeId);
+        _structural.emplace(key, typeId);
+        return typeId;
+    }
+
+    TypeId TypeTable::ref(TypeId contained, bool valueMutable)
+    {
+        assert((size_t)contained < _types.size());
+        auto key = structuralKey(KeyKind::Ref, (uint32_t)contained, valueMutable);
+        auto existing = _structural.find(key);
+        if(existing != _structural.end())
+            return existing->second;
+        auto typeId = add(std::make_shared<BSRefType>(BSRefType{type(contained), valueMutable}), contained);
+        _structural.emplace(key, typeId);
+        return typeId;
+    }
+
+    TypeId TypeTable::intern(const BSType& type)
+    {
+        if(auto* baseType = std::get_if<BSBaseType>(&type))
+            return base(*baseType);
+        if(auto* structNode = std::get_if<IRNode<BSStructType>>(&type))
+            return structType((*structNode)->structId);
+        auto& refType = std::get<IRNode<BSRefType>>(type);
+        return ref(intern(refType->contained), refType->valueMutable);
+    }
+
+    TypeId TypeTable::intern(const TypeTable& other, TypeId id)
+    {
+        if(&other == this || baseType(id))
+            return id;
+        return intern(other.type(id));
+    }
+
+    const BSType& TypeTable::type(TypeId id) const
+    {
+        assert((size_t)id < _types.size());
+        return _types[(size_t)id];
+    }
+
+    bool TypeTable::isStruct(TypeId id) const { return std::holds_alternative<IRNode<BSStructType>>(type(id)); }
+
+    bool TypeTable::isRef(TypeId id) const { return std::holds_alternative<IRNode<BSRefType>>(type(id)); }
+
+    bool TypeTable::isMutableRef(TypeId id) const
+    {
+        auto* refType = std::get_if<IRNode<BSRefType>>(&type(id));
+        return refType && (*refType)->valueMutable;
+    }
+
+    TypeId TypeTable::dereferenced(TypeId id) const { return _contained[(size_t)id]; }
+
+    size_t TypeTable::size() const { return _types.size(); }
+} // namespace BraneScript
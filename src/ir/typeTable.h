@@ -0,0 +1,107 @@
+#ifndef BRANESCRIPT_TYPETABLE_H
+#define BRANESCRIPT_TYPETABLE_H
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace BraneScript
+{
+    template<typename T>
+    using IRNode = std::shared_ptr<T>;
+
+    /// References can be stored as either full paths, or as context dependent ids, with positive ids representing local
+    /// symbols, and negative representing external symbols, and 0 being a null value. Id -n names the nth entry of the
+    /// module's imports, see BSModule.
+    using IDRef = std::variant<std::string, int32_t>;
+
+    enum class BSBaseType
+    {
+        U8,
+        I8,
+        U16,
+        I16,
+        U32,
+        I32,
+        F32,
+        U64,
+        I64,
+        F64,
+        U128,
+        I128
+    };
+
+    struct BSStructType
+    {
+        IDRef structId;
+    };
+
+    struct BSRefType;
+    using BSType = std::variant<BSBaseType, IRNode<BSStructType>, IRNode<BSRefType>>;
+
+    struct BSRefType
+    {
+        BSType contained;
+        bool valueMutable;
+    };
+
+    /// Handle to a type interned in a TypeTable, only meaningful for the table that handed it out. Base types are the
+    /// exception, their ids are the same in every table.
+    enum class TypeId : uint32_t
+    {
+    };
+
+    /// Hash consed store of the types used by a module. Every distinct type is created once and referred to by a
+    /// TypeId, so two types are equal exactly when their ids are. Structs referred to by index are relative to the
+    /// module that uses the id, the same as in a BSStructType.
+    ///
+    /// Tables are not thread safe. Code lowered on several threads interns into a table per thread, and merges them
+    /// into the module's table afterwards with intern(other, id).
+    class TypeTable
+    {
+        std::vector<BSType> _types;
+        /// Type each ref refers to, other types hold their own id
+        std::vector<TypeId> _contained;
+        /// Refs and indexed structs by a key packed from their parts, named structs by name
+        std::unordered_map<uint64_t, TypeId> _structural;
+        std::unordered_map<std::string, TypeId> _named;
+
+        TypeId add(BSType type, TypeId contained);
+
+      public:
+        TypeTable();
+
+        static constexpr TypeId base(BSBaseType type) { return (TypeId)type; }
+
+        /// Base types can be told apart by their id alone
+        static constexpr std::optional<BSBaseType> baseType(TypeId id)
+        {
+            if((uint32_t)id <= (uint32_t)BSBaseType::I128)
+                return (BSBaseType)id;
+            return std::nullopt;
+        }
+
+        TypeId structType(const IDRef& id);
+        TypeId ref(TypeId contained, bool valueMutable);
+        /// Interns a type and every type it contains
+        TypeId intern(const BSType& type);
+        /// Interns a type of another table into this one
+        TypeId intern(const TypeTable& other, TypeId id);
+
+        /// The table's instance of a type
+        const BSType& type(TypeId id) const;
+        bool isStruct(TypeId id) const;
+        bool isRef(TypeId id) const;
+        bool isMutableRef(TypeId id) const;
+        /// The type a ref refers to, or the type itself if it isn't a ref
+        TypeId dereferenced(TypeId id) const;
+
+        size_t size() const;
+    };
+} // namespace BraneScript
+
+#endif
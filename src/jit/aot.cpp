@@ -0,0 +1,291 @@
+#include "aot.h"
+
+#include <format>
+#include <fstream>
+#include <mutex>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Object/ArchiveWriter.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+#if LLVM_VERSION_MAJOR >= 17
+#include <llvm/TargetParser/Host.h>
+#else
+#include <llvm/Support/Host.h>
+#endif
+
+namespace BraneScript
+{
+    namespace
+    {
+        std::expected<std::string, std::string> emitObject(llvm::Module& module, llvm::TargetMachine& target)
+        {
+            llvm::SmallVector<char, 0> buffer;
+            llvm::raw_svector_ostream stream(buffer);
+            llvm::legacy::PassManager codegen;
+#if LLVM_VERSION_MAJOR >= 18
+            auto fileType = llvm::CodeGenFileType::ObjectFile;
+#else
+            auto fileType = llvm::CGFT_ObjectFile;
+#endif
+            if(target.addPassesToEmitFile(codegen, stream, nullptr, fileType))
+                return std::unexpected(
+                    std::format("Target {} can't emit object files", target.getTargetTriple().str()));
+            codegen.run(module);
+            return std::string(buffer.data(), buffer.size());
+        }
+
+        /// Generates and optimizes a module for a target
+        std::expected<std::unique_ptr<llvm::Module>, std::string> generateFor(std::span<const BSModule> modules,
+                                                                              size_t source,
+                                                                              llvm::LLVMContext& context,
+                                                                              llvm::TargetMachine& target,
+                                                                              NativeOptLevel optLevel)
+        {
+            auto module = generateLLVMModule(modules, source, context);
+            if(!module)
+                return std::unexpected(module.error());
+            (*module)->setDataLayout(target.createDataLayout());
+            (*module)->setTargetTriple(target.getTargetTriple().str());
+            optimizeLLVMModule(**module, optLevel, &target);
+            return module;
+        }
+
+        std::expected<void, std::string> writeFile(const std::filesystem::path& path, std::string_view contents)
+        {
+            std::ofstream file(path, std::ios::binary);
+            if(!file.is_open())
+                return std::unexpected(std::format("Could not open {} for writing", path.string()));
+            file.write(contents.data(), (std::streamsize)contents.size());
+            if(!file)
+                return std::unexpected(std::format("Failed to write {}", path.string()));
+            return {};
+        }
+
+        std::string cType(const BSType& type)
+        {
+            if(std::holds_alternative<IRNode<BSRefType>>(type))
+                return "void*";
+            auto* base = std::get_if<BSBaseType>(&type);
+            if(!base)
+                return "void* /* unsupported */";
+            switch(*base)
+            {
+                case BSBaseType::U8:
+                    return "uint8_t";
+                case BSBaseType::I8:
+                    return "int8_t";
+                case BSBaseType::U16:
+                    return "uint16_t";
+                case BSBaseType::I16:
+                    return "int16_t";
+                case BSBaseType::U32:
+                    return "uint32_t";
+                case BSBaseType::I32:
+                    return "int32_t";
+                case BSBaseType::F32:
+                    return "float";
+                case BSBaseType::U64:
+                    return "uint64_t";
+                case BSBaseType::I64:
+                    return "int64_t";
+                case BSBaseType::F64:
+                    return "double";
+                case BSBaseType::U128:
+                    return "unsigned __int128";
+                case BSBaseType::I128:
+                    return "__int128";
+            }
+            return "void* /* unsupported */";
+        }
+
+        void declareEntryPoints(std::string& header,
+                                const TypeTable& types,
+                                std::string_view id,
+                                std::span<const TypeId> inputs,
+                                std::span<const TypeId> outputs)
+        {
+            header += std::format("/* {} */\n", id);
+            header += std::format("uint32_t {}(BSNativeContext* ctx", nativeSymbolName(id));
+            for(size_t i = 0; i < inputs.size(); ++i)
+                header += std::format(", {} in{}", cType(types.type(inputs[i])), i);
+            for(size_t i = 0; i < outputs.size(); ++i)
+                header += std::format(", {}* out{}", cType(types.type(outputs[i])), i);
+            header += ");\n";
+            header += std::format("uint32_t {}(BSNativeContext* ctx, const uint64_t* inputs, uint64_t* outputs);\n\n",
+                                  nativeRegisterSymbolName(id));
+        }
+    } // namespace
+
+    std::expected<std::unique_ptr<llvm::TargetMachine>, std::string> createNativeTargetMachine(
+        const NativeTargetOptions& options)
+    {
+        static std::once_flag targetsInitialized;
+        std::call_once(targetsInitialized, []() {
+            llvm::InitializeAllTargetInfos();
+            llvm::InitializeAllTargets();
+            llvm::InitializeAllTargetMCs();
+            llvm::InitializeAllAsmPrinters();
+        });
+
+        std::string triple = options.triple.empty() ? llvm::sys::getDefaultTargetTriple() : options.triple;
+        std::string error;
+        auto* target = llvm::TargetRegistry::lookupTarget(triple, error);
+        if(!target)
+            return std::unexpected(error);
+        // Objects are position independent so they can be linked into shared libraries as well as executables
+        std::unique_ptr<llvm::TargetMachine> machine(target->createTargetMachine(triple,
+                                                                                 options.cpu,
+                                                                                 options.features,
+                                                                                 llvm::TargetOptions(),
+                                                                                 llvm::Reloc::PIC_,
+                                                                                 {},
+                                                                                 codeGenOptLevel(options.optLevel)));
+        if(!machine)
+            return std::unexpected(std::format("Could not create a target machine for {}", triple));
+        return machine;
+    }
+
+    std::expected<std::string, std::string> compileNativeObject(std::span<const BSModule> modules,
+                                                                const NativeTargetOptions& options)
+    {
+        auto target = createNativeTargetMachine(options);
+        if(!target)
+            return std::unexpected(target.error());
+
+        llvm::LLVMContext context;
+        auto linked = std::make_unique<llvm::Module>("branescript", context);
+        llvm::Linker linker(*linked);
+        for(size_t m = 0; m < modules.size(); ++m)
+        {
+            auto module = generateLLVMModule(modules, m, context);
+            if(!module)
+                return std::unexpected(module.error());
+            if(linker.linkInModule(std::move(*module)))
+                return std::unexpected(std::format("Failed to link module {}", modules[m].name));
+        }
+        // Optimizing after linking lets calls between modules be inlined
+        linked->setDataLayout((*target)->createDataLayout());
+        linked->setTargetTriple((*target)->getTargetTriple().str());
+        optimizeLLVMModule(*linked, options.optLevel, target->get());
+        return emitObject(*linked, **target);
+    }
+
+    std::expected<void, std::string> writeNativeObject(std::span<const BSModule> modules,
+                                                       const std::filesystem::path& path,
+                                                       const NativeTargetOptions& options)
+    {
+        auto object = compileNativeObject(modules, options);
+        if(!object)
+            return std::unexpected(object.error());
+        return writeFile(path, *object);
+    }
+
+    std::expected<void, std::string> writeNativeLibrary(std::span<const BSModule> modules,
+                                                        const std::filesystem::path& path,
+                                                        const NativeTargetOptions& options)
+    {
+        auto target = createNativeTargetMachine(options);
+        if(!target)
+            return std::unexpected(target.error());
+
+        std::vector<llvm::NewArchiveMember> members;
+        for(size_t m = 0; m < modules.size(); ++m)
+        {
+            auto& source = modules[m];
+            llvm::LLVMContext context;
+            auto module = generateFor(modules, m, context, **target, options.optLevel);
+            if(!module)
+                return std::unexpected(module.error());
+            auto object = emitObject(**module, **target);
+            if(!object)
+                return std::unexpected(object.error());
+
+            auto memberName = nativeSymbolName(source.name).substr(3) + ".o";
+            auto& member = members.emplace_back();
+            member.Buf = llvm::MemoryBuffer::getMemBufferCopy(*object, memberName);
+            member.MemberName = member.Buf->getBufferIdentifier();
+        }
+
+        auto& triple = (*target)->getTargetTriple();
+        auto kind = triple.isOSDarwin()    ? llvm::object::Archive::K_DARWIN
+                    : triple.isOSWindows() ? llvm::object::Archive::K_COFF
+                                           : llvm::object::Archive::K_GNU;
+#if LLVM_VERSION_MAJOR >= 18
+        auto symbolTable = llvm::SymtabWritingMode::NormalSymtab;
+#else
+        bool symbolTable = true;
+#endif
+        auto error = llvm::writeArchive(path.string(), members, symbolTable, kind, true, false);
+        if(error)
+            return std::unexpected(llvm::toString(std::move(error)));
+        return {};
+    }
+
+    std::string generateNativeHeader(std::span<const BSModule> modules, std::string_view includeGuard)
+    {
+        std::string guard(includeGuard);
+        std::string header = "/* Generated by BraneScript, do not edit */\n"
+                             "#ifndef " + guard + "\n"
+                             "#define " + guard + "\n\n"
+                             "#include <stdbool.h>\n"
+                             "#include <stddef.h>\n"
+                             "#include <stdint.h>\n\n"
+                             "#ifdef __cplusplus\n"
+                             "extern \"C\" {\n"
+                             "#endif\n\n";
+        // Shared between every generated header, matches MemoryRegion, NativeContext and NativeStatus
+        header += "#ifndef BRANESCRIPT_NATIVE_ABI\n"
+                  "#define BRANESCRIPT_NATIVE_ABI\n"
+                  "typedef struct BSMemoryRegion\n{\n"
+                  "    uint8_t* data;\n"
+                  "    size_t size;\n"
+                  "    bool writable;\n"
+                  "} BSMemoryRegion;\n\n"
+                  "typedef struct BSNativeContext\n{\n"
+                  "    const BSMemoryRegion* regions;\n"
+                  "    uint64_t regionCount;\n"
+                  "    uint32_t callDepth;\n"
+                  "} BSNativeContext;\n\n"
+                  "enum BSNativeStatus\n{\n";
+        static constexpr std::string_view statusNames[] = {"OK",
+                                                           "DIVISION_BY_ZERO",
+                                                           "UNBOUND_REGION",
+                                                           "OUT_OF_BOUNDS",
+                                                           "READ_ONLY_REGION",
+                                                           "NULL_POINTER",
+                                                           "CALL_DEPTH_EXCEEDED"};
+        static_assert(std::size(statusNames) == (size_t)NativeStatus::CallDepthExceeded + 1);
+        for(uint32_t status = 0; status < std::size(statusNames); ++status)
+            header += std::format("    /* {} */\n    BS_NATIVE_{} = {},\n",
+                                  nativeStatusMessage((NativeStatus)status),
+                                  statusNames[status],
+                                  status);
+        header += "};\n#endif\n\n";
+
+        for(auto& module : modules)
+        {
+            header += std::format("/* Module {} */\n\n", module.name);
+            for(auto& function : module.functions)
+                declareEntryPoints(header, module.types, function->id, function->inputs, function->outputs);
+            for(auto& pipeline : module.pipelines)
+            {
+                if(pipeline->stages)
+                    declareEntryPoints(header, module.types, pipeline->id, pipeline->inputs, pipeline->outputs);
+            }
+        }
+
+        header += "#ifdef __cplusplus\n"
+                  "}\n"
+                  "#endif\n\n"
+                  "#endif /* " + guard + " */\n";
+        return header;
+    }
+} // namespace BraneScript
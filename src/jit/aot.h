@@ -0,0 +1,45 @@
+#ifndef BRANESCRIPT_AOT_H
+#define BRANESCRIPT_AOT_H
+
+#include <expected>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include "llvmCodegen.h"
+
+namespace BraneScript
+{
+    struct NativeTargetOptions
+    {
+        /// Target triple to generate code for, empty for the host
+        std::string triple;
+        std::string cpu;
+        std::string features;
+        NativeOptLevel optLevel = NativeOptLevel::O2;
+    };
+
+    std::expected<std::unique_ptr<llvm::TargetMachine>, std::string> createNativeTargetMachine(
+        const NativeTargetOptions& options);
+
+    /// Compiles modules into one relocatable object file. Every function and pipeline is exported under its
+    /// nativeSymbolName and nativeRegisterSymbolName, calls between the modules are resolved inside the object.
+    std::expected<std::string, std::string> compileNativeObject(std::span<const BSModule> modules,
+                                                                const NativeTargetOptions& options);
+
+    std::expected<void, std::string> writeNativeObject(std::span<const BSModule> modules,
+                                                       const std::filesystem::path& path,
+                                                       const NativeTargetOptions& options);
+
+    /// Writes a static library with one object per module, so that the host's linker only pulls in the modules it
+    /// references
+    std::expected<void, std::string> writeNativeLibrary(std::span<const BSModule> modules,
+                                                        const std::filesystem::path& path,
+                                                        const NativeTargetOptions& options);
+
+    /// C header declaring the native ABI types and the entry points of every function and pipeline in the modules
+    std::string generateNativeHeader(std::span<const BSModule> modules, std::string_view includeGuard);
+} // namespace BraneScript
+
+#endif
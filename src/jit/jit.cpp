@@ -0,0 +1,88 @@
+#include "jit.h"
+
+#include <format>
+#include <mutex>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Target/TargetMachine.h>
+
+namespace BraneScript
+{
+    JITEngine::JITEngine(std::unique_ptr<llvm::orc::LLJIT> jit, NativeOptLevel optLevel)
+        : _jit(std::move(jit)), _optLevel(optLevel)
+    {}
+
+    JITEngine::~JITEngine() = default;
+
+    std::expected<std::unique_ptr<JITEngine>, std::string> JITEngine::create(NativeOptLevel optLevel)
+    {
+        static std::once_flag targetInitialized;
+        std::call_once(targetInitialized, []() {
+            llvm::InitializeNativeTarget();
+            llvm::InitializeNativeTargetAsmPrinter();
+        });
+
+        auto machineBuilder = llvm::orc::JITTargetMachineBuilder::detectHost();
+        if(!machineBuilder)
+            return std::unexpected(llvm::toString(machineBuilder.takeError()));
+        machineBuilder->setCodeGenOptLevel(codeGenOptLevel(optLevel));
+        auto targetMachine = machineBuilder->createTargetMachine();
+        if(!targetMachine)
+            return std::unexpected(llvm::toString(targetMachine.takeError()));
+
+        auto jit = llvm::orc::LLJITBuilder().setJITTargetMachineBuilder(std::move(*machineBuilder)).create();
+        if(!jit)
+            return std::unexpected(llvm::toString(jit.takeError()));
+
+        // Modules are optimized as they are materialized, so that modules that are never called cost nothing
+        std::shared_ptr<llvm::TargetMachine> optimizerTarget = std::move(*targetMachine);
+        (*jit)->getIRTransformLayer().setTransform(
+            [optimizerTarget, optLevel](llvm::orc::ThreadSafeModule module,
+                                        const llvm::orc::MaterializationResponsibility&)
+                -> llvm::Expected<llvm::orc::ThreadSafeModule> {
+                module.withModuleDo([&](llvm::Module& m) { optimizeLLVMModule(m, optLevel, optimizerTarget.get()); });
+                return module;
+            });
+        return std::unique_ptr<JITEngine>(new JITEngine(std::move(*jit), optLevel));
+    }
+
+    NativeOptLevel JITEngine::optLevel() const { return _optLevel; }
+
+    std::expected<void, std::string> JITEngine::addModule(std::span<const BSModule> modules, size_t module)
+    {
+        // Each module gets its own context so that modules can be compiled on different threads
+        auto context = std::make_unique<llvm::LLVMContext>();
+        auto generated = generateLLVMModule(modules, module, *context);
+        if(!generated)
+            return std::unexpected(generated.error());
+        (*generated)->setDataLayout(_jit->getDataLayout());
+        (*generated)->setTargetTriple(_jit->getTargetTriple().str());
+
+        auto error = _jit->addIRModule(llvm::orc::ThreadSafeModule(std::move(*generated), std::move(context)));
+        if(error)
+            return std::unexpected(std::format("{}: {}", modules[module].name, llvm::toString(std::move(error))));
+        return {};
+    }
+
+    std::expected<void*, std::string> JITEngine::lookup(std::string_view symbol)
+    {
+        auto address = _jit->lookup(llvm::StringRef(symbol.data(), symbol.size()));
+        if(!address)
+            return std::unexpected(llvm::toString(address.takeError()));
+#if LLVM_VERSION_MAJOR >= 15
+        return address->toPtr<void*>();
+#else
+        return reinterpret_cast<void*>(address->getAddress());
+#endif
+    }
+
+    std::expected<NativeRegisterFunction, std::string> JITEngine::entryPoint(std::string_view id)
+    {
+        auto address = lookup(nativeRegisterSymbolName(id));
+        if(!address)
+            return std::unexpected(address.error());
+        return reinterpret_cast<NativeRegisterFunction>(*address);
+    }
+} // namespace BraneScript
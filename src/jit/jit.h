@@ -0,0 +1,57 @@
+#ifndef BRANESCRIPT_JIT_H
+#define BRANESCRIPT_JIT_H
+
+#include <expected>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include "llvmCodegen.h"
+
+namespace llvm::orc
+{
+    class LLJIT;
+} // namespace llvm::orc
+
+namespace BraneScript
+{
+    /// Compiles modules to native code in process with LLVM's ORC JIT. Code is compiled lazily the first time one of
+    /// a module's symbols is looked up, and stays valid for the lifetime of the engine. Modules added to the same
+    /// engine may call each other's functions by name.
+    class JITEngine
+    {
+        std::unique_ptr<llvm::orc::LLJIT> _jit;
+        NativeOptLevel _optLevel;
+
+        JITEngine(std::unique_ptr<llvm::orc::LLJIT> jit, NativeOptLevel optLevel);
+
+      public:
+        ~JITEngine();
+
+        static std::expected<std::unique_ptr<JITEngine>, std::string> create(NativeOptLevel optLevel =
+                                                                                 NativeOptLevel::O2);
+
+        NativeOptLevel optLevel() const;
+
+        /// Adds modules[module] to be compiled once one of its symbols is looked up, see generateLLVMModule
+        std::expected<void, std::string> addModule(std::span<const BSModule> modules, size_t module);
+
+        /// Address of a compiled symbol, compiling the module that defines it if needed
+        std::expected<void*, std::string> lookup(std::string_view symbol);
+
+        /// Register entry point of a function or pipeline
+        std::expected<NativeRegisterFunction, std::string> entryPoint(std::string_view id);
+
+        /// Typed C ABI entry point of a function or pipeline, see NativeRegisterFunction for the signature
+        template<class Signature>
+        std::expected<Signature*, std::string> nativeEntryPoint(std::string_view id)
+        {
+            auto address = lookup(nativeSymbolName(id));
+            if(!address)
+                return std::unexpected(address.error());
+            return reinterpret_cast<Signature*>(*address);
+        }
+    };
+} // namespace BraneScript
+
+#endif
@@ -0,0 +1,974 @@
+#include "llvmCodegen.h"
+
+#include <cctype>
+#include <format>
+#include <unordered_map>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/raw_ostream.h>
+#include "../ir/structLayout.h"
+#include "../runtime/vm.h"
+
+namespace BraneScript
+{
+#if LLVM_VERSION_MAJOR >= 18
+    LLVMCodeGenOptLevel codeGenOptLevel(NativeOptLevel level)
+    {
+        switch(level)
+        {
+            case NativeOptLevel::O0:
+                return llvm::CodeGenOptLevel::None;
+            case NativeOptLevel::O1:
+                return llvm::CodeGenOptLevel::Less;
+            case NativeOptLevel::O2:
+                return llvm::CodeGenOptLevel::Default;
+            case NativeOptLevel::O3:
+                return llvm::CodeGenOptLevel::Aggressive;
+        }
+        return llvm::CodeGenOptLevel::Default;
+    }
+#else
+    LLVMCodeGenOptLevel codeGenOptLevel(NativeOptLevel level)
+    {
+        switch(level)
+        {
+            case NativeOptLevel::O0:
+                return llvm::CodeGenOpt::None;
+            case NativeOptLevel::O1:
+                return llvm::CodeGenOpt::Less;
+            case NativeOptLevel::O2:
+                return llvm::CodeGenOpt::Default;
+            case NativeOptLevel::O3:
+                return llvm::CodeGenOpt::Aggressive;
+        }
+        return llvm::CodeGenOpt::Default;
+    }
+#endif
+
+    std::string nativeSymbolName(std::string_view id)
+    {
+        static constexpr char hex[] = "0123456789abcdef";
+        std::string symbol = "bs_";
+        for(size_t i = 0; i < id.size(); ++i)
+        {
+            unsigned char c = id[i];
+            if(std::isalnum(c) || c == '_')
+                symbol += (char)c;
+            else if(c == ':' && i + 1 < id.size() && id[i + 1] == ':')
+            {
+                symbol += "__";
+                ++i;
+            }
+            else
+            {
+                symbol += '_';
+                symbol += hex[c >> 4];
+                symbol += hex[c & 0xf];
+            }
+        }
+        return symbol;
+    }
+
+    std::string nativeRegisterSymbolName(std::string_view id) { return "bsreg_" + nativeSymbolName(id).substr(3); }
+
+    namespace
+    {
+        template<class... Ts>
+        struct overloads : Ts...
+        {
+            using Ts::operator()...;
+        };
+
+        /// Pointers are represented as i8* so that the same code works with typed and opaque pointers
+        llvm::PointerType* bytePtrType(llvm::LLVMContext& ctx)
+        {
+            return llvm::PointerType::get(llvm::Type::getInt8Ty(ctx), 0);
+        }
+
+        llvm::Type* llvmType(const BSType& type, llvm::LLVMContext& ctx)
+        {
+            if(std::holds_alternative<IRNode<BSRefType>>(type))
+                return bytePtrType(ctx);
+            auto* base = std::get_if<BSBaseType>(&type);
+            if(!base)
+                return nullptr;
+            switch(*base)
+            {
+                case BSBaseType::U8:
+                case BSBaseType::I8:
+                    return llvm::Type::getInt8Ty(ctx);
+                case BSBaseType::U16:
+                case BSBaseType::I16:
+                    return llvm::Type::getInt16Ty(ctx);
+                case BSBaseType::U32:
+                case BSBaseType::I32:
+                    return llvm::Type::getInt32Ty(ctx);
+                case BSBaseType::U64:
+                case BSBaseType::I64:
+                    return llvm::Type::getInt64Ty(ctx);
+                case BSBaseType::U128:
+                case BSBaseType::I128:
+                    return llvm::Type::getInt128Ty(ctx);
+                case BSBaseType::F32:
+                    return llvm::Type::getFloatTy(ctx);
+                case BSBaseType::F64:
+                    return llvm::Type::getDoubleTy(ctx);
+            }
+            return nullptr;
+        }
+
+        bool isSignedType(const BSType& type)
+        {
+            auto* base = std::get_if<BSBaseType>(&type);
+            if(!base)
+                return false;
+            switch(*base)
+            {
+                case BSBaseType::I8:
+                case BSBaseType::I16:
+                case BSBaseType::I32:
+                case BSBaseType::I64:
+                case BSBaseType::I128:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        unsigned bitWidth(llvm::Type* type)
+        {
+            if(type->isPointerTy())
+                return 64;
+            return type->getPrimitiveSizeInBits();
+        }
+
+        struct NativeSignature
+        {
+            llvm::Function* function = nullptr;
+            std::vector<llvm::Type*> inputs;
+            std::vector<llvm::Type*> outputs;
+        };
+
+        class ModuleCodegen;
+
+        /// Shared helpers for emitting code into one native function
+        class FunctionEmitter
+        {
+          protected:
+            ModuleCodegen& _module;
+            llvm::LLVMContext& _context;
+            llvm::Function* _function;
+            llvm::IRBuilder<> _builder;
+            llvm::IRBuilder<> _entryBuilder;
+            llvm::Value* _ctx;
+
+            FunctionEmitter(ModuleCodegen& module, llvm::LLVMContext& context, llvm::Function* function)
+                : _module(module), _context(context), _function(function), _builder(context), _entryBuilder(context),
+                  _ctx(function->getArg(0))
+            {
+                auto* entry = llvm::BasicBlock::Create(context, "entry", function);
+                _entryBuilder.SetInsertPoint(entry);
+                _builder.SetInsertPoint(entry);
+            }
+
+            llvm::Type* i64() { return llvm::Type::getInt64Ty(_context); }
+
+            /// Allocas all go at the top of the entry block so that they can be promoted to registers
+            llvm::AllocaInst* createLocal(llvm::Type* type)
+            {
+                auto* entry = &_function->getEntryBlock();
+                if(entry->empty())
+                    _entryBuilder.SetInsertPoint(entry);
+                else
+                    _entryBuilder.SetInsertPoint(entry, entry->getFirstInsertionPt());
+                return _entryBuilder.CreateAlloca(type);
+            }
+
+            /// Reinterprets a value as another type the same way a VM register would, by zero extending or
+            /// truncating its bits
+            llvm::Value* rawConvert(llvm::Value* value, llvm::Type* to)
+            {
+                auto* from = value->getType();
+                if(from == to)
+                    return value;
+                auto* fromInt = llvm::Type::getIntNTy(_context, bitWidth(from));
+                if(from->isPointerTy())
+                    value = _builder.CreatePtrToInt(value, fromInt);
+                else if(!from->isIntegerTy())
+                    value = _builder.CreateBitCast(value, fromInt);
+                value = _builder.CreateZExtOrTrunc(value, llvm::Type::getIntNTy(_context, bitWidth(to)));
+                if(to->isPointerTy())
+                    return _builder.CreateIntToPtr(value, to);
+                if(!to->isIntegerTy())
+                    return _builder.CreateBitCast(value, to);
+                return value;
+            }
+
+            void returnStatus(llvm::Value* status) { _builder.CreateRet(status); }
+
+            llvm::Value* status(NativeStatus value)
+            {
+                return llvm::ConstantInt::get(llvm::Type::getInt32Ty(_context), (uint32_t)value);
+            }
+
+            /// Returns status from the function if cond is true, the branch is weighted as unlikely
+            void trapIf(llvm::Value* cond, NativeStatus trapStatus)
+            {
+                auto* trap = llvm::BasicBlock::Create(_context, "trap", _function);
+                auto* cont = llvm::BasicBlock::Create(_context, "cont", _function);
+                _builder.CreateCondBr(cond, trap, cont, llvm::MDBuilder(_context).createBranchWeights(1, 1 << 20));
+                _builder.SetInsertPoint(trap);
+                returnStatus(status(trapStatus));
+                _builder.SetInsertPoint(cont);
+            }
+
+            /// Returns a callee's status from the function if it isn't Ok
+            void propagateStatus(llvm::Value* result)
+            {
+                auto* failed = llvm::BasicBlock::Create(_context, "failed", _function);
+                auto* cont = llvm::BasicBlock::Create(_context, "cont", _function);
+                auto* isOk = _builder.CreateICmpEQ(result, status(NativeStatus::Ok));
+                _builder.CreateCondBr(isOk, cont, failed, llvm::MDBuilder(_context).createBranchWeights(1 << 20, 1));
+                _builder.SetInsertPoint(failed);
+                returnStatus(result);
+                _builder.SetInsertPoint(cont);
+            }
+
+            /// Calls a native entry point, tracking the call depth the same way the VM does. Outputs are written
+            /// to temporaries of the callee's output types which are returned for the caller to convert.
+            std::vector<llvm::AllocaInst*> emitCall(const NativeSignature& callee, std::span<llvm::Value*> inputs)
+            {
+                auto* depthPtr = _builder.CreateStructGEP(contextType(), _ctx, 2);
+                auto* depth = _builder.CreateLoad(llvm::Type::getInt32Ty(_context), depthPtr);
+                trapIf(_builder.CreateICmpUGE(depth, _builder.getInt32(VM::maxCallDepth)),
+                       NativeStatus::CallDepthExceeded);
+                _builder.CreateStore(_builder.CreateAdd(depth, _builder.getInt32(1)), depthPtr);
+
+                std::vector<llvm::Value*> args{_ctx};
+                for(size_t i = 0; i < inputs.size(); ++i)
+                    args.push_back(rawConvert(inputs[i], callee.inputs[i]));
+                std::vector<llvm::AllocaInst*> outputs;
+                for(auto* type : callee.outputs)
+                {
+                    outputs.push_back(createLocal(type));
+                    args.push_back(outputs.back());
+                }
+                auto* result = _builder.CreateCall(callee.function, args);
+                _builder.CreateStore(depth, depthPtr);
+                propagateStatus(result);
+                return outputs;
+            }
+
+            llvm::StructType* contextType();
+        };
+
+        class ModuleCodegen
+        {
+            std::span<const BSModule> _modules;
+            size_t _moduleIndex;
+            const BSModule& _source;
+            /// Only needed to bounds check accesses through references, so computed on first use
+            std::optional<std::expected<StructLayouts, std::string>> _layouts;
+            llvm::LLVMContext& _context;
+            std::unique_ptr<llvm::Module> _module;
+            llvm::StructType* _regionType;
+            llvm::StructType* _contextType;
+            std::unordered_map<std::string, NativeSignature> _functions;
+            std::vector<NativeSignature*> _localFunctions;
+
+            llvm::Function* createFunction(const std::string& symbol,
+                                           std::span<llvm::Type* const> inputs,
+                                           std::span<llvm::Type* const> outputs,
+                                           llvm::GlobalValue::LinkageTypes linkage)
+            {
+                std::vector<llvm::Type*> params{llvm::PointerType::get(_contextType, 0)};
+                params.insert(params.end(), inputs.begin(), inputs.end());
+                for(auto* output : outputs)
+                    params.push_back(llvm::PointerType::get(output, 0));
+                auto* type = llvm::FunctionType::get(llvm::Type::getInt32Ty(_context), params, false);
+                auto* function = llvm::Function::Create(type, linkage, symbol, *_module);
+                function->addFnAttr(llvm::Attribute::NoUnwind);
+                return function;
+            }
+
+            std::expected<std::vector<llvm::Type*>, std::string> localTypes(std::string_view id,
+                                                                            const std::vector<TypeId>& types)
+            {
+                std::vector<llvm::Type*> result;
+                for(size_t i = 0; i < types.size(); ++i)
+                {
+                    auto* type = llvmType(_source.types.type(types[i]), _context);
+                    if(!type)
+                        return std::unexpected(
+                            std::format("{}: value {} has a type native code does not support yet", id, i));
+                    result.push_back(type);
+                }
+                return result;
+            }
+
+            std::expected<void, std::string> generateRegisterEntry(std::string_view id, const NativeSignature& target);
+            std::expected<void, std::string> generatePipeline(const BSPipeline& pipeline);
+
+          public:
+            ModuleCodegen(std::span<const BSModule> modules, size_t module, llvm::LLVMContext& context)
+                : _modules(modules), _moduleIndex(module), _source(modules[module]), _context(context),
+                  _module(std::make_unique<llvm::Module>(_source.name, context))
+            {
+                _regionType = llvm::StructType::create(context,
+                                                       {bytePtrType(context),
+                                                        llvm::Type::getIntNTy(context, sizeof(size_t) * 8),
+                                                        llvm::Type::getInt8Ty(context)},
+                                                       "BraneScript.MemoryRegion");
+                _contextType = llvm::StructType::create(context,
+                                                        {llvm::PointerType::get(_regionType, 0),
+                                                         llvm::Type::getInt64Ty(context),
+                                                         llvm::Type::getInt32Ty(context)},
+                                                        "BraneScript.NativeContext");
+            }
+
+            llvm::StructType* regionType() const { return _regionType; }
+
+            llvm::StructType* contextType() const { return _contextType; }
+
+            const TypeTable& types() const { return _source.types; }
+
+            /// Size of the value a ref type refers to
+            std::expected<uint64_t, std::string> pointeeSize(TypeId ref)
+            {
+                if(!_layouts)
+                    _layouts = StructLayouts::compute(_modules);
+                if(!*_layouts)
+                    return std::unexpected(_layouts->error());
+                auto& types = _source.types;
+                auto layout = (*_layouts)->typeLayout(types.type(types.dereferenced(ref)), _moduleIndex);
+                if(!layout)
+                    return std::unexpected(layout.error());
+                return layout->size;
+            }
+
+            /// Finds the entry point a call refers to, functions in other modules are declared with the types
+            /// the call site passes
+            std::expected<const NativeSignature*, std::string> resolveCall(const IDRef& target,
+                                                                           std::span<llvm::Type* const> inputs,
+                                                                           std::span<llvm::Type* const> outputs)
+            {
+                return std::visit(
+                    overloads{[&](const std::string& name) -> std::expected<const NativeSignature*, std::string> {
+                        auto existing = _functions.find(name);
+                        if(existing != _functions.end())
+                            return &existing->second;
+                        auto& declared = _functions[name];
+                        declared.inputs.assign(inputs.begin(), inputs.end());
+                        declared.outputs.assign(outputs.begin(), outputs.end());
+                        declared.function = createFunction(
+                            nativeSymbolName(name), inputs, outputs, llvm::GlobalValue::ExternalLinkage);
+                        return &declared;
+                    },
+                              [&](int32_t id) -> std::expected<const NativeSignature*, std::string> {
+                        if(auto* imported = importedSymbol(_source, id))
+                            return resolveCall(*imported, inputs, outputs);
+                        if(id <= 0 || (size_t)id > _localFunctions.size())
+                            return std::unexpected(std::format("call to unbound external function {}", id));
+                        return _localFunctions[id - 1];
+                    }},
+                    target);
+            }
+
+            std::expected<std::unique_ptr<llvm::Module>, std::string> generate();
+        };
+
+        llvm::StructType* FunctionEmitter::contextType() { return _module.contextType(); }
+
+        /// Lowers the instructions of a function or pipeline stage. Every local var gets an alloca, which the
+        /// optimizer promotes to SSA registers.
+        class BodyCodegen : public FunctionEmitter
+        {
+            std::string_view _id;
+            const std::vector<TypeId>& _localVars;
+            const InstructionList& _code;
+            std::vector<llvm::AllocaInst*> _locals;
+            std::vector<llvm::Type*> _types;
+            std::vector<bool> _signed;
+
+            std::unexpected<std::string> error(const Instruction& inst, std::string_view message) const
+            {
+                return std::unexpected(
+                    std::format("{}: {} at instruction {}", _id, message, &inst - _code.instructions.data()));
+            }
+
+            bool operandsValid(const Instruction& inst) const
+            {
+                size_t frameSize = _localVars.size();
+                if(inst.op == OpCode::Call)
+                {
+                    if(inst.a >= _code.callTargets.size() || inst.b > _code.callOperands.size() ||
+                       (size_t)inst.count + inst.c > _code.callOperands.size() - inst.b)
+                        return false;
+                    for(size_t i = 0; i < (size_t)inst.count + inst.c; ++i)
+                    {
+                        if(_code.callOperands[inst.b + i] >= frameSize)
+                            return false;
+                    }
+                    return true;
+                }
+                if(inst.c >= frameSize)
+                    return false;
+                if(isConstOp(inst.op))
+                    return true;
+                if(inst.a >= frameSize)
+                    return false;
+                bool readsB = isBinaryOp(inst.op) || ((inst.op == OpCode::Load || inst.op == OpCode::Store) &&
+                                                      !(inst.flags & InstructionFlags_ConstStore));
+                return !readsB || inst.b < frameSize;
+            }
+
+            llvm::Value* load(uint32_t value) { return _builder.CreateLoad(_types[value], _locals[value]); }
+
+            void store(uint32_t value, llvm::Value* result)
+            {
+                _builder.CreateStore(rawConvert(result, _types[value]), _locals[value]);
+            }
+
+            /// Loads a value for arithmetic, pointers are treated as 64 bit unsigned integers like in the VM
+            llvm::Value* operand(uint32_t value)
+            {
+                auto* result = load(value);
+                if(result->getType()->isPointerTy())
+                    return _builder.CreatePtrToInt(result, i64());
+                return result;
+            }
+
+            llvm::Value* isTrue(llvm::Value* value)
+            {
+                auto* zero = llvm::Constant::getNullValue(value->getType());
+                if(value->getType()->isFloatingPointTy())
+                    return _builder.CreateFCmpUNE(value, zero);
+                return _builder.CreateICmpNE(value, zero);
+            }
+
+            /// Booleans are 0 or 1 in whatever type the instruction writes
+            void storeBool(uint32_t out, llvm::Value* flag)
+            {
+                if(_types[out]->isFloatingPointTy())
+                    _builder.CreateStore(_builder.CreateUIToFP(flag, _types[out]), _locals[out]);
+                else
+                    store(out, _builder.CreateZExt(flag, i64()));
+            }
+
+            std::expected<void, std::string> emitBinary(const Instruction& inst)
+            {
+                bool isSigned = _signed[inst.a];
+                llvm::Value* lhs = operand(inst.a);
+                llvm::Value* rhs = rawConvert(operand(inst.b), lhs->getType());
+                bool isFloat = lhs->getType()->isFloatingPointTy();
+                switch(inst.op)
+                {
+                    case OpCode::Add:
+                        store(inst.c, isFloat ? _builder.CreateFAdd(lhs, rhs) : _builder.CreateAdd(lhs, rhs));
+                        return {};
+                    case OpCode::Sub:
+                        store(inst.c, isFloat ? _builder.CreateFSub(lhs, rhs) : _builder.CreateSub(lhs, rhs));
+                        return {};
+                    case OpCode::Mul:
+                        store(inst.c, isFloat ? _builder.CreateFMul(lhs, rhs) : _builder.CreateMul(lhs, rhs));
+                        return {};
+                    case OpCode::Div:
+                    case OpCode::Mod:
+                    {
+                        bool isDiv = inst.op == OpCode::Div;
+                        if(isFloat)
+                        {
+                            store(inst.c, isDiv ? _builder.CreateFDiv(lhs, rhs) : _builder.CreateFRem(lhs, rhs));
+                            return {};
+                        }
+                        auto* type = llvm::cast<llvm::IntegerType>(lhs->getType());
+                        llvm::Value* invalid = _builder.CreateICmpEQ(rhs, llvm::ConstantInt::get(type, 0));
+                        if(isSigned)
+                        {
+                            auto* min =
+                                llvm::ConstantInt::get(type, llvm::APInt::getSignedMinValue(type->getBitWidth()));
+                            auto* overflow = _builder.CreateAnd(
+                                _builder.CreateICmpEQ(lhs, min),
+                                _builder.CreateICmpEQ(rhs, llvm::ConstantInt::getSigned(type, -1)));
+                            invalid = _builder.CreateOr(invalid, overflow);
+                        }
+                        trapIf(invalid, NativeStatus::DivisionByZero);
+                        llvm::Value* result;
+                        if(isDiv)
+                            result = isSigned ? _builder.CreateSDiv(lhs, rhs) : _builder.CreateUDiv(lhs, rhs);
+                        else
+                            result = isSigned ? _builder.CreateSRem(lhs, rhs) : _builder.CreateURem(lhs, rhs);
+                        store(inst.c, result);
+                        return {};
+                    }
+                    case OpCode::Eq:
+                        storeBool(inst.c, isFloat ? _builder.CreateFCmpOEQ(lhs, rhs) : _builder.CreateICmpEQ(lhs, rhs));
+                        return {};
+                    case OpCode::Ne:
+                        storeBool(inst.c, isFloat ? _builder.CreateFCmpUNE(lhs, rhs) : _builder.CreateICmpNE(lhs, rhs));
+                        return {};
+                    case OpCode::Gt:
+                        storeBool(inst.c,
+                                  isFloat    ? _builder.CreateFCmpOGT(lhs, rhs)
+                                  : isSigned ? _builder.CreateICmpSGT(lhs, rhs)
+                                             : _builder.CreateICmpUGT(lhs, rhs));
+                        return {};
+                    case OpCode::Ge:
+                        storeBool(inst.c,
+                                  isFloat    ? _builder.CreateFCmpOGE(lhs, rhs)
+                                  : isSigned ? _builder.CreateICmpSGE(lhs, rhs)
+                                             : _builder.CreateICmpUGE(lhs, rhs));
+                        return {};
+                    case OpCode::LogicAnd:
+                        storeBool(inst.c, _builder.CreateAnd(isTrue(lhs), isTrue(rhs)));
+                        return {};
+                    case OpCode::LogicOr:
+                        storeBool(inst.c, _builder.CreateOr(isTrue(lhs), isTrue(rhs)));
+                        return {};
+                    default:
+                        break;
+                }
+                if(isFloat)
+                    return error(inst, "operation is not supported for its operand type");
+                switch(inst.op)
+                {
+                    case OpCode::BitAnd:
+                        store(inst.c, _builder.CreateAnd(lhs, rhs));
+                        return {};
+                    case OpCode::BitOr:
+                        store(inst.c, _builder.CreateOr(lhs, rhs));
+                        return {};
+                    case OpCode::BitXor:
+                        store(inst.c, _builder.CreateXor(lhs, rhs));
+                        return {};
+                    default:
+                        return error(inst, "unknown op code");
+                }
+            }
+
+            std::expected<void, std::string> emitUnary(const Instruction& inst)
+            {
+                auto* i32 = _builder.getInt32Ty();
+                auto* f32 = _builder.getFloatTy();
+                switch(inst.op)
+                {
+                    case OpCode::LogicNot:
+                        storeBool(inst.c, _builder.CreateNot(isTrue(operand(inst.a))));
+                        return {};
+                    case OpCode::BitNot:
+                    {
+                        auto* value = operand(inst.a);
+                        if(!value->getType()->isIntegerTy())
+                            return error(inst, "operation is not supported for its operand type");
+                        store(inst.c, _builder.CreateNot(value));
+                        return {};
+                    }
+                    case OpCode::I32ToF32:
+                        store(inst.c, _builder.CreateSIToFP(rawConvert(load(inst.a), i32), f32));
+                        return {};
+                    case OpCode::U32ToF32:
+                        store(inst.c, _builder.CreateUIToFP(rawConvert(load(inst.a), i32), f32));
+                        return {};
+                    case OpCode::F32ToI32:
+                    case OpCode::F32ToU32:
+                    {
+                        // The saturating intrinsics match the VM, out of range values clamp and NaN becomes 0
+                        auto id =
+                            inst.op == OpCode::F32ToI32 ? llvm::Intrinsic::fptosi_sat : llvm::Intrinsic::fptoui_sat;
+                        store(inst.c, _builder.CreateIntrinsic(id, {i32, f32}, {rawConvert(load(inst.a), f32)}));
+                        return {};
+                    }
+                    default:
+                        return error(inst, "unknown op code");
+                }
+            }
+
+            std::expected<void, std::string> emitMemory(const Instruction& inst)
+            {
+                bool isLoad = inst.op == OpCode::Load;
+                // Loads take their width from what they write, stores from what they read
+                auto* accessType = _types[isLoad ? inst.c : inst.a];
+                auto* offset = rawConvert(load(isLoad ? inst.a : inst.c), i64());
+
+                llvm::Value* base;
+                llvm::Value* size;
+                if(inst.flags & InstructionFlags_ConstStore)
+                {
+                    auto* regionCount = _builder.CreateLoad(i64(), _builder.CreateStructGEP(contextType(), _ctx, 1));
+                    trapIf(_builder.CreateICmpUGE(_builder.getInt64(inst.b), regionCount), NativeStatus::UnboundRegion);
+                    auto* regionType = _module.regionType();
+                    auto* regions = _builder.CreateLoad(llvm::PointerType::get(regionType, 0),
+                                                        _builder.CreateStructGEP(contextType(), _ctx, 0));
+                    auto* region = _builder.CreateGEP(regionType, regions, _builder.getInt64(inst.b));
+                    base = _builder.CreateLoad(bytePtrType(_context), _builder.CreateStructGEP(regionType, region, 0));
+                    size = rawConvert(_builder.CreateLoad(regionType->getElementType(1),
+                                                          _builder.CreateStructGEP(regionType, region, 1)),
+                                      i64());
+                    if(!isLoad)
+                    {
+                        auto* writable = _builder.CreateLoad(_builder.getInt8Ty(),
+                                                             _builder.CreateStructGEP(regionType, region, 2));
+                        trapIf(_builder.CreateICmpEQ(writable, _builder.getInt8(0)), NativeStatus::ReadOnlyRegion);
+                    }
+                }
+                else
+                {
+                    // Accesses through a pointer are bounds checked against the size of the value it refers to
+                    auto ref = _localVars[inst.b];
+                    if(!_module.types().isRef(ref))
+                        return error(inst, "memory access through a value that is not a reference");
+                    auto pointeeSize = _module.pointeeSize(ref);
+                    if(!pointeeSize)
+                        return error(inst, pointeeSize.error());
+                    size = _builder.getInt64(*pointeeSize);
+                    base = rawConvert(load(inst.b), bytePtrType(_context));
+                    trapIf(_builder.CreateIsNull(base), NativeStatus::NullPointer);
+                }
+                auto* accessSize = _builder.getInt64(bitWidth(accessType) / 8);
+                trapIf(_builder.CreateOr(_builder.CreateICmpUGT(offset, size),
+                                         _builder.CreateICmpUGT(accessSize, _builder.CreateSub(size, offset))),
+                       NativeStatus::OutOfBounds);
+
+                auto* address = _builder.CreateGEP(_builder.getInt8Ty(), base, offset);
+                auto* typed = _builder.CreateBitCast(address, llvm::PointerType::get(accessType, 0));
+                if(isLoad)
+                    store(inst.c, _builder.CreateAlignedLoad(accessType, typed, llvm::Align(1)));
+                else
+                    _builder.CreateAlignedStore(load(inst.a), typed, llvm::Align(1));
+                return {};
+            }
+
+            std::expected<void, std::string> emitCall(const Instruction& inst)
+            {
+                auto inputs = _code.callInputs(inst);
+                auto outputs = _code.callOutputs(inst);
+                std::vector<llvm::Type*> inputTypes;
+                std::vector<llvm::Type*> outputTypes;
+                std::vector<llvm::Value*> inputValues;
+                for(uint32_t input : inputs)
+                {
+                    inputTypes.push_back(_types[input]);
+                    inputValues.push_back(load(input));
+                }
+                for(uint32_t output : outputs)
+                    outputTypes.push_back(_types[output]);
+
+                auto callee = _module.resolveCall(_code.callTarget(inst), inputTypes, outputTypes);
+                if(!callee)
+                    return error(inst, callee.error());
+                if((*callee)->inputs.size() != inputs.size() || (*callee)->outputs.size() != outputs.size())
+                    return error(inst, "call has the wrong number of arguments");
+                auto results = FunctionEmitter::emitCall(**callee, inputValues);
+                for(size_t i = 0; i < outputs.size(); ++i)
+                    store(outputs[i], _builder.CreateLoad((*callee)->outputs[i], results[i]));
+                return {};
+            }
+
+          public:
+            BodyCodegen(ModuleCodegen& module,
+                        llvm::LLVMContext& context,
+                        const NativeSignature& signature,
+                        std::string_view id,
+                        const std::vector<TypeId>& localVars,
+                        const InstructionList& code)
+                : FunctionEmitter(module, context, signature.function), _id(id), _localVars(localVars), _code(code)
+            {}
+
+            /// The signature's inputs are the first local vars, outputs are the given values
+            std::expected<void, std::string> generate(std::span<const uint32_t> outputs)
+            {
+                auto& types = _module.types();
+                for(auto type : _localVars)
+                {
+                    auto* native = llvmType(types.type(type), _context);
+                    if(!native)
+                        return std::unexpected(std::format("{}: local var type not supported by native code", _id));
+                    _types.push_back(native);
+                    _signed.push_back(isSignedType(types.type(type)));
+                    _locals.push_back(_builder.CreateAlloca(native));
+                }
+
+                size_t inputCount = _function->arg_size() - 1 - outputs.size();
+                for(size_t i = 0; i < _locals.size(); ++i)
+                {
+                    llvm::Value* initial = i < inputCount ? (llvm::Value*)_function->getArg(i + 1)
+                                                          : llvm::Constant::getNullValue(_types[i]);
+                    _builder.CreateStore(initial, _locals[i]);
+                }
+
+                for(auto& inst : _code.instructions)
+                {
+                    if(!operandsValid(inst))
+                        return error(inst, "operand out of range");
+                    std::expected<void, std::string> result;
+                    switch(inst.op)
+                    {
+                        case OpCode::Mov:
+                            store(inst.c, load(inst.a));
+                            break;
+                        case OpCode::ConstI32:
+                        case OpCode::ConstU32:
+                        case OpCode::ConstF32:
+                            store(inst.c, _builder.getInt32(inst.a));
+                            break;
+                        case OpCode::Load:
+                        case OpCode::Store:
+                            result = emitMemory(inst);
+                            break;
+                        case OpCode::Call:
+                            result = emitCall(inst);
+                            break;
+                        default:
+                            result = isBinaryOp(inst.op) ? emitBinary(inst) : emitUnary(inst);
+                            break;
+                    }
+                    if(!result)
+                        return result;
+                }
+
+                for(size_t i = 0; i < outputs.size(); ++i)
+                {
+                    if(outputs[i] >= _locals.size())
+                        return std::unexpected(std::format("{}: output out of range", _id));
+                    _builder.CreateStore(load(outputs[i]), _function->getArg(1 + inputCount + i));
+                }
+                returnStatus(status(NativeStatus::Ok));
+                return {};
+            }
+        };
+
+        /// Entry points that don't correspond to a body, pipelines chaining their stages and register entry points
+        class GlueCodegen : public FunctionEmitter
+        {
+          public:
+            GlueCodegen(ModuleCodegen& module, llvm::LLVMContext& context, llvm::Function* function)
+                : FunctionEmitter(module, context, function)
+            {}
+
+            /// Calls each stage with the previous one's outputs, the last stage's outputs become the pipeline's
+            std::expected<void, std::string> generatePipeline(std::string_view id,
+                                                              std::span<const NativeSignature> stages,
+                                                              std::span<llvm::Type* const> outputTypes)
+            {
+                std::vector<llvm::Value*> carried;
+                size_t inputCount = _function->arg_size() - 1 - outputTypes.size();
+                for(size_t i = 0; i < inputCount; ++i)
+                    carried.push_back(_function->getArg(i + 1));
+                for(size_t s = 0; s < stages.size(); ++s)
+                {
+                    if(stages[s].inputs.size() != carried.size())
+                        return std::unexpected(std::format("{}: stage {} receives {} values but takes {}",
+                                                           id,
+                                                           s,
+                                                           carried.size(),
+                                                           stages[s].inputs.size()));
+                    auto results = emitCall(stages[s], carried);
+                    carried.clear();
+                    for(size_t i = 0; i < results.size(); ++i)
+                        carried.push_back(_builder.CreateLoad(stages[s].outputs[i], results[i]));
+                }
+                if(carried.size() != outputTypes.size())
+                    return std::unexpected(
+                        std::format("{}: last stage produces {} values but the pipeline has {} outputs",
+                                    id,
+                                    carried.size(),
+                                    outputTypes.size()));
+                for(size_t i = 0; i < carried.size(); ++i)
+                    _builder.CreateStore(rawConvert(carried[i], outputTypes[i]), _function->getArg(1 + inputCount + i));
+                returnStatus(status(NativeStatus::Ok));
+                return {};
+            }
+
+            /// Unpacks zero extended 64 bit slots into the target's arguments and packs its outputs back
+            void generateRegisterEntry(const NativeSignature& target)
+            {
+                auto* inputs = _function->getArg(1);
+                auto* outputs = _function->getArg(2);
+                std::vector<llvm::Value*> args;
+                for(size_t i = 0; i < target.inputs.size(); ++i)
+                {
+                    auto* slot = _builder.CreateGEP(i64(), inputs, _builder.getInt64(i));
+                    args.push_back(_builder.CreateLoad(i64(), slot));
+                }
+                auto results = emitCall(target, args);
+                for(size_t i = 0; i < results.size(); ++i)
+                {
+                    auto* value = _builder.CreateLoad(target.outputs[i], results[i]);
+                    auto* slot = _builder.CreateGEP(i64(), outputs, _builder.getInt64(i));
+                    _builder.CreateStore(rawConvert(value, i64()), slot);
+                }
+                returnStatus(status(NativeStatus::Ok));
+            }
+        };
+
+        std::expected<void, std::string> ModuleCodegen::generateRegisterEntry(std::string_view id,
+                                                                              const NativeSignature& target)
+        {
+            auto* slotPtr = llvm::PointerType::get(llvm::Type::getInt64Ty(_context), 0);
+            auto* type = llvm::FunctionType::get(llvm::Type::getInt32Ty(_context),
+                                                 {llvm::PointerType::get(_contextType, 0), slotPtr, slotPtr},
+                                                 false);
+            auto* function = llvm::Function::Create(
+                type, llvm::GlobalValue::ExternalLinkage, nativeRegisterSymbolName(id), *_module);
+            function->addFnAttr(llvm::Attribute::NoUnwind);
+            GlueCodegen(*this, _context, function).generateRegisterEntry(target);
+            return {};
+        }
+
+        std::expected<void, std::string> ModuleCodegen::generatePipeline(const BSPipeline& pipeline)
+        {
+            auto inputs = localTypes(pipeline.id, pipeline.inputs);
+            if(!inputs)
+                return std::unexpected(inputs.error());
+            auto outputs = localTypes(pipeline.id, pipeline.outputs);
+            if(!outputs)
+                return std::unexpected(outputs.error());
+
+            std::vector<NativeSignature> stages;
+            size_t inputCount = pipeline.inputs.size();
+            for(size_t s = 0; s < pipeline.stages->size(); ++s)
+            {
+                auto& stage = (*pipeline.stages)[s];
+                auto stageId = std::format("{}[{}]", pipeline.id, s);
+                if(inputCount > stage.localVars.size())
+                    return std::unexpected(std::format("{}: missing input local vars", stageId));
+                if(!stage.asyncOps.empty())
+                    return std::unexpected(
+                        std::format("{}: async calls can't be compiled to native code, run it on an AsyncRuntime",
+                                    stageId));
+                auto locals = localTypes(stageId, stage.localVars);
+                if(!locals)
+                    return std::unexpected(locals.error());
+
+                auto& signature = stages.emplace_back();
+                signature.inputs.assign(locals->begin(), locals->begin() + inputCount);
+                std::vector<uint32_t> stageOutputs;
+                for(auto output : stage.outputs)
+                {
+                    if(output.id >= locals->size())
+                        return std::unexpected(std::format("{}: stage output out of range", stageId));
+                    signature.outputs.push_back((*locals)[output.id]);
+                    stageOutputs.push_back(output.id);
+                }
+                signature.function = createFunction(std::format("{}.stage{}", nativeSymbolName(pipeline.id), s),
+                                                    signature.inputs,
+                                                    signature.outputs,
+                                                    llvm::GlobalValue::InternalLinkage);
+                auto result = BodyCodegen(*this, _context, signature, stageId, stage.localVars, stage.operations)
+                                  .generate(stageOutputs);
+                if(!result)
+                    return result;
+                inputCount = stage.outputs.size();
+            }
+
+            if(_module->getFunction(nativeSymbolName(pipeline.id)))
+                return std::unexpected(std::format("{}: native symbol is already defined", pipeline.id));
+            NativeSignature entry{nullptr, *inputs, *outputs};
+            entry.function =
+                createFunction(nativeSymbolName(pipeline.id), *inputs, *outputs, llvm::GlobalValue::ExternalLinkage);
+            auto result = GlueCodegen(*this, _context, entry.function).generatePipeline(pipeline.id, stages, *outputs);
+            if(!result)
+                return result;
+            return generateRegisterEntry(pipeline.id, entry);
+        }
+
+        std::expected<std::unique_ptr<llvm::Module>, std::string> ModuleCodegen::generate()
+        {
+            // Declare every function first so that calls can reference functions defined later
+            for(auto& function : _source.functions)
+            {
+                size_t inputCount = function->inputs.size();
+                size_t outputCount = function->outputs.size();
+                if(inputCount + outputCount > function->localVars.size())
+                    return std::unexpected(std::format("{}: missing input or output local vars", function->id));
+                auto locals = localTypes(function->id, function->localVars);
+                if(!locals)
+                    return std::unexpected(locals.error());
+                if(_module->getFunction(nativeSymbolName(function->id)))
+                    return std::unexpected(std::format("Function {} is defined more than once", function->id));
+                auto& signature = _functions[function->id];
+                signature.inputs.assign(locals->begin(), locals->begin() + inputCount);
+                signature.outputs.assign(locals->begin() + inputCount, locals->begin() + inputCount + outputCount);
+                signature.function = createFunction(nativeSymbolName(function->id),
+                                                    signature.inputs,
+                                                    signature.outputs,
+                                                    llvm::GlobalValue::ExternalLinkage);
+                _localFunctions.push_back(&signature);
+            }
+
+            for(size_t f = 0; f < _source.functions.size(); ++f)
+            {
+                auto& function = *_source.functions[f];
+                auto& signature = *_localFunctions[f];
+                std::vector<uint32_t> outputs;
+                for(size_t i = 0; i < function.outputs.size(); ++i)
+                    outputs.push_back((uint32_t)(function.inputs.size() + i));
+                auto result =
+                    BodyCodegen(*this, _context, signature, function.id, function.localVars, function.operations)
+                        .generate(outputs);
+                if(!result)
+                    return std::unexpected(result.error());
+                if(auto entry = generateRegisterEntry(function.id, signature); !entry)
+                    return std::unexpected(entry.error());
+            }
+
+            for(auto& pipeline : _source.pipelines)
+            {
+                if(!pipeline->stages)
+                    continue;
+                if(auto result = generatePipeline(*pipeline); !result)
+                    return std::unexpected(result.error());
+            }
+
+            std::string verifierErrors;
+            llvm::raw_string_ostream errorStream(verifierErrors);
+            if(llvm::verifyModule(*_module, &errorStream))
+                return std::unexpected(
+                    std::format("{}: generated invalid LLVM IR: {}", _source.name, errorStream.str()));
+            return std::move(_module);
+        }
+    } // namespace
+
+    std::expected<std::unique_ptr<llvm::Module>, std::string>
+    generateLLVMModule(std::span<const BSModule> modules, size_t module, llvm::LLVMContext& context)
+    {
+        return ModuleCodegen(modules, module, context).generate();
+    }
+
+    void optimizeLLVMModule(llvm::Module& module, NativeOptLevel level, llvm::TargetMachine* target)
+    {
+        llvm::LoopAnalysisManager loopAnalysis;
+        llvm::FunctionAnalysisManager functionAnalysis;
+        llvm::CGSCCAnalysisManager cgsccAnalysis;
+        llvm::ModuleAnalysisManager moduleAnalysis;
+        llvm::PassBuilder builder(target);
+        builder.registerModuleAnalyses(moduleAnalysis);
+        builder.registerCGSCCAnalyses(cgsccAnalysis);
+        builder.registerFunctionAnalyses(functionAnalysis);
+        builder.registerLoopAnalyses(loopAnalysis);
+        builder.crossRegisterProxies(loopAnalysis, functionAnalysis, cgsccAnalysis, moduleAnalysis);
+
+        llvm::ModulePassManager passes;
+        switch(level)
+        {
+            case NativeOptLevel::O0:
+                passes = builder.buildO0DefaultPipeline(llvm::OptimizationLevel::O0);
+                break;
+            case NativeOptLevel::O1:
+                passes = builder.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O1);
+                break;
+            case NativeOptLevel::O2:
+                passes = builder.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O2);
+                break;
+            case NativeOptLevel::O3:
+                passes = builder.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O3);
+                break;
+        }
+        passes.run(module, moduleAnalysis);
+    }
+} // namespace BraneScript
@@ -0,0 +1,59 @@
+#ifndef BRANESCRIPT_LLVMCODEGEN_H
+#define BRANESCRIPT_LLVMCODEGEN_H
+
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/CodeGen.h>
+#include "../ir/ir.h"
+#include "../runtime/bytecode.h"
+#include "../runtime/nativeAbi.h"
+
+namespace llvm
+{
+    class LLVMContext;
+    class Module;
+    class TargetMachine;
+} // namespace llvm
+
+namespace BraneScript
+{
+    /// Symbol of the typed entry point for a function or pipeline id. Characters that are not valid in a C identifier
+    /// are escaped, "::" becomes "__".
+    std::string nativeSymbolName(std::string_view id);
+    /// Symbol of the register entry point for a function or pipeline id
+    std::string nativeRegisterSymbolName(std::string_view id);
+
+    enum class NativeOptLevel
+    {
+        O0,
+        O1,
+        O2,
+        O3
+    };
+
+#if LLVM_VERSION_MAJOR >= 18
+    using LLVMCodeGenOptLevel = llvm::CodeGenOptLevel;
+#else
+    using LLVMCodeGenOptLevel = llvm::CodeGenOpt::Level;
+#endif
+
+    /// Code generator setting that goes with an optimization level
+    LLVMCodeGenOptLevel codeGenOptLevel(NativeOptLevel level);
+
+    /// Lowers every function and pipeline of modules[module] to LLVM IR. Calls by name to functions of other modules
+    /// are left as external declarations for the linker or JIT to resolve. The rest of the modules provide the
+    /// layouts of structs the module refers to, which accesses through references are bounds checked against.
+    std::expected<std::unique_ptr<llvm::Module>, std::string>
+    generateLLVMModule(std::span<const BSModule> modules, size_t module, llvm::LLVMContext& context);
+
+    /// Runs LLVM's default optimization pipeline for a level over a generated module. Passing the target machine
+    /// code will be generated for lets the optimizer use its cost model.
+    void optimizeLLVMModule(llvm::Module& module, NativeOptLevel level, llvm::TargetMachine* target = nullptr);
+} // namespace BraneScript
+
+#endif
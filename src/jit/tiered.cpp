@@ -0,0 +1,139 @@
+#include "tiered.h"
+
+#include <format>
+
+namespace BraneScript
+{
+    TieredEngine::TieredEngine(std::vector<BSModule> modules,
+                               std::shared_ptr<const Program> program,
+                               TieredOptions options)
+        : _shared(std::make_shared<Shared>())
+    {
+        _shared->modules = std::move(modules);
+        _shared->program = std::move(program);
+        _shared->options = options;
+        _tiers = std::make_shared<TierTable>(
+            *_shared->program,
+            options.threshold,
+            [shared = _shared](TierTable::Kind kind, uint32_t index) { shared->promote(kind, index); });
+        // The thread only runs while the engine exists, which keeps the tier table alive for it
+        _compiler = std::thread([shared = _shared.get(), tiers = _tiers.get()] { shared->compileLoop(*tiers); });
+    }
+
+    TieredEngine::~TieredEngine()
+    {
+        {
+            std::lock_guard lock(_shared->mutex);
+            _shared->stopping = true;
+            _shared->queueChanged.notify_all();
+        }
+        _compiler.join();
+    }
+
+    std::expected<std::unique_ptr<TieredEngine>, std::string> TieredEngine::create(std::vector<BSModule> modules,
+                                                                                   TieredOptions options)
+    {
+        if(options.threshold == 0)
+            return std::unexpected("The promotion threshold must be at least 1");
+        auto program = Program::load(modules, options.host);
+        if(!program)
+            return std::unexpected(program.error());
+        return std::unique_ptr<TieredEngine>(new TieredEngine(
+            std::move(modules), std::make_shared<const Program>(std::move(*program)), options));
+    }
+
+    void TieredEngine::Shared::promote(TierTable::Kind kind, uint32_t index)
+    {
+        std::lock_guard lock(mutex);
+        // Nothing compiles promotions once the engine is gone
+        if(stopping)
+            return;
+        queue.emplace_back(kind, index);
+        queueChanged.notify_all();
+    }
+
+    void TieredEngine::Shared::compileLoop(TierTable& tiers)
+    {
+        std::unique_lock lock(mutex);
+        while(true)
+        {
+            queueChanged.wait(lock, [&] { return stopping || !queue.empty(); });
+            if(stopping)
+                return;
+            auto [kind, index] = queue.front();
+            queue.pop_front();
+            compiling = true;
+            lock.unlock();
+
+            auto native = compile(kind, index);
+            if(native)
+                tiers.install(kind, index, *native);
+
+            lock.lock();
+            compiling = false;
+            if(native)
+                promoted++;
+            else
+                errors.push_back(std::move(native.error()));
+            queueChanged.notify_all();
+        }
+    }
+
+    std::expected<NativeRegisterFunction, std::string> TieredEngine::Shared::compile(TierTable::Kind kind,
+                                                                                     uint32_t index)
+    {
+        if(!jit)
+        {
+            auto created = JITEngine::create(options.optLevel);
+            if(!created)
+                return std::unexpected(created.error());
+            jit = std::move(*created);
+            // Modules are only lowered to LLVM IR here and compiled once a symbol of theirs is looked up. A module
+            // the backend rejects leaves its code, and anything calling into it, interpreted.
+            for(size_t m = 0; m < modules.size(); ++m)
+            {
+                if(auto added = jit->addModule(modules, m); !added)
+                {
+                    std::lock_guard lock(mutex);
+                    errors.push_back(added.error());
+                }
+            }
+        }
+
+        auto& id = kind == TierTable::Kind::Function ? program->functions()[index].id : program->pipelines()[index].id;
+        auto entry = jit->entryPoint(id);
+        if(!entry)
+            return std::unexpected(std::format("{}: {}", id, entry.error()));
+        return *entry;
+    }
+
+    const std::shared_ptr<const Program>& TieredEngine::program() const { return _shared->program; }
+
+    const std::shared_ptr<TierTable>& TieredEngine::tierTable() const { return _tiers; }
+
+    VM TieredEngine::createVM(size_t stackSize) const
+    {
+        VM vm(_shared->program, stackSize);
+        vm.setTierTable(_tiers);
+        return vm;
+    }
+
+    void TieredEngine::waitForCompiles()
+    {
+        auto& shared = *_shared;
+        std::unique_lock lock(shared.mutex);
+        shared.queueChanged.wait(lock, [&] { return shared.stopping || (shared.queue.empty() && !shared.compiling); });
+    }
+
+    size_t TieredEngine::promotedCount() const
+    {
+        std::lock_guard lock(_shared->mutex);
+        return _shared->promoted;
+    }
+
+    std::vector<std::string> TieredEngine::errors() const
+    {
+        std::lock_guard lock(_shared->mutex);
+        return _shared->errors;
+    }
+} // namespace BraneScript
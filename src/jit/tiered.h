@@ -0,0 +1,88 @@
+#ifndef BRANESCRIPT_TIERED_H
+#define BRANESCRIPT_TIERED_H
+
+#include <condition_variable>
+#include <deque>
+#include <expected>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "../runtime/tiering.h"
+#include "../runtime/vm.h"
+#include "jit.h"
+
+namespace BraneScript
+{
+    struct TieredOptions
+    {
+        /// Invocations after which a function or pipeline is compiled to native code
+        uint32_t threshold = 1000;
+        NativeOptLevel optLevel = NativeOptLevel::O2;
+        /// Host functions the modules may call, only used while loading. Code that calls them stays interpreted.
+        const HostFunctionTable* host = nullptr;
+    };
+
+    /// Runs modules in the interpreter as soon as they are loaded, and compiles the functions and pipelines that get
+    /// hot to native code on a background thread. Nothing is handed to LLVM until the first promotion, so code that
+    /// never gets hot costs nothing beyond lowering to bytecode. Code that can't be compiled natively, such as
+    /// pipelines making async calls, stays interpreted.
+    class TieredEngine
+    {
+        /// Everything the tier table's promote callback and native code refer to. The tier table holds on to it, so
+        /// VMs that outlive the engine keep their native code, they just stop getting new promotions.
+        struct Shared
+        {
+            using Promotion = std::pair<TierTable::Kind, uint32_t>;
+
+            std::vector<BSModule> modules;
+            std::shared_ptr<const Program> program;
+            TieredOptions options;
+            /// Only touched by the compiler thread
+            std::unique_ptr<JITEngine> jit;
+
+            mutable std::mutex mutex;
+            std::condition_variable queueChanged;
+            std::deque<Promotion> queue;
+            bool compiling = false;
+            bool stopping = false;
+            std::vector<std::string> errors;
+            size_t promoted = 0;
+
+            void promote(TierTable::Kind kind, uint32_t index);
+            void compileLoop(TierTable& tiers);
+            std::expected<NativeRegisterFunction, std::string> compile(TierTable::Kind kind, uint32_t index);
+        };
+
+        std::shared_ptr<Shared> _shared;
+        std::shared_ptr<TierTable> _tiers;
+        std::thread _compiler;
+
+        TieredEngine(std::vector<BSModule> modules, std::shared_ptr<const Program> program, TieredOptions options);
+
+      public:
+        ~TieredEngine();
+        TieredEngine(const TieredEngine&) = delete;
+        TieredEngine& operator=(const TieredEngine&) = delete;
+
+        static std::expected<std::unique_ptr<TieredEngine>, std::string> create(std::vector<BSModule> modules,
+                                                                                TieredOptions options = {});
+
+        const std::shared_ptr<const Program>& program() const;
+        const std::shared_ptr<TierTable>& tierTable() const;
+
+        /// A VM sharing this engine's tier table, one is needed per thread. It may outlive the engine.
+        VM createVM(size_t stackSize = VM::defaultStackSize) const;
+
+        /// Blocks until every promotion requested so far has been compiled or has failed
+        void waitForCompiles();
+        /// Number of functions and pipelines running natively
+        size_t promotedCount() const;
+        /// Why promotions failed, the code in question stays interpreted
+        std::vector<std::string> errors() const;
+    };
+} // namespace BraneScript
+
+#endif
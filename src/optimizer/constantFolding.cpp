@@ -0,0 +1,326 @@
+#include "passes.h"
+
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+namespace BraneScript
+{
+    namespace
+    {
+        struct Constant
+        {
+            OpCode kind;
+            uint32_t bits;
+        };
+
+        bool returnsBool(OpCode op)
+        {
+            switch(op)
+            {
+                case OpCode::Eq:
+                case OpCode::Ne:
+                case OpCode::Gt:
+                case OpCode::Ge:
+                case OpCode::LogicNot:
+                case OpCode::LogicAnd:
+                case OpCode::LogicOr:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        template<class T>
+        std::optional<uint32_t> foldInt(OpCode op, T a, T b)
+        {
+            // Arithmetic is done unsigned so that overflow wraps the same way it does at runtime
+            uint32_t ua = (uint32_t)a;
+            uint32_t ub = (uint32_t)b;
+            switch(op)
+            {
+                case OpCode::Add:
+                    return ua + ub;
+                case OpCode::Sub:
+                    return ua - ub;
+                case OpCode::Mul:
+                    return ua * ub;
+                case OpCode::Div:
+                case OpCode::Mod:
+                    if(b == 0)
+                        return std::nullopt;
+                    if constexpr(std::is_signed_v<T>)
+                    {
+                        if(a == std::numeric_limits<T>::min() && b == -1)
+                            return std::nullopt;
+                    }
+                    return (uint32_t)(op == OpCode::Div ? a / b : a % b);
+                case OpCode::Eq:
+                    return a == b;
+                case OpCode::Ne:
+                    return a != b;
+                case OpCode::Gt:
+                    return a > b;
+                case OpCode::Ge:
+                    return a >= b;
+                case OpCode::LogicAnd:
+                    return a != 0 && b != 0;
+                case OpCode::LogicOr:
+                    return a != 0 || b != 0;
+                case OpCode::BitAnd:
+                    return ua & ub;
+                case OpCode::BitOr:
+                    return ua | ub;
+                case OpCode::BitXor:
+                    return ua ^ ub;
+                default:
+                    return std::nullopt;
+            }
+        }
+
+        std::optional<uint32_t> foldFloat(OpCode op, float a, float b)
+        {
+            switch(op)
+            {
+                case OpCode::Add:
+                    return std::bit_cast<uint32_t>(a + b);
+                case OpCode::Sub:
+                    return std::bit_cast<uint32_t>(a - b);
+                case OpCode::Mul:
+                    return std::bit_cast<uint32_t>(a * b);
+                case OpCode::Div:
+                    return std::bit_cast<uint32_t>(a / b);
+                case OpCode::Mod:
+                    return std::bit_cast<uint32_t>(std::fmod(a, b));
+                case OpCode::Eq:
+                    return a == b;
+                case OpCode::Ne:
+                    return a != b;
+                case OpCode::Gt:
+                    return a > b;
+                case OpCode::Ge:
+                    return a >= b;
+                case OpCode::LogicAnd:
+                    return a != 0.0f && b != 0.0f;
+                case OpCode::LogicOr:
+                    return a != 0.0f || b != 0.0f;
+                default:
+                    return std::nullopt;
+            }
+        }
+
+        std::optional<uint32_t> foldBinary(OpCode op, Constant a, Constant b)
+        {
+            if(a.kind != b.kind)
+                return std::nullopt;
+            switch(a.kind)
+            {
+                case OpCode::ConstI32:
+                    return foldInt<int32_t>(op, std::bit_cast<int32_t>(a.bits), std::bit_cast<int32_t>(b.bits));
+                case OpCode::ConstU32:
+                    return foldInt<uint32_t>(op, a.bits, b.bits);
+                case OpCode::ConstF32:
+                    return foldFloat(op, std::bit_cast<float>(a.bits), std::bit_cast<float>(b.bits));
+                default:
+                    return std::nullopt;
+            }
+        }
+
+        /// Returns the folded bits along with the kind of constant they are
+        std::optional<Constant> foldUnary(OpCode op, Constant in)
+        {
+            float f = std::bit_cast<float>(in.bits);
+            switch(op)
+            {
+                case OpCode::LogicNot:
+                    if(in.kind == OpCode::ConstF32)
+                        return Constant{in.kind, f == 0.0f};
+                    return Constant{in.kind, in.bits == 0};
+                case OpCode::BitNot:
+                    if(in.kind == OpCode::ConstF32)
+                        return std::nullopt;
+                    return Constant{in.kind, ~in.bits};
+                case OpCode::I32ToF32:
+                    if(in.kind != OpCode::ConstI32)
+                        return std::nullopt;
+                    return Constant{OpCode::ConstF32, std::bit_cast<uint32_t>((float)std::bit_cast<int32_t>(in.bits))};
+                case OpCode::U32ToF32:
+                    if(in.kind != OpCode::ConstU32)
+                        return std::nullopt;
+                    return Constant{OpCode::ConstF32, std::bit_cast<uint32_t>((float)in.bits)};
+                // Out of range float to int conversions are undefined, so only in range values are folded
+                case OpCode::F32ToI32:
+                    if(in.kind != OpCode::ConstF32 || !(f >= -2147483648.0f && f < 2147483648.0f))
+                        return std::nullopt;
+                    return Constant{OpCode::ConstI32, std::bit_cast<uint32_t>((int32_t)f)};
+                case OpCode::F32ToU32:
+                    if(in.kind != OpCode::ConstF32 || !(f > -1.0f && f < 4294967296.0f))
+                        return std::nullopt;
+                    return Constant{OpCode::ConstU32, (uint32_t)f};
+                default:
+                    return std::nullopt;
+            }
+        }
+
+        /// Booleans are stored as 0 or 1 in whatever type the operation writes
+        uint32_t boolBits(OpCode kind, uint32_t value)
+        {
+            if(kind == OpCode::ConstF32)
+                return std::bit_cast<uint32_t>(value ? 1.0f : 0.0f);
+            return value;
+        }
+
+        bool isCommutative(OpCode op)
+        {
+            switch(op)
+            {
+                case OpCode::Add:
+                case OpCode::Mul:
+                case OpCode::BitAnd:
+                case OpCode::BitOr:
+                case OpCode::BitXor:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        enum class Identity
+        {
+            None,
+            Left,
+            Zero
+        };
+
+        /// Integer identities where the right operand is the constant c
+        Identity constantIdentity(OpCode op, uint32_t c)
+        {
+            switch(op)
+            {
+                case OpCode::Add:
+                case OpCode::Sub:
+                case OpCode::BitOr:
+                case OpCode::BitXor:
+                    return c == 0 ? Identity::Left : Identity::None;
+                case OpCode::Mul:
+                    if(c == 0)
+                        return Identity::Zero;
+                    return c == 1 ? Identity::Left : Identity::None;
+                case OpCode::Div:
+                    return c == 1 ? Identity::Left : Identity::None;
+                case OpCode::BitAnd:
+                    return c == 0 ? Identity::Zero : Identity::None;
+                default:
+                    return Identity::None;
+            }
+        }
+
+        /// Integer identities where both operands are the same value
+        Identity sameOperandIdentity(OpCode op)
+        {
+            switch(op)
+            {
+                case OpCode::Sub:
+                case OpCode::BitXor:
+                    return Identity::Zero;
+                case OpCode::BitAnd:
+                case OpCode::BitOr:
+                    return Identity::Left;
+                default:
+                    return Identity::None;
+            }
+        }
+    } // namespace
+
+    std::string_view ConstantFolding::name() const { return "constant-folding"; }
+
+    bool ConstantFolding::run(CodeBody& body) const
+    {
+        std::vector<std::optional<Constant>> constants(body.localVars.size());
+        bool changed = false;
+
+        auto makeConst = [&](Instruction& inst, OpCode kind, uint32_t bits) {
+            inst = Instruction{kind, 0, 0, bits, 0, inst.c};
+            constants[inst.c] = Constant{kind, bits};
+            changed = true;
+        };
+        auto makeMov = [&](Instruction& inst, uint32_t src) {
+            inst = Instruction{OpCode::Mov, 0, 0, src, 0, inst.c};
+            constants[inst.c] = constants[src];
+            changed = true;
+        };
+
+        for(auto& inst : body.code.instructions)
+        {
+            if(isConstOp(inst.op))
+            {
+                constants[inst.c] = Constant{inst.op, inst.a};
+                continue;
+            }
+
+            auto outKind = isBinaryOp(inst.op) || isUnaryOp(inst.op) || inst.op == OpCode::Mov
+                               ? constOpFor(body.localVars[inst.c])
+                               : std::nullopt;
+            if(!outKind)
+                continue;
+
+            if(inst.op == OpCode::Mov)
+            {
+                if(constants[inst.a] && constants[inst.a]->kind == *outKind)
+                    makeConst(inst, *outKind, constants[inst.a]->bits);
+                continue;
+            }
+
+            auto& a = constants[inst.a];
+            if(isUnaryOp(inst.op))
+            {
+                if(!a)
+                    continue;
+                auto result = foldUnary(inst.op, *a);
+                if(!result)
+                    continue;
+                if(returnsBool(inst.op))
+                    makeConst(inst, *outKind, boolBits(*outKind, result->bits));
+                else if(result->kind == *outKind)
+                    makeConst(inst, *outKind, result->bits);
+                continue;
+            }
+
+            auto& b = constants[inst.b];
+            if(a && b)
+            {
+                auto result = foldBinary(inst.op, *a, *b);
+                if(!result)
+                    continue;
+                if(returnsBool(inst.op))
+                    makeConst(inst, *outKind, boolBits(*outKind, *result));
+                else if(a->kind == *outKind)
+                    makeConst(inst, *outKind, *result);
+                continue;
+            }
+
+            // Identities only hold for integers that have the same type as the result
+            if(*outKind == OpCode::ConstF32 || body.localVars[inst.a] != body.localVars[inst.c] ||
+               body.localVars[inst.b] != body.localVars[inst.c])
+                continue;
+
+            Identity identity = Identity::None;
+            uint32_t other = inst.a;
+            if(inst.a == inst.b)
+                identity = sameOperandIdentity(inst.op);
+            else if(b)
+                identity = constantIdentity(inst.op, b->bits);
+            else if(a && isCommutative(inst.op))
+            {
+                identity = constantIdentity(inst.op, a->bits);
+                other = inst.b;
+            }
+
+            if(identity == Identity::Left)
+                makeMov(inst, other);
+            else if(identity == Identity::Zero)
+                makeConst(inst, *outKind, 0);
+        }
+        return changed;
+    }
+} // namespace BraneScript
@@ -0,0 +1,50 @@
+#include "passes.h"
+#include "../ir/defUse.h"
+
+namespace BraneScript
+{
+    std::string_view CopyPropagation::name() const { return "copy-propagation"; }
+
+    bool CopyPropagation::run(CodeBody& body) const
+    {
+        auto& code = body.code;
+        size_t valueCount = body.localVars.size();
+
+        std::vector<bool> isOutput(valueCount, false);
+        for(auto output : body.outputs)
+            isOutput[output.id] = true;
+        DefUseChains chains(code, valueCount, body.outputs);
+
+        for(uint32_t i = 0; i < code.instructions.size(); ++i)
+        {
+            auto& inst = code.instructions[i];
+            if(inst.op != OpCode::Mov)
+                continue;
+            // Earlier copies have already pointed this one's source at the value they copied
+            uint32_t src = inst.a;
+            uint32_t dest = inst.c;
+            if(body.localVars[src] != body.localVars[dest])
+                continue;
+
+            if(!body.outputsPinned || !isOutput[dest])
+            {
+                chains.removeInstruction(i);
+                chains.replaceAllUses(dest, src);
+                continue;
+            }
+
+            // A pinned output can take over a value if nothing could observe the difference: the value must be
+            // computed in this body, the output must not have been read yet, and neither may already be spoken for
+            if(chains.definitions(src).empty() || isOutput[src] || chains.definingInstruction(dest) != i)
+                continue;
+            bool readBefore = false;
+            for(auto use : chains.uses(dest))
+                readBefore |= !use.isExternal() && use.instruction < i;
+            if(readBefore)
+                continue;
+            chains.removeInstruction(i);
+            chains.renameValue(src, dest);
+        }
+        return chains.compact();
+    }
+} // namespace BraneScript
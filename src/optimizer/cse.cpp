@@ -0,0 +1,78 @@
+#include "passes.h"
+
+#include <unordered_map>
+
+namespace BraneScript
+{
+    namespace
+    {
+        struct ExpressionKey
+        {
+            OpCode op;
+            uint32_t a;
+            uint32_t b;
+
+            bool operator==(const ExpressionKey&) const = default;
+        };
+
+        struct ExpressionKeyHash
+        {
+            size_t operator()(const ExpressionKey& key) const
+            {
+                uint64_t packed = ((uint64_t)key.a << 32) | key.b;
+                return std::hash<uint64_t>{}(packed * 31 + (uint64_t)key.op);
+            }
+        };
+
+        bool isCommutative(OpCode op)
+        {
+            switch(op)
+            {
+                case OpCode::Add:
+                case OpCode::Mul:
+                case OpCode::Eq:
+                case OpCode::Ne:
+                case OpCode::LogicAnd:
+                case OpCode::LogicOr:
+                case OpCode::BitAnd:
+                case OpCode::BitOr:
+                case OpCode::BitXor:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+    } // namespace
+
+    std::string_view CommonSubexpressionElimination::name() const { return "cse"; }
+
+    bool CommonSubexpressionElimination::run(CodeBody& body) const
+    {
+        // In SSA form an operand always holds the same value, so expressions are equal when their operands are
+        std::unordered_map<ExpressionKey, uint32_t, ExpressionKeyHash> available;
+        bool changed = false;
+        for(auto& inst : body.code.instructions)
+        {
+            ExpressionKey key{inst.op, inst.a, 0};
+            if(isBinaryOp(inst.op))
+            {
+                key.b = inst.b;
+                if(isCommutative(inst.op) && key.a > key.b)
+                    std::swap(key.a, key.b);
+            }
+            else if(!isUnaryOp(inst.op) && !isConstOp(inst.op))
+                continue;
+
+            TypeId outType = body.localVars[inst.c];
+            if(!TypeTable::baseType(outType))
+                continue;
+
+            auto [existing, inserted] = available.insert({key, inst.c});
+            if(inserted || body.localVars[existing->second] != outType)
+                continue;
+            inst = Instruction{OpCode::Mov, 0, 0, existing->second, 0, inst.c};
+            changed = true;
+        }
+        return changed;
+    }
+} // namespace BraneScript
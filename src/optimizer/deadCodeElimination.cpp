@@ -0,0 +1,67 @@
+#include "passes.h"
+#include "../ir/defUse.h"
+
+namespace BraneScript
+{
+    namespace
+    {
+        /// Loads trap on accesses out of bounds and integer division on a zero divisor or overflow, so those stay even
+        /// when their result is unused
+        bool mayTrap(const CodeBody& body, const DefUseChains& chains, const Instruction& inst)
+        {
+            if(inst.op == OpCode::Load)
+                return true;
+            if(inst.op != OpCode::Div && inst.op != OpCode::Mod)
+                return false;
+            auto type = TypeTable::baseType(body.localVars[inst.a]);
+            if(type == BSBaseType::F32 || type == BSBaseType::F64)
+                return false;
+            auto definition = chains.definingInstruction(inst.b);
+            if(!definition)
+                return true;
+            // -1 is excluded as well, the smallest signed value divided by it overflows
+            auto& divisor = body.code.instructions[*definition];
+            return !isConstOp(divisor.op) || divisor.a == 0 || divisor.a == UINT32_MAX;
+        }
+    } // namespace
+
+    std::string_view DeadCodeElimination::name() const { return "dce"; }
+
+    bool DeadCodeElimination::run(CodeBody& body) const
+    {
+        auto& code = body.code;
+        DefUseChains chains(code, body.localVars.size(), body.outputs);
+
+        // Removing an instruction can only make the values it read dead, so only their definitions are revisited
+        std::vector<uint32_t> worklist(code.instructions.size());
+        for(uint32_t i = 0; i < worklist.size(); ++i)
+            worklist[i] = (uint32_t)worklist.size() - 1 - i;
+        std::vector<uint32_t> read;
+        while(!worklist.empty())
+        {
+            uint32_t i = worklist.back();
+            worklist.pop_back();
+            if(chains.removed(i))
+                continue;
+            auto& inst = code.instructions[i];
+            if(inst.op == OpCode::Store || inst.op == OpCode::Call || mayTrap(body, chains, inst))
+                continue;
+            bool needed = false;
+            code.forEachDef(inst, [&](uint32_t& value) { needed |= !chains.unused(value); });
+            if(needed)
+                continue;
+
+            read.clear();
+            code.forEachUse(inst, [&](uint32_t& value) { read.push_back(value); });
+            chains.removeInstruction(i);
+            for(auto value : read)
+            {
+                if(!chains.unused(value))
+                    continue;
+                for(auto def : chains.definitions(value))
+                    worklist.push_back(def.instruction);
+            }
+        }
+        return chains.compact();
+    }
+} // namespace BraneScript
@@ -0,0 +1,417 @@
+#include "passes.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace BraneScript
+{
+    namespace
+    {
+        constexpr uint32_t unresolved = UINT32_MAX;
+
+        /// Every function of every module, numbered in module order the way Program::load numbers them
+        class CallGraph
+        {
+            std::span<BSModule> _modules;
+            std::unordered_map<std::string, uint32_t> _indices;
+
+          public:
+            std::vector<BSFunction*> functions;
+            std::vector<size_t> functionModules;
+            std::vector<uint32_t> moduleFirstFunction;
+            /// Functions that can reach themselves through calls
+            std::vector<bool> recursive;
+
+            explicit CallGraph(std::span<BSModule> modules) : _modules(modules)
+            {
+                for(size_t m = 0; m < modules.size(); ++m)
+                {
+                    moduleFirstFunction.push_back((uint32_t)functions.size());
+                    for(auto& function : modules[m].functions)
+                    {
+                        _indices.try_emplace(function->id, (uint32_t)functions.size());
+                        functions.push_back(function.get());
+                        functionModules.push_back(m);
+                    }
+                }
+                recursive.resize(functions.size(), false);
+            }
+
+            /// The function a call made from module resolves to, or unresolved for functions outside of the compile
+            uint32_t resolve(const IDRef& target, size_t module) const
+            {
+                if(auto* name = std::get_if<std::string>(&target))
+                {
+                    auto index = _indices.find(*name);
+                    return index == _indices.end() ? unresolved : index->second;
+                }
+                int32_t id = std::get<int32_t>(target);
+                if(auto* imported = importedSymbol(_modules[module], id))
+                    return resolve(*imported, module);
+                if(id <= 0 || (size_t)id > _modules[module].functions.size())
+                    return unresolved;
+                return moduleFirstFunction[module] + (uint32_t)(id - 1);
+            }
+
+            std::vector<uint32_t> callees(uint32_t function) const
+            {
+                std::vector<uint32_t> callees;
+                for(auto& target : functions[function]->operations.callTargets)
+                {
+                    uint32_t callee = resolve(target, functionModules[function]);
+                    if(callee != unresolved)
+                        callees.push_back(callee);
+                }
+                return callees;
+            }
+
+            /// Strongly connected components with callees ordered before their callers, marking recursive functions
+            std::vector<std::vector<uint32_t>> components()
+            {
+                // Iterative Tarjan, so deep call chains can't overflow the stack
+                constexpr uint32_t unvisited = UINT32_MAX;
+                std::vector<uint32_t> index(functions.size(), unvisited);
+                std::vector<uint32_t> lowLink(functions.size(), 0);
+                std::vector<bool> onStack(functions.size(), false);
+                std::vector<uint32_t> stack;
+                std::vector<std::vector<uint32_t>> components;
+                uint32_t nextIndex = 0;
+
+                struct Frame
+                {
+                    uint32_t function;
+                    std::vector<uint32_t> callees;
+                    size_t next = 0;
+                };
+
+                for(uint32_t root = 0; root < functions.size(); ++root)
+                {
+                    if(index[root] != unvisited)
+                        continue;
+                    std::vector<Frame> frames;
+                    auto visit = [&](uint32_t function) {
+                        index[function] = lowLink[function] = nextIndex++;
+                        stack.push_back(function);
+                        onStack[function] = true;
+                        frames.push_back({function, callees(function)});
+                    };
+                    visit(root);
+                    while(!frames.empty())
+                    {
+                        auto& frame = frames.back();
+                        uint32_t function = frame.function;
+                        if(frame.next < frame.callees.size())
+                        {
+                            uint32_t callee = frame.callees[frame.next++];
+                            if(callee == function)
+                                recursive[function] = true;
+                            if(index[callee] == unvisited)
+                                visit(callee);
+                            else if(onStack[callee])
+                                lowLink[function] = std::min(lowLink[function], index[callee]);
+                            continue;
+                        }
+
+                        frames.pop_back();
+                        if(!frames.empty())
+                        {
+                            uint32_t caller = frames.back().function;
+                            lowLink[caller] = std::min(lowLink[caller], lowLink[function]);
+                        }
+                        if(lowLink[function] != index[function])
+                            continue;
+                        auto& component = components.emplace_back();
+                        uint32_t member;
+                        do
+                        {
+                            member = stack.back();
+                            stack.pop_back();
+                            onStack[member] = false;
+                            component.push_back(member);
+                        } while(member != function);
+                        if(component.size() > 1)
+                        {
+                            for(auto m : component)
+                                recursive[m] = true;
+                        }
+                    }
+                }
+                return components;
+            }
+        };
+
+        /// Rewrites references to a module's structs and imports by index into references by name, so a type stays
+        /// valid when code is moved into another module. Returns nullopt if an index doesn't name a struct.
+        std::optional<BSType> portableType(const BSType& type, const BSModule& module)
+        {
+            if(auto* structType = std::get_if<IRNode<BSStructType>>(&type))
+            {
+                auto* id = std::get_if<int32_t>(&(*structType)->structId);
+                if(!id)
+                    return type;
+                if(auto* imported = importedSymbol(module, *id))
+                    return std::make_shared<BSStructType>(BSStructType{*imported});
+                if(*id <= 0 || (size_t)*id > module.structs.size())
+                    return std::nullopt;
+                return std::make_shared<BSStructType>(BSStructType{module.structs[*id - 1]->id});
+            }
+            if(auto* refType = std::get_if<IRNode<BSRefType>>(&type))
+            {
+                auto contained = portableType((*refType)->contained, module);
+                if(!contained)
+                    return std::nullopt;
+                return std::make_shared<BSRefType>(BSRefType{std::move(*contained), (*refType)->valueMutable});
+            }
+            return type;
+        }
+
+        /// A function's body prepared for copying into callers of another module. Struct types and calls by index
+        /// are rewritten to refer to their targets by name, and types are taken out of the callee's type table.
+        struct InlineBody
+        {
+            std::vector<BSType> localVars;
+            std::vector<IDRef> callTargets;
+        };
+
+        std::optional<InlineBody> portableBody(const BSFunction& function, const BSModule& module)
+        {
+            InlineBody body;
+            for(auto type : function.localVars)
+            {
+                auto portable = portableType(module.types.type(type), module);
+                if(!portable)
+                    return std::nullopt;
+                body.localVars.push_back(std::move(*portable));
+            }
+            for(auto& target : function.operations.callTargets)
+            {
+                auto* id = std::get_if<int32_t>(&target);
+                if(!id)
+                {
+                    body.callTargets.push_back(target);
+                    continue;
+                }
+                if(auto* imported = importedSymbol(module, *id))
+                    body.callTargets.push_back(*imported);
+                else if(*id <= 0 || (size_t)*id > module.functions.size())
+                    return std::nullopt;
+                else
+                    body.callTargets.push_back(module.functions[*id - 1]->id);
+            }
+            return body;
+        }
+
+        class Inliner
+        {
+            std::span<BSModule> _modules;
+            const InlineOptions& _options;
+            CallGraph& _graph;
+
+            uint64_t _profiledCalls = 0;
+
+            /// Values known to hold a constant at the current point of the body being rewritten
+            std::vector<bool> _constant;
+            /// Function or pipeline the body being rewritten belongs to, when the profile has counts for it
+            std::optional<std::string_view> _profiledCaller;
+            bool _callerIsPipeline = false;
+
+            bool inlinable(uint32_t callee, size_t callerModule, const Instruction& call) const
+            {
+                if(_graph.recursive[callee])
+                    return false;
+                auto& function = *_graph.functions[callee];
+                // Calls with the wrong number of arguments are left for Program::load to report
+                if(function.inputs.size() != call.count || function.outputs.size() != call.c ||
+                   function.localVars.size() < function.inputs.size() + function.outputs.size())
+                    return false;
+                size_t calleeModule = _graph.functionModules[callee];
+                return calleeModule == callerModule || portableBody(function, _modules[calleeModule]);
+            }
+
+            bool worthInlining(const InstructionList& caller, const Instruction& call, uint32_t callee) const
+            {
+                uint32_t threshold = _options.threshold;
+                if(_profiledCaller)
+                {
+                    auto& calleeId = _graph.functions[callee]->id;
+                    uint64_t calls = _callerIsPipeline ? _options.profile->pipelineCallCount(*_profiledCaller, calleeId)
+                                                       : _options.profile->callCount(*_profiledCaller, calleeId);
+                    if(!calls)
+                        return false;
+                    if((double)calls >= _options.hotCallFraction * (double)_profiledCalls)
+                        threshold *= _options.hotThresholdScale;
+                }
+
+                uint32_t benefit = _options.callOverhead + call.count + call.c;
+                for(auto input : caller.callInputs(call))
+                {
+                    if(_constant[input])
+                        benefit += _options.constantArgumentBonus;
+                }
+                return inlineSize(_graph.functions[callee]->operations) <= threshold + benefit;
+            }
+
+            void splice(InstructionList& code,
+                        std::vector<TypeId>& localVars,
+                        const InstructionList& caller,
+                        const Instruction& call,
+                        uint32_t callee,
+                        size_t callerModule)
+            {
+                auto& function = *_graph.functions[callee];
+                size_t calleeModule = _graph.functionModules[callee];
+                std::optional<InlineBody> portable;
+                if(calleeModule != callerModule)
+                    portable = portableBody(function, _modules[calleeModule]);
+
+                auto offset = (uint32_t)localVars.size();
+                if(portable)
+                {
+                    auto& types = _modules[callerModule].types;
+                    for(auto& type : portable->localVars)
+                        localVars.push_back(types.intern(type));
+                }
+                else
+                    localVars.insert(localVars.end(), function.localVars.begin(), function.localVars.end());
+                _constant.resize(localVars.size(), false);
+
+                auto inputCount = (uint32_t)function.inputs.size();
+                auto inputs = caller.callInputs(call);
+                for(uint32_t i = 0; i < inputCount; ++i)
+                    code.mov({inputs[i]}, {offset + i});
+
+                auto& calleeCode = function.operations;
+                for(auto inst : calleeCode.instructions)
+                {
+                    if(inst.op == OpCode::Call)
+                    {
+                        auto operands = std::span<const uint32_t>(calleeCode.callOperands)
+                                            .subspan(inst.b, inst.count + inst.c);
+                        auto& targets = portable ? portable->callTargets : calleeCode.callTargets;
+                        code.callTargets.push_back(targets[inst.a]);
+                        inst.a = (uint32_t)code.callTargets.size() - 1;
+                        inst.b = (uint32_t)code.callOperands.size();
+                        for(uint32_t operand : operands)
+                            code.callOperands.push_back(operand + offset);
+                    }
+                    else
+                    {
+                        code.forEachUse(inst, [&](uint32_t& value) { value += offset; });
+                        code.forEachDef(inst, [&](uint32_t& value) { value += offset; });
+                    }
+                    code.instructions.push_back(inst);
+                }
+
+                auto outputs = caller.callOutputs(call);
+                for(uint32_t i = 0; i < outputs.size(); ++i)
+                    code.mov({offset + inputCount + i}, {outputs[i]});
+            }
+
+          public:
+            Inliner(std::span<BSModule> modules, const InlineOptions& options, CallGraph& graph)
+                : _modules(modules), _options(options), _graph(graph)
+            {
+                if(options.profile)
+                    _profiledCalls = options.profile->totalCalls();
+            }
+
+            /// Sets which function or pipeline the following bodies belong to, for looking them up in the profile
+            void setCaller(std::string_view id, bool pipeline)
+            {
+                _callerIsPipeline = pipeline;
+                _profiledCaller.reset();
+                auto* profile = _options.profile;
+                if(!profile)
+                    return;
+                if(pipeline ? profile->pipelineInvocations(id) != 0 : profile->functions.contains(std::string(id)))
+                    _profiledCaller = id;
+            }
+
+            /// Inlines every call of a body that the cost model accepts
+            bool run(std::vector<TypeId>& localVars, InstructionList& caller, size_t module)
+            {
+                _constant.assign(localVars.size(), false);
+                InstructionList code;
+                bool changed = false;
+                for(auto inst : caller.instructions)
+                {
+                    if(inst.op != OpCode::Call)
+                    {
+                        code.instructions.push_back(inst);
+                        bool constant = inst.op == OpCode::ConstI32 || inst.op == OpCode::ConstU32 ||
+                                        inst.op == OpCode::ConstF32;
+                        caller.forEachDef(inst, [&](uint32_t& value) { _constant[value] = constant; });
+                        continue;
+                    }
+
+                    uint32_t callee = _graph.resolve(caller.callTarget(inst), module);
+                    if(callee != unresolved && code.size() < _options.maxBodySize &&
+                       inlinable(callee, module, inst) && worthInlining(caller, inst, callee))
+                    {
+                        splice(code, localVars, caller, inst, callee, module);
+                        changed = true;
+                    }
+                    else
+                    {
+                        auto operands =
+                            std::span<const uint32_t>(caller.callOperands).subspan(inst.b, inst.count + inst.c);
+                        code.callTargets.push_back(caller.callTargets[inst.a]);
+                        inst.a = (uint32_t)code.callTargets.size() - 1;
+                        inst.b = (uint32_t)code.callOperands.size();
+                        code.callOperands.insert(code.callOperands.end(), operands.begin(), operands.end());
+                        code.instructions.push_back(inst);
+                    }
+                    caller.forEachDef(inst, [&](uint32_t& value) { _constant[value] = false; });
+                }
+                if(changed)
+                    caller = std::move(code);
+                return changed;
+            }
+        };
+    } // namespace
+
+    uint32_t inlineSize(const InstructionList& code)
+    {
+        // Calls are weighted by their operands, as each one is a copy into or out of the callee's frame
+        auto size = (uint32_t)code.size();
+        for(auto& inst : code.instructions)
+        {
+            if(inst.op == OpCode::Call)
+                size += inst.count + inst.c;
+        }
+        return size;
+    }
+
+    bool inlineCalls(std::span<BSModule> modules, const InlineOptions& options)
+    {
+        CallGraph graph(modules);
+        Inliner inliner(modules, options, graph);
+        bool changed = false;
+
+        // Callees are finished before their callers, so code is only ever copied once it has had its own calls
+        // inlined. Members of a component with more than one function call each other recursively and are never
+        // inlined, so the order within a component doesn't matter.
+        for(auto& component : graph.components())
+        {
+            for(auto member : component)
+            {
+                auto& function = *graph.functions[member];
+                inliner.setCaller(function.id, false);
+                changed |= inliner.run(function.localVars, function.operations, graph.functionModules[member]);
+            }
+        }
+
+        for(size_t m = 0; m < modules.size(); ++m)
+        {
+            for(auto& pipeline : modules[m].pipelines)
+            {
+                if(!pipeline->stages)
+                    continue;
+                inliner.setCaller(pipeline->id, true);
+                for(auto& stage : *pipeline->stages)
+                    changed |= inliner.run(stage.localVars, stage.operations, m);
+            }
+        }
+        return changed;
+    }
+} // namespace BraneScript
@@ -0,0 +1,131 @@
+#include "passManager.h"
+
+#include <cassert>
+#include "passes.h"
+#include "slotAllocator.h"
+
+namespace BraneScript
+{
+    PassManager PassManager::defaultPipeline()
+    {
+        PassManager manager;
+        manager.addPass<ConstantFolding>();
+        manager.addPass<CommonSubexpressionElimination>();
+        manager.addPass<CopyPropagation>();
+        manager.addPass<DeadCodeElimination>();
+        return manager;
+    }
+
+    void PassManager::addPass(std::unique_ptr<OptimizationPass> pass) { _passes.push_back(std::move(pass)); }
+
+    void PassManager::setMaxIterations(size_t iterations) { _maxIterations = iterations; }
+
+    void PassManager::setAllocateSlots(bool allocate) { _allocateSlots = allocate; }
+
+    void PassManager::setFuseStages(bool fuse) { _fuseStages = fuse; }
+
+    void PassManager::setInlineThreshold(std::optional<uint32_t> threshold) { _inlineThreshold = threshold; }
+
+    void PassManager::setProfile(const ProfileData* profile) { _profile = profile; }
+
+    bool PassManager::run(CodeBody& body) const
+    {
+        bool changed = buildSSA(body);
+        for(size_t i = 0; i < _maxIterations; ++i)
+        {
+            bool iterationChanged = false;
+            for(auto& pass : _passes)
+                iterationChanged |= pass->run(body);
+            changed |= iterationChanged;
+            if(!iterationChanged)
+                break;
+        }
+        changed |= _allocateSlots ? assignSlots(body) : compactLocals(body);
+        return changed;
+    }
+
+    bool PassManager::run(BSFunction& function) const
+    {
+        uint32_t inputCount = (uint32_t)function.inputs.size();
+        uint32_t outputCount = (uint32_t)function.outputs.size();
+        assert(function.localVars.size() >= inputCount + outputCount && "Function is missing input or output vars");
+
+        CodeBody body{function.localVars, function.operations, inputCount, {}, true};
+        for(uint32_t i = 0; i < outputCount; ++i)
+            body.outputs.push_back({inputCount + i});
+        return run(body);
+    }
+
+    bool PassManager::run(BSPipeline& pipeline) const { return run(pipeline, nullptr); }
+
+    bool PassManager::run(BSPipeline& pipeline, const BSModule* module) const
+    {
+        if(!pipeline.stages)
+            return false;
+
+        bool changed = _fuseStages && fuseStages(pipeline, module);
+        auto& stages = *pipeline.stages;
+        for(size_t i = 0; i < stages.size(); ++i)
+        {
+            auto& stage = stages[i];
+            uint32_t inputCount = i == 0 ? (uint32_t)pipeline.inputs.size() : passedValueCount(stages[i - 1]);
+            // Async calls read their inputs after the stage has run, so those are outputs of the body as well
+            CodeBody body{stage.localVars, stage.operations, inputCount, stage.outputs};
+            for(auto& op : stage.asyncOps)
+            {
+                auto& inputs = std::get<BSAsyncCall>(op).inputs;
+                body.outputs.insert(body.outputs.end(), inputs.begin(), inputs.end());
+            }
+            changed |= run(body);
+
+            auto output = body.outputs.begin() + (ptrdiff_t)stage.outputs.size();
+            stage.outputs.assign(body.outputs.begin(), output);
+            for(auto& op : stage.asyncOps)
+            {
+                for(auto& input : std::get<BSAsyncCall>(op).inputs)
+                    input = *output++;
+            }
+        }
+        return changed;
+    }
+
+    bool PassManager::run(BSModule& module) const { return run(std::span<BSModule>(&module, 1)); }
+
+    bool PassManager::run(std::span<BSModule> modules) const
+    {
+        bool changed = false;
+        if(_inlineThreshold)
+        {
+            InlineOptions options;
+            options.threshold = *_inlineThreshold;
+            options.profile = _profile;
+            changed |= inlineCalls(modules, options);
+        }
+        for(auto& module : modules)
+        {
+            for(auto& function : module.functions)
+                changed |= run(*function);
+            for(auto& pipeline : module.pipelines)
+                changed |= run(*pipeline, &module);
+        }
+        return changed;
+    }
+
+    std::optional<OpCode> constOpFor(TypeId type)
+    {
+        auto base = TypeTable::baseType(type);
+        if(!base)
+            return std::nullopt;
+        switch(*base)
+        {
+            case BSBaseType::I32:
+                return OpCode::ConstI32;
+            case BSBaseType::U32:
+                return OpCode::ConstU32;
+            case BSBaseType::F32:
+                return OpCode::ConstF32;
+            default:
+                return std::nullopt;
+        }
+    }
+} // namespace BraneScript
@@ -0,0 +1,97 @@
+#ifndef BRANESCRIPT_PASSMANAGER_H
+#define BRANESCRIPT_PASSMANAGER_H
+
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+#include "../ir/ir.h"
+#include "../ir/profileData.h"
+
+namespace BraneScript
+{
+    /// The code of a function or pipeline stage as seen by optimization passes
+    struct CodeBody
+    {
+        std::vector<TypeId>& localVars;
+        InstructionList& code;
+        /// The first inputCount local vars are set before the body runs
+        uint32_t inputCount = 0;
+        /// Values read after the body has run
+        std::vector<IRValue> outputs;
+        /// Function outputs live in fixed local vars, so passes may not move them to other values. Stage outputs are
+        /// a list of values, which passes may rewrite freely.
+        bool outputsPinned = false;
+    };
+
+    class OptimizationPass
+    {
+      public:
+        virtual ~OptimizationPass() = default;
+        virtual std::string_view name() const = 0;
+        /// Bodies are always in SSA form when passed to a pass, and must be left that way. Returns true if anything
+        /// was changed.
+        virtual bool run(CodeBody& body) const = 0;
+    };
+
+    /// Runs a list of passes over every function and pipeline stage of a module, repeating the list until no pass
+    /// makes any further changes. Calls worth inlining are inlined and adjacent pipeline stages fused first, and
+    /// afterwards values are packed into as few local vars as their lifetimes allow.
+    class PassManager
+    {
+        std::vector<std::unique_ptr<OptimizationPass>> _passes;
+        size_t _maxIterations = 8;
+        bool _allocateSlots = true;
+        bool _fuseStages = true;
+        std::optional<uint32_t> _inlineThreshold = 16;
+        const ProfileData* _profile = nullptr;
+
+        bool run(BSPipeline& pipeline, const BSModule* module) const;
+
+      public:
+        PassManager() = default;
+        PassManager(PassManager&&) = default;
+        PassManager& operator=(PassManager&&) = default;
+
+        /// Constant folding, common subexpression elimination, copy propagation and dead code elimination
+        static PassManager defaultPipeline();
+
+        void addPass(std::unique_ptr<OptimizationPass> pass);
+
+        template<class T, class... Args>
+        void addPass(Args&&... args)
+        {
+            addPass(std::make_unique<T>(std::forward<Args>(args)...));
+        }
+
+        /// Upper bound on how many times the pass list is repeated per body
+        void setMaxIterations(size_t iterations);
+
+        /// When disabled bodies are left in SSA form, with only unreferenced local vars removed
+        void setAllocateSlots(bool allocate);
+
+        /// When disabled every pipeline stage is optimized on its own, see fuseStages
+        void setFuseStages(bool fuse);
+
+        /// Inlining threshold used when whole modules are optimized, see InlineOptions. nullopt disables inlining.
+        void setInlineThreshold(std::optional<uint32_t> threshold);
+
+        /// Counters from a profiled run that guide inlining, see InlineOptions::profile. Null to compile without
+        /// them. The profile must outlive any runs.
+        void setProfile(const ProfileData* profile);
+
+        bool run(CodeBody& body) const;
+        bool run(BSFunction& function) const;
+        /// Stages calling functions by name are never fused, as they may be external to the pipeline's module
+        bool run(BSPipeline& pipeline) const;
+        bool run(BSModule& module) const;
+        /// Optimizes modules compiled together, calls between them may be inlined
+        bool run(std::span<BSModule> modules) const;
+    };
+
+    /// The op code of constants that can hold values of a type, if there is one
+    std::optional<OpCode> constOpFor(TypeId type);
+} // namespace BraneScript
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef BRANESCRIPT_PASSES_H
+#define BRANESCRIPT_PASSES_H
+
+#include "passManager.h"
+
+namespace BraneScript
+{
+    /// Rewrite a body so that every value is written at most once. Since bodies have no control flow this is a
+    /// single renaming sweep without any phi nodes. The last write of a value keeps its id where possible, so pinned
+    /// outputs usually need no extra copies. Returns true if any value was renamed.
+    bool buildSSA(CodeBody& body);
+
+    /// Renumber local vars so that values no instruction or output references are dropped. Inputs and pinned outputs
+    /// keep their ids.
+    bool compactLocals(CodeBody& body);
+
+    /// Merges adjacent pipeline stages where nothing has to happen between them: the earlier stage starts no async
+    /// operations and neither stage calls a function outside of module. Values held from one stage to the next become
+    /// copies that copy propagation removes, so they stay in registers instead of being passed between frames. Every
+    /// call by name counts as external when module is null. Returns true if any stages were merged.
+    bool fuseStages(BSPipeline& pipeline, const BSModule* module);
+
+    /// Tuning for inlineCalls. A call is inlined when the callee's inlineSize is at most threshold plus the benefit of
+    /// inlining it: callOverhead, one for each argument and result that no longer has to be copied between frames,
+    /// and constantArgumentBonus for each argument that is a constant the callee's code could be folded with.
+    struct InlineOptions
+    {
+        uint32_t threshold = 16;
+        uint32_t callOverhead = 8;
+        uint32_t constantArgumentBonus = 4;
+        /// Calls are no longer inlined into a body once it has grown to this many instructions
+        uint32_t maxBodySize = 4096;
+        /// Counters from a profiled run. Calls from a function or pipeline that ran but never made them are left out
+        /// of line, and calls that make up at least hotCallFraction of every call made have their threshold scaled by
+        /// hotThresholdScale. Functions and pipelines that never ran use the static model.
+        const ProfileData* profile = nullptr;
+        double hotCallFraction = 0.01;
+        uint32_t hotThresholdScale = 4;
+    };
+
+    /// Size of a body for the inlining cost model, its instruction count with calls weighted by their operands
+    uint32_t inlineSize(const InstructionList& code);
+
+    /// Replaces calls to functions of any of the modules with a copy of the function's body, wherever the cost model
+    /// in options finds it worthwhile. Functions are processed callees first so small helpers are inlined into each
+    /// other before being inlined into their callers, and functions that can reach themselves through calls are
+    /// never inlined. Code copied into another module refers to structs and functions by name. Functions are kept
+    /// even once every call to them has been inlined, since the host may call them. Returns true if any call was
+    /// inlined.
+    bool inlineCalls(std::span<BSModule> modules, const InlineOptions& options = {});
+
+    /// Evaluates operations on 32 bit constants at compile time, and simplifies integer identities such as x + 0
+    /// or x ^ x. Division by zero and other operations that trap or are undefined at runtime are left alone.
+    class ConstantFolding : public OptimizationPass
+    {
+      public:
+        std::string_view name() const override;
+        bool run(CodeBody& body) const override;
+    };
+
+    /// Replaces repeated pure operations on the same operands with a copy of the first result
+    class CommonSubexpressionElimination : public OptimizationPass
+    {
+      public:
+        std::string_view name() const override;
+        bool run(CodeBody& body) const override;
+    };
+
+    /// Removes copies by pointing their uses at the copied value. Copies into pinned outputs are removed by having
+    /// the instruction that computed the value write the output directly.
+    class CopyPropagation : public OptimizationPass
+    {
+      public:
+        std::string_view name() const override;
+        bool run(CodeBody& body) const override;
+    };
+
+    /// Removes instructions whose results are never read. Stores, calls and operations that may trap are always kept.
+    class DeadCodeElimination : public OptimizationPass
+    {
+      public:
+        std::string_view name() const override;
+        bool run(CodeBody& body) const override;
+    };
+} // namespace BraneScript
+
+#endif
@@ -0,0 +1,132 @@
+#include "slotAllocator.h"
+
+#include <algorithm>
+#include <queue>
+
+namespace BraneScript
+{
+    std::vector<LiveInterval> computeLiveIntervals(CodeBody& body)
+    {
+        constexpr uint32_t unset = UINT32_MAX;
+        auto& code = body.code;
+        size_t valueCount = body.localVars.size();
+        std::vector<LiveInterval> intervals(valueCount);
+        for(uint32_t i = 0; i < valueCount; ++i)
+            intervals[i] = {i, unset, 0};
+
+        auto touch = [&](uint32_t value, uint32_t point) {
+            auto& interval = intervals[value];
+            interval.start = std::min(interval.start, point);
+            interval.end = std::max(interval.end, point);
+        };
+        for(uint32_t i = 0; i < body.inputCount; ++i)
+            touch(i, entryPoint());
+        for(size_t i = 0; i < code.instructions.size(); ++i)
+        {
+            auto& inst = code.instructions[i];
+            code.forEachUse(inst, [&](uint32_t& value) {
+                // Reading a value that hasn't been written yet reads whatever it held on entry
+                if(intervals[value].start == unset)
+                    touch(value, entryPoint());
+                touch(value, usePoint(i));
+            });
+            code.forEachDef(inst, [&](uint32_t& value) { touch(value, defPoint(i)); });
+        }
+        uint32_t exit = exitPoint(code.instructions.size());
+        for(auto output : body.outputs)
+        {
+            if(intervals[output.id].start == unset)
+                touch(output.id, entryPoint());
+            touch(output.id, exit);
+        }
+
+        std::erase_if(intervals, [](const LiveInterval& interval) { return interval.start == unset; });
+        std::stable_sort(
+            intervals.begin(), intervals.end(), [](auto& a, auto& b) { return a.start < b.start; });
+        return intervals;
+    }
+
+    SlotAssignment allocateSlots(CodeBody& body)
+    {
+        constexpr uint32_t unassigned = UINT32_MAX;
+        SlotAssignment assignment;
+        assignment.valueSlots.assign(body.localVars.size(), unassigned);
+
+        // Inputs and pinned outputs are precoloured to their own ids
+        uint32_t fixedCount = body.inputCount;
+        if(body.outputsPinned)
+        {
+            for(auto output : body.outputs)
+                fixedCount = std::max(fixedCount, output.id + 1);
+        }
+        for(uint32_t i = 0; i < fixedCount; ++i)
+        {
+            assignment.valueSlots[i] = i;
+            assignment.slotTypes.push_back(body.localVars[i]);
+        }
+
+        // Free slots are pooled by type, types are interned so a slot's pool is found by indexing with its type id
+        std::vector<std::vector<uint32_t>> freeSlots;
+        auto release = [&](uint32_t slot) {
+            auto pool = (size_t)assignment.slotTypes[slot];
+            if(pool >= freeSlots.size())
+                freeSlots.resize(pool + 1);
+            freeSlots[pool].push_back(slot);
+        };
+        auto acquire = [&](TypeId type) {
+            auto pool = (size_t)type;
+            if(pool < freeSlots.size() && !freeSlots[pool].empty())
+            {
+                uint32_t slot = freeSlots[pool].back();
+                freeSlots[pool].pop_back();
+                return slot;
+            }
+            assignment.slotTypes.push_back(type);
+            return (uint32_t)assignment.slotTypes.size() - 1;
+        };
+
+        // Active intervals ordered by end, so expired ones can be released in order
+        using Active = std::pair<uint32_t, uint32_t>;
+        std::priority_queue<Active, std::vector<Active>, std::greater<>> active;
+        for(auto& interval : computeLiveIntervals(body))
+        {
+            while(!active.empty() && active.top().first < interval.start)
+            {
+                release(active.top().second);
+                active.pop();
+            }
+
+            if(interval.value < fixedCount)
+            {
+                // Pinned output slots stay reserved for the whole body, inputs can be reused once they are dead
+                if(interval.value < body.inputCount)
+                    active.push({interval.end, interval.value});
+                continue;
+            }
+            uint32_t slot = acquire(body.localVars[interval.value]);
+            assignment.valueSlots[interval.value] = slot;
+            active.push({interval.end, slot});
+        }
+        return assignment;
+    }
+
+    bool assignSlots(CodeBody& body)
+    {
+        auto assignment = allocateSlots(body);
+        bool changed = assignment.slotTypes.size() != body.localVars.size();
+        auto rename = [&](uint32_t& value) {
+            uint32_t slot = assignment.valueSlots[value];
+            changed |= slot != value;
+            value = slot;
+        };
+        for(auto& inst : body.code.instructions)
+        {
+            body.code.forEachUse(inst, rename);
+            body.code.forEachDef(inst, rename);
+        }
+        for(auto& output : body.outputs)
+            rename(output.id);
+        body.localVars = std::move(assignment.slotTypes);
+        return changed;
+    }
+} // namespace BraneScript
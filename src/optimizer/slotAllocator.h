@@ -0,0 +1,49 @@
+#ifndef BRANESCRIPT_SLOTALLOCATOR_H
+#define BRANESCRIPT_SLOTALLOCATOR_H
+
+#include <cstdint>
+#include <vector>
+#include "passManager.h"
+
+namespace BraneScript
+{
+    /// Range of program points over which a value has to be kept. Instruction i reads its operands at point 2i + 1
+    /// and writes its results at 2i + 2, point 0 is entry and 2n + 1 is exit.
+    struct LiveInterval
+    {
+        uint32_t value;
+        uint32_t start;
+        uint32_t end;
+    };
+
+    inline uint32_t entryPoint() { return 0; }
+
+    inline uint32_t usePoint(size_t instruction) { return (uint32_t)(2 * instruction + 1); }
+
+    inline uint32_t defPoint(size_t instruction) { return (uint32_t)(2 * instruction + 2); }
+
+    inline uint32_t exitPoint(size_t instructionCount) { return (uint32_t)(2 * instructionCount + 1); }
+
+    /// Live intervals of every value that is referenced by the body, sorted by start. Code has no control flow, so a
+    /// value is live from its first write, or from entry if it is read before being written, up to its last access.
+    std::vector<LiveInterval> computeLiveIntervals(CodeBody& body);
+
+    struct SlotAssignment
+    {
+        /// Slot of every value, or UINT32_MAX for values that are never referenced
+        std::vector<uint32_t> valueSlots;
+        std::vector<TypeId> slotTypes;
+    };
+
+    /// Linear scan allocation of values to frame slots. Values of the same type whose intervals don't overlap share a
+    /// slot, so a result may land in the slot of an operand that dies at the same instruction; executors must read
+    /// every operand of an instruction before writing its results. Inputs and pinned outputs keep their ids, input
+    /// slots are reused once the input is dead.
+    SlotAssignment allocateSlots(CodeBody& body);
+
+    /// Rewrite a body to use the slots from allocateSlots, so that its local vars become its frame layout. This
+    /// takes the body out of SSA form, so it should be the last thing done to it. Returns true if anything changed.
+    bool assignSlots(CodeBody& body);
+} // namespace BraneScript
+
+#endif
@@ -0,0 +1,106 @@
+#include "passes.h"
+
+namespace BraneScript
+{
+    bool buildSSA(CodeBody& body)
+    {
+        auto& code = body.code;
+        size_t valueCount = body.localVars.size();
+
+        // Values that are read before the body writes them, inputs included, hold whatever they were on entry. Every
+        // write to them has to go to a new value, otherwise the last write of a value can keep its id.
+        std::vector<uint32_t> writesLeft(valueCount, 0);
+        std::vector<bool> readOnEntry(valueCount, false);
+        for(uint32_t i = 0; i < body.inputCount; ++i)
+            readOnEntry[i] = true;
+        for(auto& inst : code.instructions)
+        {
+            code.forEachUse(inst, [&](uint32_t& value) {
+                if(writesLeft[value] == 0)
+                    readOnEntry[value] = true;
+            });
+            code.forEachDef(inst, [&](uint32_t& value) { writesLeft[value]++; });
+        }
+
+        bool changed = false;
+        std::vector<uint32_t> current(valueCount);
+        for(uint32_t i = 0; i < valueCount; ++i)
+            current[i] = i;
+        for(auto& inst : code.instructions)
+        {
+            code.forEachUse(inst, [&](uint32_t& value) { value = current[value]; });
+            code.forEachDef(inst, [&](uint32_t& value) {
+                uint32_t original = value;
+                if(--writesLeft[original] == 0 && !readOnEntry[original])
+                {
+                    current[original] = original;
+                    return;
+                }
+                body.localVars.push_back(body.localVars[original]);
+                value = (uint32_t)body.localVars.size() - 1;
+                current[original] = value;
+                changed = true;
+            });
+        }
+
+        for(auto& output : body.outputs)
+        {
+            if(current[output.id] == output.id)
+                continue;
+            if(body.outputsPinned)
+            {
+                code.mov({current[output.id]}, output);
+                changed = true;
+            }
+            else
+                output.id = current[output.id];
+        }
+        return changed;
+    }
+
+    bool compactLocals(CodeBody& body)
+    {
+        auto& code = body.code;
+        size_t valueCount = body.localVars.size();
+        std::vector<bool> referenced(valueCount, false);
+        for(uint32_t i = 0; i < body.inputCount; ++i)
+            referenced[i] = true;
+        if(body.outputsPinned)
+        {
+            for(auto output : body.outputs)
+                referenced[output.id] = true;
+        }
+        auto mark = [&](uint32_t& value) { referenced[value] = true; };
+        for(auto& inst : code.instructions)
+        {
+            code.forEachUse(inst, mark);
+            code.forEachDef(inst, mark);
+        }
+        for(auto output : body.outputs)
+            referenced[output.id] = true;
+
+        // Pinned ids always form the prefix, so keeping relative order leaves them where they are
+        std::vector<uint32_t> remap(valueCount, UINT32_MAX);
+        std::vector<TypeId> localVars;
+        for(uint32_t i = 0; i < valueCount; ++i)
+        {
+            if(!referenced[i])
+                continue;
+            remap[i] = (uint32_t)localVars.size();
+            localVars.push_back(body.localVars[i]);
+        }
+        if(localVars.size() == valueCount)
+            return false;
+
+        auto rename = [&](uint32_t& value) { value = remap[value]; };
+        for(auto& inst : code.instructions)
+        {
+            code.forEachUse(inst, rename);
+            code.forEachDef(inst, rename);
+        }
+        for(auto& output : body.outputs)
+            output.id = remap[output.id];
+        body.localVars = std::move(localVars);
+        return true;
+    }
+} // namespace BraneScript
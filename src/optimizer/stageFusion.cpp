@@ -0,0 +1,92 @@
+#include "passes.h"
+
+#include <algorithm>
+
+namespace BraneScript
+{
+    namespace
+    {
+        bool callsExternal(const BSPipelineStage& stage, const BSModule* module)
+        {
+            for(auto& target : stage.operations.callTargets)
+            {
+                if(auto* id = std::get_if<int32_t>(&target))
+                {
+                    if(*id <= 0)
+                        return true;
+                    continue;
+                }
+                auto& name = std::get<std::string>(target);
+                if(!module || std::none_of(module->functions.begin(),
+                                           module->functions.end(),
+                                           [&](const auto& function) { return function->id == name; }))
+                    return true;
+            }
+            return false;
+        }
+
+        /// Appends next to stage. The values next receives become copies of the ones stage passes on.
+        void fuse(BSPipelineStage& stage, BSPipelineStage& next)
+        {
+            auto offset = (uint32_t)stage.localVars.size();
+            auto& code = stage.operations;
+            stage.localVars.insert(stage.localVars.end(), next.localVars.begin(), next.localVars.end());
+            for(uint32_t i = 0; i < stage.outputs.size() && i < next.localVars.size(); ++i)
+                code.mov(stage.outputs[i], {offset + i});
+
+            for(auto inst : next.operations.instructions)
+            {
+                if(inst.op == OpCode::Call)
+                {
+                    auto operands =
+                        std::span<const uint32_t>(next.operations.callOperands).subspan(inst.b, inst.count + inst.c);
+                    code.callTargets.push_back(std::move(next.operations.callTargets[inst.a]));
+                    inst.a = (uint32_t)code.callTargets.size() - 1;
+                    inst.b = (uint32_t)code.callOperands.size();
+                    for(uint32_t operand : operands)
+                        code.callOperands.push_back(operand + offset);
+                }
+                else
+                {
+                    code.forEachUse(inst, [&](uint32_t& value) { value += offset; });
+                    code.forEachDef(inst, [&](uint32_t& value) { value += offset; });
+                }
+                code.instructions.push_back(inst);
+            }
+
+            stage.outputs.clear();
+            for(auto output : next.outputs)
+                stage.outputs.push_back({output.id + offset});
+            for(auto& op : next.asyncOps)
+            {
+                auto& call = std::get<BSAsyncCall>(op);
+                for(auto& input : call.inputs)
+                    input.id += offset;
+                stage.asyncOps.push_back(std::move(call));
+            }
+        }
+    } // namespace
+
+    bool fuseStages(BSPipeline& pipeline, const BSModule* module)
+    {
+        if(!pipeline.stages || pipeline.stages->size() < 2)
+            return false;
+
+        auto& stages = *pipeline.stages;
+        std::vector<BSPipelineStage> fused;
+        fused.push_back(std::move(stages.front()));
+        for(size_t i = 1; i < stages.size(); ++i)
+        {
+            auto& last = fused.back();
+            // Async operations complete and external calls return at stage boundaries, so those have to stay
+            if(!last.asyncOps.empty() || callsExternal(last, module) || callsExternal(stages[i], module))
+                fused.push_back(std::move(stages[i]));
+            else
+                fuse(last, stages[i]);
+        }
+
+        bool changed = fused.size() != stages.size();
+        stages = std::move(fused);
+        return changed;
+    }
+} // namespace BraneScript
@@ -7,8 +7,10 @@
 #include <cassert>
 #include <charconv>
 #include <expected>
+#include <format>
 #include <functional>
 #include <iostream>
+#include <list>
 #include <memory>
 #include <stack>
 #include "parser/documentContext.h"
@@ -283,7 +285,6 @@ namespace BraneScript
     {
         std::filesystem::path path;
         std::string_view source;
-        std::shared_ptr<BraneScriptParser> parser;
         std::vector<ParserMessage> messages;
         TSTree* tree;
 
@@ -950,7 +951,7 @@ namespace BraneScript
 
         ParserResult<DocumentContext> parseDocument()
         {
-            tree = ts_parser_parse_string(parser->parser(), nullptr, source.data(), source.size());
+            tree = parseBraneScript(source);
 
             auto doc = std::make_shared<DocumentContext>();
             auto scope = pushScope(doc);
@@ -969,32 +970,28 @@ namespace BraneScript
         }
     };
 
-    BraneScriptParser::BraneScriptParser()
+    TSTree* parseBraneScript(std::string_view source)
     {
-        _value = ts_parser_new();
-        ts_parser_set_language(_value, tree_sitter_branescript());
+        // Parsers are cheap and keep no state between parses, one per thread lets documents parse concurrently
+        thread_local std::unique_ptr<TSParser, decltype(&ts_parser_delete)> threadParser = []
+        {
+            std::unique_ptr<TSParser, decltype(&ts_parser_delete)> parser(ts_parser_new(), ts_parser_delete);
+            ts_parser_set_language(parser.get(), tree_sitter_branescript());
+            return parser;
+        }();
+        return ts_parser_parse_string(threadParser.get(), nullptr, source.data(), source.size());
     }
 
-    BraneScriptParser::BraneScriptParser(BraneScriptParser&& other) noexcept
-    {
-        _value = other._value;
-        other._value = nullptr;
-    }
-
-    BraneScriptParser::~BraneScriptParser()
-    {
-        if(_value)
-            ts_parser_delete(_value);
-    }
-
-    TSParser* BraneScriptParser::parser() const { return _value; }
+    ParsedDocument::ParsedDocument(std::filesystem::path path, std::string source)
+        : _path(std::move(path)), _source(std::move(source))
+    {}
 
-    ParsedDocument::ParsedDocument(std::filesystem::path path,
-                                   std::string source,
-                                   std::shared_ptr<BraneScriptParser> parser)
-        : _path(std::move(path)), _source(std::move(source)), _parser(std::move(parser))
+    ParsedDocument::ParsedDocument(std::filesystem::path path, ParserResult<DocumentContext> context)
+        : _path(std::move(path)), _cachedResult(std::move(context))
     {}
 
+    const std::filesystem::path& ParsedDocument::path() const { return _path; }
+
     std::string_view ParsedDocument::source() const { return _source; }
 
     void ParsedDocument::update(TSRange updateRange, std::string newText)
@@ -1005,9 +1002,10 @@ namespace BraneScript
 
     ParserResult<DocumentContext> ParsedDocument::getDocumentContext()
     {
+        std::scoped_lock lock(_cacheLock);
         if(_cachedResult)
             return _cachedResult.value();
-        ParserAPI ctx{_path, _source, _parser};
+        ParserAPI ctx{_path, _source};
         _cachedResult = std::make_optional(ctx.parseDocument());
         return _cachedResult.value();
     }
@@ -7,24 +7,16 @@
 
 #include <expected>
 #include <memory>
+#include <mutex>
 #include <string>
 #include "parser/documentContext.h"
 #include <tree_sitter/api.h>
 
 namespace BraneScript
 {
-    class BraneScriptParser
-    {
-      private:
-        TSParser* _value;
-
-      public:
-        BraneScriptParser();
-        BraneScriptParser(BraneScriptParser&&) noexcept;
-        ~BraneScriptParser();
-
-        TSParser* parser() const;
-    };
+    /// Parses source with a tree-sitter parser owned by the calling thread, so documents can be parsed concurrently.
+    /// The caller owns the returned tree.
+    TSTree* parseBraneScript(std::string_view source);
 
     enum class MessageType
     {
@@ -52,12 +44,17 @@ namespace BraneScript
     {
         std::filesystem::path _path;
         std::string _source;
-        std::shared_ptr<BraneScriptParser> _parser;
 
+        std::mutex _cacheLock;
         std::optional<ParserResult<DocumentContext>> _cachedResult;
 
       public:
-        ParsedDocument(std::filesystem::path path, std::string source, std::shared_ptr<BraneScriptParser> parser);
+        ParsedDocument(std::filesystem::path path, std::string source);
+        /// A document whose context was built directly instead of parsed, such as one generated by a tool. Its source
+        /// is empty.
+        ParsedDocument(std::filesystem::path path, ParserResult<DocumentContext> context);
+
+        const std::filesystem::path& path() const;
 
         std::string_view source() const;
 
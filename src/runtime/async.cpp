@@ -0,0 +1,310 @@
+#include "async.h"
+
+#include <algorithm>
+#include <format>
+#include <utility>
+#include "vm.h"
+
+namespace BraneScript
+{
+    namespace
+    {
+        /// VM of the runtime thread the current coroutine was resumed on
+        thread_local VM* workerVM = nullptr;
+
+        /// Suspends at a stage boundary so that other instances waiting for a thread get a turn
+        struct Reschedule
+        {
+            AsyncRuntime& runtime;
+
+            bool await_ready() const noexcept { return false; }
+
+            void await_suspend(std::coroutine_handle<> handle) { runtime.schedule(handle); }
+
+            void await_resume() const noexcept {}
+        };
+    } // namespace
+
+    /// Awaits every async call of a stage. Lives in the coroutine frame of the instance that made the calls until the
+    /// last of them completes.
+    struct AsyncCallState
+    {
+        AsyncRuntime& runtime;
+        const BytecodeFunction& stage;
+        /// Inputs of every call, one after the other
+        std::span<const Register> inputs;
+        std::vector<std::vector<Register>> results;
+        std::atomic<size_t> remaining = 0;
+        std::mutex errorMutex;
+        std::string error;
+        std::coroutine_handle<> handle;
+
+        AsyncCallState(AsyncRuntime& runtime, const BytecodeFunction& stage, std::span<const Register> inputs)
+            : runtime(runtime), stage(stage), inputs(inputs)
+        {}
+
+        bool await_ready() const noexcept { return stage.asyncCalls.empty(); }
+
+        bool await_suspend(std::coroutine_handle<> suspended)
+        {
+            handle = suspended;
+            results.resize(stage.asyncCalls.size());
+            // Holding one count until every call has been made keeps calls that complete straight away from resuming
+            // the instance early
+            remaining = stage.asyncCalls.size() + 1;
+            size_t offset = 0;
+            for(size_t i = 0; i < stage.asyncCalls.size(); ++i)
+            {
+                auto& call = stage.asyncCalls[i];
+                auto& host = runtime._hostFunctions.at(call.function);
+                host(inputs.subspan(offset, call.inputs.size()), AsyncCallResult(this, i));
+                offset += call.inputs.size();
+            }
+            // Resume right away if every call already completed
+            return !release();
+        }
+
+        void await_resume() const noexcept {}
+
+        bool release() { return remaining.fetch_sub(1) == 1; }
+
+        void completed()
+        {
+            if(release())
+                runtime.schedule(handle);
+        }
+
+        void fail(size_t index, std::string_view message)
+        {
+            std::lock_guard lock(errorMutex);
+            if(error.empty())
+                error = std::format("Async call to {} in {} failed: {}",
+                                    stage.asyncCalls[index].function,
+                                    stage.id,
+                                    message);
+        }
+    };
+
+    AsyncCallResult::AsyncCallResult(AsyncCallState* state, size_t index) : _state(state), _index(index) {}
+
+    AsyncCallResult::AsyncCallResult(AsyncCallResult&& other) noexcept
+        : _state(std::exchange(other._state, nullptr)), _index(other._index)
+    {}
+
+    AsyncCallResult& AsyncCallResult::operator=(AsyncCallResult&& other) noexcept
+    {
+        if(this != &other)
+        {
+            if(_state)
+                fail("The result was replaced without being completed");
+            _state = std::exchange(other._state, nullptr);
+            _index = other._index;
+        }
+        return *this;
+    }
+
+    AsyncCallResult::~AsyncCallResult()
+    {
+        if(_state)
+            fail("The result was dropped without being completed");
+    }
+
+    size_t AsyncCallResult::outputCount() const
+    {
+        return _state ? _state->stage.asyncCalls[_index].outputCount : 0;
+    }
+
+    void AsyncCallResult::complete(std::span<const Register> outputs)
+    {
+        if(!_state)
+            return;
+        if(outputs.size() != outputCount())
+        {
+            fail(std::format("Completed with {} values instead of {}", outputs.size(), outputCount()));
+            return;
+        }
+        _state->results[_index].assign(outputs.begin(), outputs.end());
+        std::exchange(_state, nullptr)->completed();
+    }
+
+    void AsyncCallResult::fail(std::string error)
+    {
+        if(!_state)
+            return;
+        _state->fail(_index, error);
+        std::exchange(_state, nullptr)->completed();
+    }
+
+    /// Coroutine running one pipeline instance. It starts suspended so that start() can hand it to a runtime thread,
+    /// and frees itself once it has run to completion.
+    struct AsyncRuntime::Task
+    {
+        struct promise_type
+        {
+            Task get_return_object() { return {std::coroutine_handle<promise_type>::from_promise(*this)}; }
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+
+            std::suspend_never final_suspend() noexcept { return {}; }
+
+            void return_void() {}
+
+            void unhandled_exception() { std::terminate(); }
+        };
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    AsyncRuntime::AsyncRuntime(std::shared_ptr<const Program> program, size_t threadCount)
+        : _program(std::move(program))
+    {
+        for(size_t i = 0; i < std::max<size_t>(threadCount, 1); ++i)
+            _threads.emplace_back([this]() { work(); });
+    }
+
+    AsyncRuntime::~AsyncRuntime()
+    {
+        wait();
+        {
+            std::lock_guard lock(_queueMutex);
+            _stopping = true;
+        }
+        _queueReady.notify_all();
+        for(auto& thread : _threads)
+            thread.join();
+    }
+
+    size_t AsyncRuntime::defaultThreadCount() { return std::max(std::thread::hardware_concurrency(), 1u); }
+
+    std::shared_ptr<const Program> AsyncRuntime::program() const { return _program.load(std::memory_order_acquire); }
+
+    void AsyncRuntime::setProgram(std::shared_ptr<const Program> program)
+    {
+        _program.store(std::move(program), std::memory_order_release);
+    }
+
+    void AsyncRuntime::registerHostFunction(std::string name, AsyncHostFunction function)
+    {
+        _hostFunctions.insert_or_assign(std::move(name), std::move(function));
+    }
+
+    std::expected<void, std::string> AsyncRuntime::start(uint32_t pipeline,
+                                                         std::vector<Register> inputs,
+                                                         PipelineCompletion completion,
+                                                         std::span<const MemoryRegion> regions)
+    {
+        auto program = this->program();
+        if(pipeline >= program->pipelines().size())
+            return std::unexpected("Pipeline index out of range");
+        auto& bytecode = program->pipelines()[pipeline];
+        if(inputs.size() != bytecode.inputCount)
+            return std::unexpected(std::format("{} takes {} inputs", bytecode.id, bytecode.inputCount));
+        if(bytecode.stages.empty())
+            return std::unexpected(std::format("{} has no stages to run", bytecode.id));
+        for(auto& stage : bytecode.stages)
+        {
+            for(auto& call : stage.asyncCalls)
+            {
+                if(!_hostFunctions.contains(call.function))
+                    return std::unexpected(
+                        std::format("{}: no host function named {} is registered", stage.id, call.function));
+            }
+        }
+
+        _inFlight++;
+        schedule(run(*this, std::move(program), pipeline, std::move(inputs), regions, std::move(completion)).handle);
+        return {};
+    }
+
+    void AsyncRuntime::wait()
+    {
+        std::unique_lock lock(_idleMutex);
+        _idle.wait(lock, [this]() { return _inFlight == 0; });
+    }
+
+    size_t AsyncRuntime::inFlight() const { return _inFlight; }
+
+    void AsyncRuntime::schedule(std::coroutine_handle<> handle)
+    {
+        // Notifying under the lock, as host threads may complete the last instance's calls while the runtime waits
+        // to be destroyed
+        std::lock_guard lock(_queueMutex);
+        _queue.push_back(handle);
+        _queueReady.notify_one();
+    }
+
+    void AsyncRuntime::work()
+    {
+        VM vm(program());
+        workerVM = &vm;
+        while(true)
+        {
+            std::coroutine_handle<> handle;
+            {
+                std::unique_lock lock(_queueMutex);
+                _queueReady.wait(lock, [this]() { return _stopping || !_queue.empty(); });
+                if(_queue.empty())
+                    return;
+                handle = _queue.front();
+                _queue.pop_front();
+            }
+            handle.resume();
+        }
+    }
+
+    void AsyncRuntime::finish(const PipelineCompletion& completion,
+                              std::expected<std::vector<Register>, std::string> outputs)
+    {
+        if(completion)
+            completion(std::move(outputs));
+        if(_inFlight.fetch_sub(1) == 1)
+        {
+            std::lock_guard lock(_idleMutex);
+            _idle.notify_all();
+        }
+    }
+
+    AsyncRuntime::Task AsyncRuntime::run(AsyncRuntime& runtime,
+                                         std::shared_ptr<const Program> program,
+                                         uint32_t pipeline,
+                                         std::vector<Register> values,
+                                         std::span<const MemoryRegion> regions,
+                                         PipelineCompletion completion)
+    {
+        // The frame keeps the program the instance started with alive until it completes
+        auto& stages = program->pipelines()[pipeline].stages;
+        std::vector<Register> carried;
+        for(size_t s = 0; s < stages.size(); ++s)
+        {
+            if(s > 0)
+                co_await Reschedule{runtime};
+
+            // Instances started before and after a switch share the threads, each stage may resume on a VM that last
+            // ran the other program
+            if(&workerVM->program() != program.get())
+                workerVM->setProgram(program);
+            auto& stage = stages[s];
+            auto ran = workerVM->runStage(pipeline, s, values, carried, regions);
+            if(!ran)
+            {
+                runtime.finish(completion, std::unexpected(std::move(ran.error())));
+                co_return;
+            }
+            auto passed = (ptrdiff_t)stage.stageOutputs.size();
+            values.assign(carried.begin(), carried.begin() + passed);
+            if(stage.asyncCalls.empty())
+                continue;
+
+            AsyncCallState calls{runtime, stage, std::span<const Register>(carried).subspan(passed)};
+            co_await calls;
+            if(!calls.error.empty())
+            {
+                runtime.finish(completion, std::unexpected(std::move(calls.error)));
+                co_return;
+            }
+            for(auto& results : calls.results)
+                values.insert(values.end(), results.begin(), results.end());
+        }
+        runtime.finish(completion, std::move(values));
+    }
+} // namespace BraneScript
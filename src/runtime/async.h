@@ -0,0 +1,120 @@
+#ifndef BRANESCRIPT_ASYNC_H
+#define BRANESCRIPT_ASYNC_H
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <expected>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "bytecode.h"
+
+namespace BraneScript
+{
+    struct AsyncCallState;
+
+    /// Completes an async host call. The host may complete it from any thread and at any time after the call was
+    /// made, but only once. Dropping it without completing it fails the call.
+    class AsyncCallResult
+    {
+        AsyncCallState* _state = nullptr;
+        size_t _index = 0;
+
+      public:
+        AsyncCallResult(AsyncCallState* state, size_t index);
+        AsyncCallResult(AsyncCallResult&& other) noexcept;
+        AsyncCallResult& operator=(AsyncCallResult&& other) noexcept;
+        AsyncCallResult(const AsyncCallResult&) = delete;
+        AsyncCallResult& operator=(const AsyncCallResult&) = delete;
+        ~AsyncCallResult();
+
+        /// Number of values complete() expects
+        size_t outputCount() const;
+
+        void complete(std::span<const Register> outputs);
+        void fail(std::string error);
+    };
+
+    /// Host side of an async call. Inputs are only valid for the duration of the call, the result may be kept and
+    /// completed later.
+    using AsyncHostFunction = std::function<void(std::span<const Register> inputs, AsyncCallResult result)>;
+
+    using PipelineCompletion = std::function<void(std::expected<std::vector<Register>, std::string> outputs)>;
+
+    /// Runs pipelines as coroutines on a small pool of threads. Every stage boundary is a suspension point, so
+    /// instances take turns on the threads, and a stage's async calls suspend its instance until the host completes
+    /// them instead of blocking a thread. Each thread runs stages on its own VM.
+    class AsyncRuntime
+    {
+        struct Task;
+        friend struct AsyncCallState;
+
+        std::atomic<std::shared_ptr<const Program>> _program;
+        std::unordered_map<std::string, AsyncHostFunction> _hostFunctions;
+
+        std::mutex _queueMutex;
+        std::condition_variable _queueReady;
+        std::deque<std::coroutine_handle<>> _queue;
+        bool _stopping = false;
+
+        std::mutex _idleMutex;
+        std::condition_variable _idle;
+        std::atomic<size_t> _inFlight = 0;
+
+        std::vector<std::thread> _threads;
+
+        void work();
+        void finish(const PipelineCompletion& completion,
+                    std::expected<std::vector<Register>, std::string> outputs);
+        static Task run(AsyncRuntime& runtime,
+                        std::shared_ptr<const Program> program,
+                        uint32_t pipeline,
+                        std::vector<Register> values,
+                        std::span<const MemoryRegion> regions,
+                        PipelineCompletion completion);
+
+      public:
+        explicit AsyncRuntime(std::shared_ptr<const Program> program, size_t threadCount = defaultThreadCount());
+        /// Waits for every started pipeline to complete
+        ~AsyncRuntime();
+        AsyncRuntime(const AsyncRuntime&) = delete;
+        AsyncRuntime& operator=(const AsyncRuntime&) = delete;
+
+        static size_t defaultThreadCount();
+
+        std::shared_ptr<const Program> program() const;
+
+        /// Switches to another program, such as a newer version of the same modules. Pipelines that have already
+        /// started finish on the program they started with, pipeline indices passed to later starts refer to the new
+        /// one. May be called from any thread, also while pipelines are running.
+        void setProgram(std::shared_ptr<const Program> program);
+
+        /// Host functions have to be registered before any pipeline that calls them is started
+        void registerHostFunction(std::string name, AsyncHostFunction function);
+
+        /// Starts a pipeline and returns without waiting for it. completion is called on one of the runtime's threads
+        /// with the pipeline's outputs or the error that stopped it. Regions must stay valid until then.
+        std::expected<void, std::string> start(uint32_t pipeline,
+                                               std::vector<Register> inputs,
+                                               PipelineCompletion completion,
+                                               std::span<const MemoryRegion> regions = {});
+
+        /// Blocks until every started pipeline has completed
+        void wait();
+
+        size_t inFlight() const;
+
+        /// Resumes a coroutine on one of the runtime's threads
+        void schedule(std::coroutine_handle<> handle);
+    };
+} // namespace BraneScript
+
+#endif
@@ -0,0 +1,421 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <limits>
+#include <type_traits>
+
+// AVX2 kernels are compiled alongside the baseline ones and picked at runtime on x86
+#if defined(BS_BATCH_VECTORS) && (defined(__x86_64__) || defined(__i386__))
+#define BS_BATCH_AVX2 1
+#endif
+
+namespace BraneScript
+{
+    struct BatchFrame
+    {
+        std::byte* data = nullptr;
+        const BatchPlan* plan = nullptr;
+        std::span<const MemoryRegion> regions;
+        /// Entities in the block, and that count rounded up to whole vectors. Lanes past count hold stale values
+        /// that kernels may compute on but never trap on or write to memory.
+        size_t count = 0;
+        size_t lanes = 0;
+        size_t firstEntity = 0;
+        std::string error;
+        alignas(64) uint8_t mask[BatchExecutor::blockSize];
+    };
+
+    namespace
+    {
+        constexpr size_t batchVectorLanes = 8;
+        static_assert(BatchExecutor::blockSize % batchVectorLanes == 0);
+
+        template<class T>
+        T loadLane(const std::byte* column, size_t lane)
+        {
+            T value;
+            std::memcpy(&value, column + lane * sizeof(T), sizeof(T));
+            return value;
+        }
+
+        template<class T>
+        void storeLane(std::byte* column, size_t lane, T value)
+        {
+            std::memcpy(column + lane * sizeof(T), &value, sizeof(T));
+        }
+
+        // Scalar semantics match the VM's
+        template<class T>
+        bool divisionValid(T a, T b)
+        {
+            if constexpr(std::is_integral_v<T>)
+            {
+                if(b == 0)
+                    return false;
+                if constexpr(std::is_signed_v<T>)
+                    return !(a == std::numeric_limits<T>::min() && b == -1);
+            }
+            return true;
+        }
+
+        template<class T>
+        T modValues(T a, T b)
+        {
+            if constexpr(std::is_integral_v<T>)
+                return a % b;
+            else
+                return std::fmod(a, b);
+        }
+
+        template<class T>
+        T convertFloat(float value)
+        {
+            if(std::isnan(value))
+                return 0;
+            if(value <= (float)std::numeric_limits<T>::min())
+                return std::numeric_limits<T>::min();
+            if(value >= (float)std::numeric_limits<T>::max())
+                return std::numeric_limits<T>::max();
+            return (T)value;
+        }
+
+        bool batchTrap(BatchFrame& frame, const BatchStep& step, size_t lane, std::string_view message)
+        {
+            auto& function = *frame.plan->function;
+            frame.error = std::format("{} in {} at {} ({}) for entity {}",
+                                      message,
+                                      function.id,
+                                      step.instruction,
+                                      bcOpName(function.code[step.instruction].op),
+                                      frame.firstEntity + lane);
+            return false;
+        }
+
+        // Kernels pass vectors wider than the baseline ABI by value, which is fine as they never leave this file. GCC
+        // reports that at the end of the file, so the warning stays off for the rest of it.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+        namespace baseline
+        {
+#include "batchKernels.inl"
+        } // namespace baseline
+
+#ifdef BS_BATCH_AVX2
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+        namespace avx2
+        {
+#include "batchKernels.inl"
+        } // namespace avx2
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+        bool hasAVX2()
+        {
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+        }
+#endif
+
+        struct KernelSet
+        {
+            std::string_view name;
+            std::expected<BatchPlan, std::string> (*lower)(const BytecodeFunction& function);
+        };
+
+        /// Kernel sets the machine can run, best first
+        std::vector<KernelSet> availableKernelSets()
+        {
+            std::vector<KernelSet> sets;
+#ifdef BS_BATCH_AVX2
+            if(hasAVX2())
+                sets.push_back({"avx2", &avx2::lowerPlan});
+#endif
+#ifdef BS_BATCH_VECTORS
+            sets.push_back({"baseline", &baseline::lowerPlan});
+#else
+            sets.push_back({"scalar", &baseline::lowerPlan});
+#endif
+            return sets;
+        }
+
+        bool runPlan(const BatchPlan& plan, BatchFrame& frame)
+        {
+            frame.plan = &plan;
+            for(auto& step : plan.steps)
+            {
+                if(!step.kernel(step, frame))
+                    return false;
+            }
+            return true;
+        }
+
+        /// Moves count values between columns of possibly different widths, zero extending or truncating
+        void copyColumn(const std::byte* from, size_t fromWidth, std::byte* to, size_t toWidth, size_t count)
+        {
+            if(fromWidth == toWidth)
+            {
+                std::memcpy(to, from, count * fromWidth);
+                return;
+            }
+            size_t width = std::min(fromWidth, toWidth);
+            std::memset(to, 0, count * toWidth);
+            for(size_t i = 0; i < count; ++i)
+                std::memcpy(to + i * toWidth, from + i * fromWidth, width);
+        }
+
+        std::expected<void, std::string> checkBindings(std::string_view id,
+                                                       size_t inputCount,
+                                                       size_t outputCount,
+                                                       std::span<const void* const> inputs,
+                                                       std::span<void* const> outputs,
+                                                       size_t count)
+        {
+            if(inputs.size() != inputCount || outputs.size() != outputCount)
+                return std::unexpected(std::format("{} takes {} inputs and {} outputs", id, inputCount, outputCount));
+            if(count == 0)
+                return {};
+            for(auto* input : inputs)
+            {
+                if(!input)
+                    return std::unexpected(std::format("{} was passed a null input column", id));
+            }
+            for(auto* output : outputs)
+            {
+                if(!output)
+                    return std::unexpected(std::format("{} was passed a null output column", id));
+            }
+            return {};
+        }
+    } // namespace
+
+    size_t BatchExecutor::columnWidth(ValueType type)
+    {
+        switch(type)
+        {
+            case ValueType::Char:
+                return 1;
+            case ValueType::U32:
+            case ValueType::I32:
+            case ValueType::F32:
+                return 4;
+            default:
+                return 8;
+        }
+    }
+
+    BatchExecutor::BatchExecutor(std::shared_ptr<const Program> program)
+    {
+        auto best = availableKernelSets().front();
+        _kernelSet = best.name;
+        _lower = best.lower;
+        setProgram(std::move(program));
+    }
+
+    void BatchExecutor::setProgram(std::shared_ptr<const Program> program)
+    {
+        _program = std::move(program);
+        _functions.clear();
+        _pipelines.clear();
+        _frameBytes = 0;
+        for(auto& function : _program->functions())
+        {
+            auto plan = _lower(function);
+            if(plan)
+                _frameBytes = std::max(_frameBytes, plan->frameBytes);
+            _functions.push_back(std::move(plan));
+        }
+        for(auto& pipeline : _program->pipelines())
+        {
+            std::vector<BatchPlan> stages;
+            std::expected<std::vector<BatchPlan>, std::string> plans;
+            for(auto& stage : pipeline.stages)
+            {
+                auto plan = _lower(stage);
+                if(!plan)
+                {
+                    plans = std::unexpected(plan.error());
+                    break;
+                }
+                _frameBytes = std::max(_frameBytes, plan->frameBytes);
+                stages.push_back(std::move(*plan));
+            }
+            if(plans)
+                plans = std::move(stages);
+            _pipelines.push_back(std::move(plans));
+        }
+        _frames.resize(_frameBytes * 2);
+    }
+
+    const Program& BatchExecutor::program() const { return *_program; }
+
+    std::string_view BatchExecutor::kernelSet() const { return _kernelSet; }
+
+    std::vector<std::string_view> BatchExecutor::kernelSets()
+    {
+        std::vector<std::string_view> names;
+        for(auto& set : availableKernelSets())
+            names.push_back(set.name);
+        return names;
+    }
+
+    std::expected<void, std::string> BatchExecutor::useKernelSet(std::string_view kernelSet)
+    {
+        for(auto& set : availableKernelSets())
+        {
+            if(set.name != kernelSet)
+                continue;
+            _kernelSet = set.name;
+            _lower = set.lower;
+            setProgram(std::move(_program));
+            return {};
+        }
+        return std::unexpected(std::format("Kernel set {} is not available", kernelSet));
+    }
+
+    std::expected<void, std::string> BatchExecutor::functionSupported(uint32_t function) const
+    {
+        if(function >= _functions.size())
+            return std::unexpected("Function index out of range");
+        if(!_functions[function])
+            return std::unexpected(_functions[function].error());
+        return {};
+    }
+
+    std::expected<void, std::string> BatchExecutor::pipelineSupported(uint32_t pipeline) const
+    {
+        if(pipeline >= _pipelines.size())
+            return std::unexpected("Pipeline index out of range");
+        if(!_pipelines[pipeline])
+            return std::unexpected(_pipelines[pipeline].error());
+        return {};
+    }
+
+    std::expected<void, std::string> BatchExecutor::call(uint32_t function,
+                                                         std::span<const void* const> inputs,
+                                                         std::span<void* const> outputs,
+                                                         size_t count,
+                                                         std::span<const MemoryRegion> regions)
+    {
+        auto supported = functionSupported(function);
+        if(!supported)
+            return supported;
+        auto& plan = *_functions[function];
+        auto& bytecode = *plan.function;
+        auto bound = checkBindings(bytecode.id, bytecode.inputCount, bytecode.outputCount, inputs, outputs, count);
+        if(!bound)
+            return bound;
+
+        BatchFrame frame;
+        frame.data = _frames.data();
+        frame.regions = regions;
+        for(size_t first = 0; first < count; first += blockSize)
+        {
+            frame.firstEntity = first;
+            frame.count = std::min(blockSize, count - first);
+            frame.lanes = (frame.count + batchVectorLanes - 1) / batchVectorLanes * batchVectorLanes;
+
+            // Registers start out zeroed, as they do in the VM
+            std::memset(frame.data, 0, plan.frameBytes);
+            for(size_t i = 0; i < inputs.size(); ++i)
+            {
+                size_t width = plan.widths[i];
+                std::memcpy(frame.data + plan.columns[i],
+                            static_cast<const std::byte*>(inputs[i]) + first * width,
+                            frame.count * width);
+            }
+            if(!runPlan(plan, frame))
+                return std::unexpected(std::move(frame.error));
+            for(size_t i = 0; i < outputs.size(); ++i)
+            {
+                size_t reg = bytecode.inputCount + i;
+                size_t width = plan.widths[reg];
+                std::memcpy(static_cast<std::byte*>(outputs[i]) + first * width,
+                            frame.data + plan.columns[reg],
+                            frame.count * width);
+            }
+        }
+        return {};
+    }
+
+    std::expected<void, std::string> BatchExecutor::runPipeline(uint32_t pipeline,
+                                                                std::span<const void* const> inputs,
+                                                                std::span<void* const> outputs,
+                                                                size_t count,
+                                                                std::span<const MemoryRegion> regions)
+    {
+        auto supported = pipelineSupported(pipeline);
+        if(!supported)
+            return supported;
+        auto& bytecode = _program->pipelines()[pipeline];
+        auto& stages = *_pipelines[pipeline];
+        auto bound = checkBindings(bytecode.id, bytecode.inputCount, bytecode.outputCount, inputs, outputs, count);
+        if(!bound)
+            return bound;
+        if(stages.empty())
+            return std::unexpected(std::format("{} has no stages to run", bytecode.id));
+
+        BatchFrame frame;
+        frame.regions = regions;
+        for(size_t first = 0; first < count; first += blockSize)
+        {
+            frame.firstEntity = first;
+            frame.count = std::min(blockSize, count - first);
+            frame.lanes = (frame.count + batchVectorLanes - 1) / batchVectorLanes * batchVectorLanes;
+
+            // Stages alternate between the two frames, each one reading its inputs from the previous stage's columns
+            std::byte* current = _frames.data();
+            std::byte* next = current + _frameBytes;
+            auto& firstStage = stages.front();
+            std::memset(current, 0, firstStage.frameBytes);
+            for(size_t i = 0; i < inputs.size(); ++i)
+            {
+                size_t width = firstStage.widths[i];
+                std::memcpy(current + firstStage.columns[i],
+                            static_cast<const std::byte*>(inputs[i]) + first * width,
+                            frame.count * width);
+            }
+            for(size_t s = 0; s < stages.size(); ++s)
+            {
+                auto& stage = stages[s];
+                frame.data = current;
+                if(!runPlan(stage, frame))
+                    return std::unexpected(std::move(frame.error));
+
+                auto& passed = stage.function->stageOutputs;
+                if(s + 1 == stages.size())
+                {
+                    for(size_t i = 0; i < outputs.size() && i < passed.size(); ++i)
+                    {
+                        size_t width = stage.widths[passed[i]];
+                        std::memcpy(static_cast<std::byte*>(outputs[i]) + first * width,
+                                    current + stage.columns[passed[i]],
+                                    frame.count * width);
+                    }
+                    break;
+                }
+                auto& nextStage = stages[s + 1];
+                std::memset(next, 0, nextStage.frameBytes);
+                for(size_t i = 0; i < passed.size() && i < nextStage.columns.size(); ++i)
+                    copyColumn(current + stage.columns[passed[i]],
+                               stage.widths[passed[i]],
+                               next + nextStage.columns[i],
+                               nextStage.widths[i],
+                               frame.count);
+                std::swap(current, next);
+            }
+        }
+        return {};
+    }
+} // namespace BraneScript
@@ -0,0 +1,117 @@
+#ifndef BRANESCRIPT_BATCH_H
+#define BRANESCRIPT_BATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "bytecode.h"
+
+// Batch kernels are written with the vector extension of GCC and Clang, other compilers get plain loops
+#if(defined(__GNUC__) || defined(__clang__)) && !defined(BS_BATCH_NO_VECTORS)
+#define BS_BATCH_VECTORS 1
+#endif
+
+namespace BraneScript
+{
+    struct BatchFrame;
+    struct BatchStep;
+
+    /// Runs one instruction for every entity of a block, returns false after recording a trap in the frame
+    using BatchKernel = bool (*)(const BatchStep& step, BatchFrame& frame);
+
+    /// One instruction of a BatchPlan. Operands are byte offsets of columns in the frame, except for the region index
+    /// of region loads and stores.
+    struct BatchStep
+    {
+        BatchKernel kernel = nullptr;
+        uint32_t a = 0;
+        uint32_t b = 0;
+        uint32_t c = 0;
+        /// Bits of the constant a LoadConst writes, or the size of the value a pointer load or store may access
+        uint64_t constant = 0;
+        /// Bytecode instruction the step was lowered from, for trap messages
+        uint32_t instruction = 0;
+    };
+
+    /// A function or pipeline stage lowered to run a whole block of entities per instruction. Every register gets a
+    /// column holding its value for each entity of the block, packed at the width of its type.
+    struct BatchPlan
+    {
+        const BytecodeFunction* function = nullptr;
+        std::vector<BatchStep> steps;
+        /// Byte offset and element width of each register's column
+        std::vector<uint32_t> columns;
+        std::vector<uint8_t> widths;
+        size_t frameBytes = 0;
+    };
+
+    /// Runs functions and pipelines over many independent entities at once. Values are passed struct of arrays: input
+    /// and output i each point to an array of count values of that parameter, stored the way the VM holds its type, so
+    /// 8 bit types take one byte and references are 64 bit pointers.
+    ///
+    /// Each bytecode instruction runs over a block of entities before the next one starts, so dispatch is paid once
+    /// per block rather than once per entity, and arithmetic, comparisons, bitwise ops and conversions run on SIMD
+    /// kernels. Entities have to be independent, memory one entity writes must not be read by another in the same
+    /// call. Functions that make calls can't be batched, callers should fall back to the VM for those.
+    class BatchExecutor
+    {
+        std::shared_ptr<const Program> _program;
+        std::string_view _kernelSet;
+        /// Lowers a function for the selected kernel set
+        std::expected<BatchPlan, std::string> (*_lower)(const BytecodeFunction& function) = nullptr;
+        std::vector<std::expected<BatchPlan, std::string>> _functions;
+        std::vector<std::expected<std::vector<BatchPlan>, std::string>> _pipelines;
+        /// Two frames, so that a stage can hand its outputs to the next one
+        std::vector<std::byte> _frames;
+        size_t _frameBytes = 0;
+
+      public:
+        /// Entities run per block, a multiple of the widest vector the kernels use
+        static constexpr size_t blockSize = 256;
+
+        explicit BatchExecutor(std::shared_ptr<const Program> program);
+
+        /// Bytes each value of a column of the type takes
+        static size_t columnWidth(ValueType type);
+
+        const Program& program() const;
+
+        /// Switches to another program, such as a newer version of the same modules, and plans its functions and
+        /// pipelines again. Must not be called while the executor is running.
+        void setProgram(std::shared_ptr<const Program> program);
+
+        /// Instruction set the kernels were selected for, "avx2", "baseline" or "scalar"
+        std::string_view kernelSet() const;
+
+        /// Kernel sets this build can run on this machine, the one selected by default first
+        static std::vector<std::string_view> kernelSets();
+
+        /// Plans the program again with the kernels of another set from kernelSets(), such as to compare them. Must
+        /// not be called while the executor is running.
+        std::expected<void, std::string> useKernelSet(std::string_view kernelSet);
+
+        /// Whether a function or pipeline can be run in batches, and why not otherwise
+        std::expected<void, std::string> functionSupported(uint32_t function) const;
+        std::expected<void, std::string> pipelineSupported(uint32_t pipeline) const;
+
+        std::expected<void, std::string> call(uint32_t function,
+                                              std::span<const void* const> inputs,
+                                              std::span<void* const> outputs,
+                                              size_t count,
+                                              std::span<const MemoryRegion> regions = {});
+
+        /// Runs every stage of a pipeline over each block, the values passed between stages never leave the frames
+        std::expected<void, std::string> runPipeline(uint32_t pipeline,
+                                                     std::span<const void* const> inputs,
+                                                     std::span<void* const> outputs,
+                                                     size_t count,
+                                                     std::span<const MemoryRegion> regions = {});
+    };
+} // namespace BraneScript
+
+#endif
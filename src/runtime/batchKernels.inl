@@ -0,0 +1,661 @@
+// Kernels and plan lowering for BatchExecutor. batch.cpp includes this file once for each instruction set it builds
+// kernels for, every time inside a namespace of its own, so nothing here may be declared outside of that namespace.
+
+#ifdef BS_BATCH_VECTORS
+template<class T>
+using Vector [[gnu::vector_size(batchVectorLanes * sizeof(T))]] = T;
+
+template<class T>
+Vector<T> loadVector(const std::byte* column, size_t lane)
+{
+    Vector<T> value;
+    std::memcpy(&value, column + lane * sizeof(T), sizeof(value));
+    return value;
+}
+
+template<class T>
+void storeVector(std::byte* column, size_t lane, Vector<T> value)
+{
+    std::memcpy(column + lane * sizeof(T), &value, sizeof(value));
+}
+#endif
+
+// Functors shared by the vector and scalar loops. Integer arithmetic is done on unsigned types so that it wraps.
+struct Add
+{
+    template<class V>
+    static V apply(V a, V b)
+    {
+        return (V)(a + b);
+    }
+};
+
+struct Sub
+{
+    template<class V>
+    static V apply(V a, V b)
+    {
+        return (V)(a - b);
+    }
+};
+
+struct Mul
+{
+    template<class V>
+    static V apply(V a, V b)
+    {
+        return (V)(a * b);
+    }
+};
+
+struct Div
+{
+    template<class V>
+    static V apply(V a, V b)
+    {
+        return (V)(a / b);
+    }
+};
+
+struct Mod
+{
+    template<class V>
+    static V apply(V a, V b)
+    {
+        return modValues(a, b);
+    }
+};
+
+struct BitNot
+{
+    template<class V>
+    static V apply(V a, V)
+    {
+        return (V)~a;
+    }
+};
+
+struct BitAnd
+{
+    template<class V>
+    static V apply(V a, V b)
+    {
+        return (V)(a & b);
+    }
+};
+
+struct BitOr
+{
+    template<class V>
+    static V apply(V a, V b)
+    {
+        return (V)(a | b);
+    }
+};
+
+struct BitXor
+{
+    template<class V>
+    static V apply(V a, V b)
+    {
+        return (V)(a ^ b);
+    }
+};
+
+// Comparisons yield a bool for scalars and a lane mask of all ones or zeros for vectors
+struct Eq
+{
+    template<class V>
+    static auto apply(V a, V b)
+    {
+        return a == b;
+    }
+};
+
+struct Ne
+{
+    template<class V>
+    static auto apply(V a, V b)
+    {
+        return a != b;
+    }
+};
+
+struct Gt
+{
+    template<class V>
+    static auto apply(V a, V b)
+    {
+        return a > b;
+    }
+};
+
+struct Ge
+{
+    template<class V>
+    static auto apply(V a, V b)
+    {
+        return a >= b;
+    }
+};
+
+struct LogicNot
+{
+    template<class V>
+    static auto apply(V a, V)
+    {
+        return a == V{};
+    }
+};
+
+struct LogicAnd
+{
+    template<class V>
+    static auto apply(V a, V b)
+    {
+        return (a != V{}) & (b != V{});
+    }
+};
+
+struct LogicOr
+{
+    template<class V>
+    static auto apply(V a, V b)
+    {
+        return (a != V{}) | (b != V{});
+    }
+};
+
+template<class T, class Fn>
+bool binaryKernel(const BatchStep& step, BatchFrame& frame)
+{
+    const std::byte* a = frame.data + step.a;
+    const std::byte* b = frame.data + step.b;
+    std::byte* c = frame.data + step.c;
+#ifdef BS_BATCH_VECTORS
+    for(size_t i = 0; i < frame.lanes; i += batchVectorLanes)
+        storeVector<T>(c, i, Fn::apply(loadVector<T>(a, i), loadVector<T>(b, i)));
+#else
+    for(size_t i = 0; i < frame.lanes; ++i)
+        storeLane<T>(c, i, Fn::apply(loadLane<T>(a, i), loadLane<T>(b, i)));
+#endif
+    return true;
+}
+
+/// Integer division traps, so it only runs for the entities of the block, one at a time
+template<class T, class Fn>
+bool divisionKernel(const BatchStep& step, BatchFrame& frame)
+{
+    const std::byte* a = frame.data + step.a;
+    const std::byte* b = frame.data + step.b;
+    std::byte* c = frame.data + step.c;
+    for(size_t i = 0; i < frame.count; ++i)
+    {
+        T x = loadLane<T>(a, i);
+        T y = loadLane<T>(b, i);
+        if(!divisionValid(x, y))
+            return batchTrap(frame, step, i, "Integer division by zero or overflow");
+        storeLane<T>(c, i, Fn::apply(x, y));
+    }
+    return true;
+}
+
+/// Writes 0 or 1 for each lane to the frame's mask
+template<class T, class Fn>
+bool compareKernel(const BatchStep& step, BatchFrame& frame)
+{
+    const std::byte* a = frame.data + step.a;
+    const std::byte* b = frame.data + step.b;
+#ifdef BS_BATCH_VECTORS
+    for(size_t i = 0; i < frame.lanes; i += batchVectorLanes)
+    {
+        auto mask = Fn::apply(loadVector<T>(a, i), loadVector<T>(b, i));
+        Vector<uint8_t> bits = __builtin_convertvector(mask, Vector<uint8_t>) & 1;
+        std::memcpy(frame.mask + i, &bits, sizeof(bits));
+    }
+#else
+    for(size_t i = 0; i < frame.lanes; ++i)
+        frame.mask[i] = Fn::apply(loadLane<T>(a, i), loadLane<T>(b, i)) ? 1 : 0;
+#endif
+    return true;
+}
+
+/// Widens the frame's mask to booleans of the type a comparison writes
+template<class T>
+bool maskKernel(const BatchStep& step, BatchFrame& frame)
+{
+    std::byte* c = frame.data + step.c;
+#ifdef BS_BATCH_VECTORS
+    for(size_t i = 0; i < frame.lanes; i += batchVectorLanes)
+    {
+        Vector<uint8_t> bits;
+        std::memcpy(&bits, frame.mask + i, sizeof(bits));
+        storeVector<T>(c, i, __builtin_convertvector(bits, Vector<T>));
+    }
+#else
+    for(size_t i = 0; i < frame.lanes; ++i)
+        storeLane<T>(c, i, (T)frame.mask[i]);
+#endif
+    return true;
+}
+
+/// Value conversions, and raw moves between registers of different widths when used with unsigned types
+template<class From, class To>
+bool convertKernel(const BatchStep& step, BatchFrame& frame)
+{
+    const std::byte* a = frame.data + step.a;
+    std::byte* c = frame.data + step.c;
+#ifdef BS_BATCH_VECTORS
+    for(size_t i = 0; i < frame.lanes; i += batchVectorLanes)
+        storeVector<To>(c, i, __builtin_convertvector(loadVector<From>(a, i), Vector<To>));
+#else
+    for(size_t i = 0; i < frame.lanes; ++i)
+        storeLane<To>(c, i, (To)loadLane<From>(a, i));
+#endif
+    return true;
+}
+
+template<class T>
+bool saturateKernel(const BatchStep& step, BatchFrame& frame)
+{
+    const std::byte* a = frame.data + step.a;
+    std::byte* c = frame.data + step.c;
+    for(size_t i = 0; i < frame.lanes; ++i)
+        storeLane<T>(c, i, convertFloat<T>(loadLane<float>(a, i)));
+    return true;
+}
+
+template<class T>
+bool constantKernel(const BatchStep& step, BatchFrame& frame)
+{
+    std::byte* c = frame.data + step.c;
+    T value;
+    std::memcpy(&value, &step.constant, sizeof(T));
+#ifdef BS_BATCH_VECTORS
+    Vector<T> splat = Vector<T>{} + value;
+    for(size_t i = 0; i < frame.lanes; i += batchVectorLanes)
+        storeVector<T>(c, i, splat);
+#else
+    for(size_t i = 0; i < frame.lanes; ++i)
+        storeLane<T>(c, i, value);
+#endif
+    return true;
+}
+
+// Memory accesses go lane by lane, offsets and pointers are read from 64 bit columns
+template<class T>
+bool loadRegionKernel(const BatchStep& step, BatchFrame& frame)
+{
+    if(step.b >= frame.regions.size())
+        return batchTrap(frame, step, 0, "Load from an unbound memory region");
+    auto& region = frame.regions[step.b];
+    const std::byte* a = frame.data + step.a;
+    std::byte* c = frame.data + step.c;
+    for(size_t i = 0; i < frame.count; ++i)
+    {
+        uint64_t offset = loadLane<uint64_t>(a, i);
+        if(offset > region.size || sizeof(T) > region.size - offset)
+            return batchTrap(frame, step, i, "Load out of bounds");
+        T value;
+        std::memcpy(&value, region.data + offset, sizeof(T));
+        storeLane<T>(c, i, value);
+    }
+    return true;
+}
+
+template<class T>
+bool loadPtrKernel(const BatchStep& step, BatchFrame& frame)
+{
+    const std::byte* a = frame.data + step.a;
+    const std::byte* b = frame.data + step.b;
+    std::byte* c = frame.data + step.c;
+    for(size_t i = 0; i < frame.count; ++i)
+    {
+        auto* ptr = loadLane<const std::byte*>(b, i);
+        if(!ptr)
+            return batchTrap(frame, step, i, "Load from a null pointer");
+        uint64_t offset = loadLane<uint64_t>(a, i);
+        if(offset > step.constant || sizeof(T) > step.constant - offset)
+            return batchTrap(frame, step, i, "Load out of bounds");
+        T value;
+        std::memcpy(&value, ptr + offset, sizeof(T));
+        storeLane<T>(c, i, value);
+    }
+    return true;
+}
+
+template<class T>
+bool storeRegionKernel(const BatchStep& step, BatchFrame& frame)
+{
+    if(step.b >= frame.regions.size())
+        return batchTrap(frame, step, 0, "Store to an unbound memory region");
+    auto& region = frame.regions[step.b];
+    if(!region.writable)
+        return batchTrap(frame, step, 0, "Store to a read only memory region");
+    const std::byte* a = frame.data + step.a;
+    const std::byte* c = frame.data + step.c;
+    for(size_t i = 0; i < frame.count; ++i)
+    {
+        uint64_t offset = loadLane<uint64_t>(c, i);
+        if(offset > region.size || sizeof(T) > region.size - offset)
+            return batchTrap(frame, step, i, "Store out of bounds");
+        T value = loadLane<T>(a, i);
+        std::memcpy(region.data + offset, &value, sizeof(T));
+    }
+    return true;
+}
+
+template<class T>
+bool storePtrKernel(const BatchStep& step, BatchFrame& frame)
+{
+    const std::byte* a = frame.data + step.a;
+    const std::byte* b = frame.data + step.b;
+    const std::byte* c = frame.data + step.c;
+    for(size_t i = 0; i < frame.count; ++i)
+    {
+        auto* ptr = loadLane<std::byte*>(b, i);
+        if(!ptr)
+            return batchTrap(frame, step, i, "Store to a null pointer");
+        uint64_t offset = loadLane<uint64_t>(c, i);
+        if(offset > step.constant || sizeof(T) > step.constant - offset)
+            return batchTrap(frame, step, i, "Store out of bounds");
+        T value = loadLane<T>(a, i);
+        std::memcpy(ptr + offset, &value, sizeof(T));
+    }
+    return true;
+}
+
+template<size_t width>
+using Bits = std::conditional_t<width == 1, uint8_t, std::conditional_t<width == 4, uint32_t, uint64_t>>;
+
+template<size_t from>
+BatchKernel moveKernelFrom(size_t to)
+{
+    switch(to)
+    {
+        case 1:
+            return &convertKernel<Bits<from>, uint8_t>;
+        case 4:
+            return &convertKernel<Bits<from>, uint32_t>;
+        default:
+            return &convertKernel<Bits<from>, uint64_t>;
+    }
+}
+
+/// Zero extends or truncates raw register bits, the way the VM moves values between registers of different types
+BatchKernel moveKernel(size_t from, size_t to)
+{
+    switch(from)
+    {
+        case 1:
+            return moveKernelFrom<1>(to);
+        case 4:
+            return moveKernelFrom<4>(to);
+        default:
+            return moveKernelFrom<8>(to);
+    }
+}
+
+template<class T>
+using Arithmetic =
+    typename std::conditional_t<std::is_integral_v<T>, std::make_unsigned<T>, std::type_identity<T>>::type;
+
+class PlanLowering
+{
+    const BytecodeFunction& _function;
+    BatchPlan& _plan;
+    /// Columns for operands whose register has a different width than the instruction reads or writes
+    uint32_t _scratch[3] = {};
+    uint32_t _instruction = 0;
+
+    void push(BatchKernel kernel, uint32_t a, uint32_t b, uint32_t c, uint64_t constant = 0)
+    {
+        _plan.steps.push_back({kernel, a, b, c, constant, _instruction});
+    }
+
+    /// Column holding a register's value at a width, moving it to a scratch column first if it is stored at another
+    uint32_t read(SerializedValue operand, size_t width, size_t scratch)
+    {
+        uint16_t reg = operand.index;
+        if(_plan.widths[reg] == width)
+            return _plan.columns[reg];
+        push(moveKernel(_plan.widths[reg], width), _plan.columns[reg], 0, _scratch[scratch]);
+        return _scratch[scratch];
+    }
+
+    uint32_t write(SerializedValue operand, size_t width) const
+    {
+        return _plan.widths[operand.index] == width ? _plan.columns[operand.index] : _scratch[2];
+    }
+
+    /// Moves a result written to the scratch column by write() into its register
+    void commit(SerializedValue operand, size_t width)
+    {
+        uint16_t reg = operand.index;
+        if(_plan.widths[reg] != width)
+            push(moveKernel(width, _plan.widths[reg]), _scratch[2], 0, _plan.columns[reg]);
+    }
+
+    template<class T>
+    void binary(BatchKernel kernel, const BCInstruction& inst, bool readsB = true)
+    {
+        uint32_t a = read(inst.a, sizeof(T), 0);
+        uint32_t b = readsB ? read(inst.b, sizeof(T), 1) : a;
+        push(kernel, a, b, write(inst.c, sizeof(T)));
+        commit(inst.c, sizeof(T));
+    }
+
+    template<class From, class To>
+    void unary(BatchKernel kernel, const BCInstruction& inst)
+    {
+        uint32_t a = read(inst.a, sizeof(From), 0);
+        push(kernel, a, 0, write(inst.c, sizeof(To)));
+        commit(inst.c, sizeof(To));
+    }
+
+    /// Comparisons write their mask straight into the type of their result, so the bytecode's bool to float
+    /// conversions that follow them are skipped
+    template<class T, class Fn>
+    void compare(const BCInstruction& inst, bool readsB = true)
+    {
+        uint32_t a = read(inst.a, sizeof(T), 0);
+        uint32_t b = readsB ? read(inst.b, sizeof(T), 1) : a;
+        push(&compareKernel<T, Fn>, a, b, 0);
+        BatchKernel widen;
+        switch(_function.registerTypes[inst.c.index])
+        {
+            case ValueType::F32:
+                widen = &maskKernel<float>;
+                break;
+            case ValueType::F64:
+                widen = &maskKernel<double>;
+                break;
+            default:
+                widen = _plan.widths[inst.c.index] == 1   ? &maskKernel<uint8_t>
+                        : _plan.widths[inst.c.index] == 4 ? &maskKernel<uint32_t>
+                                                          : &maskKernel<uint64_t>;
+                break;
+        }
+        push(widen, 0, 0, _plan.columns[inst.c.index]);
+    }
+
+    template<class T>
+    void load(BatchKernel kernel, const BCInstruction& inst, bool region)
+    {
+        uint32_t offset = read(inst.a, sizeof(uint64_t), 0);
+        uint32_t store = region ? inst.b.index : read(inst.b, sizeof(uint64_t), 1);
+        push(kernel, offset, store, write(inst.c, sizeof(T)), region ? 0 : inst.b.offset);
+        commit(inst.c, sizeof(T));
+    }
+
+    template<class T>
+    void store(BatchKernel kernel, const BCInstruction& inst, bool region)
+    {
+        uint32_t value = read(inst.a, sizeof(T), 0);
+        uint32_t store = region ? inst.b.index : read(inst.b, sizeof(uint64_t), 1);
+        push(kernel, value, store, read(inst.c, sizeof(uint64_t), 2), region ? 0 : inst.b.offset);
+    }
+
+  public:
+    PlanLowering(const BytecodeFunction& function, BatchPlan& plan) : _function(function), _plan(plan) {}
+
+    std::expected<void, std::string> lower()
+    {
+        if(!_function.asyncCalls.empty())
+            return std::unexpected(std::format("{} makes async calls, which can't run in batches", _function.id));
+        _plan.function = &_function;
+        size_t offset = 0;
+        for(ValueType type : _function.registerTypes)
+        {
+            _plan.columns.push_back((uint32_t)offset);
+            _plan.widths.push_back((uint8_t)BatchExecutor::columnWidth(type));
+            offset += BatchExecutor::columnWidth(type) * BatchExecutor::blockSize;
+        }
+        for(auto& scratch : _scratch)
+        {
+            scratch = (uint32_t)offset;
+            offset += sizeof(uint64_t) * BatchExecutor::blockSize;
+        }
+        _plan.frameBytes = offset;
+
+        for(auto& inst : _function.code)
+        {
+            _instruction = (uint32_t)(&inst - _function.code.data());
+            switch(inst.op)
+            {
+                case BCOp::Mov:
+                {
+                    uint16_t a = inst.a.index;
+                    uint16_t c = inst.c.index;
+                    push(moveKernel(_plan.widths[a], _plan.widths[c]), _plan.columns[a], 0, _plan.columns[c]);
+                    break;
+                }
+                case BCOp::LoadConst:
+                {
+                    size_t width = _plan.widths[inst.c.index];
+                    BatchKernel kernel = width == 1   ? &constantKernel<uint8_t>
+                                         : width == 4 ? &constantKernel<uint32_t>
+                                                      : &constantKernel<uint64_t>;
+                    push(kernel, 0, 0, _plan.columns[inst.c.index], _function.constants[inst.a.index].bits);
+                    break;
+                }
+#define BS_BATCH_TYPES(X, name, ...)                                                                                   \
+    X(name##I32, int32_t, __VA_ARGS__)                                                                                 \
+    X(name##U32, uint32_t, __VA_ARGS__)                                                                                \
+    X(name##I64, int64_t, __VA_ARGS__)                                                                                 \
+    X(name##U64, uint64_t, __VA_ARGS__)                                                                                \
+    X(name##F32, float, __VA_ARGS__)                                                                                   \
+    X(name##F64, double, __VA_ARGS__)
+#define BS_BATCH_INT_TYPES(X, name, ...)                                                                               \
+    X(name##I32, int32_t, __VA_ARGS__)                                                                                 \
+    X(name##U32, uint32_t, __VA_ARGS__)                                                                                \
+    X(name##I64, int64_t, __VA_ARGS__)                                                                                 \
+    X(name##U64, uint64_t, __VA_ARGS__)
+#define BS_BATCH_BINARY(op, T, Fn, readsB)                                                                             \
+    case BCOp::op:                                                                                                     \
+        binary<T>(&binaryKernel<Arithmetic<T>, Fn>, inst, readsB);                                                     \
+        break;
+#define BS_BATCH_DIVISION(op, T, Fn)                                                                                   \
+    case BCOp::op:                                                                                                     \
+        if constexpr(std::is_same_v<Fn, Div> && std::is_floating_point_v<T>)                                           \
+            binary<T>(&binaryKernel<T, Fn>, inst);                                                                     \
+        else                                                                                                           \
+            binary<T>(&divisionKernel<T, Fn>, inst);                                                                   \
+        break;
+#define BS_BATCH_COMPARE(op, T, Fn, readsB)                                                                            \
+    case BCOp::op:                                                                                                     \
+        compare<T, Fn>(inst, readsB);                                                                                  \
+        break;
+                BS_BATCH_TYPES(BS_BATCH_BINARY, Add, Add, true)
+                BS_BATCH_TYPES(BS_BATCH_BINARY, Sub, Sub, true)
+                BS_BATCH_TYPES(BS_BATCH_BINARY, Mul, Mul, true)
+                BS_BATCH_TYPES(BS_BATCH_DIVISION, Div, Div)
+                BS_BATCH_TYPES(BS_BATCH_DIVISION, Mod, Mod)
+                BS_BATCH_TYPES(BS_BATCH_COMPARE, Eq, Eq, true)
+                BS_BATCH_TYPES(BS_BATCH_COMPARE, Ne, Ne, true)
+                BS_BATCH_TYPES(BS_BATCH_COMPARE, Gt, Gt, true)
+                BS_BATCH_TYPES(BS_BATCH_COMPARE, Ge, Ge, true)
+                BS_BATCH_TYPES(BS_BATCH_COMPARE, LogicNot, LogicNot, false)
+                BS_BATCH_TYPES(BS_BATCH_COMPARE, LogicAnd, LogicAnd, true)
+                BS_BATCH_TYPES(BS_BATCH_COMPARE, LogicOr, LogicOr, true)
+                BS_BATCH_INT_TYPES(BS_BATCH_BINARY, BitNot, BitNot, false)
+                BS_BATCH_INT_TYPES(BS_BATCH_BINARY, BitAnd, BitAnd, true)
+                BS_BATCH_INT_TYPES(BS_BATCH_BINARY, BitOr, BitOr, true)
+                BS_BATCH_INT_TYPES(BS_BATCH_BINARY, BitXor, BitXor, true)
+#undef BS_BATCH_TYPES
+#undef BS_BATCH_INT_TYPES
+#undef BS_BATCH_BINARY
+#undef BS_BATCH_DIVISION
+#undef BS_BATCH_COMPARE
+                case BCOp::I32ToF32:
+                    unary<int32_t, float>(&convertKernel<int32_t, float>, inst);
+                    break;
+                case BCOp::U32ToF32:
+                    unary<uint32_t, float>(&convertKernel<uint32_t, float>, inst);
+                    break;
+                case BCOp::F32ToI32:
+                    unary<float, int32_t>(&saturateKernel<int32_t>, inst);
+                    break;
+                case BCOp::F32ToU32:
+                    unary<float, uint32_t>(&saturateKernel<uint32_t>, inst);
+                    break;
+                case BCOp::BoolToF32:
+                case BCOp::BoolToF64:
+                    break;
+                case BCOp::LoadRegion8:
+                    load<uint8_t>(&loadRegionKernel<uint8_t>, inst, true);
+                    break;
+                case BCOp::LoadRegion32:
+                    load<uint32_t>(&loadRegionKernel<uint32_t>, inst, true);
+                    break;
+                case BCOp::LoadRegion64:
+                    load<uint64_t>(&loadRegionKernel<uint64_t>, inst, true);
+                    break;
+                case BCOp::LoadPtr8:
+                    load<uint8_t>(&loadPtrKernel<uint8_t>, inst, false);
+                    break;
+                case BCOp::LoadPtr32:
+                    load<uint32_t>(&loadPtrKernel<uint32_t>, inst, false);
+                    break;
+                case BCOp::LoadPtr64:
+                    load<uint64_t>(&loadPtrKernel<uint64_t>, inst, false);
+                    break;
+                case BCOp::StoreRegion8:
+                    store<uint8_t>(&storeRegionKernel<uint8_t>, inst, true);
+                    break;
+                case BCOp::StoreRegion32:
+                    store<uint32_t>(&storeRegionKernel<uint32_t>, inst, true);
+                    break;
+                case BCOp::StoreRegion64:
+                    store<uint64_t>(&storeRegionKernel<uint64_t>, inst, true);
+                    break;
+                case BCOp::StorePtr8:
+                    store<uint8_t>(&storePtrKernel<uint8_t>, inst, false);
+                    break;
+                case BCOp::StorePtr32:
+                    store<uint32_t>(&storePtrKernel<uint32_t>, inst, false);
+                    break;
+                case BCOp::StorePtr64:
+                    store<uint64_t>(&storePtrKernel<uint64_t>, inst, false);
+                    break;
+                case BCOp::Call:
+                case BCOp::CallHost:
+                    return std::unexpected(std::format("{} makes calls, which can't run in batches", _function.id));
+                case BCOp::Return:
+                    return {};
+                default:
+                    return std::unexpected(std::format("{}: invalid op code at {}", _function.id, _instruction));
+            }
+        }
+        return {};
+    }
+};
+
+std::expected<BatchPlan, std::string> lowerPlan(const BytecodeFunction& function)
+{
+    BatchPlan plan;
+    auto result = PlanLowering(function, plan).lower();
+    if(!result)
+        return std::unexpected(result.error());
+    return plan;
+}
@@ -0,0 +1,784 @@
+#include "bytecode.h"
+
+#include <algorithm>
+#include <format>
+#include <functional>
+#include "../ir/structLayout.h"
+#include "hostFunctions.h"
+#include "vm.h"
+
+namespace BraneScript
+{
+    template<class... Ts>
+    struct overloads : Ts...
+    {
+        using Ts::operator()...;
+    };
+
+    std::string_view bcOpName(BCOp op)
+    {
+        static constexpr std::string_view names[] = {
+#define BS_BYTECODE_NAME(name) #name,
+            BS_BYTECODE_OPS(BS_BYTECODE_NAME)
+#undef BS_BYTECODE_NAME
+        };
+        return (size_t)op < std::size(names) ? names[(size_t)op] : "Invalid";
+    }
+
+    std::optional<ValueType> vmValueType(const BSType& type)
+    {
+        if(std::holds_alternative<IRNode<BSRefType>>(type))
+            return ValueType::U64;
+        auto* base = std::get_if<BSBaseType>(&type);
+        if(!base)
+            return std::nullopt;
+        switch(*base)
+        {
+            case BSBaseType::U8:
+            case BSBaseType::I8:
+                return ValueType::Char;
+            case BSBaseType::U32:
+                return ValueType::U32;
+            case BSBaseType::I32:
+                return ValueType::I32;
+            case BSBaseType::U64:
+                return ValueType::U64;
+            case BSBaseType::I64:
+                return ValueType::I64;
+            case BSBaseType::F32:
+                return ValueType::F32;
+            case BSBaseType::F64:
+                return ValueType::F64;
+            default:
+                return std::nullopt;
+        }
+    }
+
+    namespace
+    {
+        /// Position of a type within a typed op family, see BS_BYTECODE_OPS
+        std::optional<uint16_t> typedOpOffset(ValueType type, bool allowFloat)
+        {
+            switch(type)
+            {
+                case ValueType::I32:
+                    return 0;
+                case ValueType::U32:
+                    return 1;
+                case ValueType::I64:
+                    return 2;
+                case ValueType::U64:
+                    return 3;
+                case ValueType::F32:
+                    return allowFloat ? std::optional<uint16_t>(4) : std::nullopt;
+                case ValueType::F64:
+                    return allowFloat ? std::optional<uint16_t>(5) : std::nullopt;
+                default:
+                    return std::nullopt;
+            }
+        }
+
+        struct TypedOp
+        {
+            BCOp first;
+            bool allowFloat;
+            bool returnsBool;
+        };
+
+        std::optional<TypedOp> typedOpFor(OpCode op)
+        {
+            switch(op)
+            {
+                case OpCode::Add:
+                    return TypedOp{BCOp::AddI32, true, false};
+                case OpCode::Sub:
+                    return TypedOp{BCOp::SubI32, true, false};
+                case OpCode::Mul:
+                    return TypedOp{BCOp::MulI32, true, false};
+                case OpCode::Div:
+                    return TypedOp{BCOp::DivI32, true, false};
+                case OpCode::Mod:
+                    return TypedOp{BCOp::ModI32, true, false};
+                case OpCode::Eq:
+                    return TypedOp{BCOp::EqI32, true, true};
+                case OpCode::Ne:
+                    return TypedOp{BCOp::NeI32, true, true};
+                case OpCode::Gt:
+                    return TypedOp{BCOp::GtI32, true, true};
+                case OpCode::Ge:
+                    return TypedOp{BCOp::GeI32, true, true};
+                case OpCode::LogicNot:
+                    return TypedOp{BCOp::LogicNotI32, true, true};
+                case OpCode::LogicAnd:
+                    return TypedOp{BCOp::LogicAndI32, true, true};
+                case OpCode::LogicOr:
+                    return TypedOp{BCOp::LogicOrI32, true, true};
+                case OpCode::BitNot:
+                    return TypedOp{BCOp::BitNotI32, false, false};
+                case OpCode::BitAnd:
+                    return TypedOp{BCOp::BitAndI32, false, false};
+                case OpCode::BitOr:
+                    return TypedOp{BCOp::BitOrI32, false, false};
+                case OpCode::BitXor:
+                    return TypedOp{BCOp::BitXorI32, false, false};
+                default:
+                    return std::nullopt;
+            }
+        }
+
+        std::optional<uint16_t> memoryOpOffset(ValueType type)
+        {
+            switch(type)
+            {
+                case ValueType::Bool:
+                case ValueType::Char:
+                    return 0;
+                case ValueType::I32:
+                case ValueType::U32:
+                case ValueType::F32:
+                    return 1;
+                case ValueType::I64:
+                case ValueType::U64:
+                case ValueType::F64:
+                    return 2;
+                default:
+                    return std::nullopt;
+            }
+        }
+
+        BCOp offsetOp(BCOp first, uint16_t offset) { return (BCOp)((uint16_t)first + offset); }
+
+        struct CallTarget
+        {
+            uint32_t index;
+            /// Set when the call is bound to a host function, index is then its Program::hostFunctions slot
+            const HostFunction* host = nullptr;
+        };
+
+        using FunctionResolver = std::function<std::expected<CallTarget, std::string>(const IDRef&)>;
+        /// Size of the value a ref type refers to
+        using PointeeSize = std::function<std::expected<uint64_t, std::string>(TypeId)>;
+
+        class BodyLowering
+        {
+            const std::vector<TypeId>& _localVars;
+            const TypeTable& _typeTable;
+            const InstructionList& _code;
+            const FunctionResolver& _resolve;
+            const PointeeSize& _pointeeSize;
+            BytecodeFunction& _out;
+            std::vector<ValueType> _types;
+
+            SerializedValue reg(uint32_t value) const
+            {
+                return {(uint16_t)value, 0, _types[value], ValueStorageType_Reg};
+            }
+
+            std::unexpected<std::string> error(const Instruction& inst, std::string_view message) const
+            {
+                return std::unexpected(std::format("{}: {} at instruction {}",
+                                                   _out.id,
+                                                   message,
+                                                   &inst - _code.instructions.data()));
+            }
+
+            /// Operands are not checked when a module is loaded, and the interpreter trusts them, so they are
+            /// checked here
+            bool operandsValid(const Instruction& inst) const
+            {
+                size_t frameSize = _localVars.size();
+                if(inst.op == OpCode::Call)
+                {
+                    if(inst.a >= _code.callTargets.size() || inst.b > _code.callOperands.size() ||
+                       (size_t)inst.count + inst.c > _code.callOperands.size() - inst.b)
+                        return false;
+                    for(size_t i = 0; i < (size_t)inst.count + inst.c; ++i)
+                    {
+                        if(_code.callOperands[inst.b + i] >= frameSize)
+                            return false;
+                    }
+                    return true;
+                }
+                if(inst.c >= frameSize)
+                    return false;
+                if(isConstOp(inst.op))
+                    return true;
+                if(inst.a >= frameSize)
+                    return false;
+                bool readsB = isBinaryOp(inst.op) || ((inst.op == OpCode::Load || inst.op == OpCode::Store) &&
+                                                      !(inst.flags & InstructionFlags_ConstStore));
+                return !readsB || inst.b < frameSize;
+            }
+
+            void emit(BCOp op, SerializedValue a, SerializedValue b, SerializedValue c)
+            {
+                _out.code.push_back({op, a, b, c});
+            }
+
+            /// References are handed to scripts by the host, arithmetic or conversions producing one would let a
+            /// script forge pointers and reading one into a number would leak addresses
+            bool touchesRef(const Instruction& inst) const
+            {
+                if(_typeTable.isRef(_localVars[inst.c]))
+                    return true;
+                if(isConstOp(inst.op))
+                    return false;
+                return _typeTable.isRef(_localVars[inst.a]) ||
+                       (isBinaryOp(inst.op) && _typeTable.isRef(_localVars[inst.b]));
+            }
+
+            std::expected<void, std::string>
+            lowerConversion(const Instruction& inst, BCOp op, ValueType from, ValueType to)
+            {
+                if(touchesRef(inst) || _types[inst.a] != from || _types[inst.c] != to)
+                    return error(inst, "conversion operands have the wrong types");
+                emit(op, reg(inst.a), {}, reg(inst.c));
+                return {};
+            }
+
+            static bool constFits(OpCode op, ValueType type)
+            {
+                switch(op)
+                {
+                    case OpCode::ConstF32:
+                        return type == ValueType::F32;
+                    case OpCode::ConstI32:
+                        return type == ValueType::I32 || type == ValueType::U32;
+                    default:
+                        return type == ValueType::I32 || type == ValueType::U32 || type == ValueType::I64 ||
+                               type == ValueType::U64;
+                }
+            }
+
+            /// Booleans are 0 or 1 in whatever type the instruction writes, integer ops already produce that
+            void emitBoolConversion(uint32_t out)
+            {
+                if(_types[out] == ValueType::F32)
+                    emit(BCOp::BoolToF32, reg(out), {}, reg(out));
+                else if(_types[out] == ValueType::F64)
+                    emit(BCOp::BoolToF64, reg(out), {}, reg(out));
+            }
+
+            std::expected<void, std::string> lowerTyped(const Instruction& inst)
+            {
+                auto typed = typedOpFor(inst.op);
+                if(!typed)
+                    return error(inst, "unknown op code");
+                if(touchesRef(inst))
+                    return error(inst, "operation on a reference");
+                auto offset = typedOpOffset(_types[inst.a], typed->allowFloat);
+                if(!offset)
+                    return error(inst, "operation is not supported for its operand type");
+                // Handlers take every operand's width from the op, so operands of another type would be reinterpreted
+                if(isBinaryOp(inst.op) && _types[inst.b] != _types[inst.a])
+                    return error(inst, "operands have different types");
+                if(!typed->returnsBool && _types[inst.c] != _types[inst.a])
+                    return error(inst, "result type does not match the operand type");
+                SerializedValue b = isBinaryOp(inst.op) ? reg(inst.b) : SerializedValue{};
+                emit(offsetOp(typed->first, *offset), reg(inst.a), b, reg(inst.c));
+                if(typed->returnsBool)
+                    emitBoolConversion(inst.c);
+                return {};
+            }
+
+            std::expected<void, std::string> lowerMemory(const Instruction& inst)
+            {
+                bool isLoad = inst.op == OpCode::Load;
+                // A reference loaded from memory could point anywhere, and one stored there leaks a host address
+                if(_typeTable.isRef(_localVars[isLoad ? inst.c : inst.a]))
+                    return error(inst, isLoad ? "load into a reference" : "store of a reference");
+                // Loads take their width from what they write, stores from what they read
+                auto offset = memoryOpOffset(_types[isLoad ? inst.c : inst.a]);
+                if(!offset)
+                    return error(inst, "memory access of an unsupported type");
+
+                SerializedValue store;
+                BCOp first;
+                if(inst.flags & InstructionFlags_ConstStore)
+                {
+                    if(inst.b > UINT16_MAX)
+                        return error(inst, "memory region index out of range");
+                    store = {(uint16_t)inst.b, 0, ValueType::U32, ValueStorageType_Global};
+                    first = isLoad ? BCOp::LoadRegion8 : BCOp::StoreRegion8;
+                }
+                else
+                {
+                    // Host memory handed to scripts through an immutable reference may be read only
+                    auto ref = _localVars[inst.b];
+                    if(!_typeTable.isRef(ref))
+                        return error(inst, "memory access through a value that is not a reference");
+                    if(!isLoad && !_typeTable.isMutableRef(ref))
+                        return error(inst, "store through an immutable reference");
+                    // Accesses through a pointer are bounds checked against the size of the value it refers to
+                    auto size = _pointeeSize(ref);
+                    if(!size)
+                        return error(inst, size.error());
+                    if(*size > UINT16_MAX)
+                        return error(inst, "referenced value is too large to bounds check");
+                    store = reg(inst.b);
+                    store.offset = (uint16_t)*size;
+                    store.storageType = ValueStorageType_Ptr;
+                    first = isLoad ? BCOp::LoadPtr8 : BCOp::StorePtr8;
+                }
+                emit(offsetOp(first, *offset), reg(inst.a), store, reg(inst.c));
+                return {};
+            }
+
+            /// Host thunks trust the registers they are handed to hold their parameter types, so that is checked here
+            bool matchesSignature(const Instruction& inst, const HostFunction& host) const
+            {
+                auto inputs = _code.callInputs(inst);
+                auto outputs = _code.callOutputs(inst);
+                if(inputs.size() != host.inputs.size() || outputs.size() != host.outputs.size())
+                    return false;
+                for(size_t i = 0; i < inputs.size(); ++i)
+                {
+                    if(_types[inputs[i]] != host.inputs[i])
+                        return false;
+                }
+                // Pointers a host function returns are U64 like any other address, a script may not take them as
+                // references
+                for(size_t i = 0; i < outputs.size(); ++i)
+                {
+                    if(_types[outputs[i]] != host.outputs[i] || _typeTable.isRef(_localVars[outputs[i]]))
+                        return false;
+                }
+                return true;
+            }
+
+            std::expected<void, std::string> lowerCall(const Instruction& inst)
+            {
+                auto target = _resolve(_code.callTarget(inst));
+                if(!target)
+                    return error(inst, target.error());
+                BCCallSite site{
+                    target->index, (uint32_t)_out.callOperands.size(), inst.count, (uint16_t)inst.c, !!target->host};
+                if(inst.c > UINT16_MAX)
+                    return error(inst, "too many call outputs");
+                if(target->host && !matchesSignature(inst, *target->host))
+                    return error(inst, std::format("call does not match the signature of host function {}",
+                                                   target->host->id));
+                for(uint32_t input : _code.callInputs(inst))
+                    _out.callOperands.push_back((uint16_t)input);
+                for(uint32_t output : _code.callOutputs(inst))
+                    _out.callOperands.push_back((uint16_t)output);
+                emit(site.host ? BCOp::CallHost : BCOp::Call,
+                     {(uint16_t)_out.calls.size(), 0, ValueType::Void, ValueStorageType_Null},
+                     {},
+                     {});
+                _out.calls.push_back(site);
+                if(_out.calls.size() > UINT16_MAX + 1)
+                    return error(inst, "too many calls in one body");
+                return {};
+            }
+
+          public:
+            BodyLowering(const std::vector<TypeId>& localVars,
+                         const TypeTable& typeTable,
+                         const InstructionList& code,
+                         const FunctionResolver& resolve,
+                         const PointeeSize& pointeeSize,
+                         BytecodeFunction& out)
+                : _localVars(localVars), _typeTable(typeTable), _code(code), _resolve(resolve),
+                  _pointeeSize(pointeeSize), _out(out)
+            {}
+
+            std::expected<void, std::string> lower()
+            {
+                if(_localVars.size() > UINT16_MAX)
+                    return std::unexpected(std::format("{}: too many local vars for a VM frame", _out.id));
+                _out.frameSize = (uint16_t)_localVars.size();
+                for(size_t i = 0; i < _localVars.size(); ++i)
+                {
+                    auto type = vmValueType(_typeTable.type(_localVars[i]));
+                    if(!type)
+                        return std::unexpected(std::format("{}: local var {} has a type the VM does not support",
+                                                           _out.id,
+                                                           i));
+                    _types.push_back(*type);
+
+                    auto& ref = _out.refTypes.emplace_back();
+                    if(!_typeTable.isRef(_localVars[i]))
+                        continue;
+                    auto size = _pointeeSize(_localVars[i]);
+                    if(!size)
+                        return std::unexpected(std::format("{}: {}", _out.id, size.error()));
+                    ref = {*size, true, _typeTable.isMutableRef(_localVars[i])};
+                }
+
+                for(auto& inst : _code.instructions)
+                {
+                    if(!operandsValid(inst))
+                        return error(inst, "operand out of range");
+                    std::expected<void, std::string> result;
+                    switch(inst.op)
+                    {
+                        case OpCode::Mov:
+                            // Compared by type rather than VM type, so moves can't turn numbers into references or
+                            // immutable references into mutable ones
+                            if(_localVars[inst.a] != _localVars[inst.c])
+                                return error(inst, "move between values of different types");
+                            emit(BCOp::Mov, reg(inst.a), {}, reg(inst.c));
+                            break;
+                        case OpCode::ConstI32:
+                        case OpCode::ConstU32:
+                        case OpCode::ConstF32:
+                            // Constants are written zero extended, which keeps unsigned values but would turn a
+                            // negative I32 into a large positive 64 bit value
+                            if(!constFits(inst.op, _types[inst.c]) || touchesRef(inst))
+                                return error(inst, "constant does not match the type of its destination");
+                            emit(BCOp::LoadConst,
+                                 {(uint16_t)_out.constants.size(), 0, _types[inst.c], ValueStorageType_Const},
+                                 {},
+                                 reg(inst.c));
+                            _out.constants.push_back(Register::of(inst.a));
+                            break;
+                        case OpCode::I32ToF32:
+                            result = lowerConversion(inst, BCOp::I32ToF32, ValueType::I32, ValueType::F32);
+                            break;
+                        case OpCode::U32ToF32:
+                            result = lowerConversion(inst, BCOp::U32ToF32, ValueType::U32, ValueType::F32);
+                            break;
+                        case OpCode::F32ToI32:
+                            result = lowerConversion(inst, BCOp::F32ToI32, ValueType::F32, ValueType::I32);
+                            break;
+                        case OpCode::F32ToU32:
+                            result = lowerConversion(inst, BCOp::F32ToU32, ValueType::F32, ValueType::U32);
+                            break;
+                        case OpCode::Load:
+                        case OpCode::Store:
+                            result = lowerMemory(inst);
+                            break;
+                        case OpCode::Call:
+                            result = lowerCall(inst);
+                            break;
+                        default:
+                            result = lowerTyped(inst);
+                            break;
+                    }
+                    if(!result)
+                        return result;
+                }
+                if(_out.constants.size() > UINT16_MAX + 1)
+                    return std::unexpected(std::format("{}: too many constants in one body", _out.id));
+                emit(BCOp::Return, {}, {}, {});
+                _out.registerTypes = _types;
+                threadBytecode(_out);
+                return {};
+            }
+        };
+    } // namespace
+
+    std::expected<Program, std::string> Program::load(std::span<const BSModule> modules, const HostFunctionTable* host)
+    {
+        return lower(modules, host, nullptr, 0);
+    }
+
+    std::expected<Program, std::string> Program::reload(const Program& previous,
+                                                        std::span<const BSModule> modules,
+                                                        size_t changed,
+                                                        const HostFunctionTable* host)
+    {
+        return lower(modules, host, &previous, changed);
+    }
+
+    std::expected<Program, std::string> Program::lower(std::span<const BSModule> modules,
+                                                       const HostFunctionTable* host,
+                                                       const Program* previous,
+                                                       size_t changed)
+    {
+        Program program;
+        std::unordered_map<std::string, uint32_t> hostSlots;
+        // Index everything first so that calls can reference functions defined later or in other modules
+        for(auto& module : modules)
+        {
+            program._moduleNames.push_back(module.name);
+            program._moduleFunctions.push_back((uint32_t)program._functions.size());
+            program._modulePipelines.push_back((uint32_t)program._pipelines.size());
+            for(auto& function : module.functions)
+            {
+                if(!program._functionIndices.insert({function->id, (uint32_t)program._functions.size()}).second)
+                    return std::unexpected(std::format("Function {} is defined more than once", function->id));
+                auto& out = program._functions.emplace_back();
+                out.id = function->id;
+                out.profileSlot = program._profileSlotCount++;
+            }
+            for(auto& pipeline : module.pipelines)
+            {
+                if(!program._pipelineIndices.insert({pipeline->id, (uint32_t)program._pipelines.size()}).second)
+                    return std::unexpected(std::format("Pipeline {} is defined more than once", pipeline->id));
+                program._pipelines.emplace_back().id = pipeline->id;
+            }
+        }
+        program._moduleFunctions.push_back((uint32_t)program._functions.size());
+        program._modulePipelines.push_back((uint32_t)program._pipelines.size());
+
+        // Bind each host function once, every call to it then goes through the same slot
+        auto hostSlot = [&](const HostFunction& function) {
+            auto [slot, inserted] = hostSlots.insert({function.id, (uint32_t)program._hostFunctions.size()});
+            if(inserted)
+                program._hostFunctions.push_back({function.id,
+                                                  function.function,
+                                                  function.thunk,
+                                                  (uint16_t)function.inputs.size(),
+                                                  (uint16_t)function.outputs.size()});
+            return slot->second;
+        };
+
+        // A call in bytecode taken from the previous program keeps its target if a function of the same name is
+        // still defined, or the same host function is still bound to it
+        auto rebound = [&](const BCCallSite& site) -> std::optional<CallTarget> {
+            if(!site.host)
+            {
+                auto index = program.function(previous->_functions[site.function].id);
+                return index ? std::optional<CallTarget>(CallTarget{*index}) : std::nullopt;
+            }
+            auto& bound = previous->_hostFunctions[site.function];
+            auto* function = host && !program.function(bound.id) ? host->find(bound.id) : nullptr;
+            if(!function || function->function != bound.function || function->thunk != bound.thunk)
+                return std::nullopt;
+            return CallTarget{0, function};
+        };
+
+        auto reuse = [&](size_t m) -> bool {
+            if(!previous || m == changed || m + 1 >= previous->_moduleFunctions.size() ||
+               previous->_moduleNames[m] != modules[m].name)
+                return false;
+            auto& module = modules[m];
+            auto functions = std::span(previous->_functions)
+                                 .subspan(previous->_moduleFunctions[m],
+                                          previous->_moduleFunctions[m + 1] - previous->_moduleFunctions[m]);
+            auto pipelines = std::span(previous->_pipelines)
+                                 .subspan(previous->_modulePipelines[m],
+                                          previous->_modulePipelines[m + 1] - previous->_modulePipelines[m]);
+            if(functions.size() != module.functions.size() || pipelines.size() != module.pipelines.size())
+                return false;
+            // Check everything before binding anything, so a module that has to be lowered again leaves no trace
+            auto resolves = [&](const BytecodeFunction& body) {
+                return std::ranges::all_of(body.calls, [&](const BCCallSite& site) { return !!rebound(site); });
+            };
+            for(size_t i = 0; i < functions.size(); ++i)
+            {
+                if(functions[i].id != module.functions[i]->id || !resolves(functions[i]))
+                    return false;
+            }
+            for(size_t i = 0; i < pipelines.size(); ++i)
+            {
+                if(pipelines[i].id != module.pipelines[i]->id || !std::ranges::all_of(pipelines[i].stages, resolves))
+                    return false;
+            }
+
+            auto rebind = [&](BytecodeFunction& body) {
+                for(auto& site : body.calls)
+                {
+                    auto target = *rebound(site);
+                    site.function = target.host ? hostSlot(*target.host) : target.index;
+                }
+            };
+            for(size_t i = 0; i < functions.size(); ++i)
+            {
+                auto& out = program._functions[program._moduleFunctions[m] + i];
+                uint32_t profileSlot = out.profileSlot;
+                out = functions[i];
+                out.profileSlot = profileSlot;
+                rebind(out);
+            }
+            for(size_t i = 0; i < pipelines.size(); ++i)
+            {
+                auto& out = program._pipelines[program._modulePipelines[m] + i];
+                out = pipelines[i];
+                for(auto& stage : out.stages)
+                {
+                    stage.profileSlot = program._profileSlotCount++;
+                    rebind(stage);
+                }
+            }
+            return true;
+        };
+
+        // Layouts are only needed to bounds check accesses through references, so they are computed on first use
+        std::optional<std::expected<StructLayouts, std::string>> layouts;
+        uint32_t nextFunction = 0;
+        uint32_t nextPipeline = 0;
+        for(size_t m = 0; m < modules.size(); ++m)
+        {
+            auto& module = modules[m];
+            if(reuse(m))
+            {
+                nextFunction += (uint32_t)module.functions.size();
+                nextPipeline += (uint32_t)module.pipelines.size();
+                continue;
+            }
+            auto resolveName = [&](const std::string& name) -> std::expected<CallTarget, std::string> {
+                if(auto index = program.function(name))
+                    return CallTarget{*index};
+                auto* function = host ? host->find(name) : nullptr;
+                if(!function)
+                    return std::unexpected(std::format("call to undefined function {}", name));
+                return CallTarget{hostSlot(*function), function};
+            };
+            FunctionResolver resolve = [&](const IDRef& ref) -> std::expected<CallTarget, std::string> {
+                return std::visit(overloads{resolveName,
+                                            [&](int32_t id) -> std::expected<CallTarget, std::string> {
+                    if(auto* imported = importedSymbol(module, id))
+                        return resolveName(*imported);
+                    if(id <= 0 || (size_t)id > module.functions.size())
+                        return std::unexpected(std::format("call to unbound external function {}", id));
+                    return CallTarget{program._moduleFunctions[m] + (uint32_t)(id - 1)};
+                }},
+                                  ref);
+            };
+            PointeeSize pointeeSize = [&](TypeId ref) -> std::expected<uint64_t, std::string> {
+                if(!layouts)
+                    layouts = StructLayouts::compute(modules);
+                if(!*layouts)
+                    return std::unexpected(layouts->error());
+                auto layout = (*layouts)->typeLayout(module.types.type(module.types.dereferenced(ref)), m);
+                if(!layout)
+                    return std::unexpected(layout.error());
+                return layout->size;
+            };
+
+            for(auto& function : module.functions)
+            {
+                auto& out = program._functions[nextFunction++];
+                if(function->inputs.size() + function->outputs.size() > function->localVars.size())
+                    return std::unexpected(std::format("{}: missing input or output local vars", out.id));
+                out.inputCount = (uint16_t)function->inputs.size();
+                out.outputCount = (uint16_t)function->outputs.size();
+                auto result =
+                    BodyLowering(function->localVars, module.types, function->operations, resolve, pointeeSize, out)
+                        .lower();
+                if(!result)
+                    return std::unexpected(result.error());
+            }
+
+            for(auto& pipeline : module.pipelines)
+            {
+                auto& out = program._pipelines[nextPipeline++];
+                out.inputCount = (uint16_t)pipeline->inputs.size();
+                out.outputCount = (uint16_t)pipeline->outputs.size();
+                if(!pipeline->stages)
+                    continue;
+                uint16_t inputCount = out.inputCount;
+                for(size_t s = 0; s < pipeline->stages->size(); ++s)
+                {
+                    auto& stage = (*pipeline->stages)[s];
+                    auto& stageOut = out.stages.emplace_back();
+                    stageOut.id = std::format("{}[{}]", pipeline->id, s);
+                    stageOut.profileSlot = program._profileSlotCount++;
+                    stageOut.inputCount = inputCount;
+                    if(inputCount > stage.localVars.size())
+                        return std::unexpected(std::format("{}: missing input local vars", stageOut.id));
+                    for(auto output : stage.outputs)
+                    {
+                        if(output.id >= stage.localVars.size())
+                            return std::unexpected(std::format("{}: stage output out of range", stageOut.id));
+                        stageOut.stageOutputs.push_back((uint16_t)output.id);
+                    }
+                    for(auto& op : stage.asyncOps)
+                    {
+                        auto& call = std::get<BSAsyncCall>(op);
+                        auto& callOut = stageOut.asyncCalls.emplace_back();
+                        callOut.function = call.function;
+                        for(auto input : call.inputs)
+                        {
+                            if(input.id >= stage.localVars.size())
+                                return std::unexpected(
+                                    std::format("{}: async call input out of range", stageOut.id));
+                            callOut.inputs.push_back((uint16_t)input.id);
+                        }
+                        for(auto output : call.outputs)
+                        {
+                            if(module.types.isRef(output))
+                                return std::unexpected(std::format(
+                                    "{}: async call to {} returns a reference", stageOut.id, call.function));
+                            if(!vmValueType(module.types.type(output)))
+                                return std::unexpected(std::format(
+                                    "{}: async call to {} returns a type the VM does not support",
+                                    stageOut.id,
+                                    call.function));
+                        }
+                        callOut.outputCount = (uint16_t)call.outputs.size();
+                    }
+                    auto result =
+                        BodyLowering(stage.localVars, module.types, stage.operations, resolve, pointeeSize, stageOut)
+                            .lower();
+                    if(!result)
+                        return std::unexpected(result.error());
+                    inputCount = (uint16_t)passedValueCount(stage);
+                }
+                if(inputCount != out.outputCount)
+                    return std::unexpected(
+                        std::format("{}: last stage produces {} values but the pipeline has {} outputs",
+                                    out.id,
+                                    inputCount,
+                                    out.outputCount));
+            }
+        }
+
+        auto checkCalls = [&](const BytecodeFunction& caller) -> std::expected<void, std::string> {
+            for(auto& site : caller.calls)
+            {
+                if(site.host)
+                    continue;
+                auto& callee = program._functions[site.function];
+                if(site.inputCount != callee.inputCount || site.outputCount != callee.outputCount)
+                    return std::unexpected(std::format("{}: call to {} has the wrong number of arguments",
+                                                       caller.id,
+                                                       callee.id));
+                // The callee's inputs and outputs are the first registers of its frame, in operand order
+                auto operands =
+                    std::span(caller.callOperands).subspan(site.operandOffset, site.inputCount + site.outputCount);
+                for(size_t i = 0; i < operands.size(); ++i)
+                {
+                    if(caller.registerTypes[operands[i]] != callee.registerTypes[i] ||
+                       caller.refTypes[operands[i]] != callee.refTypes[i])
+                        return std::unexpected(std::format("{}: operand {} of the call to {} does not match its type",
+                                                           caller.id,
+                                                           i,
+                                                           callee.id));
+                }
+            }
+            return {};
+        };
+        for(auto& function : program._functions)
+        {
+            if(auto result = checkCalls(function); !result)
+                return std::unexpected(result.error());
+        }
+        for(auto& pipeline : program._pipelines)
+        {
+            for(auto& stage : pipeline.stages)
+            {
+                if(auto result = checkCalls(stage); !result)
+                    return std::unexpected(result.error());
+            }
+        }
+        return program;
+    }
+
+    const std::vector<BytecodeFunction>& Program::functions() const { return _functions; }
+
+    const std::vector<BytecodePipeline>& Program::pipelines() const { return _pipelines; }
+
+    const std::vector<BCHostFunction>& Program::hostFunctions() const { return _hostFunctions; }
+
+    std::optional<uint32_t> Program::function(std::string_view id) const
+    {
+        auto index = _functionIndices.find(std::string(id));
+        if(index == _functionIndices.end())
+            return std::nullopt;
+        return index->second;
+    }
+
+    std::optional<uint32_t> Program::pipeline(std::string_view id) const
+    {
+        auto index = _pipelineIndices.find(std::string(id));
+        if(index == _pipelineIndices.end())
+            return std::nullopt;
+        return index->second;
+    }
+
+    uint32_t Program::profileSlotCount() const { return _profileSlotCount; }
+} // namespace BraneScript
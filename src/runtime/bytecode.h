@@ -0,0 +1,247 @@
+#ifndef BRANESCRIPT_BYTECODE_H
+#define BRANESCRIPT_BYTECODE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "../ir/ir.h"
+#include "../types/valueType.h"
+
+namespace BraneScript
+{
+    /// One slot of a frame. Values narrower than 64 bits are stored zero extended in the low bytes.
+    struct Register
+    {
+        uint64_t bits = 0;
+
+        template<class T>
+        static Register of(T value)
+        {
+            static_assert(sizeof(T) <= sizeof(uint64_t));
+            Register reg;
+            std::memcpy(&reg.bits, &value, sizeof(T));
+            return reg;
+        }
+
+        template<class T>
+        T as() const
+        {
+            static_assert(sizeof(T) <= sizeof(uint64_t));
+            T value;
+            std::memcpy(&value, &bits, sizeof(T));
+            return value;
+        }
+    };
+
+    /// Unpacks a host function's arguments from VM registers, calls it and packs its results back. Thunks are
+    /// generated per signature, see hostFunction, so a call costs one indirect call and no type checks.
+    using HostThunk = void (*)(void (*function)(), const Register* inputs, Register* outputs);
+
+#define BS_BYTECODE_NUMERIC_OPS(X, name) \
+    X(name##I32) X(name##U32) X(name##I64) X(name##U64) X(name##F32) X(name##F64)
+#define BS_BYTECODE_INT_OPS(X, name) X(name##I32) X(name##U32) X(name##I64) X(name##U64)
+#define BS_BYTECODE_MEMORY_OPS(X, name) X(name##8) X(name##32) X(name##64)
+
+/// Every bytecode op. Typed families are laid out in the order I32, U32, I64, U64, F32, F64 so that the lowering can
+/// pick a variant by offsetting from the first one.
+#define BS_BYTECODE_OPS(X)                                                                                             \
+    X(Mov)                                                                                                             \
+    X(LoadConst)                                                                                                       \
+    BS_BYTECODE_NUMERIC_OPS(X, Add)                                                                                    \
+    BS_BYTECODE_NUMERIC_OPS(X, Sub)                                                                                    \
+    BS_BYTECODE_NUMERIC_OPS(X, Mul)                                                                                    \
+    BS_BYTECODE_NUMERIC_OPS(X, Div)                                                                                    \
+    BS_BYTECODE_NUMERIC_OPS(X, Mod)                                                                                    \
+    BS_BYTECODE_NUMERIC_OPS(X, Eq)                                                                                     \
+    BS_BYTECODE_NUMERIC_OPS(X, Ne)                                                                                     \
+    BS_BYTECODE_NUMERIC_OPS(X, Gt)                                                                                     \
+    BS_BYTECODE_NUMERIC_OPS(X, Ge)                                                                                     \
+    BS_BYTECODE_NUMERIC_OPS(X, LogicNot)                                                                               \
+    BS_BYTECODE_NUMERIC_OPS(X, LogicAnd)                                                                               \
+    BS_BYTECODE_NUMERIC_OPS(X, LogicOr)                                                                                \
+    BS_BYTECODE_INT_OPS(X, BitNot)                                                                                     \
+    BS_BYTECODE_INT_OPS(X, BitAnd)                                                                                     \
+    BS_BYTECODE_INT_OPS(X, BitOr)                                                                                      \
+    BS_BYTECODE_INT_OPS(X, BitXor)                                                                                     \
+    X(I32ToF32)                                                                                                        \
+    X(U32ToF32)                                                                                                        \
+    X(F32ToI32)                                                                                                        \
+    X(F32ToU32)                                                                                                        \
+    X(BoolToF32)                                                                                                       \
+    X(BoolToF64)                                                                                                       \
+    BS_BYTECODE_MEMORY_OPS(X, LoadRegion)                                                                              \
+    BS_BYTECODE_MEMORY_OPS(X, LoadPtr)                                                                                 \
+    BS_BYTECODE_MEMORY_OPS(X, StoreRegion)                                                                             \
+    BS_BYTECODE_MEMORY_OPS(X, StorePtr)                                                                                \
+    X(Call)                                                                                                            \
+    X(CallHost)                                                                                                        \
+    X(Return)
+
+    enum class BCOp : uint16_t
+    {
+#define BS_BYTECODE_ENUM(name) name,
+        BS_BYTECODE_OPS(BS_BYTECODE_ENUM)
+#undef BS_BYTECODE_ENUM
+            Count
+    };
+
+    std::string_view bcOpName(BCOp op);
+
+    /// Operands are registers in the current frame, except for constants which index the function's constant pool,
+    /// regions which index the memory regions bound to an invocation and pointers whose address is in a register.
+    /// The offset of a pointer operand is the size of the value it points to, which accesses through it must stay in.
+    /// Every operand of an instruction is read before its result is written, so results may reuse operand slots.
+    struct BCInstruction
+    {
+        BCOp op;
+        SerializedValue a{};
+        SerializedValue b{};
+        SerializedValue c{};
+    };
+
+    static_assert(sizeof(BCInstruction) == 20, "Bytecode instructions should stay compact");
+
+    struct BCCallSite
+    {
+        /// Index into Program::functions, or into Program::hostFunctions for CallHost
+        uint32_t function;
+        /// Offset of the call's input registers followed by its output registers in BytecodeFunction::callOperands
+        uint32_t operandOffset;
+        uint16_t inputCount;
+        uint16_t outputCount;
+        bool host = false;
+    };
+
+    /// Slot of a Program's host function table, bound when the program is loaded
+    struct BCHostFunction
+    {
+        std::string id;
+        void (*function)() = nullptr;
+        HostThunk thunk = nullptr;
+        uint16_t inputCount = 0;
+        uint16_t outputCount = 0;
+    };
+
+    /// Host call a pipeline stage makes once it has run, see BSAsyncCall
+    struct BCAsyncCall
+    {
+        std::string function;
+        /// Registers holding the call's inputs
+        std::vector<uint16_t> inputs;
+        uint16_t outputCount = 0;
+    };
+
+    /// What a register holding a reference may access. Accesses are bounds checked by the size the body that makes
+    /// them declared, so references may only be passed to bodies that declare the same one.
+    struct BCRefType
+    {
+        uint64_t pointeeSize = 0;
+        bool isRef = false;
+        bool isMutable = false;
+
+        bool operator==(const BCRefType&) const = default;
+    };
+
+    /// Executable form of a function or pipeline stage. Inputs occupy the first registers of the frame, function
+    /// outputs the registers after them.
+    struct BytecodeFunction
+    {
+        std::string id;
+        std::vector<BCInstruction> code;
+        /// Handler address for every instruction when the interpreter uses direct threading, empty otherwise
+        std::vector<const void*> threadedCode;
+        std::vector<Register> constants;
+        std::vector<BCCallSite> calls;
+        std::vector<uint16_t> callOperands;
+        uint16_t frameSize = 0;
+        uint16_t inputCount = 0;
+        uint16_t outputCount = 0;
+        /// VM type of every register in the frame
+        std::vector<ValueType> registerTypes;
+        /// Reference type of every register in the frame
+        std::vector<BCRefType> refTypes;
+        /// Registers holding the values a stage passes on, empty for functions
+        std::vector<uint16_t> stageOutputs;
+        /// Calls a stage makes after it has run, their results are passed on after stageOutputs
+        std::vector<BCAsyncCall> asyncCalls;
+        /// Index of the function's counters in a Profile. Functions come first, in Program::functions order, followed
+        /// by the stages of every pipeline.
+        uint32_t profileSlot = 0;
+    };
+
+    struct BytecodePipeline
+    {
+        std::string id;
+        uint16_t inputCount = 0;
+        uint16_t outputCount = 0;
+        std::vector<BytecodeFunction> stages;
+    };
+
+    /// Memory that Load and Store instructions with a constant store index address
+    struct MemoryRegion
+    {
+        std::byte* data = nullptr;
+        size_t size = 0;
+        bool writable = false;
+    };
+
+    class HostFunctionTable;
+
+    /// A set of modules lowered to bytecode with every call resolved to a function index or host function slot
+    class Program
+    {
+        std::vector<BytecodeFunction> _functions;
+        std::vector<BytecodePipeline> _pipelines;
+        std::vector<BCHostFunction> _hostFunctions;
+        std::unordered_map<std::string, uint32_t> _functionIndices;
+        std::unordered_map<std::string, uint32_t> _pipelineIndices;
+        uint32_t _profileSlotCount = 0;
+        /// Name of every module the program was loaded from, and where its functions and pipelines start. The last
+        /// entry of each range list is the total count.
+        std::vector<std::string> _moduleNames;
+        std::vector<uint32_t> _moduleFunctions;
+        std::vector<uint32_t> _modulePipelines;
+
+        static std::expected<Program, std::string> lower(std::span<const BSModule> modules,
+                                                         const HostFunctionTable* host,
+                                                         const Program* previous,
+                                                         size_t changed);
+
+      public:
+        /// Calls by name may reference functions in any of the modules, calls by positive id reference the
+        /// function at index id - 1 of the calling module. Names no module defines are bound to the host function of
+        /// that name, if any, whose signature must match the call's operand types.
+        static std::expected<Program, std::string> load(std::span<const BSModule> modules,
+                                                        const HostFunctionTable* host = nullptr);
+        /// Loads modules after modules[changed] was replaced or added, lowering only that module. The bytecode of
+        /// every other module is taken from previous, which must have been loaded from the same modules with the
+        /// same host functions, and its calls are bound again by name. Struct layouts the other modules use must not
+        /// have changed, since accesses through references are checked against them. A module whose calls no longer
+        /// resolve to the same kind of function is lowered again.
+        static std::expected<Program, std::string> reload(const Program& previous,
+                                                          std::span<const BSModule> modules,
+                                                          size_t changed,
+                                                          const HostFunctionTable* host = nullptr);
+
+        const std::vector<BytecodeFunction>& functions() const;
+        const std::vector<BytecodePipeline>& pipelines() const;
+        /// Host functions the program calls, in the order they were first called
+        const std::vector<BCHostFunction>& hostFunctions() const;
+        std::optional<uint32_t> function(std::string_view id) const;
+        std::optional<uint32_t> pipeline(std::string_view id) const;
+        /// Number of functions and pipeline stages, see BytecodeFunction::profileSlot
+        uint32_t profileSlotCount() const;
+    };
+
+    /// The VM type that holds values of a BSType, if the VM supports it. References are held as pointers.
+    std::optional<ValueType> vmValueType(const BSType& type);
+} // namespace BraneScript
+
+#endif
@@ -0,0 +1,26 @@
+#include "hostFunctions.h"
+
+#include <format>
+
+namespace BraneScript
+{
+    std::expected<void, std::string> HostFunctionTable::add(HostFunction function)
+    {
+        if(!function.function || !function.thunk)
+            return std::unexpected(std::format("Host function {} has no implementation", function.id));
+        if(!_indices.insert({function.id, (uint32_t)_functions.size()}).second)
+            return std::unexpected(std::format("Host function {} is defined more than once", function.id));
+        _functions.push_back(std::move(function));
+        return {};
+    }
+
+    const HostFunction* HostFunctionTable::find(std::string_view id) const
+    {
+        auto index = _indices.find(std::string(id));
+        if(index == _indices.end())
+            return nullptr;
+        return &_functions[index->second];
+    }
+
+    const std::vector<HostFunction>& HostFunctionTable::functions() const { return _functions; }
+} // namespace BraneScript
@@ -0,0 +1,94 @@
+#ifndef BRANESCRIPT_HOSTFUNCTIONS_H
+#define BRANESCRIPT_HOSTFUNCTIONS_H
+
+#include <cstdint>
+#include <expected>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "bytecode.h"
+
+namespace BraneScript
+{
+    /// A function the host provides to scripts, which call it by name like any other function
+    struct HostFunction
+    {
+        std::string id;
+        std::vector<ValueType> inputs;
+        std::vector<ValueType> outputs;
+        /// Type erased pointer to the host function, only meaningful to the thunk
+        void (*function)() = nullptr;
+        HostThunk thunk = nullptr;
+    };
+
+    /// VM type a host function parameter of type T is passed as
+    template<class T>
+    consteval ValueType hostValueType()
+    {
+        if constexpr(std::is_pointer_v<T>)
+            return ValueType::U64;
+        else if constexpr(std::is_same_v<T, int8_t> || std::is_same_v<T, uint8_t> || std::is_same_v<T, char>)
+            return ValueType::Char;
+        else if constexpr(std::is_same_v<T, int32_t>)
+            return ValueType::I32;
+        else if constexpr(std::is_same_v<T, uint32_t>)
+            return ValueType::U32;
+        else if constexpr(std::is_same_v<T, int64_t>)
+            return ValueType::I64;
+        else if constexpr(std::is_same_v<T, uint64_t>)
+            return ValueType::U64;
+        else if constexpr(std::is_same_v<T, float>)
+            return ValueType::F32;
+        else if constexpr(std::is_same_v<T, double>)
+            return ValueType::F64;
+        else
+            static_assert(!sizeof(T), "Host function parameters must be integers, floats or pointers");
+    }
+
+    /// Describes a host function and generates its thunk from the function's own signature
+    template<class R, class... Args>
+    HostFunction hostFunction(std::string id, R (*function)(Args...))
+    {
+        HostFunction host;
+        host.id = std::move(id);
+        host.inputs = {hostValueType<Args>()...};
+        if constexpr(!std::is_void_v<R>)
+            host.outputs = {hostValueType<R>()};
+        host.function = reinterpret_cast<void (*)()>(function);
+        host.thunk = [](void (*erased)(), const Register* inputs, Register* outputs) {
+            auto typed = reinterpret_cast<R (*)(Args...)>(erased);
+            [&]<size_t... I>(std::index_sequence<I...>) {
+                if constexpr(std::is_void_v<R>)
+                    typed(inputs[I].template as<Args>()...);
+                else
+                    outputs[0] = Register::of(typed(inputs[I].template as<Args>()...));
+            }(std::index_sequence_for<Args...>{});
+        };
+        return host;
+    }
+
+    /// Host functions available to a Program, looked up by name only while the program is loaded. Loading copies
+    /// the functions a program calls into its own dense table, so the host table does not need to outlive it.
+    class HostFunctionTable
+    {
+        std::vector<HostFunction> _functions;
+        std::unordered_map<std::string, uint32_t> _indices;
+
+      public:
+        std::expected<void, std::string> add(HostFunction function);
+
+        template<class R, class... Args>
+        std::expected<void, std::string> add(std::string id, R (*function)(Args...))
+        {
+            return add(hostFunction(std::move(id), function));
+        }
+
+        const HostFunction* find(std::string_view id) const;
+        const std::vector<HostFunction>& functions() const;
+    };
+} // namespace BraneScript
+
+#endif
@@ -0,0 +1,196 @@
+#include "hostViews.h"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+
+namespace BraneScript
+{
+    namespace
+    {
+        std::expected<void, std::string> checkView(const HostView& view, TypeLayout layout)
+        {
+            if(view.count && !view.data)
+                return std::unexpected("view has elements but no data");
+            if(view.elementSize != layout.size)
+                return std::unexpected(
+                    std::format("elements are {} bytes but the script type is {}", view.elementSize, layout.size));
+            if(view.elementAlignment < layout.alignment || view.stride % layout.alignment != 0 ||
+               reinterpret_cast<uintptr_t>(view.data) % layout.alignment != 0)
+                return std::unexpected(std::format("elements are not {} byte aligned", layout.alignment));
+            if(view.count > 1 && view.stride < view.elementSize)
+                return std::unexpected("elements overlap");
+            return {};
+        }
+    } // namespace
+
+    std::expected<PipelineViews, std::string> PipelineViews::bind(const Program& program,
+                                                                  const BSModule& module,
+                                                                  const BSPipeline& pipeline,
+                                                                  const StructLayouts& layouts,
+                                                                  size_t moduleIndex,
+                                                                  std::span<const HostView> inputs,
+                                                                  std::span<const HostView> outputs)
+    {
+        auto index = program.pipeline(pipeline.id);
+        if(!index)
+            return std::unexpected(std::format("Pipeline {} is not part of the program", pipeline.id));
+        if(inputs.size() != pipeline.inputs.size() || outputs.size() != pipeline.outputs.size())
+            return std::unexpected(std::format("{} takes {} inputs and {} outputs",
+                                               pipeline.id,
+                                               pipeline.inputs.size(),
+                                               pipeline.outputs.size()));
+
+        PipelineViews views;
+        views._pipeline = *index;
+        views._count = inputs.empty() ? (outputs.empty() ? 0 : outputs.front().count) : inputs.front().count;
+        auto bindView = [&](const HostView& view,
+                            TypeId type,
+                            bool output,
+                            size_t i) -> std::expected<Binding, std::string> {
+            auto error = [&](std::string_view message) {
+                return std::unexpected(
+                    std::format("{} {} of {}: {}", output ? "output" : "input", i, pipeline.id, message));
+            };
+            if(view.count != views._count)
+                return error("every view must have the same number of elements");
+
+            Binding binding{view};
+            auto& types = module.types;
+            if(types.isRef(type))
+            {
+                if(output)
+                    return error("references can't be returned into host memory");
+                if(types.isMutableRef(type) && !view.writable)
+                    return error("the pipeline writes through this reference but the view is read only");
+                binding.byRef = true;
+            }
+            else
+            {
+                if(!vmValueType(types.type(type)))
+                    return error("values of this type can't be passed directly, bind the view to a reference");
+                if(output && !view.writable)
+                    return error("the view is read only");
+            }
+
+            auto layout = layouts.typeLayout(types.type(types.dereferenced(type)), moduleIndex);
+            if(!layout)
+                return error(layout.error());
+            if(auto checked = checkView(view, *layout); !checked)
+                return error(checked.error());
+            return binding;
+        };
+
+        for(size_t i = 0; i < inputs.size(); ++i)
+        {
+            auto binding = bindView(inputs[i], pipeline.inputs[i], false, i);
+            if(!binding)
+                return std::unexpected(binding.error());
+            views._inputs.push_back(*binding);
+        }
+        for(size_t i = 0; i < outputs.size(); ++i)
+        {
+            auto binding = bindView(outputs[i], pipeline.outputs[i], true, i);
+            if(!binding)
+                return std::unexpected(binding.error());
+            views._outputs.push_back(*binding);
+        }
+        return views;
+    }
+
+    bool PipelineViews::Binding::packed() const { return !byRef && view.stride == view.elementSize; }
+
+    uint64_t PipelineViews::count() const { return _count; }
+
+    std::expected<void, std::string> PipelineViews::run(VM& vm, std::span<const MemoryRegion> regions) const
+    {
+        std::vector<Register> inputs(_inputs.size());
+        std::vector<Register> outputs(_outputs.size());
+        for(uint64_t e = 0; e < _count; ++e)
+        {
+            for(size_t i = 0; i < _inputs.size(); ++i)
+            {
+                auto& binding = _inputs[i];
+                std::byte* element = binding.view.element(e);
+                if(binding.byRef)
+                    inputs[i] = Register::of(element);
+                else
+                {
+                    // Registers hold narrower values zero extended, the same as copying them into the low bytes
+                    inputs[i] = {};
+                    std::memcpy(&inputs[i].bits, element, binding.view.elementSize);
+                }
+            }
+            auto result = vm.runPipeline(_pipeline, inputs, outputs, regions);
+            if(!result)
+                return std::unexpected(std::format("{} (element {})", result.error(), e));
+            for(size_t i = 0; i < _outputs.size(); ++i)
+                std::memcpy(_outputs[i].view.element(e), &outputs[i].bits, _outputs[i].view.elementSize);
+        }
+        return {};
+    }
+
+    std::expected<void, std::string> PipelineViews::run(BatchExecutor& batch,
+                                                         std::span<const MemoryRegion> regions) const
+    {
+        if(auto supported = batch.pipelineSupported(_pipeline); !supported)
+            return supported;
+
+        // Columns hold values at the width the VM stores them, which for base types is the element size
+        constexpr uint64_t chunkSize = 16 * BatchExecutor::blockSize;
+        std::vector<std::vector<std::byte>> inputColumns(_inputs.size());
+        std::vector<std::vector<std::byte>> outputColumns(_outputs.size());
+        std::vector<const void*> inputs(_inputs.size());
+        std::vector<void*> outputs(_outputs.size());
+        for(uint64_t first = 0; first < _count; first += chunkSize)
+        {
+            uint64_t count = std::min(chunkSize, _count - first);
+            for(size_t i = 0; i < _inputs.size(); ++i)
+            {
+                auto& binding = _inputs[i];
+                if(binding.packed())
+                {
+                    inputs[i] = binding.view.element(first);
+                    continue;
+                }
+                size_t width = binding.byRef ? sizeof(std::byte*) : binding.view.elementSize;
+                auto& column = inputColumns[i];
+                column.resize(count * width);
+                for(uint64_t e = 0; e < count; ++e)
+                {
+                    std::byte* element = binding.view.element(first + e);
+                    std::memcpy(column.data() + e * width, binding.byRef ? (std::byte*)&element : element, width);
+                }
+                inputs[i] = column.data();
+            }
+            for(size_t i = 0; i < _outputs.size(); ++i)
+            {
+                auto& binding = _outputs[i];
+                if(binding.packed())
+                    outputs[i] = binding.view.element(first);
+                else
+                {
+                    outputColumns[i].resize(count * binding.view.elementSize);
+                    outputs[i] = outputColumns[i].data();
+                }
+            }
+
+            auto result = batch.runPipeline(_pipeline, inputs, outputs, count, regions);
+            if(!result)
+                return std::unexpected(
+                    std::format("{} (in the chunk of elements {} to {})", result.error(), first, first + count - 1));
+
+            for(size_t i = 0; i < _outputs.size(); ++i)
+            {
+                auto& binding = _outputs[i];
+                if(binding.packed())
+                    continue;
+                for(uint64_t e = 0; e < count; ++e)
+                    std::memcpy(binding.view.element(first + e),
+                                outputColumns[i].data() + e * binding.view.elementSize,
+                                binding.view.elementSize);
+            }
+        }
+        return {};
+    }
+} // namespace BraneScript
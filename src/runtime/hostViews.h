@@ -0,0 +1,112 @@
+#ifndef BRANESCRIPT_HOSTVIEWS_H
+#define BRANESCRIPT_HOSTVIEWS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "../ir/structLayout.h"
+#include "batch.h"
+#include "bytecode.h"
+#include "vm.h"
+
+namespace BraneScript
+{
+    /// Host memory shared with scripts without copying it: count elements of elementSize bytes, stride bytes apart.
+    /// Views of const memory are read only.
+    struct HostView
+    {
+        std::byte* data = nullptr;
+        uint64_t count = 0;
+        uint64_t stride = 0;
+        uint64_t elementSize = 0;
+        uint64_t elementAlignment = 1;
+        bool writable = false;
+
+        std::byte* element(uint64_t index) const { return data + index * stride; }
+
+        /// The whole view as a memory region, for scripts that index it themselves with bounds checks
+        MemoryRegion region() const { return {data, count ? (count - 1) * stride + elementSize : 0, writable}; }
+    };
+
+    template<class T>
+    HostView hostView(std::span<T> elements)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "Scripts can only share trivially copyable host types");
+        return {reinterpret_cast<std::byte*>(const_cast<std::remove_const_t<T>*>(elements.data())),
+                elements.size(),
+                sizeof(T),
+                sizeof(T),
+                alignof(T),
+                !std::is_const_v<T>};
+    }
+
+    /// View of one member of every element of an array, such as the positions of an array of particles
+    template<class T, class M>
+    HostView hostView(std::span<T> elements, M std::remove_const_t<T>::*member)
+    {
+        static_assert(std::is_trivially_copyable_v<M>, "Scripts can only share trivially copyable host types");
+        auto view = hostView(elements);
+        if(!elements.empty())
+            view.data = reinterpret_cast<std::byte*>(const_cast<M*>(&(elements.data()->*member)));
+        view.elementSize = sizeof(M);
+        view.elementAlignment = alignof(M);
+        return view;
+    }
+
+    /// Runs a pipeline once for every element of a set of host views, reading its inputs from and writing its outputs
+    /// to the views in place. An input of type ref T is handed a pointer to the element, so the pipeline reads it,
+    /// and through a mutable ref writes it, where it is. Inputs and outputs of base types are read from and written
+    /// to the element directly. Each view is checked once, when it is bound, against the layout of the type it is
+    /// bound to. Accesses through a ref are bounds checked against the size of T, so a pipeline can't reach past the
+    /// element it was handed.
+    class PipelineViews
+    {
+        struct Binding
+        {
+            HostView view;
+            /// Whether the pipeline takes a pointer to the element rather than its value
+            bool byRef = false;
+
+            /// Whether the view holds values back to back, the way a batch column does
+            bool packed() const;
+        };
+
+        uint32_t _pipeline;
+        std::vector<Binding> _inputs;
+        std::vector<Binding> _outputs;
+        uint64_t _count = 0;
+
+        PipelineViews() = default;
+
+      public:
+        /// Binds a view to every input and output of pipeline, which must be the IR the program's pipeline was loaded
+        /// from, and module the IR of the module it belongs to. layouts are the struct layouts of the modules the
+        /// program was loaded from, and moduleIndex the index of module among them. Every view must have the same
+        /// number of elements.
+        static std::expected<PipelineViews, std::string> bind(const Program& program,
+                                                              const BSModule& module,
+                                                              const BSPipeline& pipeline,
+                                                              const StructLayouts& layouts,
+                                                              size_t moduleIndex,
+                                                              std::span<const HostView> inputs,
+                                                              std::span<const HostView> outputs);
+
+        uint64_t count() const;
+
+        /// Stops at the first element the pipeline traps on, the elements before it have been written
+        std::expected<void, std::string> run(VM& vm, std::span<const MemoryRegion> regions = {}) const;
+
+        /// Runs the elements in blocks on a batch executor of the same program, so instructions are dispatched once
+        /// per block instead of once per element. Values of views packed without gaps are passed in place, strided
+        /// views and refs are gathered a chunk at a time. Stops at the first chunk the pipeline traps in, the chunks
+        /// before it have been written. Fails without running anything if the pipeline can't be batched.
+        std::expected<void, std::string> run(BatchExecutor& batch, std::span<const MemoryRegion> regions = {}) const;
+    };
+} // namespace BraneScript
+
+#endif
@@ -0,0 +1,327 @@
+#include "hotReload.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <format>
+#include <unordered_map>
+
+namespace BraneScript
+{
+    namespace
+    {
+        struct StructSource
+        {
+            const BSStruct* definition;
+            const BSModule* module;
+        };
+
+        std::unordered_map<std::string, StructSource> structSources(std::span<const BSModule> modules)
+        {
+            std::unordered_map<std::string, StructSource> sources;
+            for(auto& module : modules)
+            {
+                for(auto& structDef : module.structs)
+                    sources.try_emplace(structDef->id, StructSource{structDef.get(), &module});
+            }
+            return sources;
+        }
+
+        std::string_view structName(const IDRef& id, const BSModule& module)
+        {
+            if(auto* name = std::get_if<std::string>(&id))
+                return *name;
+            int32_t local = std::get<int32_t>(id);
+            if(auto* imported = importedSymbol(module, local))
+                return *imported;
+            if(local <= 0 || (size_t)local > module.structs.size())
+                return {};
+            return module.structs[local - 1]->id;
+        }
+
+        bool sameLayout(const StructLayout& a, const StructLayout& b)
+        {
+            return a.type == b.type && a.offsets == b.offsets && a.order == b.order;
+        }
+
+        /// Pairs members of a struct before and after a reload, by name if both versions name their members and by
+        /// position otherwise
+        std::vector<std::pair<size_t, size_t>> matchMembers(const BSStruct& before, const BSStruct& after)
+        {
+            std::vector<std::pair<size_t, size_t>> matches;
+            if(before.memberNames.empty() || after.memberNames.empty())
+            {
+                for(size_t i = 0; i < std::min(before.members.size(), after.members.size()); ++i)
+                    matches.emplace_back(i, i);
+                return matches;
+            }
+            for(size_t i = 0; i < after.memberNames.size(); ++i)
+            {
+                auto old = std::ranges::find(before.memberNames, after.memberNames[i]);
+                if(old != before.memberNames.end())
+                    matches.emplace_back((size_t)(old - before.memberNames.begin()), i);
+            }
+            return matches;
+        }
+
+        /// Compares types before and after a reload. A struct is unchanged if its layout is the same and so is every
+        /// member, down through the structs it holds by value. Refs only have to point to a struct of the same name,
+        /// the value they point to is migrated on its own.
+        class TypeMatcher
+        {
+            const StructLayouts& _oldLayouts;
+            const StructLayouts& _newLayouts;
+            const std::unordered_map<std::string, StructSource>& _oldSources;
+            const std::unordered_map<std::string, StructSource>& _newSources;
+            std::span<const BSModule> _newModules;
+            mutable std::unordered_map<std::string, bool> _unchanged;
+
+            std::string_view structOf(const BSType& type, const BSModule& module) const
+            {
+                auto* structType = std::get_if<IRNode<BSStructType>>(&type);
+                return structType ? structName((*structType)->structId, module) : std::string_view{};
+            }
+
+          public:
+            TypeMatcher(const StructLayouts& oldLayouts,
+                        const StructLayouts& newLayouts,
+                        const std::unordered_map<std::string, StructSource>& oldSources,
+                        const std::unordered_map<std::string, StructSource>& newSources,
+                        std::span<const BSModule> newModules)
+                : _oldLayouts(oldLayouts), _newLayouts(newLayouts), _oldSources(oldSources), _newSources(newSources),
+                  _newModules(newModules)
+            {}
+
+            bool unchanged(const std::string& id) const
+            {
+                if(auto known = _unchanged.find(id); known != _unchanged.end())
+                    return known->second;
+                auto old = _oldSources.find(id);
+                auto now = _newSources.find(id);
+                auto* before = _oldLayouts.find(id);
+                auto* after = _newLayouts.find(id);
+                // Structs held by value can't contain themselves, so this recursion ends
+                bool result = old != _oldSources.end() && now != _newSources.end() && before && after &&
+                              sameLayout(*before, *after);
+                if(result)
+                {
+                    auto& oldDef = *old->second.definition;
+                    auto& newDef = *now->second.definition;
+                    result = oldDef.members.size() == newDef.members.size() && oldDef.memberNames == newDef.memberNames;
+                    for(size_t i = 0; result && i < oldDef.members.size(); ++i)
+                        result = same(old->second.module->types.type(oldDef.members[i]),
+                                      *old->second.module,
+                                      now->second.module->types.type(newDef.members[i]),
+                                      *now->second.module);
+                }
+                _unchanged.emplace(id, result);
+                return result;
+            }
+
+            bool same(const BSType& before,
+                      const BSModule& oldModule,
+                      const BSType& after,
+                      const BSModule& newModule,
+                      bool byValue = true) const
+            {
+                if(before.index() != after.index())
+                    return false;
+                if(auto* base = std::get_if<BSBaseType>(&before))
+                    return *base == std::get<BSBaseType>(after);
+                if(auto* ref = std::get_if<IRNode<BSRefType>>(&before))
+                {
+                    auto& afterRef = std::get<IRNode<BSRefType>>(after);
+                    return (*ref)->valueMutable == afterRef->valueMutable &&
+                           same((*ref)->contained, oldModule, afterRef->contained, newModule, false);
+                }
+                auto name = structOf(before, oldModule);
+                if(name.empty() || name != structOf(after, newModule))
+                    return false;
+                return !byValue || unchanged(std::string(name));
+            }
+
+            /// Calls copy(from, to, size) for the bytes of every member of struct id that can be carried over from
+            /// the old layout at offset from to the new one at offset to. Members that are structs of the same name
+            /// whose layout changed are migrated member by member.
+            template<class F>
+            std::expected<void, std::string> copies(const std::string& id, uint64_t from, uint64_t to, F&& copy) const
+            {
+                auto& old = _oldSources.at(id);
+                auto& now = _newSources.at(id);
+                auto& before = *_oldLayouts.find(id);
+                auto& after = *_newLayouts.find(id);
+                auto& oldDef = *old.definition;
+                auto& newDef = *now.definition;
+                for(auto [o, n] : matchMembers(oldDef, newDef))
+                {
+                    auto& oldMember = old.module->types.type(oldDef.members[o]);
+                    auto& newMember = now.module->types.type(newDef.members[n]);
+                    uint64_t memberFrom = from + before.offsets[o];
+                    uint64_t memberTo = to + after.offsets[n];
+                    if(same(oldMember, *old.module, newMember, *now.module))
+                    {
+                        auto layout = _newLayouts.typeLayout(newMember, (size_t)(now.module - _newModules.data()));
+                        if(!layout)
+                            return std::unexpected(layout.error());
+                        copy(memberFrom, memberTo, layout->size);
+                        continue;
+                    }
+                    auto name = structOf(oldMember, *old.module);
+                    if(!name.empty() && name == structOf(newMember, *now.module))
+                    {
+                        if(auto result = copies(std::string(name), memberFrom, memberTo, copy); !result)
+                            return result;
+                    }
+                }
+                return {};
+            }
+        };
+    } // namespace
+
+    const std::string& StructMigration::id() const { return _id; }
+
+    uint64_t StructMigration::fromSize() const { return _fromSize; }
+
+    uint64_t StructMigration::toSize() const { return _toSize; }
+
+    void StructMigration::apply(std::span<const std::byte> from, std::span<std::byte> to) const
+    {
+        size_t count = _fromSize ? from.size() / _fromSize : 0;
+        assert(to.size() >= count * _toSize && "Migration target is too small");
+        std::memset(to.data(), 0, count * _toSize);
+        for(size_t i = 0; i < count; ++i)
+        {
+            const std::byte* source = from.data() + i * _fromSize;
+            std::byte* dest = to.data() + i * _toSize;
+            for(auto& copy : _copies)
+                std::memcpy(dest + copy.to, source + copy.from, copy.size);
+        }
+    }
+
+    ReloadableProgram::ReloadableProgram(std::vector<BSModule> modules,
+                                         StructLayouts layouts,
+                                         const HostFunctionTable* host,
+                                         std::shared_ptr<const Program> program)
+        : _modules(std::move(modules)), _layouts(std::move(layouts)), _host(host), _program(std::move(program))
+    {}
+
+    std::expected<std::unique_ptr<ReloadableProgram>, std::string> ReloadableProgram::create(
+        std::vector<BSModule> modules, const HostFunctionTable* host)
+    {
+        auto layouts = StructLayouts::compute(modules);
+        if(!layouts)
+            return std::unexpected(layouts.error());
+        auto program = Program::load(modules, host);
+        if(!program)
+            return std::unexpected(program.error());
+        return std::unique_ptr<ReloadableProgram>(new ReloadableProgram(std::move(modules),
+                                                                        std::move(*layouts),
+                                                                        host,
+                                                                        std::make_shared<const Program>(
+                                                                            std::move(*program))));
+    }
+
+    std::shared_ptr<const Program> ReloadableProgram::current() const
+    {
+        return _program.load(std::memory_order_acquire);
+    }
+
+    uint64_t ReloadableProgram::generation() const { return _generation.load(std::memory_order_acquire); }
+
+    std::expected<ReloadResult, std::string> ReloadableProgram::reload(BSModule module)
+    {
+        std::lock_guard lock(_reloadMutex);
+        // Everything is built on the side, so a module that fails to load leaves the running program untouched
+        auto modules = _modules;
+        auto existing = std::find_if(
+            modules.begin(), modules.end(), [&](const BSModule& loaded) { return loaded.name == module.name; });
+        size_t changed = (size_t)(existing - modules.begin());
+        if(existing != modules.end())
+            *existing = std::move(module);
+        else
+            modules.push_back(std::move(module));
+
+        auto layouts = StructLayouts::compute(modules);
+        if(!layouts)
+            return std::unexpected(layouts.error());
+
+        ReloadResult result;
+        auto oldSources = structSources(_modules);
+        auto newSources = structSources(modules);
+        TypeMatcher matcher(_layouts, *layouts, oldSources, newSources, modules);
+        for(auto& [id, source] : newSources)
+        {
+            if(!oldSources.contains(id) || matcher.unchanged(id))
+                continue;
+            StructMigration migration;
+            migration._id = id;
+            migration._fromSize = _layouts.find(id)->type.size;
+            migration._toSize = layouts->find(id)->type.size;
+            auto copied = matcher.copies(id, 0, 0, [&](uint64_t from, uint64_t to, uint64_t size) {
+                migration._copies.push_back({from, to, size});
+            });
+            if(!copied)
+                return std::unexpected(copied.error());
+            result.migrations.push_back(std::move(migration));
+        }
+
+        // Bytecode of the other modules is bounds checked against the struct layouts it was lowered with, so it can
+        // only be reused while none of them changed
+        bool layoutsKept = result.migrations.empty() && std::ranges::all_of(oldSources, [&](auto& source) {
+            return newSources.contains(source.first);
+        });
+        auto program =
+            layoutsKept ? Program::reload(*current(), modules, changed, _host) : Program::load(modules, _host);
+        if(!program)
+            return std::unexpected(program.error());
+
+        _modules = std::move(modules);
+        _layouts = std::move(*layouts);
+        _program.store(std::make_shared<const Program>(std::move(*program)), std::memory_order_release);
+        result.generation = _generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+        return result;
+    }
+
+    std::expected<void, std::string> ReloadableProgram::prepare(VM& vm) const
+    {
+        auto program = current();
+        if(&vm.program() == program.get())
+            return {};
+        // Switching here would stop profiling or tiering without the caller finding out
+        if(vm.profile() || vm.tierTable())
+            return std::unexpected("The program was reloaded while the VM was profiling or tiering it, update the VM "
+                                   "to move it over");
+        vm.setProgram(std::move(program));
+        return {};
+    }
+
+    VMInstrumentation ReloadableProgram::update(VM& vm) const { return vm.setProgram(current()); }
+
+    std::expected<void, std::string> ReloadableProgram::call(VM& vm,
+                                                             std::string_view function,
+                                                             std::span<const Register> inputs,
+                                                             std::span<Register> outputs,
+                                                             std::span<const MemoryRegion> regions) const
+    {
+        if(auto prepared = prepare(vm); !prepared)
+            return prepared;
+        auto index = vm.program().function(function);
+        if(!index)
+            return std::unexpected(std::format("Function {} is not defined", function));
+        return vm.call(*index, inputs, outputs, regions);
+    }
+
+    std::expected<void, std::string> ReloadableProgram::runPipeline(VM& vm,
+                                                                    std::string_view pipeline,
+                                                                    std::span<const Register> inputs,
+                                                                    std::span<Register> outputs,
+                                                                    std::span<const MemoryRegion> regions) const
+    {
+        if(auto prepared = prepare(vm); !prepared)
+            return prepared;
+        auto index = vm.program().pipeline(pipeline);
+        if(!index)
+            return std::unexpected(std::format("Pipeline {} is not defined", pipeline));
+        return vm.runPipeline(*index, inputs, outputs, regions);
+    }
+} // namespace BraneScript
@@ -0,0 +1,115 @@
+#ifndef BRANESCRIPT_HOTRELOAD_H
+#define BRANESCRIPT_HOTRELOAD_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../ir/structLayout.h"
+#include "bytecode.h"
+#include "vm.h"
+
+namespace BraneScript
+{
+    /// Converts values of a struct from its layout before a reload to its layout after it. Members are matched by
+    /// name, or by position if either version has no member names. Members that are structs whose layout changed
+    /// are converted the same way, other members whose type changed and members that were added are zeroed.
+    class StructMigration
+    {
+        struct Copy
+        {
+            uint64_t from;
+            uint64_t to;
+            uint64_t size;
+        };
+
+        std::string _id;
+        uint64_t _fromSize = 0;
+        uint64_t _toSize = 0;
+        std::vector<Copy> _copies;
+
+        friend class ReloadableProgram;
+
+      public:
+        const std::string& id() const;
+        uint64_t fromSize() const;
+        uint64_t toSize() const;
+
+        /// Converts an array of values, to must have room for as many values in the new layout as from holds in the
+        /// old one. from and to must not overlap.
+        void apply(std::span<const std::byte> from, std::span<std::byte> to) const;
+    };
+
+    struct ReloadResult
+    {
+        /// Incremented by every reload
+        uint64_t generation = 0;
+        /// Structs whose layout or members changed. Host memory holding them has to be converted before new invocations
+        /// read it.
+        std::vector<StructMigration> migrations;
+    };
+
+    /// Modules that can be swapped for recompiled versions while pipelines are running. Each reload loads a new
+    /// Program and publishes it atomically. Invocations that have already started keep the program they
+    /// started with alive until they finish, and later invocations run the new one. Starting an invocation only reads
+    /// the current program, so a reload never pauses pipelines that are running or starting.
+    ///
+    /// Functions and pipelines are looked up by name, as their indices can change between reloads.
+    class ReloadableProgram
+    {
+        /// Serializes reloads, invocations never take it
+        std::mutex _reloadMutex;
+        std::vector<BSModule> _modules;
+        StructLayouts _layouts;
+        const HostFunctionTable* _host;
+        std::atomic<std::shared_ptr<const Program>> _program;
+        std::atomic<uint64_t> _generation = 0;
+
+        ReloadableProgram(std::vector<BSModule> modules,
+                          StructLayouts layouts,
+                          const HostFunctionTable* host,
+                          std::shared_ptr<const Program> program);
+
+        /// Switches the VM to the current program if a reload happened since it last ran, unless that would detach
+        /// its profile or tier table
+        std::expected<void, std::string> prepare(VM& vm) const;
+
+      public:
+        /// host, if set, must outlive the ReloadableProgram, every reload binds calls against it
+        static std::expected<std::unique_ptr<ReloadableProgram>, std::string> create(
+            std::vector<BSModule> modules, const HostFunctionTable* host = nullptr);
+
+        std::shared_ptr<const Program> current() const;
+        uint64_t generation() const;
+
+        /// Replaces the module of the same name, or adds it if there is none. Only that module is lowered to bytecode
+        /// again unless a struct layout changed, the bytecode of the others is reused with its calls relinked. If the
+        /// modules no longer load together the error is returned and the current program keeps running.
+        std::expected<ReloadResult, std::string> reload(BSModule module);
+
+        /// Moves vm to the current program. Its profile and tier table belong to the program it ran before, so they
+        /// are detached and returned, for the caller to read out and replace with ones for the new program.
+        VMInstrumentation update(VM& vm) const;
+
+        /// Run on the current program, moving vm over to it first if needed. A VM that is profiling or tiering is
+        /// not moved, the call fails instead until it has been moved with update.
+        std::expected<void, std::string> call(VM& vm,
+                                              std::string_view function,
+                                              std::span<const Register> inputs,
+                                              std::span<Register> outputs,
+                                              std::span<const MemoryRegion> regions = {}) const;
+        std::expected<void, std::string> runPipeline(VM& vm,
+                                                     std::string_view pipeline,
+                                                     std::span<const Register> inputs,
+                                                     std::span<Register> outputs,
+                                                     std::span<const MemoryRegion> regions = {}) const;
+    };
+} // namespace BraneScript
+
+#endif
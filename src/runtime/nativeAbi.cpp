@@ -0,0 +1,26 @@
+#include "nativeAbi.h"
+
+namespace BraneScript
+{
+    std::string_view nativeStatusMessage(NativeStatus status)
+    {
+        switch(status)
+        {
+            case NativeStatus::Ok:
+                return "Ok";
+            case NativeStatus::DivisionByZero:
+                return "Integer division by zero or overflow";
+            case NativeStatus::UnboundRegion:
+                return "Access to an unbound memory region";
+            case NativeStatus::OutOfBounds:
+                return "Memory access out of bounds";
+            case NativeStatus::ReadOnlyRegion:
+                return "Store to a read only memory region";
+            case NativeStatus::NullPointer:
+                return "Memory access through a null pointer";
+            case NativeStatus::CallDepthExceeded:
+                return "Maximum call depth exceeded";
+        }
+        return "Unknown status";
+    }
+} // namespace BraneScript
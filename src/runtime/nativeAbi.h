@@ -0,0 +1,40 @@
+#ifndef BRANESCRIPT_NATIVEABI_H
+#define BRANESCRIPT_NATIVEABI_H
+
+#include <cstdint>
+#include <string_view>
+#include "bytecode.h"
+
+namespace BraneScript
+{
+    /// Result of a native call. Native code traps in the same places as the VM, but reports it through its return value
+    /// instead of an error string.
+    enum class NativeStatus : uint32_t
+    {
+        Ok = 0,
+        DivisionByZero,
+        UnboundRegion,
+        OutOfBounds,
+        ReadOnlyRegion,
+        NullPointer,
+        CallDepthExceeded
+    };
+
+    std::string_view nativeStatusMessage(NativeStatus status);
+
+    /// State shared by every call made from one native invocation. The layout is part of the native ABI.
+    struct NativeContext
+    {
+        const MemoryRegion* regions = nullptr;
+        uint64_t regionCount = 0;
+        uint32_t callDepth = 0;
+    };
+
+    /// Every function and pipeline is compiled to a C ABI entry point of the form
+    ///     uint32_t symbol(NativeContext* ctx, Input0 in0, ..., Output0* out0, ...)
+    /// returning a NativeStatus, and a register entry point that takes and returns values in the same zero extended
+    /// 64 bit slots as the VM, so that callers that don't know the signature at compile time can still call it.
+    using NativeRegisterFunction = uint32_t (*)(NativeContext* ctx, const Register* inputs, Register* outputs);
+} // namespace BraneScript
+
+#endif
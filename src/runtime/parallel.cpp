@@ -0,0 +1,159 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+
+namespace BraneScript
+{
+    ParallelExecutor::Worker::Worker(std::shared_ptr<const Program> program) : batch(program), vm(std::move(program))
+    {}
+
+    ParallelExecutor::ParallelExecutor(std::shared_ptr<const Program> program,
+                                       TaskScheduler& scheduler,
+                                       size_t chunkSize)
+        : _program(std::move(program)), _scheduler(scheduler), _chunkSize(std::max<size_t>(chunkSize, 1))
+    {}
+
+    std::shared_ptr<const Program> ParallelExecutor::program() const
+    {
+        return _program.load(std::memory_order_acquire);
+    }
+
+    void ParallelExecutor::setProgram(std::shared_ptr<const Program> program)
+    {
+        _program.store(std::move(program), std::memory_order_release);
+        // Workers are planned for a single program, idle ones for the previous one won't be used again
+        std::lock_guard lock(_workersMutex);
+        _idleWorkers.clear();
+    }
+
+    std::unique_ptr<ParallelExecutor::Worker> ParallelExecutor::acquireWorker(
+        const std::shared_ptr<const Program>& program)
+    {
+        {
+            std::lock_guard lock(_workersMutex);
+            auto idle = std::ranges::find_if(_idleWorkers,
+                                             [&](auto& worker) { return &worker->vm.program() == program.get(); });
+            if(idle != _idleWorkers.end())
+            {
+                auto worker = std::move(*idle);
+                _idleWorkers.erase(idle);
+                return worker;
+            }
+        }
+        return std::make_unique<Worker>(program);
+    }
+
+    void ParallelExecutor::releaseWorker(std::unique_ptr<Worker> worker)
+    {
+        // Runs that started before a switch release workers for the previous program, those are dropped
+        auto program = _program.load(std::memory_order_acquire);
+        std::lock_guard lock(_workersMutex);
+        if(&worker->vm.program() == program.get())
+            _idleWorkers.push_back(std::move(worker));
+    }
+
+    std::expected<void, std::string> ParallelExecutor::runChunk(Worker& worker,
+                                                                const Program& program,
+                                                                uint32_t pipeline,
+                                                                std::span<const void* const> inputs,
+                                                                std::span<void* const> outputs,
+                                                                size_t begin,
+                                                                size_t end,
+                                                                std::span<const MemoryRegion> regions)
+    {
+        auto& bytecode = program.pipelines()[pipeline];
+        auto& firstStage = bytecode.stages.front();
+        auto& lastStage = bytecode.stages.back();
+        auto inputWidth = [&](size_t i) { return BatchExecutor::columnWidth(firstStage.registerTypes[i]); };
+        auto outputWidth = [&](size_t i)
+        {
+            return BatchExecutor::columnWidth(lastStage.registerTypes[lastStage.stageOutputs[i]]);
+        };
+
+        if(worker.batch.pipelineSupported(pipeline))
+        {
+            std::vector<const void*> chunkInputs;
+            std::vector<void*> chunkOutputs;
+            for(size_t i = 0; i < inputs.size(); ++i)
+                chunkInputs.push_back(static_cast<const std::byte*>(inputs[i]) + begin * inputWidth(i));
+            for(size_t i = 0; i < outputs.size(); ++i)
+                chunkOutputs.push_back(static_cast<std::byte*>(outputs[i]) + begin * outputWidth(i));
+            auto ran = worker.batch.runPipeline(pipeline, chunkInputs, chunkOutputs, end - begin, regions);
+            if(!ran)
+                return std::unexpected(std::format("{} of the chunk starting at entity {}", ran.error(), begin));
+            return {};
+        }
+
+        // Registers hold values zero extended, so copying the bytes a column stores is enough in both directions
+        std::vector<Register> entityInputs(inputs.size());
+        std::vector<Register> entityOutputs(outputs.size());
+        for(size_t entity = begin; entity < end; ++entity)
+        {
+            for(size_t i = 0; i < inputs.size(); ++i)
+            {
+                size_t width = inputWidth(i);
+                entityInputs[i] = {};
+                std::memcpy(&entityInputs[i].bits, static_cast<const std::byte*>(inputs[i]) + entity * width, width);
+            }
+            auto ran = worker.vm.runPipeline(pipeline, entityInputs, entityOutputs, regions);
+            if(!ran)
+                return std::unexpected(std::format("{} for entity {}", ran.error(), entity));
+            for(size_t i = 0; i < outputs.size(); ++i)
+            {
+                size_t width = outputWidth(i);
+                std::memcpy(static_cast<std::byte*>(outputs[i]) + entity * width, &entityOutputs[i].bits, width);
+            }
+        }
+        return {};
+    }
+
+    std::expected<void, std::string> ParallelExecutor::runPipeline(uint32_t pipeline,
+                                                                   std::span<const void* const> inputs,
+                                                                   std::span<void* const> outputs,
+                                                                   size_t count,
+                                                                   std::span<const MemoryRegion> regions)
+    {
+        // Every chunk runs on the program the run started with, even if it is switched before they are done
+        auto program = _program.load(std::memory_order_acquire);
+        if(pipeline >= program->pipelines().size())
+            return std::unexpected("Pipeline index out of range");
+        auto& bytecode = program->pipelines()[pipeline];
+        if(inputs.size() != bytecode.inputCount || outputs.size() != bytecode.outputCount)
+            return std::unexpected(std::format(
+                "{} takes {} inputs and {} outputs", bytecode.id, bytecode.inputCount, bytecode.outputCount));
+        if(bytecode.stages.empty())
+            return std::unexpected(std::format("{} has no stages to run", bytecode.id));
+        if(outputs.size() > bytecode.stages.back().stageOutputs.size())
+            return std::unexpected(std::format("{} passes on fewer values than it outputs", bytecode.id));
+        if(count == 0)
+            return {};
+        if(std::ranges::find(inputs, nullptr) != inputs.end() || std::ranges::find(outputs, nullptr) != outputs.end())
+            return std::unexpected(std::format("{} was passed a null column", bytecode.id));
+
+        std::mutex errorMutex;
+        size_t errorChunk = count;
+        std::string error;
+        auto run = [&](size_t begin, size_t end)
+        {
+            auto worker = acquireWorker(program);
+            auto ran = runChunk(*worker, *program, pipeline, inputs, outputs, begin, end, regions);
+            releaseWorker(std::move(worker));
+            if(ran)
+                return;
+            // Chunks complete in any order, reporting the first one keeps the error the same from run to run
+            std::lock_guard lock(errorMutex);
+            if(begin < errorChunk)
+            {
+                errorChunk = begin;
+                error = std::move(ran.error());
+            }
+        };
+        _scheduler.parallelFor(0, count, _chunkSize, run);
+
+        if(errorChunk != count)
+            return std::unexpected(std::move(error));
+        return {};
+    }
+} // namespace BraneScript
@@ -0,0 +1,87 @@
+#ifndef BRANESCRIPT_PARALLEL_H
+#define BRANESCRIPT_PARALLEL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+#include "../util/taskScheduler.h"
+#include "batch.h"
+#include "vm.h"
+
+namespace BraneScript
+{
+    /// Runs a pipeline over a large range of entities on a TaskScheduler. The range is split into chunks that the
+    /// scheduler's workers pick up and steal from each other. Values are passed struct of arrays the same way as to
+    /// BatchExecutor, and each chunk reads and writes the caller's columns at its own offset, so the outputs need no
+    /// merging.
+    ///
+    /// Stages only read the sources and write the sinks their pipeline declares, so entities are independent and
+    /// chunks may run in any order on any thread. Memory regions are shared by every chunk, entities must not write
+    /// bytes that other entities read or write.
+    class ParallelExecutor
+    {
+        /// Executors for one chunk at a time, neither of them can be shared between threads
+        struct Worker
+        {
+            BatchExecutor batch;
+            VM vm;
+
+            explicit Worker(std::shared_ptr<const Program> program);
+        };
+
+        std::atomic<std::shared_ptr<const Program>> _program;
+        TaskScheduler& _scheduler;
+        size_t _chunkSize;
+
+        std::mutex _workersMutex;
+        std::vector<std::unique_ptr<Worker>> _idleWorkers;
+
+        /// Worker for the program a run started with
+        std::unique_ptr<Worker> acquireWorker(const std::shared_ptr<const Program>& program);
+        void releaseWorker(std::unique_ptr<Worker> worker);
+
+        std::expected<void, std::string> runChunk(Worker& worker,
+                                                  const Program& program,
+                                                  uint32_t pipeline,
+                                                  std::span<const void* const> inputs,
+                                                  std::span<void* const> outputs,
+                                                  size_t begin,
+                                                  size_t end,
+                                                  std::span<const MemoryRegion> regions);
+
+      public:
+        /// Large enough to amortize scheduling, small enough that idle workers find chunks to steal
+        static constexpr size_t defaultChunkSize = 16 * BatchExecutor::blockSize;
+
+        ParallelExecutor(std::shared_ptr<const Program> program,
+                         TaskScheduler& scheduler,
+                         size_t chunkSize = defaultChunkSize);
+        ParallelExecutor(const ParallelExecutor&) = delete;
+        ParallelExecutor& operator=(const ParallelExecutor&) = delete;
+
+        std::shared_ptr<const Program> program() const;
+
+        /// Switches to another program, such as a newer version of the same modules. Runs that have already started
+        /// finish on the program they started with, pipeline indices passed to later runs refer to the new one. May
+        /// be called from any thread, also while runs are in progress.
+        void setProgram(std::shared_ptr<const Program> program);
+
+        /// Runs the pipeline for count entities and blocks until every chunk has completed, with the calling thread
+        /// helping out. Chunks run on the batch executor when the pipeline supports it, and entity by entity on the VM
+        /// otherwise. If entities trap, the error of the first chunk that trapped is returned, outputs of other chunks
+        /// are still written.
+        std::expected<void, std::string> runPipeline(uint32_t pipeline,
+                                                     std::span<const void* const> inputs,
+                                                     std::span<void* const> outputs,
+                                                     size_t count,
+                                                     std::span<const MemoryRegion> regions = {});
+    };
+} // namespace BraneScript
+
+#endif
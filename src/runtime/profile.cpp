@@ -0,0 +1,82 @@
+#include "profile.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace BraneScript
+{
+    Profile::Profile(std::shared_ptr<const Program> program) : _program(std::move(program))
+    {
+        _entries.resize(_program->profileSlotCount());
+        for(auto& function : _program->functions())
+            _entries[function.profileSlot].callSites.resize(function.calls.size());
+        for(auto& pipeline : _program->pipelines())
+        {
+            for(auto& stage : pipeline.stages)
+                _entries[stage.profileSlot].callSites.resize(stage.calls.size());
+        }
+    }
+
+    const Program& Profile::program() const { return *_program; }
+
+    const ProfileCounters& Profile::counters(uint32_t slot) const { return _entries[slot].counters; }
+
+    const ProfileCounters& Profile::callSite(uint32_t slot, uint32_t site) const
+    {
+        return _entries[slot].callSites[site];
+    }
+
+    void Profile::merge(const Profile& other)
+    {
+        assert(_program == other._program && "Profiles of different programs can't be merged");
+        for(size_t i = 0; i < _entries.size(); ++i)
+        {
+            _entries[i].counters.merge(other._entries[i].counters);
+            for(size_t site = 0; site < _entries[i].callSites.size(); ++site)
+                _entries[i].callSites[site].merge(other._entries[i].callSites[site]);
+        }
+    }
+
+    void Profile::reset()
+    {
+        for(auto& entry : _entries)
+        {
+            entry.counters = {};
+            std::fill(entry.callSites.begin(), entry.callSites.end(), ProfileCounters{});
+        }
+    }
+
+    ProfileData Profile::data() const
+    {
+        ProfileData data;
+        auto addCallSites = [&](const BytecodeFunction& caller) {
+            auto& entry = _entries[caller.profileSlot];
+            for(uint32_t site = 0; site < entry.callSites.size(); ++site)
+            {
+                if(!entry.callSites[site].invocations)
+                    continue;
+                auto& target = caller.calls[site];
+                auto& callee = target.host ? _program->hostFunctions()[target.function].id
+                                           : _program->functions()[target.function].id;
+                data.callSites.push_back({caller.id, site, callee, entry.callSites[site]});
+            }
+        };
+
+        for(auto& function : _program->functions())
+        {
+            if(_entries[function.profileSlot].counters.invocations)
+                data.functions.emplace(function.id, _entries[function.profileSlot].counters);
+            addCallSites(function);
+        }
+        for(auto& pipeline : _program->pipelines())
+        {
+            for(auto& stage : pipeline.stages)
+            {
+                if(_entries[stage.profileSlot].counters.invocations)
+                    data.stages.emplace(stage.id, _entries[stage.profileSlot].counters);
+                addCallSites(stage);
+            }
+        }
+        return data;
+    }
+} // namespace BraneScript
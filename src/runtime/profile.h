@@ -0,0 +1,82 @@
+#ifndef BRANESCRIPT_PROFILE_H
+#define BRANESCRIPT_PROFILE_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "../ir/profileData.h"
+#include "bytecode.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace BraneScript
+{
+    /// Cheapest monotonic clock available: the time stamp counter on x86, the virtual counter on ARM and nanoseconds
+    /// elsewhere. Ticks are only comparable within one machine.
+    inline uint64_t profileClock()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#elif defined(__aarch64__)
+        uint64_t ticks;
+        asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+        return ticks;
+#else
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+#endif
+    }
+
+    /// Counters a VM fills in while profiling is enabled, one entry per function and pipeline stage of a Program,
+    /// indexed by BytecodeFunction::profileSlot. Counters are plain integers, so a Profile must only be written by
+    /// one VM at a time. Threads running their own VMs should each record into their own Profile and merge them.
+    class Profile
+    {
+        struct Entry
+        {
+            ProfileCounters counters;
+            /// One for each of BytecodeFunction::calls
+            std::vector<ProfileCounters> callSites;
+        };
+
+        std::shared_ptr<const Program> _program;
+        std::vector<Entry> _entries;
+
+      public:
+        explicit Profile(std::shared_ptr<const Program> program);
+
+        const Program& program() const;
+
+        void record(uint32_t slot, uint64_t cycles, bool trapped)
+        {
+            auto& counters = _entries[slot].counters;
+            counters.invocations++;
+            counters.cycles += cycles;
+            counters.traps += trapped;
+        }
+
+        void recordCall(uint32_t slot, uint32_t site, uint64_t cycles, bool trapped)
+        {
+            auto& counters = _entries[slot].callSites[site];
+            counters.invocations++;
+            counters.cycles += cycles;
+            counters.traps += trapped;
+        }
+
+        const ProfileCounters& counters(uint32_t slot) const;
+        const ProfileCounters& callSite(uint32_t slot, uint32_t site) const;
+
+        /// Adds the counts of a profile of the same program
+        void merge(const Profile& other);
+        void reset();
+
+        /// Counters by name, leaving out everything that never ran
+        ProfileData data() const;
+    };
+} // namespace BraneScript
+
+#endif
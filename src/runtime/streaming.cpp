@@ -0,0 +1,260 @@
+#include "streaming.h"
+
+#include <algorithm>
+#include <format>
+#include <optional>
+#include "vm.h"
+
+namespace BraneScript
+{
+    StreamingPipeline::StreamingPipeline(std::shared_ptr<const Program> program,
+                                         uint32_t pipeline,
+                                         size_t queueCapacity,
+                                         std::span<const MemoryRegion> regions)
+        : _program(std::move(program)), _pipeline(pipeline), _regions(regions.begin(), regions.end())
+    {
+        auto& bytecode = _program->pipelines()[pipeline];
+        _pipelineId = bytecode.id;
+        for(auto& stage : bytecode.stages)
+        {
+            auto& s = *_stages.emplace_back(std::make_unique<Stage>());
+            s.input = std::make_unique<SpscRing<Register>>(queueCapacity, stage.inputCount);
+        }
+        _output = std::make_unique<SpscRing<Register>>(queueCapacity, bytecode.outputCount);
+        // Only start threads once every ring exists, each stage pushes to the next one's
+        for(size_t i = 0; i < _stages.size(); ++i)
+            _stages[i]->thread = std::thread([this, i, program = _program, pipeline]()
+                                             { runStage(i, program, pipeline); });
+    }
+
+    std::expected<std::unique_ptr<StreamingPipeline>, std::string> StreamingPipeline::start(
+        std::shared_ptr<const Program> program,
+        uint32_t pipeline,
+        size_t queueCapacity,
+        std::span<const MemoryRegion> regions)
+    {
+        if(pipeline >= program->pipelines().size())
+            return std::unexpected("Pipeline index out of range");
+        auto& bytecode = program->pipelines()[pipeline];
+        if(bytecode.stages.empty())
+            return std::unexpected(std::format("{} has no stages to run", bytecode.id));
+        if(bytecode.stages.back().stageOutputs.size() < bytecode.outputCount)
+            return std::unexpected(std::format("{} passes on fewer values than it outputs", bytecode.id));
+        for(auto& stage : bytecode.stages)
+        {
+            if(!stage.asyncCalls.empty())
+                return std::unexpected(std::format("{} makes async calls, run it on an AsyncRuntime", bytecode.id));
+        }
+        return std::unique_ptr<StreamingPipeline>(
+            new StreamingPipeline(std::move(program), pipeline, queueCapacity, regions));
+    }
+
+    StreamingPipeline::~StreamingPipeline()
+    {
+        close();
+        _output->abandon();
+        for(auto& stage : _stages)
+            stage->thread.join();
+    }
+
+    void StreamingPipeline::runStage(size_t index, std::shared_ptr<const Program> program, uint32_t pipeline)
+    {
+        auto& stage = *_stages[index];
+        auto& input = *stage.input;
+        auto& output = index + 1 < _stages.size() ? *_stages[index + 1]->input : *_output;
+
+        // Stages start on the program the stream started with, the pushing thread may switch before they get going
+        VM vm(std::move(program));
+        uint64_t sequence = 0;
+        size_t applied = 0;
+        std::optional<ProgramSwitch> next;
+        std::vector<Register> inputs(input.stride());
+        std::vector<Register> carried;
+        uint64_t depthSum = 0;
+        size_t maxDepth = 0;
+        while(true)
+        {
+            if(!input.tryPop(inputs))
+            {
+                if(!input.closed())
+                {
+                    input.waitForData();
+                    continue;
+                }
+                // Everything pushed before the ring was closed is visible once the close is
+                if(!input.tryPop(inputs))
+                    break;
+            }
+
+            // The producer may refill the slot this entity left before the size is read, but the ring never held
+            // more than its capacity
+            size_t depth = std::min(input.size() + 1, input.capacity());
+            depthSum += depth;
+            maxDepth = std::max(maxDepth, depth);
+            stage.depthSum.store(depthSum, std::memory_order_relaxed);
+            stage.maxDepth.store(maxDepth, std::memory_order_relaxed);
+
+            // A switch is published before the first entity it applies to is pushed, so it is visible by the time
+            // that entity gets here
+            while(true)
+            {
+                if(!next && _switchCount.load(std::memory_order_acquire) > applied)
+                {
+                    std::lock_guard lock(_switchMutex);
+                    next = _switches[applied];
+                }
+                if(!next || next->sequence > sequence)
+                    break;
+                vm.setProgram(std::move(next->program));
+                pipeline = next->pipeline;
+                next.reset();
+                ++applied;
+            }
+            ++sequence;
+
+            auto ran = vm.runStage(pipeline, index, inputs, carried, _regions);
+            if(!ran)
+            {
+                fail(std::move(ran.error()));
+                break;
+            }
+            stage.processed.fetch_add(1, std::memory_order_relaxed);
+
+            auto passed = std::span<const Register>(carried).first(output.stride());
+            while(!output.tryPush(passed) && !output.abandoned())
+                output.waitForSpace();
+            if(output.abandoned())
+                break;
+        }
+        // Stages before this one stop once they find nothing is taking their entities, the ones after it drain what
+        // they already have
+        input.abandon();
+        output.close();
+    }
+
+    void StreamingPipeline::fail(std::string error)
+    {
+        std::lock_guard lock(_errorMutex);
+        if(!_failed)
+        {
+            _error = std::move(error);
+            _failed = true;
+        }
+    }
+
+    std::string StreamingPipeline::error()
+    {
+        std::lock_guard lock(_errorMutex);
+        return _error;
+    }
+
+    std::expected<uint32_t, std::string> StreamingPipeline::compatible(const Program& program) const
+    {
+        auto index = program.pipeline(_pipelineId);
+        if(!index)
+            return std::unexpected(std::format("Pipeline {} is not defined", _pipelineId));
+        auto& bytecode = program.pipelines()[*index];
+        if(bytecode.stages.size() != _stages.size())
+            return std::unexpected(std::format("{} has {} stages instead of {}",
+                                               _pipelineId,
+                                               bytecode.stages.size(),
+                                               _stages.size()));
+        if(bytecode.outputCount != _output->stride() || bytecode.stages.back().stageOutputs.size() < _output->stride())
+            return std::unexpected(std::format("{} has {} outputs instead of {}",
+                                               _pipelineId,
+                                               bytecode.outputCount,
+                                               _output->stride()));
+        for(size_t i = 0; i < _stages.size(); ++i)
+        {
+            auto& stage = bytecode.stages[i];
+            if(stage.inputCount != _stages[i]->input->stride())
+                return std::unexpected(std::format("{} takes {} values instead of {}",
+                                                   stage.id,
+                                                   stage.inputCount,
+                                                   _stages[i]->input->stride()));
+            if(!stage.asyncCalls.empty())
+                return std::unexpected(std::format("{} makes async calls, run it on an AsyncRuntime", _pipelineId));
+        }
+        return *index;
+    }
+
+    std::expected<void, std::string> StreamingPipeline::setProgram(std::shared_ptr<const Program> program)
+    {
+        auto pipeline = compatible(*program);
+        if(!pipeline)
+            return std::unexpected(pipeline.error());
+        _program = program;
+        _pipeline = *pipeline;
+        std::lock_guard lock(_switchMutex);
+        _switches.push_back({_pushed, std::move(program), *pipeline});
+        _switchCount.store(_switches.size(), std::memory_order_release);
+        return {};
+    }
+
+    std::expected<void, std::string> StreamingPipeline::push(std::span<const Register> inputs)
+    {
+        auto& input = *_stages.front()->input;
+        if(inputs.size() != input.stride())
+            return std::unexpected(std::format("{} takes {} inputs", _pipelineId, input.stride()));
+        if(input.closed())
+            return std::unexpected("The stream has been closed");
+        bool pushed;
+        while(!(pushed = input.tryPush(inputs)))
+        {
+            if(input.abandoned())
+                break;
+            input.waitForSpace();
+        }
+        // Program switches are sequenced by the entities that made it into the stream
+        _pushed += pushed;
+        if(_failed)
+            return std::unexpected(error());
+        if(input.abandoned())
+            return std::unexpected("The stream has stopped");
+        return {};
+    }
+
+    void StreamingPipeline::close()
+    {
+        auto& input = *_stages.front()->input;
+        if(!input.closed())
+            input.close();
+    }
+
+    std::expected<bool, std::string> StreamingPipeline::pop(std::span<Register> outputs)
+    {
+        if(outputs.size() != _output->stride())
+            return std::unexpected(std::format("{} has {} outputs", _pipelineId, _output->stride()));
+        while(!_output->tryPop(outputs))
+        {
+            if(_output->closed())
+            {
+                if(_output->tryPop(outputs))
+                    return true;
+                if(_failed)
+                    return std::unexpected(error());
+                return false;
+            }
+            _output->waitForData();
+        }
+        return true;
+    }
+
+    size_t StreamingPipeline::stageCount() const { return _stages.size(); }
+
+    std::vector<StreamStageMetrics> StreamingPipeline::metrics() const
+    {
+        std::vector<StreamStageMetrics> metrics;
+        for(auto& stage : _stages)
+        {
+            auto& m = metrics.emplace_back();
+            m.queueDepth = stage->input->size();
+            m.queueCapacity = stage->input->capacity();
+            m.processed = stage->processed.load(std::memory_order_relaxed);
+            m.maxQueueDepth = stage->maxDepth.load(std::memory_order_relaxed);
+            if(m.processed)
+                m.averageQueueDepth = (double)stage->depthSum.load(std::memory_order_relaxed) / (double)m.processed;
+        }
+        return metrics;
+    }
+} // namespace BraneScript
@@ -0,0 +1,124 @@
+#ifndef BRANESCRIPT_STREAMING_H
+#define BRANESCRIPT_STREAMING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../util/spscRing.h"
+#include "bytecode.h"
+
+namespace BraneScript
+{
+    /// How full a stage's input queue has been. The stage whose queue stays fullest is the bottleneck, the stages
+    /// before it fill their queues up to it while the ones after it wait on empty queues.
+    struct StreamStageMetrics
+    {
+        /// Entities waiting for the stage right now
+        size_t queueDepth = 0;
+        size_t queueCapacity = 0;
+        /// Entities that were waiting, including itself, each time the stage took one, averaged and at most
+        double averageQueueDepth = 0;
+        size_t maxQueueDepth = 0;
+        uint64_t processed = 0;
+    };
+
+    /// Runs each stage of a pipeline on its own thread for a long lived stream of entities. Stages are connected by
+    /// bounded single producer single consumer rings, a full ring holds back the stage feeding it, so throughput
+    /// approaches that of the slowest stage rather than the sum of all of them.
+    ///
+    /// One host thread pushes entities and one, possibly the same, pops their outputs, which come out in the order
+    /// they went in. If a stage traps the stream fails, every later push and pop returns the error.
+    class StreamingPipeline
+    {
+        struct Stage
+        {
+            std::unique_ptr<SpscRing<Register>> input;
+            std::thread thread;
+            std::atomic<uint64_t> processed = 0;
+            std::atomic<uint64_t> depthSum = 0;
+            std::atomic<size_t> maxDepth = 0;
+        };
+
+        /// Program entities from sequence number on run on
+        struct ProgramSwitch
+        {
+            uint64_t sequence;
+            std::shared_ptr<const Program> program;
+            uint32_t pipeline;
+        };
+
+        /// Program and pipeline the pushing thread last switched to
+        std::shared_ptr<const Program> _program;
+        uint32_t _pipeline;
+        std::string _pipelineId;
+        std::vector<MemoryRegion> _regions;
+        /// Entities pushed so far, only the pushing thread uses it
+        uint64_t _pushed = 0;
+
+        /// Switches in the order they were made, stages apply them as they reach their sequence numbers
+        std::mutex _switchMutex;
+        std::vector<ProgramSwitch> _switches;
+        std::atomic<size_t> _switchCount = 0;
+        std::vector<std::unique_ptr<Stage>> _stages;
+        std::unique_ptr<SpscRing<Register>> _output;
+
+        std::mutex _errorMutex;
+        std::string _error;
+        std::atomic<bool> _failed = false;
+
+        StreamingPipeline(std::shared_ptr<const Program> program,
+                          uint32_t pipeline,
+                          size_t queueCapacity,
+                          std::span<const MemoryRegion> regions);
+
+        void runStage(size_t index, std::shared_ptr<const Program> program, uint32_t pipeline);
+        /// Checks that a program runs the stream's pipeline with the same stages
+        std::expected<uint32_t, std::string> compatible(const Program& program) const;
+        void fail(std::string error);
+        std::string error();
+
+      public:
+        static constexpr size_t defaultQueueCapacity = 1024;
+
+        /// Starts a thread for each stage of the pipeline. Regions are copied, the memory they point to has to stay
+        /// valid until the stream has been destroyed.
+        static std::expected<std::unique_ptr<StreamingPipeline>, std::string> start(
+            std::shared_ptr<const Program> program,
+            uint32_t pipeline,
+            size_t queueCapacity = defaultQueueCapacity,
+            std::span<const MemoryRegion> regions = {});
+
+        /// Closes the stream, drops outputs that weren't popped and waits for the stage threads to exit
+        ~StreamingPipeline();
+        StreamingPipeline(const StreamingPipeline&) = delete;
+        StreamingPipeline& operator=(const StreamingPipeline&) = delete;
+
+        /// Blocks while the first stage's queue is full
+        std::expected<void, std::string> push(std::span<const Register> inputs);
+
+        /// Switches to another program, such as a newer version of the same modules, without draining the stream.
+        /// Entities pushed from now on run on it, the ones already pushed finish on the program they were pushed to.
+        /// The program's pipeline of the same name must have the same stages, passing on the same number of values,
+        /// and make no async calls. Called from the thread that pushes.
+        std::expected<void, std::string> setProgram(std::shared_ptr<const Program> program);
+
+        /// Signals that no more entities will be pushed, those already pushed still run to completion
+        void close();
+
+        /// Blocks until the next entity has passed through every stage. Returns false once the stream has been closed
+        /// and every output popped.
+        std::expected<bool, std::string> pop(std::span<Register> outputs);
+
+        size_t stageCount() const;
+        std::vector<StreamStageMetrics> metrics() const;
+    };
+} // namespace BraneScript
+
+#endif
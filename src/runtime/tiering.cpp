@@ -0,0 +1,37 @@
+#include "tiering.h"
+
+#include <cassert>
+
+namespace BraneScript
+{
+    TierTable::TierTable(const Program& program, uint32_t threshold, PromoteCallback promote)
+        : _functionCount((uint32_t)program.functions().size()), _pipelineCount((uint32_t)program.pipelines().size()),
+          _threshold(threshold), _promote(std::move(promote))
+    {
+        assert(threshold > 0 && "Code has to run at least once before it can be promoted");
+        _entries = std::make_unique<Entry[]>(_functionCount + _pipelineCount);
+    }
+
+    TierTable::Entry& TierTable::entry(Kind kind, uint32_t index) const
+    {
+        assert(index < (kind == Kind::Function ? _functionCount : _pipelineCount));
+        return _entries[kind == Kind::Function ? index : _functionCount + index];
+    }
+
+    void TierTable::install(Kind kind, uint32_t index, NativeRegisterFunction native)
+    {
+        entry(kind, index).native.store(native, std::memory_order_release);
+    }
+
+    NativeRegisterFunction TierTable::native(Kind kind, uint32_t index) const
+    {
+        return entry(kind, index).native.load(std::memory_order_acquire);
+    }
+
+    uint32_t TierTable::invocations(Kind kind, uint32_t index) const
+    {
+        return entry(kind, index).invocations.load(std::memory_order_relaxed);
+    }
+
+    uint32_t TierTable::threshold() const { return _threshold; }
+} // namespace BraneScript
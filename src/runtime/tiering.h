@@ -0,0 +1,68 @@
+#ifndef BRANESCRIPT_TIERING_H
+#define BRANESCRIPT_TIERING_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include "bytecode.h"
+#include "nativeAbi.h"
+
+namespace BraneScript
+{
+    /// Invocation counters and native entry points for the functions and pipelines of a Program, shared by every VM
+    /// running it. Code starts out interpreted. When its counter reaches the threshold the promote callback is called
+    /// once for it, and once native code has been installed VMs call that instead. VMs read the entry point on every
+    /// call, so installing it patches every caller at once.
+    class TierTable
+    {
+      public:
+        enum class Kind
+        {
+            Function,
+            Pipeline
+        };
+
+        /// Called on the thread whose invocation crossed the threshold, so it should only queue the work
+        using PromoteCallback = std::function<void(Kind kind, uint32_t index)>;
+
+      private:
+        struct Entry
+        {
+            std::atomic<uint32_t> invocations{0};
+            std::atomic<NativeRegisterFunction> native{nullptr};
+        };
+
+        std::unique_ptr<Entry[]> _entries;
+        uint32_t _functionCount;
+        uint32_t _pipelineCount;
+        uint32_t _threshold;
+        PromoteCallback _promote;
+
+        Entry& entry(Kind kind, uint32_t index) const;
+
+      public:
+        TierTable(const Program& program, uint32_t threshold, PromoteCallback promote);
+
+        /// Counts an invocation, returning the native entry point to call instead of interpreting if there is one.
+        /// Counting stops at the threshold, so code that failed to compile doesn't keep contending on its counter.
+        NativeRegisterFunction enter(Kind kind, uint32_t index)
+        {
+            auto& e = entry(kind, index);
+            if(auto native = e.native.load(std::memory_order_acquire))
+                return native;
+            if(e.invocations.load(std::memory_order_relaxed) >= _threshold)
+                return nullptr;
+            if(e.invocations.fetch_add(1, std::memory_order_relaxed) + 1 == _threshold)
+                _promote(kind, index);
+            return nullptr;
+        }
+
+        void install(Kind kind, uint32_t index, NativeRegisterFunction native);
+        NativeRegisterFunction native(Kind kind, uint32_t index) const;
+        uint32_t invocations(Kind kind, uint32_t index) const;
+        uint32_t threshold() const;
+    };
+} // namespace BraneScript
+
+#endif
@@ -0,0 +1,669 @@
+#include "vm.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <format>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+namespace BraneScript
+{
+    namespace
+    {
+        struct ExecutionContext
+        {
+            const Program& program;
+            std::span<const MemoryRegion> regions;
+            Register* stackEnd;
+            uint32_t depth = 0;
+            std::string error;
+            /// Null unless the VM is profiling
+            Profile* profile;
+            /// Null unless hot code is promoted to native code
+            TierTable* tiers;
+        };
+
+        // Integer arithmetic wraps on overflow
+        template<class T>
+        T addValues(T a, T b)
+        {
+            if constexpr(std::is_integral_v<T>)
+                return (T)((std::make_unsigned_t<T>)a + (std::make_unsigned_t<T>)b);
+            else
+                return a + b;
+        }
+
+        template<class T>
+        T subValues(T a, T b)
+        {
+            if constexpr(std::is_integral_v<T>)
+                return (T)((std::make_unsigned_t<T>)a - (std::make_unsigned_t<T>)b);
+            else
+                return a - b;
+        }
+
+        template<class T>
+        T mulValues(T a, T b)
+        {
+            if constexpr(std::is_integral_v<T>)
+                return (T)((std::make_unsigned_t<T>)a * (std::make_unsigned_t<T>)b);
+            else
+                return a * b;
+        }
+
+        /// Integer division by zero and signed overflow trap, floats follow IEEE
+        template<class T>
+        bool divisionValid(T a, T b)
+        {
+            if constexpr(std::is_integral_v<T>)
+            {
+                if(b == 0)
+                    return false;
+                if constexpr(std::is_signed_v<T>)
+                    return !(a == std::numeric_limits<T>::min() && b == -1);
+            }
+            return true;
+        }
+
+        template<class T>
+        T modValues(T a, T b)
+        {
+            if constexpr(std::is_integral_v<T>)
+                return a % b;
+            else
+                return std::fmod(a, b);
+        }
+
+        /// Float to int conversions saturate, and NaN converts to 0
+        template<class T>
+        T convertFloat(float value)
+        {
+            if(std::isnan(value))
+                return 0;
+            if(value <= (float)std::numeric_limits<T>::min())
+                return std::numeric_limits<T>::min();
+            if(value >= (float)std::numeric_limits<T>::max())
+                return std::numeric_limits<T>::max();
+            return (T)value;
+        }
+
+        bool trap(ExecutionContext& ctx,
+                  const BytecodeFunction& function,
+                  const BCInstruction* ip,
+                  std::string_view message)
+        {
+            ctx.error = std::format("{} in {} at {} ({})",
+                                    message,
+                                    function.id,
+                                    ip - function.code.data(),
+                                    bcOpName(ip->op));
+            return false;
+        }
+
+        /// Ops whose handler has a variant reading operand a from the accumulator, see threadBytecode
+#define BS_VM_ACC_OPS(X)                                                                                               \
+    BS_BYTECODE_NUMERIC_OPS(X, Add)                                                                                    \
+    BS_BYTECODE_NUMERIC_OPS(X, Sub)                                                                                    \
+    BS_BYTECODE_NUMERIC_OPS(X, Mul)                                                                                    \
+    BS_BYTECODE_NUMERIC_OPS(X, Div)                                                                                    \
+    BS_BYTECODE_NUMERIC_OPS(X, Mod)                                                                                    \
+    BS_BYTECODE_NUMERIC_OPS(X, Eq)                                                                                     \
+    BS_BYTECODE_NUMERIC_OPS(X, Ne)                                                                                     \
+    BS_BYTECODE_NUMERIC_OPS(X, Gt)                                                                                     \
+    BS_BYTECODE_NUMERIC_OPS(X, Ge)                                                                                     \
+    BS_BYTECODE_NUMERIC_OPS(X, LogicNot)                                                                               \
+    BS_BYTECODE_NUMERIC_OPS(X, LogicAnd)                                                                               \
+    BS_BYTECODE_NUMERIC_OPS(X, LogicOr)                                                                                \
+    BS_BYTECODE_INT_OPS(X, BitNot)                                                                                     \
+    BS_BYTECODE_INT_OPS(X, BitAnd)                                                                                     \
+    BS_BYTECODE_INT_OPS(X, BitOr)                                                                                      \
+    BS_BYTECODE_INT_OPS(X, BitXor)                                                                                     \
+    X(I32ToF32)                                                                                                        \
+    X(U32ToF32)                                                                                                        \
+    X(F32ToI32)                                                                                                        \
+    X(F32ToU32)                                                                                                        \
+    X(BoolToF32)                                                                                                       \
+    X(BoolToF64)
+
+        const void* const* computedGotoTable = nullptr;
+        const void* const* accumulatorGotoTable = nullptr;
+
+        /// Runs a function in the frame starting at frame, which must already hold its inputs. Called with a null
+        /// function it only publishes the handler tables used for direct threading.
+        bool interpret(const BytecodeFunction* function, Register* frame, ExecutionContext* ctx)
+        {
+            // Every handler that writes a register also leaves the value in the accumulator. Reading it from there
+            // instead of from the frame takes the store and reload off the dependency chain between instructions.
+            Register acc;
+
+#define VM_READ(T, operand) frame[ip->operand.index].as<T>()
+#define VM_READ_ACC(T) acc.as<T>()
+#define VM_WRITE(operand, value)                                                                                       \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        acc = Register::of(value);                                                                                     \
+        frame[ip->operand.index] = acc;                                                                                \
+    } while(0)
+#define VM_TRAP(message) return trap(*ctx, *function, ip, message)
+
+#ifdef BS_VM_COMPUTED_GOTO
+#define VM_OP(name) Op_##name:
+#define VM_ACC_OP(name, body) AccOp_##name : body
+#define VM_NEXT()                                                                                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        ++ip;                                                                                                          \
+        ++tp;                                                                                                          \
+        goto* * tp;                                                                                                    \
+    } while(0)
+#define VM_LABEL_ADDRESS(name) &&Op_##name,
+            static const void* const labels[] = {BS_BYTECODE_OPS(VM_LABEL_ADDRESS)};
+#undef VM_LABEL_ADDRESS
+            if(!function)
+            {
+                static const void* accLabels[(size_t)BCOp::Count] = {};
+#define VM_ACC_LABEL_ADDRESS(name) accLabels[(size_t)BCOp::name] = &&AccOp_##name;
+                BS_VM_ACC_OPS(VM_ACC_LABEL_ADDRESS)
+#undef VM_ACC_LABEL_ADDRESS
+                computedGotoTable = labels;
+                accumulatorGotoTable = accLabels;
+                return true;
+            }
+            const BCInstruction* ip = function->code.data();
+            const void* const* tp = function->threadedCode.data();
+            goto* *tp;
+#else
+#define VM_OP(name) case BCOp::name:
+// Nothing dispatches to accumulator variants without direct threading
+#define VM_ACC_OP(name, body)
+#define VM_NEXT()                                                                                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        ++ip;                                                                                                          \
+        goto dispatch;                                                                                                 \
+    } while(0)
+            if(!function)
+                return true;
+            const BCInstruction* ip = function->code.data();
+        dispatch:
+            switch(ip->op)
+            {
+#endif
+
+#define VM_BINARY_BODY(T, expression, readA)                                                                           \
+    {                                                                                                                  \
+        T a = readA;                                                                                                   \
+        T b = VM_READ(T, b);                                                                                           \
+        VM_WRITE(c, expression);                                                                                       \
+        VM_NEXT();                                                                                                     \
+    }
+#define VM_BINARY(name, T, expression)                                                                                 \
+    VM_OP(name) VM_BINARY_BODY(T, expression, VM_READ(T, a))                                                           \
+    VM_ACC_OP(name, VM_BINARY_BODY(T, expression, VM_READ_ACC(T)))
+#define VM_UNARY_BODY(T, expression, readA)                                                                            \
+    {                                                                                                                  \
+        T a = readA;                                                                                                   \
+        VM_WRITE(c, expression);                                                                                       \
+        VM_NEXT();                                                                                                     \
+    }
+#define VM_UNARY(name, T, expression)                                                                                  \
+    VM_OP(name) VM_UNARY_BODY(T, expression, VM_READ(T, a))                                                            \
+    VM_ACC_OP(name, VM_UNARY_BODY(T, expression, VM_READ_ACC(T)))
+#define VM_DIVISION_BODY(T, expression, readA)                                                                         \
+    {                                                                                                                  \
+        T a = readA;                                                                                                   \
+        T b = VM_READ(T, b);                                                                                           \
+        if(!divisionValid(a, b))                                                                                       \
+            VM_TRAP("Integer division by zero or overflow");                                                           \
+        VM_WRITE(c, expression);                                                                                       \
+        VM_NEXT();                                                                                                     \
+    }
+#define VM_DIVISION(name, T, expression)                                                                               \
+    VM_OP(name) VM_DIVISION_BODY(T, expression, VM_READ(T, a))                                                         \
+    VM_ACC_OP(name, VM_DIVISION_BODY(T, expression, VM_READ_ACC(T)))
+#define VM_NUMERIC(suffix, T)                                                                                          \
+    VM_BINARY(Add##suffix, T, addValues(a, b))                                                                         \
+    VM_BINARY(Sub##suffix, T, subValues(a, b))                                                                         \
+    VM_BINARY(Mul##suffix, T, mulValues(a, b))                                                                         \
+    VM_DIVISION(Div##suffix, T, (T)(a / b))                                                                            \
+    VM_DIVISION(Mod##suffix, T, modValues(a, b))                                                                       \
+    VM_BINARY(Eq##suffix, T, (uint32_t)(a == b))                                                                       \
+    VM_BINARY(Ne##suffix, T, (uint32_t)(a != b))                                                                       \
+    VM_BINARY(Gt##suffix, T, (uint32_t)(a > b))                                                                        \
+    VM_BINARY(Ge##suffix, T, (uint32_t)(a >= b))                                                                       \
+    VM_UNARY(LogicNot##suffix, T, (uint32_t)(a == T{}))                                                                \
+    VM_BINARY(LogicAnd##suffix, T, (uint32_t)(a != T{} && b != T{}))                                                   \
+    VM_BINARY(LogicOr##suffix, T, (uint32_t)(a != T{} || b != T{}))
+#define VM_BITWISE(suffix, T)                                                                                          \
+    VM_UNARY(BitNot##suffix, T, (T)~a)                                                                                 \
+    VM_BINARY(BitAnd##suffix, T, (T)(a & b))                                                                           \
+    VM_BINARY(BitOr##suffix, T, (T)(a | b))                                                                            \
+    VM_BINARY(BitXor##suffix, T, (T)(a ^ b))
+#define VM_LOAD_REGION(name, T)                                                                                        \
+    VM_OP(name)                                                                                                        \
+    {                                                                                                                  \
+        uint64_t offset = VM_READ(uint64_t, a);                                                                        \
+        if(ip->b.index >= ctx->regions.size())                                                                         \
+            VM_TRAP("Load from an unbound memory region");                                                             \
+        auto& region = ctx->regions[ip->b.index];                                                                      \
+        if(offset > region.size || sizeof(T) > region.size - offset)                                                   \
+            VM_TRAP("Load out of bounds");                                                                             \
+        T value;                                                                                                       \
+        std::memcpy(&value, region.data + offset, sizeof(T));                                                          \
+        VM_WRITE(c, value);                                                                                            \
+        VM_NEXT();                                                                                                     \
+    }
+#define VM_LOAD_PTR(name, T)                                                                                           \
+    VM_OP(name)                                                                                                        \
+    {                                                                                                                  \
+        auto* ptr = VM_READ(const std::byte*, b);                                                                      \
+        if(!ptr)                                                                                                       \
+            VM_TRAP("Load from a null pointer");                                                                       \
+        uint64_t offset = VM_READ(uint64_t, a);                                                                        \
+        if(offset > ip->b.offset || sizeof(T) > ip->b.offset - offset)                                                 \
+            VM_TRAP("Load out of bounds");                                                                             \
+        T value;                                                                                                       \
+        std::memcpy(&value, ptr + offset, sizeof(T));                                                                  \
+        VM_WRITE(c, value);                                                                                            \
+        VM_NEXT();                                                                                                     \
+    }
+#define VM_STORE_REGION(name, T)                                                                                       \
+    VM_OP(name)                                                                                                        \
+    {                                                                                                                  \
+        uint64_t offset = VM_READ(uint64_t, c);                                                                        \
+        if(ip->b.index >= ctx->regions.size())                                                                         \
+            VM_TRAP("Store to an unbound memory region");                                                              \
+        auto& region = ctx->regions[ip->b.index];                                                                      \
+        if(!region.writable)                                                                                           \
+            VM_TRAP("Store to a read only memory region");                                                             \
+        if(offset > region.size || sizeof(T) > region.size - offset)                                                   \
+            VM_TRAP("Store out of bounds");                                                                            \
+        T value = VM_READ(T, a);                                                                                       \
+        std::memcpy(region.data + offset, &value, sizeof(T));                                                          \
+        VM_NEXT();                                                                                                     \
+    }
+#define VM_STORE_PTR(name, T)                                                                                          \
+    VM_OP(name)                                                                                                        \
+    {                                                                                                                  \
+        auto* ptr = VM_READ(std::byte*, b);                                                                            \
+        if(!ptr)                                                                                                       \
+            VM_TRAP("Store to a null pointer");                                                                        \
+        uint64_t offset = VM_READ(uint64_t, c);                                                                        \
+        if(offset > ip->b.offset || sizeof(T) > ip->b.offset - offset)                                                 \
+            VM_TRAP("Store out of bounds");                                                                            \
+        T value = VM_READ(T, a);                                                                                       \
+        std::memcpy(ptr + offset, &value, sizeof(T));                                                                  \
+        VM_NEXT();                                                                                                     \
+    }
+
+            VM_OP(Mov)
+            {
+                acc = frame[ip->a.index];
+                frame[ip->c.index] = acc;
+                VM_NEXT();
+            }
+            VM_OP(LoadConst)
+            {
+                acc = function->constants[ip->a.index];
+                frame[ip->c.index] = acc;
+                VM_NEXT();
+            }
+
+            VM_NUMERIC(I32, int32_t)
+            VM_NUMERIC(U32, uint32_t)
+            VM_NUMERIC(I64, int64_t)
+            VM_NUMERIC(U64, uint64_t)
+            VM_NUMERIC(F32, float)
+            VM_NUMERIC(F64, double)
+            VM_BITWISE(I32, int32_t)
+            VM_BITWISE(U32, uint32_t)
+            VM_BITWISE(I64, int64_t)
+            VM_BITWISE(U64, uint64_t)
+
+            VM_UNARY(I32ToF32, int32_t, (float)a)
+            VM_UNARY(U32ToF32, uint32_t, (float)a)
+            VM_UNARY(F32ToI32, float, convertFloat<int32_t>(a))
+            VM_UNARY(F32ToU32, float, convertFloat<uint32_t>(a))
+            VM_UNARY(BoolToF32, uint32_t, a ? 1.0f : 0.0f)
+            VM_UNARY(BoolToF64, uint32_t, a ? 1.0 : 0.0)
+
+            VM_LOAD_REGION(LoadRegion8, uint8_t)
+            VM_LOAD_REGION(LoadRegion32, uint32_t)
+            VM_LOAD_REGION(LoadRegion64, uint64_t)
+            VM_LOAD_PTR(LoadPtr8, uint8_t)
+            VM_LOAD_PTR(LoadPtr32, uint32_t)
+            VM_LOAD_PTR(LoadPtr64, uint64_t)
+            VM_STORE_REGION(StoreRegion8, uint8_t)
+            VM_STORE_REGION(StoreRegion32, uint32_t)
+            VM_STORE_REGION(StoreRegion64, uint64_t)
+            VM_STORE_PTR(StorePtr8, uint8_t)
+            VM_STORE_PTR(StorePtr32, uint32_t)
+            VM_STORE_PTR(StorePtr64, uint64_t)
+
+            VM_OP(Call)
+            {
+                auto& site = function->calls[ip->a.index];
+                auto& callee = ctx->program.functions()[site.function];
+                // Callee frames start right after the caller's
+                Register* calleeFrame = frame + function->frameSize;
+                if(ctx->depth >= VM::maxCallDepth || callee.frameSize > ctx->stackEnd - calleeFrame)
+                    VM_TRAP("Stack overflow");
+
+                const uint16_t* operands = function->callOperands.data() + site.operandOffset;
+                for(uint16_t i = 0; i < site.inputCount; ++i)
+                    calleeFrame[i] = frame[operands[i]];
+
+                auto native = ctx->tiers ? ctx->tiers->enter(TierTable::Kind::Function, site.function) : nullptr;
+                if(native)
+                {
+                    // The callee's frame doubles as the native call's input and output slots
+                    NativeContext nativeCtx{ctx->regions.data(), ctx->regions.size(), ctx->depth};
+                    auto status = (NativeStatus)native(&nativeCtx, calleeFrame, calleeFrame + callee.inputCount);
+                    if(status != NativeStatus::Ok)
+                        VM_TRAP(nativeStatusMessage(status));
+                    for(uint16_t i = 0; i < site.outputCount; ++i)
+                        frame[operands[site.inputCount + i]] = calleeFrame[callee.inputCount + i];
+                    VM_NEXT();
+                }
+                std::fill(calleeFrame + site.inputCount, calleeFrame + callee.frameSize, Register{});
+
+                ctx->depth++;
+                if(ctx->profile)
+                {
+                    uint64_t start = profileClock();
+                    bool returned = interpret(&callee, calleeFrame, ctx);
+                    uint64_t cycles = profileClock() - start;
+                    ctx->profile->record(callee.profileSlot, cycles, !returned);
+                    ctx->profile->recordCall(function->profileSlot, ip->a.index, cycles, !returned);
+                    if(!returned)
+                        return false;
+                }
+                else if(!interpret(&callee, calleeFrame, ctx))
+                    return false;
+                ctx->depth--;
+
+                for(uint16_t i = 0; i < site.outputCount; ++i)
+                    frame[operands[site.inputCount + i]] = calleeFrame[callee.inputCount + i];
+                VM_NEXT();
+            }
+            VM_OP(CallHost)
+            {
+                auto& site = function->calls[ip->a.index];
+                auto& host = ctx->program.hostFunctions()[site.function];
+                // Arguments are gathered into the free stack above the frame, as for a call into the VM
+                Register* args = frame + function->frameSize;
+                if((ptrdiff_t)site.inputCount + site.outputCount > ctx->stackEnd - args)
+                    VM_TRAP("Stack overflow");
+
+                const uint16_t* operands = function->callOperands.data() + site.operandOffset;
+                for(uint16_t i = 0; i < site.inputCount; ++i)
+                    args[i] = frame[operands[i]];
+                if(ctx->profile)
+                {
+                    uint64_t start = profileClock();
+                    host.thunk(host.function, args, args + site.inputCount);
+                    ctx->profile->recordCall(function->profileSlot, ip->a.index, profileClock() - start, false);
+                }
+                else
+                    host.thunk(host.function, args, args + site.inputCount);
+                for(uint16_t i = 0; i < site.outputCount; ++i)
+                    frame[operands[site.inputCount + i]] = args[site.inputCount + i];
+                VM_NEXT();
+            }
+            VM_OP(Return) { return true; }
+
+#ifndef BS_VM_COMPUTED_GOTO
+                default:
+                    VM_TRAP("Invalid op code");
+            }
+#endif
+
+#undef VM_READ
+#undef VM_READ_ACC
+#undef VM_WRITE
+#undef VM_TRAP
+#undef VM_OP
+#undef VM_ACC_OP
+#undef VM_NEXT
+#undef VM_BINARY_BODY
+#undef VM_BINARY
+#undef VM_UNARY_BODY
+#undef VM_UNARY
+#undef VM_DIVISION_BODY
+#undef VM_DIVISION
+#undef VM_NUMERIC
+#undef VM_BITWISE
+#undef VM_LOAD_REGION
+#undef VM_LOAD_PTR
+#undef VM_STORE_REGION
+#undef VM_STORE_PTR
+        }
+
+        /// Runs a function from outside of the interpreter, counting the invocation when profiling
+        bool invoke(const BytecodeFunction& function, Register* frame, ExecutionContext& ctx)
+        {
+            if(!ctx.profile)
+                return interpret(&function, frame, &ctx);
+            uint64_t start = profileClock();
+            bool returned = interpret(&function, frame, &ctx);
+            ctx.profile->record(function.profileSlot, profileClock() - start, !returned);
+            return returned;
+        }
+    } // namespace
+
+    namespace
+    {
+        /// Whether an op's handler leaves its result in the accumulator
+        bool writesAccumulator(BCOp op)
+        {
+            switch(op)
+            {
+                case BCOp::StoreRegion8:
+                case BCOp::StoreRegion32:
+                case BCOp::StoreRegion64:
+                case BCOp::StorePtr8:
+                case BCOp::StorePtr32:
+                case BCOp::StorePtr64:
+                case BCOp::Call:
+                case BCOp::CallHost:
+                case BCOp::Return:
+                    return false;
+                default:
+                    return true;
+            }
+        }
+
+        bool commutative(BCOp op)
+        {
+            auto inFamily = [op](BCOp first, uint16_t size) {
+                return (uint16_t)op >= (uint16_t)first && (uint16_t)op < (uint16_t)first + size;
+            };
+            return inFamily(BCOp::AddI32, 6) || inFamily(BCOp::MulI32, 6) || inFamily(BCOp::EqI32, 6) ||
+                   inFamily(BCOp::NeI32, 6) || inFamily(BCOp::LogicAndI32, 6) || inFamily(BCOp::LogicOrI32, 6) ||
+                   inFamily(BCOp::BitAndI32, 4) || inFamily(BCOp::BitOrI32, 4) || inFamily(BCOp::BitXorI32, 4);
+        }
+    } // namespace
+
+    void threadBytecode(BytecodeFunction& function)
+    {
+#ifdef BS_VM_COMPUTED_GOTO
+        static const auto tables = [] {
+            interpret(nullptr, nullptr, nullptr);
+            return std::pair{computedGotoTable, accumulatorGotoTable};
+        }();
+        auto& code = function.code;
+        function.threadedCode.resize(code.size());
+        for(size_t i = 0; i < code.size(); ++i)
+        {
+            auto& inst = code[i];
+            function.threadedCode[i] = tables.first[(size_t)inst.op];
+            // Bodies are straight line code, so the accumulator always holds what the previous instruction wrote
+            if(i == 0 || !writesAccumulator(code[i - 1].op) || !tables.second[(size_t)inst.op])
+                continue;
+            uint16_t previous = code[i - 1].c.index;
+            if(inst.a.index != previous && inst.b.index == previous && commutative(inst.op))
+                std::swap(inst.a, inst.b);
+            if(inst.a.index == previous)
+                function.threadedCode[i] = tables.second[(size_t)inst.op];
+        }
+#else
+        function.threadedCode.clear();
+#endif
+    }
+
+    VM::VM(std::shared_ptr<const Program> program, size_t stackSize)
+        : _program(std::move(program)), _stack(std::make_unique<Register[]>(stackSize)), _stackSize(stackSize)
+    {}
+
+    const Program& VM::program() const { return *_program; }
+
+    VMInstrumentation VM::setProgram(std::shared_ptr<const Program> program)
+    {
+        if(program == _program)
+            return {};
+        _program = std::move(program);
+        return {std::exchange(_profile, nullptr), std::exchange(_tiers, nullptr)};
+    }
+
+    void VM::setProfile(Profile* profile)
+    {
+        assert((!profile || &profile->program() == _program.get()) && "Profile is for a different program");
+        _profile = profile;
+    }
+
+    Profile* VM::profile() const { return _profile; }
+
+    void VM::setTierTable(std::shared_ptr<TierTable> tiers) { _tiers = std::move(tiers); }
+
+    const std::shared_ptr<TierTable>& VM::tierTable() const { return _tiers; }
+
+    std::expected<void, std::string> VM::callNative(NativeRegisterFunction native,
+                                                    std::string_view id,
+                                                    std::span<const Register> inputs,
+                                                    std::span<Register> outputs,
+                                                    std::span<const MemoryRegion> regions)
+    {
+        NativeContext ctx{regions.data(), regions.size(), 0};
+        auto status = (NativeStatus)native(&ctx, inputs.data(), outputs.data());
+        if(status != NativeStatus::Ok)
+            return std::unexpected(std::format("{} in {} (native)", nativeStatusMessage(status), id));
+        return {};
+    }
+
+    std::expected<void, std::string> VM::call(uint32_t function,
+                                              std::span<const Register> inputs,
+                                              std::span<Register> outputs,
+                                              std::span<const MemoryRegion> regions)
+    {
+        if(function >= _program->functions().size())
+            return std::unexpected("Function index out of range");
+        auto& bytecode = _program->functions()[function];
+        if(inputs.size() != bytecode.inputCount || outputs.size() != bytecode.outputCount)
+            return std::unexpected(std::format("{} takes {} inputs and {} outputs",
+                                               bytecode.id,
+                                               bytecode.inputCount,
+                                               bytecode.outputCount));
+        if(bytecode.frameSize > _stackSize)
+            return std::unexpected("Stack overflow");
+        if(_tiers)
+        {
+            if(auto native = _tiers->enter(TierTable::Kind::Function, function))
+                return callNative(native, bytecode.id, inputs, outputs, regions);
+        }
+
+        Register* frame = _stack.get();
+        std::copy(inputs.begin(), inputs.end(), frame);
+        std::fill(frame + inputs.size(), frame + bytecode.frameSize, Register{});
+        ExecutionContext ctx{*_program, regions, _stack.get() + _stackSize, 0, {}, _profile, _tiers.get()};
+        if(!invoke(bytecode, frame, ctx))
+            return std::unexpected(std::move(ctx.error));
+        std::copy(frame + bytecode.inputCount, frame + bytecode.inputCount + bytecode.outputCount, outputs.begin());
+        return {};
+    }
+
+    std::expected<void, std::string> VM::runPipeline(uint32_t pipeline,
+                                                     std::span<const Register> inputs,
+                                                     std::span<Register> outputs,
+                                                     std::span<const MemoryRegion> regions)
+    {
+        if(pipeline >= _program->pipelines().size())
+            return std::unexpected("Pipeline index out of range");
+        auto& bytecode = _program->pipelines()[pipeline];
+        if(inputs.size() != bytecode.inputCount || outputs.size() != bytecode.outputCount)
+            return std::unexpected(std::format("{} takes {} inputs and {} outputs",
+                                               bytecode.id,
+                                               bytecode.inputCount,
+                                               bytecode.outputCount));
+        if(bytecode.stages.empty())
+            return std::unexpected(std::format("{} has no stages to run", bytecode.id));
+        for(auto& stage : bytecode.stages)
+        {
+            if(!stage.asyncCalls.empty())
+                return std::unexpected(std::format("{} makes async calls, run it on an AsyncRuntime", bytecode.id));
+        }
+        if(_tiers)
+        {
+            if(auto native = _tiers->enter(TierTable::Kind::Pipeline, pipeline))
+                return callNative(native, bytecode.id, inputs, outputs, regions);
+        }
+
+        // Each stage runs in its own frame at the bottom of the stack, the values passed between stages go through
+        // the top of the stack so that the next frame can be set up without overwriting them
+        ExecutionContext ctx{*_program, regions, _stack.get() + _stackSize, 0, {}, _profile, _tiers.get()};
+        Register* frame = _stack.get();
+        std::copy(inputs.begin(), inputs.end(), frame);
+        for(auto& stage : bytecode.stages)
+        {
+            if(stage.frameSize + stage.stageOutputs.size() > _stackSize)
+                return std::unexpected("Stack overflow");
+            std::fill(frame + stage.inputCount, frame + stage.frameSize, Register{});
+            ctx.stackEnd = _stack.get() + _stackSize - stage.stageOutputs.size();
+            if(!invoke(stage, frame, ctx))
+                return std::unexpected(std::move(ctx.error));
+
+            Register* carried = ctx.stackEnd;
+            for(size_t i = 0; i < stage.stageOutputs.size(); ++i)
+                carried[i] = frame[stage.stageOutputs[i]];
+            std::copy(carried, carried + stage.stageOutputs.size(), frame);
+        }
+        std::copy(frame, frame + outputs.size(), outputs.begin());
+        return {};
+    }
+
+    std::expected<void, std::string> VM::runStage(uint32_t pipeline,
+                                                  size_t stage,
+                                                  std::span<const Register> inputs,
+                                                  std::vector<Register>& carried,
+                                                  std::span<const MemoryRegion> regions)
+    {
+        if(pipeline >= _program->pipelines().size())
+            return std::unexpected("Pipeline index out of range");
+        auto& stages = _program->pipelines()[pipeline].stages;
+        if(stage >= stages.size())
+            return std::unexpected("Stage index out of range");
+        auto& bytecode = stages[stage];
+        if(inputs.size() != bytecode.inputCount)
+            return std::unexpected(std::format("{} takes {} inputs", bytecode.id, bytecode.inputCount));
+        if(bytecode.frameSize > _stackSize)
+            return std::unexpected("Stack overflow");
+
+        Register* frame = _stack.get();
+        std::copy(inputs.begin(), inputs.end(), frame);
+        std::fill(frame + inputs.size(), frame + bytecode.frameSize, Register{});
+        ExecutionContext ctx{*_program, regions, _stack.get() + _stackSize, 0, {}, _profile, _tiers.get()};
+        if(!invoke(bytecode, frame, ctx))
+            return std::unexpected(std::move(ctx.error));
+
+        carried.clear();
+        for(uint16_t reg : bytecode.stageOutputs)
+            carried.push_back(frame[reg]);
+        for(auto& call : bytecode.asyncCalls)
+        {
+            for(uint16_t reg : call.inputs)
+                carried.push_back(frame[reg]);
+        }
+        return {};
+    }
+} // namespace BraneScript
@@ -0,0 +1,97 @@
+#ifndef BRANESCRIPT_VM_H
+#define BRANESCRIPT_VM_H
+
+#include <expected>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+#include "bytecode.h"
+#include "nativeAbi.h"
+#include "profile.h"
+#include "tiering.h"
+
+// Direct threaded dispatch relies on the labels as values extension, other compilers use a switch
+#if(defined(__GNUC__) || defined(__clang__)) && !defined(BS_VM_NO_COMPUTED_GOTO)
+#define BS_VM_COMPUTED_GOTO 1
+#endif
+
+namespace BraneScript
+{
+    /// Fill in BytecodeFunction::threadedCode for the dispatch method the interpreter was built with
+    void threadBytecode(BytecodeFunction& function);
+
+    /// Profile and tier table a VM was using, see VM::setProgram
+    struct VMInstrumentation
+    {
+        Profile* profile = nullptr;
+        std::shared_ptr<TierTable> tiers;
+
+        explicit operator bool() const { return profile || tiers; }
+    };
+
+    /// Register based interpreter for a Program. A VM owns the register stack for its invocations, so each thread
+    /// should use its own VM, while the Program itself can be shared.
+    class VM
+    {
+        std::shared_ptr<const Program> _program;
+        std::unique_ptr<Register[]> _stack;
+        size_t _stackSize;
+        Profile* _profile = nullptr;
+        std::shared_ptr<TierTable> _tiers;
+
+        static std::expected<void, std::string> callNative(NativeRegisterFunction native,
+                                                           std::string_view id,
+                                                           std::span<const Register> inputs,
+                                                           std::span<Register> outputs,
+                                                           std::span<const MemoryRegion> regions);
+
+      public:
+        static constexpr size_t defaultStackSize = 1 << 16;
+        static constexpr uint32_t maxCallDepth = 1024;
+
+        explicit VM(std::shared_ptr<const Program> program, size_t stackSize = defaultStackSize);
+
+        const Program& program() const;
+
+        /// Switches to another program, such as a newer version of the same modules. Profiles and tier tables belong
+        /// to a single program, so the ones the VM was using are detached and returned, for the caller to read out or
+        /// replace with ones for the new program. Switching to the program the VM already runs keeps them. Must not
+        /// be called while the VM is running.
+        VMInstrumentation setProgram(std::shared_ptr<const Program> program);
+
+        /// Instrumentation mode: while a profile is set every function, stage and call site run counts its
+        /// invocations, cycles and traps into it. Pass null to stop profiling. The profile must be for this VM's
+        /// program and outlive its use, and must not be shared with VMs running on other threads.
+        void setProfile(Profile* profile);
+        Profile* profile() const;
+
+        /// Counts invocations into a tier table shared with other VMs running the same program, and calls native code
+        /// in place of any function or pipeline that has been promoted. Stages run through runStage are always
+        /// interpreted. Pass null to interpret everything.
+        void setTierTable(std::shared_ptr<TierTable> tiers);
+        const std::shared_ptr<TierTable>& tierTable() const;
+
+        std::expected<void, std::string> call(uint32_t function,
+                                              std::span<const Register> inputs,
+                                              std::span<Register> outputs,
+                                              std::span<const MemoryRegion> regions = {});
+
+        /// Runs every stage of a pipeline in order, handing each stage's outputs to the next. Pipelines that make
+        /// async calls have to run on an AsyncRuntime instead.
+        std::expected<void, std::string> runPipeline(uint32_t pipeline,
+                                                     std::span<const Register> inputs,
+                                                     std::span<Register> outputs,
+                                                     std::span<const MemoryRegion> regions = {});
+
+        /// Runs a single stage of a pipeline. carried receives the values the stage passes on, followed by the inputs
+        /// of each of its async calls in order.
+        std::expected<void, std::string> runStage(uint32_t pipeline,
+                                                  size_t stage,
+                                                  std::span<const Register> inputs,
+                                                  std::vector<Register>& carried,
+                                                  std::span<const MemoryRegion> regions = {});
+    };
+} // namespace BraneScript
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef BRANESCRIPT_SPSCRING_H
+#define BRANESCRIPT_SPSCRING_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <span>
+
+namespace BraneScript
+{
+    /// Bounded lock free queue between exactly one producer thread and one consumer thread. Each record is a fixed
+    /// number of elements, so a record can be pushed and popped as a span without allocating. The indices the two
+    /// threads write live on separate cache lines, and each side keeps a cached copy of the other's index so that it
+    /// only touches the shared line when the ring looks full or empty.
+    ///
+    /// Either side can block until the other makes progress. The producer closing the ring or the consumer abandoning
+    /// it wakes the other side up, so neither is left waiting on a thread that has stopped.
+    template<class T>
+    class SpscRing
+    {
+        static constexpr size_t cacheLine = 64;
+        /// Indices count records in their upper bits, the lowest bit flags that the side that writes it has stopped
+        static constexpr size_t stoppedBit = 1;
+        static constexpr size_t recordStep = 2;
+
+        std::unique_ptr<T[]> _slots;
+        size_t _capacity;
+        size_t _stride;
+
+        /// Written by the consumer
+        alignas(cacheLine) std::atomic<size_t> _head = 0;
+        size_t _cachedTail = 0;
+        /// Written by the producer
+        alignas(cacheLine) std::atomic<size_t> _tail = 0;
+        size_t _cachedHead = 0;
+
+        static size_t records(size_t index) { return index / recordStep; }
+
+      public:
+        /// Holds up to capacity records of stride elements each
+        SpscRing(size_t capacity, size_t stride)
+            : _slots(std::make_unique<T[]>(std::max<size_t>(capacity, 1) * stride)),
+              _capacity(std::max<size_t>(capacity, 1)), _stride(stride)
+        {}
+
+        SpscRing(const SpscRing&) = delete;
+        SpscRing& operator=(const SpscRing&) = delete;
+
+        size_t capacity() const { return _capacity; }
+
+        size_t stride() const { return _stride; }
+
+        /// Records waiting to be popped. Safe to call from any thread, but only a snapshot while both sides run.
+        size_t size() const
+        {
+            size_t head = records(_head.load(std::memory_order_acquire));
+            size_t tail = records(_tail.load(std::memory_order_acquire));
+            return tail > head ? tail - head : 0;
+        }
+
+        /// Whether the producer has said it won't push anything else
+        bool closed() const { return _tail.load(std::memory_order_acquire) & stoppedBit; }
+
+        /// Whether the consumer has said it won't pop anything else
+        bool abandoned() const { return _head.load(std::memory_order_acquire) & stoppedBit; }
+
+        /// Producer only, returns false without blocking if the ring is full
+        bool tryPush(std::span<const T> record)
+        {
+            assert(record.size() == _stride);
+            size_t tail = _tail.load(std::memory_order_relaxed);
+            if(records(tail) - records(_cachedHead) == _capacity)
+            {
+                _cachedHead = _head.load(std::memory_order_acquire);
+                if(records(tail) - records(_cachedHead) == _capacity)
+                    return false;
+            }
+            std::copy(record.begin(), record.end(), _slots.get() + (records(tail) % _capacity) * _stride);
+            _tail.store(tail + recordStep, std::memory_order_release);
+            _tail.notify_one();
+            return true;
+        }
+
+        /// Consumer only, returns false without blocking if the ring is empty
+        bool tryPop(std::span<T> record)
+        {
+            assert(record.size() == _stride);
+            size_t head = _head.load(std::memory_order_relaxed);
+            if(records(head) == records(_cachedTail))
+            {
+                _cachedTail = _tail.load(std::memory_order_acquire);
+                if(records(head) == records(_cachedTail))
+                    return false;
+            }
+            auto* slot = _slots.get() + (records(head) % _capacity) * _stride;
+            std::copy(slot, slot + _stride, record.begin());
+            _head.store(head + recordStep, std::memory_order_release);
+            _head.notify_one();
+            return true;
+        }
+
+        /// Producer only, blocks while the ring is full and the consumer hasn't abandoned it
+        void waitForSpace()
+        {
+            size_t tail = _tail.load(std::memory_order_relaxed);
+            size_t head = _head.load(std::memory_order_acquire);
+            while(!(head & stoppedBit) && records(tail) - records(head) == _capacity)
+            {
+                _head.wait(head, std::memory_order_acquire);
+                head = _head.load(std::memory_order_acquire);
+            }
+        }
+
+        /// Consumer only, blocks while the ring is empty and the producer hasn't closed it
+        void waitForData()
+        {
+            size_t head = _head.load(std::memory_order_relaxed);
+            size_t tail = _tail.load(std::memory_order_acquire);
+            while(!(tail & stoppedBit) && records(tail) == records(head))
+            {
+                _tail.wait(tail, std::memory_order_acquire);
+                tail = _tail.load(std::memory_order_acquire);
+            }
+        }
+
+        /// Producer only, records already pushed can still be popped
+        void close()
+        {
+            _tail.fetch_or(stoppedBit, std::memory_order_release);
+            _tail.notify_all();
+        }
+
+        /// Consumer only, stops the producer from waiting for space
+        void abandon()
+        {
+            _head.fetch_or(stoppedBit, std::memory_order_release);
+            _head.notify_all();
+        }
+    };
+} // namespace BraneScript
+
+#endif
@@ -0,0 +1,208 @@
+#include "taskScheduler.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace BraneScript
+{
+    namespace
+    {
+        thread_local TaskScheduler* tlsScheduler = nullptr;
+        thread_local size_t tlsQueue = 0;
+    } // namespace
+
+    TaskId TaskGraph::addTask(std::function<void()> function)
+    {
+        auto& task = _tasks.emplace_back();
+        task.function = std::move(function);
+        return (TaskId)(_tasks.size() - 1);
+    }
+
+    void TaskGraph::addDependency(TaskId before, TaskId after)
+    {
+        assert(before < _tasks.size() && after < _tasks.size() && "Task id out of range");
+        assert(before != after && "Task cannot depend on itself");
+        _tasks[before].successors.push_back(after);
+        _tasks[after].dependencyCount++;
+    }
+
+    size_t TaskGraph::size() const { return _tasks.size(); }
+
+    TaskScheduler::TaskScheduler(size_t threadCount)
+    {
+        // One queue per worker, plus a shared queue that threads outside the pool push to
+        for(size_t i = 0; i < threadCount + 1; ++i)
+            _queues.push_back(std::make_unique<WorkQueue>());
+        _workers.reserve(threadCount);
+        for(size_t i = 0; i < threadCount; ++i)
+            _workers.emplace_back([this, i]() { workerMain(i); });
+    }
+
+    TaskScheduler::~TaskScheduler()
+    {
+        {
+            std::scoped_lock lock(_sleepLock);
+            _stopping = true;
+        }
+        _wake.notify_all();
+        for(auto& worker : _workers)
+            worker.join();
+    }
+
+    size_t TaskScheduler::threadCount() const { return _workers.size(); }
+
+    size_t TaskScheduler::currentQueue()
+    {
+        if(tlsScheduler == this)
+            return tlsQueue;
+        return _queues.size() - 1;
+    }
+
+    void TaskScheduler::push(size_t queue, WorkItem item)
+    {
+        // Count the item before publishing it so the counter never drops below the number of queued items
+        _queuedItems++;
+        {
+            std::scoped_lock lock(_queues[queue]->lock);
+            _queues[queue]->items.push_back(item);
+        }
+        {
+            std::scoped_lock lock(_sleepLock);
+        }
+        _wake.notify_one();
+    }
+
+    bool TaskScheduler::pop(size_t queue, WorkItem& item)
+    {
+        auto& q = *_queues[queue];
+        std::scoped_lock lock(q.lock);
+        if(q.items.empty())
+            return false;
+        item = q.items.back();
+        q.items.pop_back();
+        _queuedItems--;
+        return true;
+    }
+
+    bool TaskScheduler::steal(size_t thief, WorkItem& item)
+    {
+        for(size_t i = 1; i < _queues.size(); ++i)
+        {
+            auto& q = *_queues[(thief + i) % _queues.size()];
+            std::scoped_lock lock(q.lock);
+            if(q.items.empty())
+                continue;
+            item = q.items.front();
+            q.items.pop_front();
+            _queuedItems--;
+            return true;
+        }
+        return false;
+    }
+
+    bool TaskScheduler::findWork(size_t queue, WorkItem& item) { return pop(queue, item) || steal(queue, item); }
+
+    void TaskScheduler::execute(size_t queue, WorkItem item)
+    {
+        TaskGraph& graph = *item.graph;
+        auto& task = graph._tasks[item.task];
+        try
+        {
+            task.function();
+        }
+        catch(...)
+        {
+            std::scoped_lock lock(graph._exceptionLock);
+            if(!graph._exception)
+                graph._exception = std::current_exception();
+        }
+
+        for(TaskId successor : task.successors)
+        {
+            if(--graph._tasks[successor].remainingDependencies == 0)
+                push(queue, {&graph, successor});
+        }
+
+        // The graph may be destroyed by the thread waiting on it as soon as this reaches zero
+        if(--graph._remainingTasks == 0)
+        {
+            {
+                std::scoped_lock lock(_sleepLock);
+            }
+            _wake.notify_all();
+        }
+    }
+
+    void TaskScheduler::workerMain(size_t index)
+    {
+        tlsScheduler = this;
+        tlsQueue = index;
+        while(true)
+        {
+            WorkItem item;
+            if(findWork(index, item))
+            {
+                execute(index, item);
+                continue;
+            }
+
+            std::unique_lock lock(_sleepLock);
+            _wake.wait(lock, [this]() { return _stopping || _queuedItems > 0; });
+            if(_stopping)
+                return;
+        }
+    }
+
+    void TaskScheduler::run(TaskGraph& graph)
+    {
+        if(graph._tasks.empty())
+            return;
+
+        std::vector<TaskId> roots;
+        for(TaskId i = 0; i < graph._tasks.size(); ++i)
+        {
+            auto& task = graph._tasks[i];
+            task.remainingDependencies = task.dependencyCount;
+            if(task.dependencyCount == 0)
+                roots.push_back(i);
+        }
+        assert(!roots.empty() && "Task graph contains a dependency cycle");
+        graph._remainingTasks = graph._tasks.size();
+
+        size_t queue = currentQueue();
+        // Push in reverse so that the owning thread pops roots in submission order
+        for(auto root = roots.rbegin(); root != roots.rend(); ++root)
+            push(queue, {&graph, *root});
+
+        while(graph._remainingTasks > 0)
+        {
+            WorkItem item;
+            if(findWork(queue, item))
+            {
+                execute(queue, item);
+                continue;
+            }
+
+            std::unique_lock lock(_sleepLock);
+            _wake.wait(lock, [&]() { return graph._remainingTasks == 0 || _queuedItems > 0; });
+        }
+
+        if(graph._exception)
+            std::rethrow_exception(graph._exception);
+    }
+
+    void TaskScheduler::parallelFor(size_t begin,
+                                    size_t end,
+                                    size_t chunkSize,
+                                    const std::function<void(size_t, size_t)>& f)
+    {
+        assert(chunkSize > 0);
+        TaskGraph graph;
+        for(size_t chunk = begin; chunk < end; chunk += chunkSize)
+        {
+            size_t chunkEnd = std::min(end, chunk + chunkSize);
+            graph.addTask([&f, chunk, chunkEnd]() { f(chunk, chunkEnd); });
+        }
+        run(graph);
+    }
+} // namespace BraneScript
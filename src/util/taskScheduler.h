@@ -0,0 +1,106 @@
+#ifndef BRANESCRIPT_TASKSCHEDULER_H
+#define BRANESCRIPT_TASKSCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace BraneScript
+{
+    class TaskScheduler;
+
+    using TaskId = uint32_t;
+
+    /// A set of tasks and the dependency edges between them, submitted to a TaskScheduler as a unit. A graph may only
+    /// be run once, and must outlive the call to TaskScheduler::run
+    class TaskGraph
+    {
+        struct Task
+        {
+            std::function<void()> function;
+            std::vector<TaskId> successors;
+            uint32_t dependencyCount = 0;
+            std::atomic<uint32_t> remainingDependencies = 0;
+        };
+
+        std::deque<Task> _tasks;
+        std::atomic<size_t> _remainingTasks = 0;
+
+        std::mutex _exceptionLock;
+        std::exception_ptr _exception;
+
+        friend class TaskScheduler;
+
+      public:
+        TaskGraph() = default;
+        TaskGraph(const TaskGraph&) = delete;
+
+        TaskId addTask(std::function<void()> function);
+
+        /// Make sure that task "after" is not started until task "before" has completed
+        void addDependency(TaskId before, TaskId after);
+
+        size_t size() const;
+    };
+
+    /// Work stealing thread pool. Each worker owns a deque that it pushes to and pops from the back of, idle workers
+    /// steal from the front of other workers' deques. Threads that call run() participate in executing tasks until
+    /// their graph has completed.
+    class TaskScheduler
+    {
+        struct WorkItem
+        {
+            TaskGraph* graph;
+            TaskId task;
+        };
+
+        struct WorkQueue
+        {
+            std::mutex lock;
+            std::deque<WorkItem> items;
+        };
+
+        std::vector<std::unique_ptr<WorkQueue>> _queues;
+        std::vector<std::thread> _workers;
+
+        std::mutex _sleepLock;
+        std::condition_variable _wake;
+        std::atomic<size_t> _queuedItems = 0;
+        std::atomic<uint32_t> _injectCounter = 0;
+        bool _stopping = false;
+
+        void workerMain(size_t index);
+
+        void push(size_t queue, WorkItem item);
+        bool pop(size_t queue, WorkItem& item);
+        bool steal(size_t thief, WorkItem& item);
+        bool findWork(size_t queue, WorkItem& item);
+
+        void execute(size_t queue, WorkItem item);
+        size_t currentQueue();
+
+      public:
+        /// Creates a scheduler with threadCount background workers, passing 0 will run all tasks on the calling thread
+        explicit TaskScheduler(size_t threadCount = std::thread::hardware_concurrency());
+        TaskScheduler(const TaskScheduler&) = delete;
+        ~TaskScheduler();
+
+        /// Execute every task in the graph, blocking until they have all completed. If a task throws, the first
+        /// exception captured is rethrown here once the graph has drained.
+        void run(TaskGraph& graph);
+
+        /// Split [begin, end) into chunks of at most chunkSize and call f(chunkBegin, chunkEnd) on each in parallel
+        void parallelFor(size_t begin, size_t end, size_t chunkSize, const std::function<void(size_t, size_t)>& f);
+
+        size_t threadCount() const;
+    };
+} // namespace BraneScript
+
+#endif
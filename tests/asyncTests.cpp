@@ -0,0 +1,221 @@
+#include "testing.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "runtime/async.h"
+
+using namespace BraneScript;
+using namespace BraneScript::Testing;
+
+namespace
+{
+    constexpr TypeId I32 = TypeTable::base(BSBaseType::I32);
+
+    /// lookup(i32 key) -> i32: the first stage passes key on and asks host::lookup for a value, the second returns
+    /// key + value
+    std::shared_ptr<const Program> lookupProgram()
+    {
+        BSModule module;
+        module.name = "test";
+        auto pipeline = makePipeline("lookup", {I32}, {I32});
+        auto& first = pipeline->stages->front();
+        first.outputs = {IRValue{0}};
+        first.asyncOps.push_back(BSAsyncCall{"host::lookup", {IRValue{0}}, {I32}});
+        auto& second = pipeline->stages->emplace_back();
+        second.localVars = {I32, I32};
+        IRValue sum = addLocal(second.localVars, I32);
+        second.operations.binary(OpCode::Add, IRValue{0}, IRValue{1}, sum);
+        second.outputs = {sum};
+        module.pipelines = {pipeline};
+        return loadProgram(std::span(&module, 1));
+    }
+
+    using Outcome = std::expected<std::vector<Register>, std::string>;
+
+    /// Runs lookup once and returns what it completed with
+    Outcome lookupOnce(AsyncRuntime& runtime, int32_t key)
+    {
+        std::optional<Outcome> outcome;
+        EXPECT_TRUE(runtime.start(0, {Register::of(key)}, [&](Outcome result) { outcome = std::move(result); }));
+        runtime.wait();
+        EXPECT_TRUE(outcome);
+        return outcome ? *outcome : std::unexpected("Pipeline did not complete");
+    }
+
+    /// Results handed off by host::lookup to be completed by a thread of its own, as a host waiting on I/O would
+    class Completer
+    {
+        std::mutex _mutex;
+        std::condition_variable _ready;
+        std::deque<std::pair<int32_t, AsyncCallResult>> _pending;
+        bool _stopping = false;
+        std::thread _thread;
+
+      public:
+        Completer()
+            : _thread(
+                  [this]
+                  {
+                      std::unique_lock lock(_mutex);
+                      while(true)
+                      {
+                          _ready.wait(lock, [this] { return _stopping || !_pending.empty(); });
+                          if(_pending.empty())
+                              return;
+                          auto [key, result] = std::move(_pending.front());
+                          _pending.pop_front();
+                          lock.unlock();
+                          Register value = Register::of(key * 10);
+                          result.complete(std::span(&value, 1));
+                          lock.lock();
+                      }
+                  })
+        {}
+
+        ~Completer()
+        {
+            {
+                std::lock_guard lock(_mutex);
+                _stopping = true;
+            }
+            _ready.notify_one();
+            _thread.join();
+        }
+
+        void push(int32_t key, AsyncCallResult result)
+        {
+            {
+                std::lock_guard lock(_mutex);
+                _pending.emplace_back(key, std::move(result));
+            }
+            _ready.notify_one();
+        }
+    };
+} // namespace
+
+TEST(AsyncRuntime, CallCompletedInline)
+{
+    AsyncRuntime runtime(lookupProgram(), 2);
+    runtime.registerHostFunction("host::lookup",
+                                 [](std::span<const Register> inputs, AsyncCallResult result)
+                                 {
+                                     EXPECT_EQ(result.outputCount(), 1);
+                                     Register value = Register::of(inputs[0].as<int32_t>() * 10);
+                                     result.complete(std::span(&value, 1));
+                                 });
+    auto outcome = lookupOnce(runtime, 4);
+    ASSERT_TRUE(outcome) << outcome.error();
+    ASSERT_EQ(outcome->size(), 1);
+    EXPECT_EQ(outcome->front().as<int32_t>(), 44);
+    EXPECT_EQ(runtime.inFlight(), 0);
+}
+
+TEST(AsyncRuntime, CallCompletedFromAnotherThread)
+{
+    Completer completer;
+    AsyncRuntime runtime(lookupProgram(), 2);
+    runtime.registerHostFunction("host::lookup",
+                                 [&](std::span<const Register> inputs, AsyncCallResult result)
+                                 { completer.push(inputs[0].as<int32_t>(), std::move(result)); });
+    auto outcome = lookupOnce(runtime, 7);
+    ASSERT_TRUE(outcome) << outcome.error();
+    EXPECT_EQ(outcome->front().as<int32_t>(), 77);
+}
+
+TEST(AsyncRuntime, FailedCallsFailThePipeline)
+{
+    AsyncRuntime runtime(lookupProgram(), 2);
+    runtime.registerHostFunction("host::lookup",
+                                 [](std::span<const Register>, AsyncCallResult result) { result.fail("not found"); });
+    auto outcome = lookupOnce(runtime, 1);
+    ASSERT_FALSE(outcome);
+    EXPECT_NE(outcome.error().find("Async call to host::lookup in lookup[0] failed: not found"), std::string::npos)
+        << outcome.error();
+}
+
+TEST(AsyncRuntime, DroppedResultsFailThePipeline)
+{
+    AsyncRuntime runtime(lookupProgram(), 2);
+    runtime.registerHostFunction("host::lookup", [](std::span<const Register>, AsyncCallResult) {});
+    auto outcome = lookupOnce(runtime, 1);
+    ASSERT_FALSE(outcome);
+    EXPECT_NE(outcome.error().find("dropped without being completed"), std::string::npos) << outcome.error();
+}
+
+TEST(AsyncRuntime, WrongOutputCountFailsThePipeline)
+{
+    AsyncRuntime runtime(lookupProgram(), 2);
+    runtime.registerHostFunction("host::lookup",
+                                 [](std::span<const Register>, AsyncCallResult result)
+                                 {
+                                     Register values[] = {Register::of(1), Register::of(2)};
+                                     result.complete(values);
+                                     // The call already failed, completing it again has no effect
+                                     result.complete(std::span(values, 1));
+                                 });
+    auto outcome = lookupOnce(runtime, 1);
+    ASSERT_FALSE(outcome);
+    EXPECT_NE(outcome.error().find("Completed with 2 values instead of 1"), std::string::npos) << outcome.error();
+}
+
+TEST(AsyncRuntime, UnregisteredHostFunctionsAreRejected)
+{
+    AsyncRuntime runtime(lookupProgram(), 2);
+    bool completed = false;
+    auto started = runtime.start(0, {Register::of(1)}, [&](Outcome) { completed = true; });
+    ASSERT_FALSE(started);
+    EXPECT_NE(started.error().find("no host function named host::lookup is registered"), std::string::npos)
+        << started.error();
+    runtime.wait();
+    EXPECT_FALSE(completed);
+    EXPECT_EQ(runtime.inFlight(), 0);
+}
+
+TEST(AsyncRuntime, ManyInstancesInFlight)
+{
+    constexpr int32_t count = 4000;
+    Completer completer;
+    AsyncRuntime runtime(lookupProgram(), 2);
+    // Odd keys complete inline, even ones on the completer's thread, so both race with the suspending instance
+    runtime.registerHostFunction("host::lookup",
+                                 [&](std::span<const Register> inputs, AsyncCallResult result)
+                                 {
+                                     int32_t key = inputs[0].as<int32_t>();
+                                     if(key % 2 == 0)
+                                     {
+                                         completer.push(key, std::move(result));
+                                         return;
+                                     }
+                                     Register value = Register::of(key * 10);
+                                     result.complete(std::span(&value, 1));
+                                 });
+
+    std::vector<int32_t> results(count, -1);
+    std::vector<std::string> errors;
+    std::mutex errorMutex;
+    for(int32_t key = 0; key < count; ++key)
+    {
+        auto started = runtime.start(0,
+                                     {Register::of(key)},
+                                     [&, key](Outcome outcome)
+                                     {
+                                         if(outcome)
+                                             results[key] = outcome->front().as<int32_t>();
+                                         else
+                                         {
+                                             std::lock_guard lock(errorMutex);
+                                             errors.push_back(outcome.error());
+                                         }
+                                     });
+        ASSERT_TRUE(started) << started.error();
+    }
+    runtime.wait();
+    EXPECT_EQ(runtime.inFlight(), 0);
+    EXPECT_TRUE(errors.empty()) << errors.front();
+    int32_t mismatches = 0;
+    for(int32_t key = 0; key < count; ++key)
+        mismatches += results[key] != key * 11;
+    EXPECT_EQ(mismatches, 0);
+}
@@ -0,0 +1,458 @@
+#include "testing.h"
+
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <limits>
+#include <tuple>
+#include "runtime/batch.h"
+
+using namespace BraneScript;
+using namespace BraneScript::Testing;
+
+namespace
+{
+    /// Neither a multiple of the kernels' 8 lane vectors nor of the block size, so the last block ends mid vector
+    constexpr size_t count = 1003;
+
+    constexpr BSBaseType numericTypes[] = {
+        BSBaseType::I32, BSBaseType::U32, BSBaseType::I64, BSBaseType::U64, BSBaseType::F32, BSBaseType::F64};
+    constexpr BSBaseType intTypes[] = {BSBaseType::I32, BSBaseType::U32, BSBaseType::I64, BSBaseType::U64};
+    /// Types a comparison may write its result to, each widened from the mask by a kernel of its own
+    constexpr BSBaseType boolTypes[] = {
+        BSBaseType::U8, BSBaseType::I32, BSBaseType::U64, BSBaseType::F32, BSBaseType::F64};
+
+    std::string_view typeName(BSBaseType type)
+    {
+        constexpr std::string_view names[] = {
+            "U8", "I8", "U16", "I16", "U32", "I32", "F32", "U64", "I64", "F64", "U128", "I128"};
+        return names[(size_t)type];
+    }
+
+    std::string_view opName(OpCode op)
+    {
+        constexpr std::string_view names[] = {"Mov",      "Load",     "Store",    "Add",      "Sub",      "Mul",
+                                              "Div",      "Mod",      "Eq",       "Ne",       "Gt",       "Ge",
+                                              "LogicNot", "LogicAnd", "LogicOr",  "BitNot",   "BitAnd",   "BitOr",
+                                              "BitXor",   "I32ToF32", "U32ToF32", "F32ToI32", "F32ToU32"};
+        return names[(size_t)op];
+    }
+
+    /// Calls f with a value of the C++ type the VM holds a base type as
+    template<class F>
+    decltype(auto) withType(BSBaseType type, F&& f)
+    {
+        switch(type)
+        {
+            case BSBaseType::U8:
+                return f(uint8_t{});
+            case BSBaseType::I32:
+                return f(int32_t{});
+            case BSBaseType::U32:
+                return f(uint32_t{});
+            case BSBaseType::I64:
+                return f(int64_t{});
+            case BSBaseType::U64:
+                return f(uint64_t{});
+            case BSBaseType::F32:
+                return f(float{});
+            default:
+                return f(double{});
+        }
+    }
+
+    size_t columnWidth(BSBaseType type) { return BatchExecutor::columnWidth(*vmValueType(BSType{type})); }
+
+    template<class T>
+    std::vector<T> edgeValues()
+    {
+        using Limits = std::numeric_limits<T>;
+        if constexpr(std::is_floating_point_v<T>)
+            return {0,
+                    (T)-0.0,
+                    1,
+                    -1,
+                    (T)0.5,
+                    (T)-2.25,
+                    (T)1e9,
+                    (T)-3e9,
+                    (T)5e18,
+                    (T)-1e30,
+                    Limits::infinity(),
+                    -Limits::infinity(),
+                    Limits::quiet_NaN(),
+                    Limits::denorm_min(),
+                    Limits::max(),
+                    Limits::lowest()};
+        else
+            return {0,
+                    1,
+                    2,
+                    7,
+                    (T)-1,
+                    (T)-7,
+                    Limits::min(),
+                    Limits::max(),
+                    (T)(Limits::min() + 1),
+                    (T)(Limits::max() - 1),
+                    (T)1000003,
+                    (T)-65536};
+    }
+
+    /// Operand of every entity, pairing each edge value with every other over the entities
+    std::vector<Register> operands(BSBaseType type, bool right)
+    {
+        return withType(type,
+                        [&]<class T>(T)
+                        {
+                            auto edges = edgeValues<T>();
+                            std::vector<Register> values(count);
+                            for(size_t i = 0; i < count; ++i)
+                                values[i] = Register::of(edges[(right ? i / edges.size() + i * 3 : i) % edges.size()]);
+                            return values;
+                        });
+    }
+
+    /// Values the way the batch executor takes them, packed at the width of their type
+    std::vector<std::byte> column(const std::vector<Register>& values, size_t width)
+    {
+        std::vector<std::byte> bytes(values.size() * width);
+        for(size_t i = 0; i < values.size(); ++i)
+            std::memcpy(bytes.data() + i * width, &values[i].bits, width);
+        return bytes;
+    }
+
+    Register entity(const std::vector<std::byte>& column, size_t width, size_t i)
+    {
+        Register value;
+        std::memcpy(&value.bits, column.data() + i * width, width);
+        return value;
+    }
+
+    /// Bits of two results are equal, except that any NaN matches any other
+    bool sameResult(BSBaseType type, Register a, Register b)
+    {
+        if(type == BSBaseType::F32 && std::isnan(a.as<float>()) && std::isnan(b.as<float>()))
+            return true;
+        if(type == BSBaseType::F64 && std::isnan(a.as<double>()) && std::isnan(b.as<double>()))
+            return true;
+        return a.bits == b.bits;
+    }
+
+    /// One op on operands of a type, writing a result of another type for comparisons and conversions
+    struct OpCase
+    {
+        OpCode op;
+        BSBaseType operand;
+        BSBaseType result;
+    };
+
+    void PrintTo(const OpCase& opCase, std::ostream* out)
+    {
+        *out << opName(opCase.op) << " " << typeName(opCase.operand) << " -> " << typeName(opCase.result);
+    }
+
+    std::vector<OpCase> opCases()
+    {
+        std::vector<OpCase> cases;
+        for(auto op : {OpCode::Add, OpCode::Sub, OpCode::Mul, OpCode::Div, OpCode::Mod})
+            for(auto type : numericTypes)
+                cases.push_back({op, type, type});
+        for(auto op :
+            {OpCode::Eq, OpCode::Ne, OpCode::Gt, OpCode::Ge, OpCode::LogicNot, OpCode::LogicAnd, OpCode::LogicOr})
+            for(auto type : numericTypes)
+                for(auto result : boolTypes)
+                    cases.push_back({op, type, result});
+        for(auto op : {OpCode::BitNot, OpCode::BitAnd, OpCode::BitOr, OpCode::BitXor})
+            for(auto type : intTypes)
+                cases.push_back({op, type, type});
+        cases.push_back({OpCode::I32ToF32, BSBaseType::I32, BSBaseType::F32});
+        cases.push_back({OpCode::U32ToF32, BSBaseType::U32, BSBaseType::F32});
+        cases.push_back({OpCode::F32ToI32, BSBaseType::F32, BSBaseType::I32});
+        cases.push_back({OpCode::F32ToU32, BSBaseType::F32, BSBaseType::U32});
+        return cases;
+    }
+
+    /// f(a, b) -> c applying a single op
+    BSModule opModule(const OpCase& opCase)
+    {
+        BSModule module;
+        module.name = "test";
+        TypeId operand = TypeTable::base(opCase.operand);
+        auto function = makeFunction("f", {operand, operand}, {TypeTable::base(opCase.result)});
+        if(isUnaryOp(opCase.op))
+            function->operations.unary(opCase.op, IRValue{0}, IRValue{2});
+        else
+            function->operations.binary(opCase.op, IRValue{0}, IRValue{1}, IRValue{2});
+        module.functions = {function};
+        return module;
+    }
+
+    /// Divisors of zero and INT_MIN / -1 trap, they are tested on their own
+    void avoidTraps(const OpCase& opCase, std::vector<Register>& a, std::vector<Register>& b)
+    {
+        if(opCase.op != OpCode::Div && opCase.op != OpCode::Mod)
+            return;
+        withType(opCase.operand,
+                 [&]<class T>(T)
+                 {
+                     if constexpr(std::is_integral_v<T>)
+                     {
+                         for(size_t i = 0; i < count; ++i)
+                         {
+                             T x = a[i].as<T>();
+                             T y = b[i].as<T>();
+                             if(y == 0 || (std::is_signed_v<T> && x == std::numeric_limits<T>::min() && y == (T)-1))
+                                 b[i] = Register::of((T)1);
+                         }
+                     }
+                 });
+    }
+
+    /// Calls function 0 for every entity on the VM, and returns its outputs or the first error
+    std::expected<std::vector<std::vector<Register>>, std::string>
+    runVM(const std::shared_ptr<const Program>& program,
+          const std::vector<std::vector<Register>>& inputs,
+          size_t outputCount,
+          std::span<const MemoryRegion> regions = {})
+    {
+        VM vm(program);
+        std::vector<std::vector<Register>> outputs(outputCount, std::vector<Register>(count));
+        std::vector<Register> in(inputs.size());
+        std::vector<Register> out(outputCount);
+        for(size_t i = 0; i < count; ++i)
+        {
+            for(size_t j = 0; j < inputs.size(); ++j)
+                in[j] = inputs[j][i];
+            auto result = vm.call(0, in, out, regions);
+            if(!result)
+                return std::unexpected(std::move(result.error()));
+            for(size_t j = 0; j < outputCount; ++j)
+                outputs[j][i] = out[j];
+        }
+        return outputs;
+    }
+
+    using KernelSet = std::string_view;
+
+    std::string caseName(const testing::TestParamInfo<std::tuple<OpCase, KernelSet>>& info)
+    {
+        auto& [opCase, kernelSet] = info.param;
+        return std::format(
+            "{}{}To{}_{}", opName(opCase.op), typeName(opCase.operand), typeName(opCase.result), kernelSet);
+    }
+
+    class BatchMatchesVM : public testing::TestWithParam<std::tuple<OpCase, KernelSet>>
+    {
+    };
+
+    class BatchKernels : public testing::TestWithParam<KernelSet>
+    {
+      protected:
+        std::shared_ptr<const Program> _program;
+        std::optional<BatchExecutor> _batch;
+
+        void load(const BSModule& module)
+        {
+            _program = loadProgram(std::span(&module, 1));
+            ASSERT_TRUE(_program);
+            _batch.emplace(_program);
+            auto selected = _batch->useKernelSet(GetParam());
+            ASSERT_TRUE(selected) << selected.error();
+            auto supported = _batch->functionSupported(0);
+            ASSERT_TRUE(supported) << supported.error();
+        }
+    };
+} // namespace
+
+TEST_P(BatchMatchesVM, Op)
+{
+    auto& [opCase, kernelSet] = GetParam();
+    BSModule module = opModule(opCase);
+    auto program = loadProgram(std::span(&module, 1));
+    ASSERT_TRUE(program);
+    BatchExecutor batch(program);
+    auto selected = batch.useKernelSet(kernelSet);
+    ASSERT_TRUE(selected) << selected.error();
+    EXPECT_EQ(batch.kernelSet(), kernelSet);
+    auto supported = batch.functionSupported(0);
+    ASSERT_TRUE(supported) << supported.error();
+
+    auto a = operands(opCase.operand, false);
+    auto b = operands(opCase.operand, true);
+    avoidTraps(opCase, a, b);
+    auto expected = runVM(program, {a, b}, 1);
+    ASSERT_TRUE(expected) << expected.error();
+
+    size_t inWidth = columnWidth(opCase.operand);
+    size_t outWidth = columnWidth(opCase.result);
+    auto aColumn = column(a, inWidth);
+    auto bColumn = column(b, inWidth);
+    std::vector<std::byte> cColumn(count * outWidth);
+    const void* inputs[] = {aColumn.data(), bColumn.data()};
+    void* outputs[] = {cColumn.data()};
+    auto result = batch.call(0, inputs, outputs, count);
+    ASSERT_TRUE(result) << result.error();
+
+    int mismatches = 0;
+    for(size_t i = 0; i < count; ++i)
+    {
+        Register actual = entity(cColumn, outWidth, i);
+        if(sameResult(opCase.result, actual, (*expected)[0][i]))
+            continue;
+        if(++mismatches <= 4)
+            ADD_FAILURE() << std::format("entity {}: batch wrote {:#x}, the VM {:#x}, for {:#x} and {:#x}",
+                                         i,
+                                         actual.bits,
+                                         (*expected)[0][i].bits,
+                                         a[i].bits,
+                                         b[i].bits);
+    }
+    EXPECT_EQ(mismatches, 0);
+}
+
+INSTANTIATE_TEST_SUITE_P(Ops,
+                         BatchMatchesVM,
+                         testing::Combine(testing::ValuesIn(opCases()),
+                                          testing::ValuesIn(BatchExecutor::kernelSets())),
+                         caseName);
+
+TEST_P(BatchKernels, DivisionTrapsMatchTheVM)
+{
+    // Trapping entities sit in the last block, which isn't a whole number of vectors
+    constexpr size_t trapping = count - 2;
+    struct TrapCase
+    {
+        OpCode op;
+        BSBaseType type;
+        Register dividend;
+        Register divisor;
+    };
+    TrapCase traps[] = {
+        {OpCode::Div, BSBaseType::I32, Register::of(std::numeric_limits<int32_t>::min()), Register::of(-1)},
+        {OpCode::Mod, BSBaseType::I32, Register::of(std::numeric_limits<int32_t>::min()), Register::of(-1)},
+        {OpCode::Div, BSBaseType::I64, Register::of(std::numeric_limits<int64_t>::min()), Register::of((int64_t)-1)},
+        {OpCode::Mod, BSBaseType::I64, Register::of(std::numeric_limits<int64_t>::min()), Register::of((int64_t)-1)},
+        {OpCode::Div, BSBaseType::U32, Register::of(7u), Register::of(0u)},
+        {OpCode::Mod, BSBaseType::U64, Register::of((uint64_t)7), Register::of((uint64_t)0)},
+    };
+    for(auto& trap : traps)
+    {
+        SCOPED_TRACE(std::format("{}{}", opName(trap.op), typeName(trap.type)));
+        OpCase opCase{trap.op, trap.type, trap.type};
+        load(opModule(opCase));
+        auto a = operands(trap.type, false);
+        auto b = operands(trap.type, true);
+        avoidTraps(opCase, a, b);
+        a[trapping] = trap.dividend;
+        b[trapping] = trap.divisor;
+
+        auto vmResult = runVM(_program, {a, b}, 1);
+        ASSERT_FALSE(vmResult);
+        EXPECT_NE(vmResult.error().find("division"), std::string::npos) << vmResult.error();
+
+        size_t width = columnWidth(trap.type);
+        auto aColumn = column(a, width);
+        auto bColumn = column(b, width);
+        std::vector<std::byte> cColumn(count * width);
+        const void* inputs[] = {aColumn.data(), bColumn.data()};
+        void* outputs[] = {cColumn.data()};
+        auto batchResult = _batch->call(0, inputs, outputs, count);
+        ASSERT_FALSE(batchResult);
+        EXPECT_NE(batchResult.error().find(std::format("for entity {}", trapping)), std::string::npos)
+            << batchResult.error();
+    }
+}
+
+TEST_P(BatchKernels, LoadsAndStoresMatchTheVM)
+{
+    // Offsets are 32 bit, so every access first widens them to the 64 bit offsets the kernels read
+    for(auto type : {BSBaseType::U8, BSBaseType::I32, BSBaseType::U64, BSBaseType::F64})
+    {
+        SCOPED_TRACE(typeName(type));
+        size_t width = columnWidth(type);
+        TypeId value = TypeTable::base(type);
+        TypeId u32 = TypeTable::base(BSBaseType::U32);
+
+        // f(offset, p) -> (x, y): x = region0[offset], y = *p, then *p = x and region1[offset] = y
+        BSModule module;
+        module.name = "test";
+        auto function = makeFunction("f", {u32, module.types.ref(value, true)}, {value, value});
+        IRValue zero = addLocal(function->localVars, u32);
+        function->operations.constU32(0, zero);
+        function->operations.load(ConstU32{0}, IRValue{0}, IRValue{2});
+        function->operations.load(IRValue{1}, zero, IRValue{3});
+        function->operations.store(IRValue{1}, IRValue{2}, zero);
+        function->operations.store(ConstU32{1}, IRValue{3}, IRValue{0});
+        module.functions = {function};
+        load(module);
+
+        std::vector<std::byte> source(count * width);
+        for(size_t i = 0; i < source.size(); ++i)
+            source[i] = (std::byte)(i * 37 + 11);
+        struct Memory
+        {
+            std::vector<std::byte> pointees;
+            std::vector<std::byte> destination;
+        };
+        auto makeMemory = [&]
+        {
+            Memory memory{std::vector<std::byte>(count * width), std::vector<std::byte>(count * width)};
+            for(size_t i = 0; i < memory.pointees.size(); ++i)
+                memory.pointees[i] = (std::byte)(i * 13 + 5);
+            return memory;
+        };
+        Memory vmMemory = makeMemory();
+        Memory batchMemory = makeMemory();
+
+        std::vector<Register> offsets(count);
+        std::vector<Register> vmPointers(count);
+        std::vector<Register> batchPointers(count);
+        for(size_t i = 0; i < count; ++i)
+        {
+            offsets[i] = Register::of((uint32_t)(i * width));
+            vmPointers[i] = Register::of(vmMemory.pointees.data() + i * width);
+            batchPointers[i] = Register::of(batchMemory.pointees.data() + i * width);
+        }
+
+        MemoryRegion vmRegions[] = {{source.data(), source.size(), false},
+                                    {vmMemory.destination.data(), vmMemory.destination.size(), true}};
+        auto expected = runVM(_program, {offsets, vmPointers}, 2, vmRegions);
+        ASSERT_TRUE(expected) << expected.error();
+
+        MemoryRegion batchRegions[] = {{source.data(), source.size(), false},
+                                       {batchMemory.destination.data(), batchMemory.destination.size(), true}};
+        auto offsetColumn = column(offsets, 4);
+        auto pointerColumn = column(batchPointers, 8);
+        std::vector<std::byte> xColumn(count * width);
+        std::vector<std::byte> yColumn(count * width);
+        const void* inputs[] = {offsetColumn.data(), pointerColumn.data()};
+        void* outputs[] = {xColumn.data(), yColumn.data()};
+        auto result = _batch->call(0, inputs, outputs, count, batchRegions);
+        ASSERT_TRUE(result) << result.error();
+
+        int mismatches = 0;
+        for(size_t i = 0; i < count; ++i)
+        {
+            mismatches += entity(xColumn, width, i).bits != (*expected)[0][i].bits;
+            mismatches += entity(yColumn, width, i).bits != (*expected)[1][i].bits;
+        }
+        EXPECT_EQ(mismatches, 0);
+        EXPECT_EQ(batchMemory.pointees, vmMemory.pointees);
+        EXPECT_EQ(batchMemory.destination, vmMemory.destination);
+        EXPECT_EQ(std::memcmp(batchMemory.pointees.data(), source.data(), source.size()), 0);
+    }
+}
+
+TEST_P(BatchKernels, UnknownKernelSetsAreRejected)
+{
+    load(opModule({OpCode::Add, BSBaseType::I32, BSBaseType::I32}));
+    auto selected = _batch->useKernelSet("sse9");
+    ASSERT_FALSE(selected);
+    EXPECT_EQ(_batch->kernelSet(), GetParam());
+}
+
+INSTANTIATE_TEST_SUITE_P(KernelSets,
+                         BatchKernels,
+                         testing::ValuesIn(BatchExecutor::kernelSets()),
+                         [](const testing::TestParamInfo<KernelSet>& info) { return std::string(info.param); });
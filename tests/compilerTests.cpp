@@ -0,0 +1,321 @@
+#include "testing.h"
+
+#include <algorithm>
+#include <format>
+#include <thread>
+#include "compiler/compiler.h"
+#include "compiler/compilerCache.h"
+#include "ir/moduleFormat.h"
+
+using namespace BraneScript;
+
+namespace
+{
+    /// Enough jobs that a compile outlasts a time slice, so workers steal jobs even on a single core
+    constexpr int moduleCount = 4;
+    constexpr int pipelineCount = 64;
+
+    /// Type of ref input r of pipeline p in module m, varied so that every job interns types the others also use
+    std::string_view refType(int m, int p, int r)
+    {
+        const char* refs[] = {"&i32", "&mut i32", "&f32", "&mut f32", "&Particle", "&mut Particle"};
+        return refs[(p * 5 + r * 7 + m) % 6];
+    }
+
+    /// Pipeline p of module m, taking refs in an order that depends on both, and one to a struct only it uses, whose id
+    /// depends on the order jobs intern in
+    std::string pipelineSource(int m, int p)
+    {
+        std::string source = std::format("    pipe P{}\n    (a: i32, b: i32", p);
+        for(int r = 0; r < 3; ++r)
+            source += std::format(", r{}: {}", r, refType(m, p, r));
+        source += std::format(", own: &Own{}", p);
+        source += "){\n    [\n        let c: i32 = a + b;\n    ]\n    }(value: c)\n\n";
+        return source;
+    }
+
+    /// Pipelines spread over a few modules
+    std::string pipelinesSource()
+    {
+        std::string source;
+        for(int m = 0; m < moduleCount; ++m)
+        {
+            source += std::format("mod m{} {{\n", m);
+            for(int p = 0; p < pipelineCount; ++p)
+                source += pipelineSource(m, p);
+            source += "}\n\n";
+        }
+        return source;
+    }
+
+    template<class T>
+    Node<T> makeChild(const Node<TextContext>& parent)
+    {
+        auto node = std::make_shared<T>();
+        node->parent = parent;
+        return node;
+    }
+
+    Node<Identifier> makeIdentifier(const Node<TextContext>& parent, std::string text)
+    {
+        auto identifier = makeChild<Identifier>(parent);
+        identifier->text = std::move(text);
+        return identifier;
+    }
+
+    /// A value declared as "label: type", where type is a base or struct name behind any number of & and &mut
+    Node<ValueContext> makeValue(const Node<TextContext>& parent, std::string label, std::string_view type)
+    {
+        auto value = makeChild<ValueContext>(parent);
+        value->label = makeIdentifier(value, std::move(label));
+        auto typeCtx = makeChild<TypeContext>(value);
+        while(type.starts_with('&'))
+        {
+            bool isMutable = type.starts_with("&mut ");
+            typeCtx->modifiers.insert(typeCtx->modifiers.begin(),
+                                      isMutable ? TypeModifiers::MutRef : TypeModifiers::ConstRef);
+            type.remove_prefix(isMutable ? 5 : 1);
+        }
+        typeCtx->baseType = makeChild<ScopedIdentifier>(typeCtx);
+        typeCtx->baseType->scopes.push_back(makeIdentifier(typeCtx->baseType, std::string(type)));
+        value->type = typeCtx;
+        return value;
+    }
+
+    Node<ModuleContext> makeModule(const Node<DocumentContext>& document, std::string name)
+    {
+        auto module = makeChild<ModuleContext>(document);
+        module->identifier = makeIdentifier(module, name);
+        document->modules.emplace(std::move(name), module);
+        return module;
+    }
+
+    /// The pipeline pipelineSource(m, p) describes, built directly so that lowering can run without a parser. Parents
+    /// are linked the way the parser links them, since ids are built from them.
+    void buildPipeline(const Node<ModuleContext>& module, int m, int p)
+    {
+        auto pipeline = makeChild<PipelineContext>(module);
+        pipeline->identifier = makeIdentifier(pipeline, std::format("P{}", p));
+        pipeline->sources = makeChild<SourceListContext>(pipeline);
+        pipeline->sources->defs.push_back(makeValue(pipeline->sources, "a", "i32"));
+        pipeline->sources->defs.push_back(makeValue(pipeline->sources, "b", "i32"));
+        for(int r = 0; r < 3; ++r)
+            pipeline->sources->defs.push_back(makeValue(pipeline->sources, std::format("r{}", r), refType(m, p, r)));
+        pipeline->sources->defs.push_back(makeValue(pipeline->sources, "own", std::format("&Own{}", p)));
+
+        auto stage = makeChild<PipelineStageContext>(pipeline);
+        stage->localVariables.push_back(makeValue(stage, "c", "i32"));
+        pipeline->stages.push_back(stage);
+
+        pipeline->sinks = makeChild<SinkListContext>(pipeline);
+        auto sink = makeChild<SinkDefContext>(pipeline->sinks);
+        sink->id = makeIdentifier(sink, "c");
+        pipeline->sinks->values.push_back(sink);
+        module->pipelines.push_back(pipeline);
+    }
+
+    std::shared_ptr<ParsedDocument> builtDocument(std::string path, Node<DocumentContext> document)
+    {
+        document->source = path;
+        return std::make_shared<ParsedDocument>(std::move(path), ParserResult<DocumentContext>{document, {}});
+    }
+
+    /// The document pipelinesSource() describes
+    std::shared_ptr<ParsedDocument> buildPipelineDocument()
+    {
+        auto document = std::make_shared<DocumentContext>();
+        for(int m = 0; m < moduleCount; ++m)
+        {
+            auto module = makeModule(document, std::format("m{}", m));
+            for(int p = 0; p < pipelineCount; ++p)
+                buildPipeline(module, m, p);
+        }
+        return builtDocument("pipelines.bscript", document);
+    }
+
+    std::shared_ptr<ParsedDocument> buildEmptyDocument(std::string path, std::string module)
+    {
+        auto document = std::make_shared<DocumentContext>();
+        makeModule(document, std::move(module));
+        return builtDocument(std::move(path), document);
+    }
+
+    /// Documents are either parsed from source, or built directly, which tests lowering without tree-sitter
+    enum class DocumentSource
+    {
+        Parsed,
+        Built
+    };
+
+    std::vector<std::shared_ptr<ParsedDocument>> makeDocuments(DocumentSource source)
+    {
+        if(source == DocumentSource::Built)
+            return {buildPipelineDocument(), buildEmptyDocument("empty.bscript", "empty")};
+        return {std::make_shared<ParsedDocument>("pipelines.bscript", pipelinesSource()),
+                std::make_shared<ParsedDocument>("empty.bscript", "mod empty {}\n")};
+    }
+
+    /// A standard library module defining std::P0
+    std::shared_ptr<ParsedDocument> makeStandardDocument(DocumentSource source)
+    {
+        if(source == DocumentSource::Parsed)
+            return std::make_shared<ParsedDocument>("std.bscript", "mod std {\n" + pipelineSource(0, 0) + "}\n");
+        auto document = std::make_shared<DocumentContext>();
+        buildPipeline(makeModule(document, "std"), 0, 0);
+        return builtDocument("std.bscript", document);
+    }
+
+    std::vector<std::vector<std::byte>> serialized(const CompileResult& result)
+    {
+        std::vector<std::vector<std::byte>> modules;
+        for(auto& module : result.modules)
+            modules.push_back(serializeModule(module));
+        return modules;
+    }
+
+    /// Every TypeId each module uses, in order, after the size of its table. Serialization writes types by structure in
+    /// order of first use, so it would hide a table interned in a different order.
+    std::vector<std::vector<uint32_t>> typeIds(const CompileResult& result)
+    {
+        std::vector<std::vector<uint32_t>> modules;
+        for(auto& module : result.modules)
+        {
+            auto& ids = modules.emplace_back();
+            ids.push_back((uint32_t)module.types.size());
+            auto append = [&](const std::vector<TypeId>& types)
+            {
+                for(auto type : types)
+                    ids.push_back((uint32_t)type);
+            };
+            for(auto& pipeline : module.pipelines)
+            {
+                append(pipeline->inputs);
+                append(pipeline->outputs);
+                if(pipeline->stages)
+                    for(auto& stage : *pipeline->stages)
+                        append(stage.localVars);
+            }
+            for(auto& function : module.functions)
+                append(function->localVars);
+        }
+        return modules;
+    }
+
+    bool hasErrors(const CompileResult& result)
+    {
+        return std::ranges::any_of(result.messages,
+                                   [](auto& message) { return message.type <= CompilerMessageType::Error; });
+    }
+
+    class CompilerOutput : public testing::TestWithParam<DocumentSource>
+    {
+      protected:
+        std::vector<std::shared_ptr<ParsedDocument>> documents() const { return makeDocuments(GetParam()); }
+        std::shared_ptr<ParsedDocument> standardDocument() const { return makeStandardDocument(GetParam()); }
+    };
+} // namespace
+
+TEST_P(CompilerOutput, SchedulerDoesNotChangeOutput)
+{
+    auto documents = this->documents();
+    auto expected = Compiler().compile(documents);
+    ASSERT_FALSE(hasErrors(expected));
+    ASSERT_EQ(expected.modules.size(), moduleCount + 1);
+    auto expectedBytes = serialized(expected);
+    auto expectedTypes = typeIds(expected);
+
+    Compiler parallel(std::nullopt, std::make_shared<TaskScheduler>(4));
+    for(int run = 0; run < 20; ++run)
+    {
+        auto result = parallel.compile(documents);
+        ASSERT_EQ(result.messages.size(), expected.messages.size());
+        ASSERT_EQ(serialized(result), expectedBytes) << "run " << run;
+        ASSERT_EQ(typeIds(result), expectedTypes) << "run " << run;
+    }
+}
+
+TEST_P(CompilerOutput, ConcurrentCompilesShareACache)
+{
+    auto cache = std::make_shared<CompilerCache>();
+    cache->addStandardDocument(standardDocument());
+    auto standardDocuments = cache->standardDocuments();
+    auto expected = Compiler(std::nullopt, nullptr, cache).compile(documents());
+    ASSERT_FALSE(hasErrors(expected));
+    ASSERT_EQ(expected.modules.size(), moduleCount + 1) << "standard documents are indexed but not emitted";
+    auto expectedBytes = serialized(expected);
+    auto expectedTypes = typeIds(expected);
+    auto internedStrings = cache->strings().size();
+
+    // Each thread makes its own copy of the documents, so parsing runs concurrently as well
+    std::vector<CompileResult> results(8);
+    std::vector<std::thread> threads;
+    for(auto& result : results)
+        threads.emplace_back(
+            [&]
+            {
+                for(int run = 0; run < 5; ++run)
+                    result = Compiler(std::nullopt, nullptr, cache).compile(documents());
+            });
+    for(auto& thread : threads)
+        thread.join();
+
+    for(auto& result : results)
+    {
+        EXPECT_EQ(serialized(result), expectedBytes);
+        EXPECT_EQ(typeIds(result), expectedTypes);
+    }
+    EXPECT_EQ(cache->strings().size(), internedStrings) << "identifiers are interned once per cache";
+    EXPECT_EQ(cache->standardDocuments(), standardDocuments) << "standard documents are parsed once per cache";
+}
+
+TEST_P(CompilerOutput, StandardSymbolsAreVisible)
+{
+    auto cache = std::make_shared<CompilerCache>();
+    cache->addStandardDocument(standardDocument());
+    auto documents = this->documents();
+    // A document of the program's own defining the same pipeline as the standard document
+    documents.push_back(makeStandardDocument(GetParam()));
+    auto result = Compiler(std::nullopt, nullptr, cache).compile(documents);
+    EXPECT_TRUE(std::ranges::any_of(result.messages,
+                                    [](auto& message)
+                                    {
+                                        return message.type == CompilerMessageType::Error &&
+                                               message.message.find("Redefinition of") != std::string::npos;
+                                    }));
+}
+
+INSTANTIATE_TEST_SUITE_P(Documents,
+                         CompilerOutput,
+                         testing::Values(DocumentSource::Parsed, DocumentSource::Built),
+                         [](const testing::TestParamInfo<DocumentSource>& info)
+                         { return info.param == DocumentSource::Parsed ? "Parsed" : "Built"; });
+
+TEST(CompilerCache, InternedStringsAreShared)
+{
+    CompilerCache cache;
+    std::string id = "m0::P0";
+    auto interned = cache.strings().intern(id);
+    id = "something else";
+    EXPECT_EQ(interned, "m0::P0");
+    EXPECT_EQ(cache.strings().intern("m0::P0").data(), interned.data());
+
+    for(int i = 0; i < 1000; ++i)
+        cache.strings().intern(std::format("m{}::P{}", i, i));
+    EXPECT_EQ(cache.strings().size(), 1000);
+    EXPECT_EQ(cache.strings().intern("m0::P0").data(), interned.data()) << "views stay valid as the pool grows";
+}
+
+TEST(CompilerCache, StandardDocumentsAreKeyedByPath)
+{
+    CompilerCache cache;
+    cache.addStandardDocument(buildEmptyDocument("b.bscript", "b"));
+    cache.addStandardDocument(buildEmptyDocument("a.bscript", "a"));
+    cache.addStandardDocument(buildEmptyDocument("a.bscript", "a2"));
+
+    auto documents = cache.standardDocuments();
+    ASSERT_EQ(documents.size(), 2);
+    EXPECT_EQ(documents[0]->path, "a.bscript");
+    EXPECT_EQ(documents[1]->path, "b.bscript");
+    ASSERT_TRUE(documents[0]->parsed.document);
+    EXPECT_TRUE(documents[0]->parsed.document->modules.contains("a2")) << "re-adding a path replaces the document";
+}
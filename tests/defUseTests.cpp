@@ -0,0 +1,74 @@
+#include "testing.h"
+
+#include <chrono>
+#include "ir/defUse.h"
+#include "optimizer/passes.h"
+
+using namespace BraneScript;
+
+TEST(DefUseChains, TracksUsesAndDefinitions)
+{
+    InstructionList code;
+    code.binary(OpCode::Add, IRValue{0}, IRValue{0}, IRValue{1});
+    code.mov(IRValue{1}, IRValue{2});
+    IRValue inputs[] = {IRValue{2}};
+    IRValue outputs[] = {IRValue{3}};
+    code.call(std::string("f"), inputs, outputs);
+    std::vector<IRValue> external = {IRValue{3}};
+    DefUseChains chains(code, 4, external);
+
+    EXPECT_EQ(chains.uses(0).size(), 2);
+    EXPECT_EQ(chains.definingInstruction(1), 0);
+    EXPECT_EQ(chains.definingInstruction(3), 2);
+    ASSERT_EQ(chains.uses(3).size(), 1);
+    EXPECT_TRUE(chains.uses(3)[0].isExternal());
+
+    chains.replaceAllUses(2, 1);
+    EXPECT_TRUE(chains.unused(2));
+    EXPECT_EQ(code.callInputs(code.instructions[2])[0], 1);
+    chains.removeInstruction(1);
+    EXPECT_TRUE(chains.definitions(2).empty());
+    EXPECT_TRUE(chains.compact());
+    EXPECT_EQ(code.size(), 2);
+    EXPECT_EQ(chains.definingInstruction(3), 1);
+
+    uint32_t renamed = chains.addValue();
+    chains.renameValue(3, renamed);
+    EXPECT_EQ(external[0].id, renamed);
+    EXPECT_EQ(chains.definingInstruction(renamed), 1);
+}
+
+#ifdef NDEBUG
+namespace
+{
+    /// Copy propagation and dead code elimination over a chain of copies, each followed by an add nothing reads
+    double reduceCopyChain(uint32_t length)
+    {
+        std::vector<TypeId> locals(2 * length + 2, TypeTable::base(BSBaseType::I32));
+        InstructionList code;
+        code.binary(OpCode::Add, IRValue{0}, IRValue{0}, IRValue{1});
+        for(uint32_t i = 1; i < length; ++i)
+        {
+            code.mov(IRValue{i}, IRValue{i + 1});
+            code.binary(OpCode::Add, IRValue{i + 1}, IRValue{i + 1}, IRValue{length + i});
+        }
+        CodeBody body{locals, code, 1, {IRValue{length}}, false};
+        auto start = std::chrono::steady_clock::now();
+        CopyPropagation().run(body);
+        DeadCodeElimination().run(body);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        EXPECT_EQ(code.size(), 1);
+        EXPECT_EQ(body.outputs[0].id, 1);
+        return std::chrono::duration<double>(elapsed).count();
+    }
+} // namespace
+
+TEST(DefUseChains, PassesScaleLinearly)
+{
+    reduceCopyChain(1000);
+    double small = reduceCopyChain(100000);
+    double large = reduceCopyChain(400000);
+    // Four times the code would take sixteen times as long if the passes were quadratic
+    EXPECT_LT(large, small * 8);
+}
+#endif
@@ -1,6 +1,6 @@
 
 #include "testing.h"
-#include <stdio>
+#include <iostream>
 
 using namespace BraneScript;
 
@@ -0,0 +1,311 @@
+#include "testing.h"
+
+#include "runtime/batch.h"
+#include "runtime/hostFunctions.h"
+#include "runtime/hostViews.h"
+
+using namespace BraneScript;
+using namespace BraneScript::Testing;
+
+namespace
+{
+    constexpr TypeId F32 = TypeTable::base(BSBaseType::F32);
+    constexpr TypeId U64 = TypeTable::base(BSBaseType::U64);
+
+    struct Particle
+    {
+        float x, y, vx, vy;
+    };
+
+    /// Per element settings the time step is read from, so that input is a strided view
+    struct Settings
+    {
+        float dt;
+        uint32_t seed;
+    };
+
+    /// step(ref mut Particle p, f32 dt) -> f32: p.x += p.vx * dt, returns the new x. The offsets p.x and p.vx are read
+    /// at can be moved to test accesses past the particle.
+    BSModule particleModule(uint32_t xOffset = 0, uint32_t vxOffset = 8)
+    {
+        BSModule module;
+        module.name = "test";
+        auto particle = std::make_shared<BSStruct>();
+        particle->id = "Particle";
+        particle->members = {F32, F32, F32, F32};
+        module.structs = {particle};
+
+        auto ref = module.types.ref(module.types.structType(std::string("Particle")), true);
+        auto pipeline = makePipeline("step", {ref, F32}, {F32});
+        auto& stage = pipeline->stages->front();
+        IRValue xAt = addLocal(stage.localVars, U64);
+        IRValue vxAt = addLocal(stage.localVars, U64);
+        IRValue x = addLocal(stage.localVars, F32);
+        IRValue vx = addLocal(stage.localVars, F32);
+        IRValue moved = addLocal(stage.localVars, F32);
+        IRValue result = addLocal(stage.localVars, F32);
+        stage.operations.constU32(xOffset, xAt);
+        stage.operations.constU32(vxOffset, vxAt);
+        stage.operations.load(IRValue{0}, xAt, x);
+        stage.operations.load(IRValue{0}, vxAt, vx);
+        stage.operations.binary(OpCode::Mul, vx, IRValue{1}, moved);
+        stage.operations.binary(OpCode::Add, x, moved, result);
+        stage.operations.store(IRValue{0}, result, xAt);
+        stage.outputs = {result};
+        module.pipelines = {pipeline};
+        return module;
+    }
+
+    struct BoundParticles
+    {
+        std::vector<BSModule> modules;
+        std::shared_ptr<const Program> program;
+        std::vector<Particle> particles;
+        std::vector<Settings> settings;
+        std::vector<float> out;
+        std::optional<PipelineViews> views;
+
+        BoundParticles(BSModule module, size_t count) : particles(count), settings(count), out(count)
+        {
+            modules.push_back(std::move(module));
+            program = loadProgram(modules);
+            if(!program)
+                return;
+            for(size_t i = 0; i < count; ++i)
+            {
+                particles[i] = {(float)i, 0, (float)(i % 7), 0};
+                settings[i] = {0.5f, (uint32_t)i};
+            }
+            auto layouts = StructLayouts::compute(modules);
+            EXPECT_TRUE(layouts) << layouts.error();
+            HostView inputs[] = {hostView(std::span(particles)),
+                                 hostView(std::span<const Settings>(settings), &Settings::dt)};
+            HostView outputs[] = {hostView(std::span(out))};
+            auto bound = PipelineViews::bind(
+                *program, modules[0], *modules[0].pipelines[0], *layouts, 0, inputs, outputs);
+            EXPECT_TRUE(bound) << bound.error();
+            if(bound)
+                views = std::move(*bound);
+        }
+    };
+} // namespace
+
+TEST(PipelineViews, VMAndBatchUpdateInPlace)
+{
+    constexpr size_t count = 10000;
+    BoundParticles vmRun(particleModule(), count);
+    BoundParticles batchRun(particleModule(), count);
+    ASSERT_TRUE(vmRun.views && batchRun.views);
+
+    VM vm(vmRun.program);
+    auto vmResult = vmRun.views->run(vm);
+    ASSERT_TRUE(vmResult) << vmResult.error();
+    BatchExecutor batch(batchRun.program);
+    auto batchResult = batchRun.views->run(batch);
+    ASSERT_TRUE(batchResult) << batchResult.error();
+
+    int mismatches = 0;
+    for(size_t i = 0; i < count; ++i)
+    {
+        float expected = (float)i + (float)(i % 7) * 0.5f;
+        mismatches += vmRun.particles[i].x != expected || vmRun.out[i] != expected;
+        mismatches += batchRun.particles[i].x != expected || batchRun.out[i] != expected;
+    }
+    EXPECT_EQ(mismatches, 0);
+}
+
+TEST(PipelineViews, RefAccessesAreBoundsChecked)
+{
+    // vy is the last float of the particle, so reading it is fine but anything past it is not
+    BoundParticles inBounds(particleModule(0, 12), 4);
+    ASSERT_TRUE(inBounds.views);
+    VM vm(inBounds.program);
+    EXPECT_TRUE(inBounds.views->run(vm));
+
+    for(uint32_t offset : {14u, 16u, 1u << 20})
+    {
+        SCOPED_TRACE(offset);
+        BoundParticles outOfBounds(particleModule(0, offset), 4);
+        ASSERT_TRUE(outOfBounds.views);
+        VM outOfBoundsVM(outOfBounds.program);
+        auto vmResult = outOfBounds.views->run(outOfBoundsVM);
+        ASSERT_FALSE(vmResult);
+        EXPECT_NE(vmResult.error().find("Load out of bounds"), std::string::npos) << vmResult.error();
+
+        BatchExecutor batch(outOfBounds.program);
+        auto batchResult = outOfBounds.views->run(batch);
+        ASSERT_FALSE(batchResult);
+        EXPECT_NE(batchResult.error().find("Load out of bounds"), std::string::npos) << batchResult.error();
+    }
+
+    BoundParticles storePast(particleModule(16, 8), 4);
+    ASSERT_TRUE(storePast.views);
+    VM storeVM(storePast.program);
+    auto stored = storePast.views->run(storeVM);
+    ASSERT_FALSE(stored);
+    EXPECT_NE(stored.error().find("out of bounds"), std::string::npos) << stored.error();
+}
+
+TEST(PipelineViews, PointersMustBeReferences)
+{
+    BSModule module;
+    module.name = "test";
+    auto pipeline = makePipeline("peek", {U64}, {U64});
+    auto& stage = pipeline->stages->front();
+    IRValue offset = addLocal(stage.localVars, U64);
+    IRValue value = addLocal(stage.localVars, U64);
+    stage.operations.constU32(0, offset);
+    stage.operations.load(IRValue{0}, offset, value);
+    stage.outputs = {value};
+    module.pipelines = {pipeline};
+    auto program = Program::load(std::span(&module, 1));
+    ASSERT_FALSE(program);
+    EXPECT_NE(program.error().find("not a reference"), std::string::npos) << program.error();
+}
+
+namespace
+{
+    uint64_t hostAddress() { return 4096; }
+} // namespace
+
+TEST(PipelineViews, ReferencesCannotBeForged)
+{
+    struct Forged
+    {
+        BSModule module;
+        TypeId particle, pair, readOnly;
+    };
+    // Every case defines last(ref Particle p) -> f32, which reads p.vy, and a function built around refs
+    auto withStructs = []()
+    {
+        Forged forged;
+        forged.module.name = "test";
+        auto particle = std::make_shared<BSStruct>();
+        particle->id = "Particle";
+        particle->members = {F32, F32, F32, F32};
+        auto pair = std::make_shared<BSStruct>();
+        pair->id = "Pair";
+        pair->members = {F32, F32};
+        forged.module.structs = {particle, pair};
+        auto& types = forged.module.types;
+        forged.particle = types.ref(types.structType(std::string("Particle")), true);
+        forged.pair = types.ref(types.structType(std::string("Pair")), true);
+        forged.readOnly = types.ref(types.structType(std::string("Particle")), false);
+
+        auto last = makeFunction("last", {forged.particle}, {F32});
+        IRValue offset = addLocal(last->localVars, U64);
+        last->operations.constU32(12, offset);
+        last->operations.load(IRValue{0}, offset, IRValue{1});
+        forged.module.functions = {last};
+        return forged;
+    };
+    auto expectRejected = [](const Forged& forged, std::string_view message, const HostFunctionTable* host = nullptr)
+    {
+        auto program = Program::load(std::span(&forged.module, 1), host);
+        ASSERT_FALSE(program) << forged.module.functions.back()->id;
+        EXPECT_NE(program.error().find(message), std::string::npos) << program.error();
+    };
+    auto callLast = [](BSFunction& caller, IRValue argument)
+    {
+        IRValue result = addLocal(caller.localVars, F32);
+        IRValue inputs[] = {argument};
+        IRValue outputs[] = {result};
+        caller.operations.call(std::string("last"), inputs, outputs);
+    };
+
+    {
+        auto forged = withStructs();
+        auto advanced = makeFunction("advanced", {forged.particle, U64}, {forged.particle});
+        advanced->operations.binary(OpCode::Add, IRValue{0}, IRValue{1}, IRValue{2});
+        forged.module.functions.push_back(advanced);
+        expectRejected(forged, "operation on a reference");
+    }
+    {
+        auto forged = withStructs();
+        auto address = makeFunction("address", {forged.particle, forged.particle}, {U64});
+        address->operations.binary(OpCode::Sub, IRValue{0}, IRValue{1}, IRValue{2});
+        forged.module.functions.push_back(address);
+        expectRejected(forged, "operation on a reference");
+    }
+    {
+        auto forged = withStructs();
+        auto constant = makeFunction("constant", {}, {forged.particle});
+        constant->operations.constU32(4096, IRValue{0});
+        forged.module.functions.push_back(constant);
+        expectRejected(forged, "constant does not match");
+    }
+    {
+        auto forged = withStructs();
+        auto cast = makeFunction("cast", {U64}, {forged.particle});
+        cast->operations.mov(IRValue{0}, IRValue{1});
+        forged.module.functions.push_back(cast);
+        expectRejected(forged, "move between values of different types");
+    }
+    {
+        auto forged = withStructs();
+        auto unlocked = makeFunction("unlocked", {forged.readOnly}, {forged.particle});
+        unlocked->operations.mov(IRValue{0}, IRValue{1});
+        forged.module.functions.push_back(unlocked);
+        expectRejected(forged, "move between values of different types");
+    }
+    {
+        auto forged = withStructs();
+        auto numbered = makeFunction("numbered", {U64}, {});
+        callLast(*numbered, IRValue{0});
+        forged.module.functions.push_back(numbered);
+        expectRejected(forged, "operand 0 of the call to last does not match its type");
+    }
+    {
+        // last would read past the end of the pair, since it is bounds checked against a particle
+        auto forged = withStructs();
+        auto smaller = makeFunction("smaller", {forged.pair}, {});
+        callLast(*smaller, IRValue{0});
+        forged.module.functions.push_back(smaller);
+        expectRejected(forged, "operand 0 of the call to last does not match its type");
+    }
+    {
+        // An address planted in a memory region would otherwise become a reference that reads anywhere
+        auto forged = withStructs();
+        auto loaded = makeFunction("loaded", {}, {forged.particle});
+        IRValue offset = addLocal(loaded->localVars, U64);
+        loaded->operations.constU32(0, offset);
+        loaded->operations.load(ConstU32{0}, offset, IRValue{0});
+        forged.module.functions.push_back(loaded);
+        expectRejected(forged, "load into a reference");
+    }
+    {
+        auto forged = withStructs();
+        auto leaked = makeFunction("leaked", {forged.particle}, {});
+        IRValue offset = addLocal(leaked->localVars, U64);
+        leaked->operations.constU32(0, offset);
+        leaked->operations.store(ConstU32{0}, IRValue{0}, offset);
+        forged.module.functions.push_back(leaked);
+        expectRejected(forged, "store of a reference");
+    }
+    {
+        // Host pointers and integers are both passed as U64, so a returned integer could be taken as a reference
+        HostFunctionTable host;
+        ASSERT_TRUE(host.add("host::address", &hostAddress));
+        auto forged = withStructs();
+        auto returned = makeFunction("returned", {}, {forged.particle});
+        IRValue outputs[] = {IRValue{0}};
+        returned->operations.call(std::string("host::address"), {}, outputs);
+        forged.module.functions.push_back(returned);
+        expectRejected(forged, "does not match the signature of host function host::address", &host);
+    }
+    {
+        auto forged = withStructs();
+        auto pipeline = makePipeline("awaited", {}, {});
+        pipeline->stages->front().asyncOps.push_back(BSAsyncCall{"host::address", {}, {forged.particle}});
+        forged.module.pipelines.push_back(pipeline);
+        expectRejected(forged, "async call to host::address returns a reference");
+    }
+    {
+        auto forged = withStructs();
+        auto matching = makeFunction("matching", {forged.particle}, {});
+        callLast(*matching, IRValue{0});
+        forged.module.functions.push_back(matching);
+        auto program = Program::load(std::span(&forged.module, 1));
+        EXPECT_TRUE(program) << program.error();
+    }
+}
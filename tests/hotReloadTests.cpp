@@ -0,0 +1,375 @@
+#include "testing.h"
+
+#include <cstring>
+#include <thread>
+#include "runtime/async.h"
+#include "runtime/hostFunctions.h"
+#include "runtime/hotReload.h"
+#include "runtime/parallel.h"
+#include "runtime/streaming.h"
+
+using namespace BraneScript;
+using namespace BraneScript::Testing;
+
+namespace
+{
+    constexpr TypeId I32 = TypeTable::base(BSBaseType::I32);
+    constexpr TypeId U32 = TypeTable::base(BSBaseType::U32);
+    constexpr TypeId F32 = TypeTable::base(BSBaseType::F32);
+    constexpr TypeId F64 = TypeTable::base(BSBaseType::F64);
+
+    /// Module with a pipeline multiplying its input by factor
+    BSModule scaleModule(std::string name, uint32_t factor)
+    {
+        BSModule module;
+        module.name = name;
+        auto pipeline = makePipeline(name + "::scale", {U32}, {U32});
+        auto& stage = pipeline->stages->front();
+        IRValue k = addLocal(stage.localVars, U32);
+        IRValue scaled = addLocal(stage.localVars, U32);
+        stage.operations.constU32(factor, k);
+        stage.operations.binary(OpCode::Mul, IRValue{0}, k, scaled);
+        stage.outputs = {scaled};
+        module.pipelines = {pipeline};
+        return module;
+    }
+
+    /// x * factor + factor over two stages
+    std::shared_ptr<const Program> twoStageProgram(int32_t factor)
+    {
+        BSModule module;
+        module.name = "m";
+        auto pipeline = makePipeline("m::p", {I32}, {I32});
+        auto& multiply = pipeline->stages->front();
+        IRValue k = addLocal(multiply.localVars, I32);
+        IRValue product = addLocal(multiply.localVars, I32);
+        multiply.operations.constI32(factor, k);
+        multiply.operations.binary(OpCode::Mul, IRValue{0}, k, product);
+        multiply.outputs = {product};
+
+        auto& add = pipeline->stages->emplace_back();
+        add.localVars = {I32, I32, I32};
+        add.operations.constI32(factor, IRValue{1});
+        add.operations.binary(OpCode::Add, IRValue{0}, IRValue{1}, IRValue{2});
+        add.outputs = {IRValue{2}};
+        module.pipelines = {pipeline};
+        return loadProgram(std::span(&module, 1));
+    }
+
+    /// Packed struct, so that members are laid out in declaration order
+    void addStruct(BSModule& module, std::string id, std::vector<std::pair<std::string, TypeId>> members)
+    {
+        auto structDef = std::make_shared<BSStruct>();
+        structDef->id = std::move(id);
+        structDef->packed = true;
+        for(auto& [name, type] : members)
+        {
+            structDef->memberNames.push_back(name);
+            structDef->members.push_back(type);
+        }
+        module.structs.push_back(structDef);
+    }
+
+    uint32_t runScale(const ReloadableProgram& program, VM& vm, std::string_view pipeline, uint32_t value)
+    {
+        Register in = Register::of(value);
+        Register out;
+        auto ran = program.runPipeline(vm, pipeline, std::span(&in, 1), std::span(&out, 1));
+        EXPECT_TRUE(ran) << ran.error();
+        return out.as<uint32_t>();
+    }
+
+    int32_t offset(int32_t value) { return value + 100; }
+
+    /// lib defines twice, app calls it by name and a host function
+    std::vector<BSModule> callingModules(OpCode twiceOp)
+    {
+        std::vector<BSModule> modules(2);
+        modules[0].name = "lib";
+        auto twice = makeFunction("lib::twice", {I32}, {I32});
+        twice->operations.binary(twiceOp, IRValue{0}, IRValue{0}, IRValue{1});
+        modules[0].functions = {twice};
+
+        modules[1].name = "app";
+        auto quad = makeFunction("app::quad", {I32}, {I32});
+        IRValue doubled = addLocal(quad->localVars, I32);
+        IRValue in[] = {IRValue{0}};
+        IRValue out[] = {doubled};
+        quad->operations.call(std::string("lib::twice"), in, out);
+        IRValue in2[] = {doubled};
+        IRValue out2[] = {IRValue{1}};
+        quad->operations.call(std::string("lib::twice"), in2, out2);
+        auto shifted = makeFunction("app::shifted", {I32}, {I32});
+        IRValue out3[] = {IRValue{1}};
+        shifted->operations.call(std::string("host::offset"), in, out3);
+        modules[1].functions = {quad, shifted};
+        return modules;
+    }
+
+    const StructMigration* findMigration(const ReloadResult& result, std::string_view id)
+    {
+        for(auto& migration : result.migrations)
+        {
+            if(migration.id() == id)
+                return &migration;
+        }
+        return nullptr;
+    }
+} // namespace
+
+TEST(HotReload, NewInvocationsRunTheReloadedModule)
+{
+    std::vector<BSModule> modules;
+    modules.push_back(scaleModule("a", 2));
+    auto created = ReloadableProgram::create(std::move(modules));
+    ASSERT_TRUE(created) << created.error();
+    auto& program = **created;
+    VM vm(program.current());
+    EXPECT_EQ(runScale(program, vm, "a::scale", 5), 10);
+
+    auto reloaded = program.reload(scaleModule("a", 3));
+    ASSERT_TRUE(reloaded) << reloaded.error();
+    EXPECT_EQ(reloaded->generation, 1);
+    EXPECT_EQ(runScale(program, vm, "a::scale", 5), 15);
+
+    // A module that doesn't load leaves the running program in place
+    auto broken = scaleModule("a", 4);
+    broken.pipelines[0]->stages->front().operations.binary(OpCode::Mul, IRValue{0}, IRValue{7}, IRValue{2});
+    EXPECT_FALSE(program.reload(std::move(broken)));
+    EXPECT_EQ(program.generation(), 1);
+    EXPECT_EQ(runScale(program, vm, "a::scale", 5), 15);
+}
+
+TEST(HotReload, MigratesMembersByName)
+{
+    std::vector<BSModule> modules;
+    modules.push_back(scaleModule("a", 1));
+    addStruct(modules[0], "P", {{"x", F32}, {"y", F32}});
+    auto created = ReloadableProgram::create(std::move(modules));
+    ASSERT_TRUE(created) << created.error();
+
+    auto next = scaleModule("a", 1);
+    addStruct(next, "P", {{"y", F32}, {"z", F64}, {"x", F32}});
+    auto reloaded = (*created)->reload(std::move(next));
+    ASSERT_TRUE(reloaded) << reloaded.error();
+    auto* migration = findMigration(*reloaded, "P");
+    ASSERT_TRUE(migration);
+    EXPECT_EQ(migration->fromSize(), 8);
+    EXPECT_EQ(migration->toSize(), 16);
+
+    struct Before
+    {
+        float x, y;
+    };
+#pragma pack(push, 1)
+    struct After
+    {
+        float y;
+        double z;
+        float x;
+    };
+#pragma pack(pop)
+    Before before[2] = {{1, 2}, {3, 4}};
+    After after[2];
+    std::memset(after, 0xff, sizeof(after));
+    migration->apply(std::as_bytes(std::span(before)), std::as_writable_bytes(std::span(after)));
+    EXPECT_EQ(after[0].x, 1);
+    EXPECT_EQ(after[0].y, 2);
+    EXPECT_EQ(after[0].z, 0);
+    EXPECT_EQ(after[1].x, 3);
+    EXPECT_EQ(after[1].y, 4);
+}
+
+TEST(HotReload, NestedStructChangesAreMigrated)
+{
+    // Swapping two members of the same size keeps every layout the same, only the member types tell the change
+    std::vector<BSModule> modules;
+    modules.push_back(scaleModule("a", 1));
+    addStruct(modules[0], "Inner", {{"a", I32}, {"b", F32}});
+    auto& types = modules[0].types;
+    addStruct(modules[0], "Outer", {{"inner", types.structType(std::string("Inner"))}, {"w", F32}});
+    addStruct(modules[0], "Holder", {{"outer", types.ref(types.structType(std::string("Outer")), true)}});
+    auto created = ReloadableProgram::create(std::move(modules));
+    ASSERT_TRUE(created) << created.error();
+
+    auto next = scaleModule("a", 1);
+    addStruct(next, "Inner", {{"b", F32}, {"a", I32}});
+    addStruct(next, "Outer", {{"inner", next.types.structType(std::string("Inner"))}, {"w", F32}});
+    addStruct(next, "Holder", {{"outer", next.types.ref(next.types.structType(std::string("Outer")), true)}});
+    auto reloaded = (*created)->reload(std::move(next));
+    ASSERT_TRUE(reloaded) << reloaded.error();
+    EXPECT_TRUE(findMigration(*reloaded, "Inner"));
+    // A ref only holds an address, so the struct holding it doesn't change with the struct it points to
+    EXPECT_FALSE(findMigration(*reloaded, "Holder"));
+    auto* outer = findMigration(*reloaded, "Outer");
+    ASSERT_TRUE(outer);
+
+    struct OuterBefore
+    {
+        int32_t a;
+        float b;
+        float w;
+    };
+    struct OuterAfter
+    {
+        float b;
+        int32_t a;
+        float w;
+    };
+    OuterBefore before{7, 1.5f, 2.5f};
+    OuterAfter after{};
+    outer->apply(std::as_bytes(std::span(&before, 1)), std::as_writable_bytes(std::span(&after, 1)));
+    EXPECT_EQ(after.a, 7);
+    EXPECT_EQ(after.b, 1.5f);
+    EXPECT_EQ(after.w, 2.5f);
+}
+
+TEST(HotReload, OnlyTheChangedModuleIsLowered)
+{
+    HostFunctionTable host;
+    ASSERT_TRUE(host.add("host::offset", &offset));
+    auto modules = callingModules(OpCode::Add);
+    auto previous = Program::load(modules, &host);
+    ASSERT_TRUE(previous) << previous.error();
+
+    // lib::twice moves to a different index, app's calls to it have to follow
+    modules[0].functions.insert(modules[0].functions.begin(), makeFunction("lib::first", {}, {}));
+    modules[0].functions[1]->operations = {};
+    modules[0].functions[1]->operations.binary(OpCode::Mul, IRValue{0}, IRValue{0}, IRValue{1});
+    // Emptying app's body shows that its bytecode is reused rather than lowered again
+    modules[1].functions[0]->operations = {};
+    auto reloaded = Program::reload(*previous, modules, 0, &host);
+    ASSERT_TRUE(reloaded) << reloaded.error();
+    auto program = std::make_shared<const Program>(std::move(*reloaded));
+    VM vm(program);
+    EXPECT_EQ(callI32(vm, "app::quad", {5}), 625);
+    EXPECT_EQ(callI32(vm, "app::shifted", {5}), 105);
+    for(uint32_t i = 0; i < program->functions().size(); ++i)
+        EXPECT_EQ(program->functions()[i].profileSlot, i);
+    EXPECT_EQ(program->profileSlotCount(), 4);
+
+    // A module whose calls no longer resolve is lowered again, and fails to load the way it would on its own
+    modules = callingModules(OpCode::Add);
+    modules[0].functions[0]->id = "lib::thrice";
+    auto unresolved = Program::reload(*previous, modules, 0, &host);
+    ASSERT_FALSE(unresolved);
+    EXPECT_NE(unresolved.error().find("call to undefined function lib::twice"), std::string::npos)
+        << unresolved.error();
+}
+
+TEST(HotReload, ProfilingVMsAreNotMovedSilently)
+{
+    std::vector<BSModule> modules;
+    modules.push_back(scaleModule("a", 2));
+    auto created = ReloadableProgram::create(std::move(modules));
+    ASSERT_TRUE(created) << created.error();
+    auto& program = **created;
+    VM vm(program.current());
+    Profile profile(program.current());
+    vm.setProfile(&profile);
+    EXPECT_EQ(runScale(program, vm, "a::scale", 5), 10);
+
+    ASSERT_TRUE(program.reload(scaleModule("a", 3)));
+    Register in = Register::of(5);
+    Register out;
+    auto ran = program.runPipeline(vm, "a::scale", std::span(&in, 1), std::span(&out, 1));
+    ASSERT_FALSE(ran);
+    EXPECT_NE(ran.error().find("profiling or tiering"), std::string::npos) << ran.error();
+
+    auto detached = program.update(vm);
+    EXPECT_EQ(detached.profile, &profile);
+    EXPECT_FALSE(vm.profile());
+    EXPECT_FALSE(program.update(vm));
+    EXPECT_EQ(runScale(program, vm, "a::scale", 5), 15);
+}
+
+TEST(HotReload, ExecutorsSwitchPrograms)
+{
+    auto before = twoStageProgram(2);
+    auto after = twoStageProgram(3);
+    uint32_t pipeline = *before->pipeline("m::p");
+    int32_t inputs[] = {1, 2, 3, 4, 5, 6, 7, 8};
+    int32_t outputs[8];
+    const void* in[] = {inputs};
+    void* out[] = {outputs};
+    auto expect = [&](int32_t factor)
+    {
+        for(size_t i = 0; i < std::size(inputs); ++i)
+            EXPECT_EQ(outputs[i], inputs[i] * factor + factor) << i;
+    };
+
+    BatchExecutor batch(before);
+    ASSERT_TRUE(batch.runPipeline(pipeline, in, out, std::size(inputs)));
+    expect(2);
+    batch.setProgram(after);
+    ASSERT_TRUE(batch.runPipeline(pipeline, in, out, std::size(inputs)));
+    expect(3);
+
+    TaskScheduler scheduler(2);
+    ParallelExecutor parallel(before, scheduler, 1);
+    ASSERT_TRUE(parallel.runPipeline(pipeline, in, out, std::size(inputs)));
+    expect(2);
+    parallel.setProgram(after);
+    EXPECT_EQ(parallel.program(), after);
+    ASSERT_TRUE(parallel.runPipeline(pipeline, in, out, std::size(inputs)));
+    expect(3);
+
+    AsyncRuntime async(before, 2);
+    int32_t results[2] = {};
+    auto completion = [&](int32_t& result)
+    {
+        return [&result](std::expected<std::vector<Register>, std::string> outputs)
+        {
+            ASSERT_TRUE(outputs) << outputs.error();
+            result = outputs->front().as<int32_t>();
+        };
+    };
+    ASSERT_TRUE(async.start(pipeline, {Register::of(5)}, completion(results[0])));
+    async.setProgram(after);
+    ASSERT_TRUE(async.start(pipeline, {Register::of(5)}, completion(results[1])));
+    async.wait();
+    EXPECT_EQ(results[0], 12);
+    EXPECT_EQ(results[1], 18);
+}
+
+TEST(HotReload, StreamsSwitchProgramsWithoutDraining)
+{
+    constexpr int32_t count = 2000;
+    auto stream = StreamingPipeline::start(twoStageProgram(2), 0, 4);
+    ASSERT_TRUE(stream) << stream.error();
+    std::thread pusher(
+        [&]
+        {
+            for(int32_t i = 0; i < count; ++i)
+            {
+                // Entities already in the queues finish on the program they were pushed to
+                if(i == count / 2)
+                {
+                    ASSERT_TRUE((*stream)->setProgram(twoStageProgram(3)));
+                }
+                Register input = Register::of(i);
+                ASSERT_TRUE((*stream)->push(std::span(&input, 1)));
+            }
+            (*stream)->close();
+        });
+
+    int32_t mismatches = 0;
+    for(int32_t i = 0; i < count; ++i)
+    {
+        Register output;
+        auto popped = (*stream)->pop(std::span(&output, 1));
+        ASSERT_TRUE(popped && *popped);
+        int32_t factor = i < count / 2 ? 2 : 3;
+        mismatches += output.as<int32_t>() != i * factor + factor;
+    }
+    pusher.join();
+    EXPECT_EQ(mismatches, 0);
+
+    // The stream's stages can't change shape
+    std::vector<BSModule> singleStage;
+    singleStage.push_back(scaleModule("m", 2));
+    singleStage[0].pipelines[0]->id = "m::p";
+    auto reshaped = (*stream)->setProgram(loadProgram(singleStage));
+    ASSERT_FALSE(reshaped);
+    EXPECT_NE(reshaped.error().find("m::p has 1 stages instead of 2"), std::string::npos) << reshaped.error();
+}
@@ -0,0 +1,446 @@
+#include "testing.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <set>
+#include <llvm/Object/Archive.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include "jit/aot.h"
+#include "jit/jit.h"
+#include "jit/tiered.h"
+#include "optimizer/passManager.h"
+
+using namespace BraneScript;
+using namespace BraneScript::Testing;
+
+namespace
+{
+    constexpr TypeId I32 = TypeTable::base(BSBaseType::I32);
+    constexpr TypeId U32 = TypeTable::base(BSBaseType::U32);
+    constexpr TypeId F32 = TypeTable::base(BSBaseType::F32);
+
+    BSModule sampleModule()
+    {
+        BSModule module;
+        module.name = "test";
+
+        auto triple = makeFunction("triple", {I32}, {I32});
+        IRValue three = addLocal(triple->localVars, I32);
+        triple->operations.constI32(3, three);
+        triple->operations.binary(OpCode::Mul, IRValue{0}, three, IRValue{1});
+
+        auto f = makeFunction("f", {I32, I32}, {I32, F32});
+        IRValue product = addLocal(f->localVars, I32);
+        IRValue sum = addLocal(f->localVars, I32);
+        IRValue seven = addLocal(f->localVars, I32);
+        IRValue rem = addLocal(f->localVars, I32);
+        IRValue tripled = addLocal(f->localVars, I32);
+        f->operations.binary(OpCode::Mul, IRValue{0}, IRValue{1}, product);
+        f->operations.binary(OpCode::Add, product, IRValue{0}, sum);
+        f->operations.constI32(7, seven);
+        f->operations.binary(OpCode::Mod, sum, seven, rem);
+        IRValue callInputs[] = {rem};
+        IRValue callOutputs[] = {tripled};
+        f->operations.call(std::string("triple"), callInputs, callOutputs);
+        f->operations.mov(tripled, IRValue{2});
+        f->operations.unary(OpCode::I32ToF32, tripled, IRValue{3});
+
+        auto mem = makeFunction("mem", {I32}, {I32});
+        IRValue storeOffset = addLocal(mem->localVars, U32);
+        IRValue loadOffset = addLocal(mem->localVars, U32);
+        IRValue doubled = addLocal(mem->localVars, I32);
+        mem->operations.constU32(4, storeOffset);
+        mem->operations.constU32(0, loadOffset);
+        mem->operations.binary(OpCode::Add, IRValue{0}, IRValue{0}, doubled);
+        mem->operations.store(ConstU32{0}, doubled, storeOffset);
+        mem->operations.load(ConstU32{0}, loadOffset, IRValue{1});
+
+        auto divide = makeFunction("divide", {I32, I32}, {I32});
+        divide->operations.binary(OpCode::Div, IRValue{0}, IRValue{1}, IRValue{2});
+
+        auto convert = makeFunction("convert", {F32}, {I32, U32});
+        convert->operations.unary(OpCode::F32ToI32, IRValue{0}, IRValue{1});
+        convert->operations.unary(OpCode::F32ToU32, IRValue{0}, IRValue{2});
+
+        auto recurse = makeFunction("recurse", {I32}, {I32});
+        IRValue recurseInputs[] = {IRValue{0}};
+        IRValue recurseOutputs[] = {IRValue{1}};
+        recurse->operations.call(std::string("recurse"), recurseInputs, recurseOutputs);
+        // Reads and writes back the i32 at an offset into a pair of them, which must stay within the pair
+        auto pair = std::make_shared<BSStruct>();
+        pair->id = "Pair";
+        pair->members = {I32, I32};
+        module.structs = {pair};
+        auto pairRef = module.types.ref(module.types.structType(std::string("Pair")), true);
+        auto touch = makeFunction("touch", {pairRef, U32}, {I32});
+        touch->operations.load(IRValue{0}, IRValue{1}, IRValue{2});
+        touch->operations.store(IRValue{0}, IRValue{2}, IRValue{1});
+
+        module.functions = {triple, f, mem, divide, convert, recurse, touch};
+
+        auto pipeline = makePipeline("p", {I32}, {I32});
+        auto& first = pipeline->stages->front();
+        IRValue ten = addLocal(first.localVars, I32);
+        IRValue plusTen = addLocal(first.localVars, I32);
+        first.operations.constI32(10, ten);
+        first.operations.binary(OpCode::Add, IRValue{0}, ten, plusTen);
+        first.outputs = {plusTen, IRValue{0}};
+        auto& second = pipeline->stages->emplace_back();
+        second.localVars = {I32, I32, I32};
+        second.operations.binary(OpCode::Mul, IRValue{0}, IRValue{1}, IRValue{2});
+        second.outputs = {IRValue{2}};
+        module.pipelines = {pipeline};
+        return module;
+    }
+
+    /// Native code has to produce the same results and trap in the same places as the VM
+    class JITMatchesVM : public testing::TestWithParam<NativeOptLevel>
+    {
+      protected:
+        BSModule _module = sampleModule();
+        std::shared_ptr<const Program> _program;
+        std::unique_ptr<VM> _vm;
+        std::unique_ptr<JITEngine> _jit;
+
+        void SetUp() override
+        {
+            PassManager::defaultPipeline().run(_module);
+            _program = loadProgram(std::span(&_module, 1));
+            ASSERT_TRUE(_program);
+            _vm = std::make_unique<VM>(_program);
+            auto jit = JITEngine::create(GetParam());
+            ASSERT_TRUE(jit) << jit.error();
+            _jit = std::move(*jit);
+            auto added = _jit->addModule(std::span(&_module, 1), 0);
+            ASSERT_TRUE(added) << added.error();
+        }
+
+        void compare(std::string_view id, std::vector<Register> inputs, std::span<const MemoryRegion> regions = {})
+        {
+            SCOPED_TRACE(id);
+            bool isFunction = _program->function(id).has_value();
+            size_t outputCount = isFunction ? _program->functions()[*_program->function(id)].outputCount
+                                            : _program->pipelines()[*_program->pipeline(id)].outputCount;
+            std::vector<Register> vmOutputs(outputCount), jitOutputs(outputCount);
+            auto vmResult = isFunction ? _vm->call(*_program->function(id), inputs, vmOutputs, regions)
+                                       : _vm->runPipeline(*_program->pipeline(id), inputs, vmOutputs, regions);
+
+            auto entry = _jit->entryPoint(id);
+            ASSERT_TRUE(entry) << entry.error();
+            NativeContext context{regions.data(), regions.size()};
+            auto status = (NativeStatus)(*entry)(&context, inputs.data(), jitOutputs.data());
+
+            ASSERT_EQ(vmResult.has_value(), status == NativeStatus::Ok) << nativeStatusMessage(status);
+            if(!vmResult)
+                return;
+            for(size_t i = 0; i < outputCount; ++i)
+                EXPECT_EQ(vmOutputs[i].bits, jitOutputs[i].bits) << "output " << i;
+        }
+    };
+
+    /// Outputs of a function or pipeline, or nullopt if it trapped
+    std::optional<std::vector<uint64_t>> runOn(VM& vm, std::string_view id, std::vector<Register> inputs)
+    {
+        auto& program = vm.program();
+        auto function = program.function(id);
+        size_t outputCount = function ? program.functions()[*function].outputCount
+                                      : program.pipelines()[*program.pipeline(id)].outputCount;
+        std::vector<Register> outputs(outputCount);
+        auto result = function ? vm.call(*function, inputs, outputs)
+                               : vm.runPipeline(*program.pipeline(id), inputs, outputs);
+        if(!result)
+            return std::nullopt;
+        std::vector<uint64_t> bits;
+        for(auto& output : outputs)
+            bits.push_back(output.bits);
+        return bits;
+    }
+
+    /// half(x) = x / 2, in a module of its own so that objects and libraries hold more than one
+    BSModule extraModule()
+    {
+        BSModule module;
+        module.name = "extra";
+        auto half = makeFunction("extra::half", {I32}, {I32});
+        IRValue two = addLocal(half->localVars, I32);
+        half->operations.constI32(2, two);
+        half->operations.binary(OpCode::Div, IRValue{0}, two, IRValue{1});
+        module.functions = {half};
+        return module;
+    }
+
+    /// Every symbol an object defines. Mach-O prefixes C symbols with an underscore, which is dropped.
+    std::expected<std::set<std::string>, std::string> definedSymbols(const llvm::object::ObjectFile& object)
+    {
+        std::set<std::string> symbols;
+        for(auto& symbol : object.symbols())
+        {
+            auto flags = symbol.getFlags();
+            if(!flags)
+                return std::unexpected(llvm::toString(flags.takeError()));
+            if((*flags & llvm::object::SymbolRef::SF_Undefined) || !(*flags & llvm::object::SymbolRef::SF_Global))
+                continue;
+            auto name = symbol.getName();
+            if(!name)
+                return std::unexpected(llvm::toString(name.takeError()));
+            std::string text = name->str();
+            if(object.isMachO() && text.starts_with('_'))
+                text.erase(0, 1);
+            symbols.insert(std::move(text));
+        }
+        return symbols;
+    }
+
+    std::expected<std::set<std::string>, std::string> definedSymbols(llvm::MemoryBufferRef buffer)
+    {
+        auto object = llvm::object::ObjectFile::createObjectFile(buffer);
+        if(!object)
+            return std::unexpected(llvm::toString(object.takeError()));
+        return definedSymbols(**object);
+    }
+
+    /// Symbols defined by each member of a static library
+    std::expected<std::map<std::string, std::set<std::string>>, std::string>
+    librarySymbols(const std::filesystem::path& path)
+    {
+        auto buffer = llvm::MemoryBuffer::getFile(path.string());
+        if(!buffer)
+            return std::unexpected(buffer.getError().message());
+        auto archive = llvm::object::Archive::create((*buffer)->getMemBufferRef());
+        if(!archive)
+            return std::unexpected(llvm::toString(archive.takeError()));
+        std::map<std::string, std::set<std::string>> members;
+        llvm::Error error = llvm::Error::success();
+        for(auto& child : (*archive)->children(error))
+        {
+            auto name = child.getName();
+            auto contents = child.getMemoryBufferRef();
+            if(!name || !contents)
+            {
+                llvm::consumeError(name.takeError());
+                llvm::consumeError(contents.takeError());
+                return std::unexpected("Unreadable archive member");
+            }
+            auto symbols = definedSymbols(*contents);
+            if(!symbols)
+                return std::unexpected(symbols.error());
+            members[name->str()] = std::move(*symbols);
+        }
+        if(error)
+            return std::unexpected(llvm::toString(std::move(error)));
+        return members;
+    }
+
+    /// Runs a shell command, returning its output on failure
+    std::expected<void, std::string> runCommand(const std::string& command, const std::filesystem::path& log)
+    {
+        if(std::system((command + " > \"" + log.string() + "\" 2>&1").c_str()) == 0)
+            return {};
+        std::ifstream file(log);
+        std::string output((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        return std::unexpected(command + "\n" + output);
+    }
+
+    /// Calls the entry points through the generated header, exiting with the number of the first check that failed
+    constexpr std::string_view nativeHostSource = R"(#include "entry.h"
+
+int main(void)
+{
+    BSNativeContext ctx = {0};
+    int32_t value = 0;
+    float asFloat = 0;
+    /* ((5 * 4 + 5) % 7) * 3 */
+    if(bs_f(&ctx, 5, 4, &value, &asFloat) != BS_NATIVE_OK || value != 12 || asFloat != 12.0f)
+        return 1;
+    if(bs_extra__half(&ctx, 9, &value) != BS_NATIVE_OK || value != 4)
+        return 2;
+    if(bs_divide(&ctx, 1, 0, &value) != BS_NATIVE_DIVISION_BY_ZERO)
+        return 3;
+    /* (21 + 10) * 21 */
+    uint64_t inputs[1] = {21};
+    uint64_t outputs[1] = {0};
+    if(bsreg_p(&ctx, inputs, outputs) != BS_NATIVE_OK || (int32_t)outputs[0] != 651)
+        return 4;
+    return 0;
+}
+)";
+} // namespace
+
+TEST_P(JITMatchesVM, Arithmetic)
+{
+    for(auto [a, b] : {std::pair{5, 6}, {-4, 9}, {0, 0}, {INT32_MAX, 2}})
+        compare("f", {Register::of(a), Register::of(b)});
+}
+
+TEST_P(JITMatchesVM, Conversions)
+{
+    for(float value : {1.5f, -1.5f, 3e9f, -3e9f, std::numeric_limits<float>::quiet_NaN()})
+        compare("convert", {Register::of(value)});
+}
+
+TEST_P(JITMatchesVM, Traps)
+{
+    compare("divide", {Register::of(7), Register::of(2)});
+    compare("divide", {Register::of(1), Register::of(0)});
+    compare("divide", {Register::of(INT32_MIN), Register::of(-1)});
+    compare("recurse", {Register::of(1)});
+}
+
+TEST_P(JITMatchesVM, MemoryRegions)
+{
+    std::byte buffer[8] = {};
+    MemoryRegion region{buffer, sizeof(buffer), true};
+    compare("mem", {Register::of(21)}, std::span(&region, 1));
+    MemoryRegion tooSmall{buffer, 6, true};
+    compare("mem", {Register::of(21)}, std::span(&tooSmall, 1));
+    MemoryRegion readOnly{buffer, sizeof(buffer), false};
+    compare("mem", {Register::of(21)}, std::span(&readOnly, 1));
+}
+
+TEST_P(JITMatchesVM, References)
+{
+    int32_t pair[2] = {5, 6};
+    for(uint32_t offset : {0u, 4u, 6u, 8u, 1u << 20})
+        compare("touch", {Register::of(&pair[0]), Register::of(offset)});
+}
+
+TEST_P(JITMatchesVM, Pipelines) { compare("p", {Register::of(21)}); }
+
+INSTANTIATE_TEST_SUITE_P(OptLevels, JITMatchesVM, testing::Values(NativeOptLevel::O0, NativeOptLevel::O2));
+
+TEST(TieredEngine, PromotesHotCodeAndMatchesTheInterpreter)
+{
+    TieredOptions options;
+    options.threshold = 10;
+    auto engine = TieredEngine::create({sampleModule()}, options);
+    ASSERT_TRUE(engine) << engine.error();
+    VM tiered = (*engine)->createVM();
+    VM interpreter((*engine)->program());
+    auto& program = *(*engine)->program();
+    auto& tiers = *(*engine)->tierTable();
+
+    auto compareAll = [&](int32_t first, int32_t last)
+    {
+        for(int32_t i = first; i < last; ++i)
+        {
+            EXPECT_EQ(runOn(tiered, "f", {Register::of(i), Register::of(i - 7)}),
+                      runOn(interpreter, "f", {Register::of(i), Register::of(i - 7)}));
+            EXPECT_EQ(runOn(tiered, "divide", {Register::of(100), Register::of(i % 4)}),
+                      runOn(interpreter, "divide", {Register::of(100), Register::of(i % 4)}));
+            EXPECT_EQ(runOn(tiered, "p", {Register::of(i)}), runOn(interpreter, "p", {Register::of(i)}));
+        }
+    };
+    compareAll(0, options.threshold - 1);
+    (*engine)->waitForCompiles();
+    EXPECT_EQ((*engine)->promotedCount(), 0);
+
+    // Crossing the threshold promotes f, the triple it calls, divide and the pipeline
+    compareAll(options.threshold - 1, options.threshold + 10);
+    (*engine)->waitForCompiles();
+    EXPECT_TRUE((*engine)->errors().empty()) << (*engine)->errors().front();
+    EXPECT_EQ((*engine)->promotedCount(), 4);
+    EXPECT_NE(tiers.native(TierTable::Kind::Function, *program.function("f")), nullptr);
+    EXPECT_NE(tiers.native(TierTable::Kind::Function, *program.function("divide")), nullptr);
+    EXPECT_NE(tiers.native(TierTable::Kind::Pipeline, *program.pipeline("p")), nullptr);
+    EXPECT_EQ(tiers.native(TierTable::Kind::Function, *program.function("mem")), nullptr);
+
+    // Native code gives the same results, and traps on the same divisions
+    compareAll(-1000, 1000);
+}
+
+TEST(TieredEngine, VMsOutliveTheEngine)
+{
+    TieredOptions options;
+    options.threshold = 1;
+    auto engine = TieredEngine::create({sampleModule()}, options);
+    ASSERT_TRUE(engine) << engine.error();
+    VM tiered = (*engine)->createVM();
+    VM interpreter((*engine)->program());
+    auto tiers = (*engine)->tierTable();
+    uint32_t f = *(*engine)->program()->function("f");
+
+    EXPECT_EQ(runOn(tiered, "f", {Register::of(3), Register::of(4)}),
+              runOn(interpreter, "f", {Register::of(3), Register::of(4)}));
+    (*engine)->waitForCompiles();
+    ASSERT_NE(tiers->native(TierTable::Kind::Function, f), nullptr);
+    engine->reset();
+
+    // The native code stays loaded for the VM, and code getting hot now stays interpreted
+    for(int32_t i = 0; i < 100; ++i)
+    {
+        EXPECT_EQ(runOn(tiered, "f", {Register::of(i), Register::of(5)}),
+                  runOn(interpreter, "f", {Register::of(i), Register::of(5)}));
+        EXPECT_EQ(runOn(tiered, "p", {Register::of(i)}), runOn(interpreter, "p", {Register::of(i)}));
+    }
+    EXPECT_NE(tiers->native(TierTable::Kind::Function, f), nullptr);
+}
+
+TEST(AOT, ObjectsAndLibrariesExportTheHeadersEntryPoints)
+{
+    std::vector<BSModule> modules = {sampleModule(), extraModule()};
+    auto dir = std::filesystem::temp_directory_path() / "bsAotTest";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+
+    NativeTargetOptions options;
+    auto objectPath = dir / "entry.o";
+    auto object = compileNativeObject(modules, options);
+    ASSERT_TRUE(object) << object.error();
+    std::ofstream(objectPath, std::ios::binary) << *object;
+    auto objectSymbols = definedSymbols(llvm::MemoryBufferRef(*object, "entry.o"));
+    ASSERT_TRUE(objectSymbols) << objectSymbols.error();
+
+    auto libraryPath = dir / "entry.a";
+    auto written = writeNativeLibrary(modules, libraryPath, options);
+    ASSERT_TRUE(written) << written.error();
+    auto members = librarySymbols(libraryPath);
+    ASSERT_TRUE(members) << members.error();
+    EXPECT_EQ(members->size(), modules.size()) << "one member per module";
+
+    // Both entry points of every function and pipeline are exported, the library's from its module's member
+    EXPECT_EQ(nativeSymbolName("extra::half"), "bs_extra__half");
+    EXPECT_EQ(nativeRegisterSymbolName("extra::half"), "bsreg_extra__half");
+    for(auto& module : modules)
+    {
+        auto member = members->find(nativeSymbolName(module.name).substr(3) + ".o");
+        ASSERT_NE(member, members->end()) << module.name;
+        std::vector<std::string> ids;
+        for(auto& function : module.functions)
+            ids.push_back(function->id);
+        for(auto& pipeline : module.pipelines)
+            ids.push_back(pipeline->id);
+        for(auto& id : ids)
+        {
+            for(auto& symbol : {nativeSymbolName(id), nativeRegisterSymbolName(id)})
+            {
+                EXPECT_TRUE(objectSymbols->contains(symbol)) << symbol;
+                EXPECT_TRUE(member->second.contains(symbol)) << symbol << " in " << member->first;
+            }
+        }
+    }
+
+#if defined(BS_TEST_C_COMPILER) && !defined(_WIN32)
+    // The header has to compile as strict C, and calls made through it have to reach the code in both outputs
+    std::ofstream(dir / "entry.h") << generateNativeHeader(modules, "BS_AOT_TEST_ENTRY_H");
+    std::ofstream(dir / "host.c") << nativeHostSource;
+    for(auto& linked : {objectPath, libraryPath})
+    {
+        SCOPED_TRACE(linked.filename().string());
+        auto host = dir / "host";
+        auto built = runCommand(std::format("\"{}\" -std=c99 -Wall -Wextra -Werror \"{}\" \"{}\" -o \"{}\"",
+                                            BS_TEST_C_COMPILER,
+                                            (dir / "host.c").string(),
+                                            linked.string(),
+                                            host.string()),
+                                dir / "build.log");
+        ASSERT_TRUE(built) << built.error();
+        auto ran = runCommand(std::format("\"{}\"", host.string()), dir / "run.log");
+        EXPECT_TRUE(ran) << ran.error();
+    }
+#else
+    GTEST_SKIP() << "Needs a C compiler to check the header with";
+#endif
+}
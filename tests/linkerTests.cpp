@@ -0,0 +1,125 @@
+#include "testing.h"
+
+#include "ir/linker.h"
+
+using namespace BraneScript;
+using namespace BraneScript::Testing;
+
+namespace
+{
+    constexpr TypeId I32 = TypeTable::base(BSBaseType::I32);
+    constexpr TypeId F32 = TypeTable::base(BSBaseType::F32);
+
+    /// math defines twice and an unused function, app calls twice through its imports and a host function by name
+    std::vector<BSModule> callingModules()
+    {
+        std::vector<BSModule> modules(2);
+        auto& math = modules[0];
+        math.name = "math";
+        auto twice = makeFunction("math::twice", {I32}, {I32});
+        twice->operations.binary(OpCode::Add, IRValue{0}, IRValue{0}, IRValue{1});
+        auto unused = makeFunction("math::unused", {I32}, {I32});
+        unused->operations.mov(IRValue{0}, IRValue{1});
+        math.functions = {twice, unused};
+
+        auto& app = modules[1];
+        app.name = "app";
+        app.imports = {"math::twice"};
+        auto quad = makeFunction("app::quad", {I32}, {I32});
+        IRValue doubled = addLocal(quad->localVars, I32);
+        IRValue in[] = {IRValue{0}};
+        IRValue out[] = {doubled};
+        quad->operations.call(int32_t{-1}, in, out);
+        IRValue in2[] = {doubled};
+        IRValue out2[] = {IRValue{1}};
+        quad->operations.call(int32_t{-1}, in2, out2);
+        auto logged = makeFunction("app::logged", {I32}, {});
+        logged->operations.call(std::string("host::log"), in, {});
+        app.functions = {quad, logged};
+        return modules;
+    }
+
+    /// Module declaring a struct named Vec, with a function taking a ref to it
+    BSModule vecModule(std::string name, std::vector<TypeId> members)
+    {
+        BSModule module;
+        module.name = name;
+        auto vec = std::make_shared<BSStruct>();
+        vec->id = "Vec";
+        vec->members = std::move(members);
+        module.structs = {vec};
+        auto ref = module.types.ref(module.types.structType(int32_t{1}), false);
+        module.functions = {makeFunction(name + "::use", {ref}, {})};
+        return module;
+    }
+} // namespace
+
+TEST(Linker, ResolvesImportsAndDropsUnreferencedFunctions)
+{
+    auto modules = callingModules();
+    LinkOptions options;
+    options.entryPoints = {"app::quad"};
+    auto linked = linkModules(modules, options);
+    ASSERT_TRUE(linked) << linked.error();
+
+    ASSERT_EQ(linked->functions.size(), 2);
+    EXPECT_EQ(linked->functions[0]->id, "math::twice");
+    EXPECT_EQ(linked->functions[1]->id, "app::quad");
+    for(auto& target : linked->functions[1]->operations.callTargets)
+        EXPECT_EQ(target, IDRef{int32_t{1}});
+
+    auto program = loadProgram(std::span(&*linked, 1));
+    ASSERT_TRUE(program);
+    VM vm(program);
+    EXPECT_EQ(callI32(vm, "app::quad", {5}), 20);
+}
+
+TEST(Linker, LeavesUndefinedFunctionsForTheLoader)
+{
+    auto modules = callingModules();
+    LinkOptions options;
+    options.keepUnreferenced = true;
+    auto linked = linkModules(modules, options);
+    ASSERT_TRUE(linked) << linked.error();
+    ASSERT_EQ(linked->functions.size(), 4);
+    EXPECT_EQ(linked->functions[3]->operations.callTargets[0], IDRef{std::string("host::log")});
+
+    modules[1].imports.clear();
+    auto unbound = linkModules(modules, options);
+    ASSERT_FALSE(unbound);
+    EXPECT_NE(unbound.error().find("unbound external function -1"), std::string::npos) << unbound.error();
+
+    modules = callingModules();
+    modules[1].functions.push_back(makeFunction("math::twice", {I32}, {I32}));
+    auto duplicate = linkModules(modules, options);
+    ASSERT_FALSE(duplicate);
+    EXPECT_NE(duplicate.error().find("math::twice is defined more than once"), std::string::npos) << duplicate.error();
+}
+
+TEST(Linker, MergesMatchingStructDeclarations)
+{
+    std::vector<BSModule> modules;
+    modules.push_back(vecModule("host", {F32, F32}));
+    modules.push_back(vecModule("script", {F32, F32}));
+    // A module that uses Vec without declaring it, the way the compiler emits one
+    auto& importing = modules.emplace_back();
+    importing.name = "importing";
+    importing.imports = {"Vec"};
+    importing.functions = {makeFunction("importing::use", {importing.types.structType(int32_t{-1})}, {})};
+
+    LinkOptions options;
+    options.keepUnreferenced = true;
+    auto linked = linkModules(modules, options);
+    ASSERT_TRUE(linked) << linked.error();
+    ASSERT_EQ(linked->structs.size(), 1);
+    auto vec = linked->types.structType(int32_t{1});
+    EXPECT_EQ(linked->functions[0]->inputs[0], linked->types.ref(vec, false));
+    EXPECT_EQ(linked->functions[1]->inputs[0], linked->types.ref(vec, false));
+    EXPECT_EQ(linked->functions[2]->inputs[0], vec);
+
+    modules[1] = vecModule("script", {F32, I32});
+    auto mismatched = linkModules(modules, options);
+    ASSERT_FALSE(mismatched);
+    EXPECT_NE(mismatched.error().find("Vec is declared differently in host and script"), std::string::npos)
+        << mismatched.error();
+}
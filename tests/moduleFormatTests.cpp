@@ -0,0 +1,168 @@
+#include "testing.h"
+
+#include <algorithm>
+#include <filesystem>
+#include "ir/moduleFormat.h"
+
+using namespace BraneScript;
+using namespace BraneScript::Testing;
+
+namespace
+{
+    constexpr TypeId I32 = TypeTable::base(BSBaseType::I32);
+    constexpr TypeId F32 = TypeTable::base(BSBaseType::F32);
+
+    BSModule sampleModule()
+    {
+        BSModule module;
+        module.name = "test";
+        auto vec = std::make_shared<BSStruct>();
+        vec->id = "test::Vec";
+        vec->members = {F32, F32};
+        vec->memberNames = {"x", "y"};
+        vec->packed = true;
+        module.structs.push_back(vec);
+
+        TypeId ref = module.types.ref(module.types.structType(std::string("test::Vec")), true);
+        auto add = makeFunction("test::add", {I32, I32}, {I32});
+        addLocal(add->localVars, ref);
+        add->operations.binary(OpCode::Add, IRValue{0}, IRValue{1}, IRValue{2});
+        IRValue values[] = {IRValue{2}};
+        add->operations.call(std::string("other"), values, values);
+        add->operations.call(int32_t(-1), values, values);
+        module.functions.push_back(add);
+
+        auto pipeline = makePipeline("test::Foo", {F32}, {F32});
+        auto& stage = pipeline->stages->front();
+        IRValue half = addLocal(stage.localVars, F32);
+        stage.operations.constF32(1.5f, half);
+        stage.outputs = {half};
+        module.pipelines.push_back(pipeline);
+        module.imports = {"other::mul"};
+        return module;
+    }
+} // namespace
+
+TEST(ModuleFormat, ViewReadsInPlace)
+{
+    auto module = sampleModule();
+    auto bytes = serializeModule(module);
+    auto view = ModuleView::open(bytes);
+    ASSERT_TRUE(view) << view.error();
+    EXPECT_EQ(view->name(), "test");
+
+    ASSERT_EQ(view->structCount(), 1);
+    EXPECT_EQ(view->structAt(0).id(), "test::Vec");
+    EXPECT_TRUE(view->structAt(0).packed());
+    EXPECT_EQ(view->structAt(0).members().size(), 2);
+    ASSERT_EQ(view->structAt(0).memberNames().size(), 2);
+    EXPECT_EQ(view->string(view->structAt(0).memberNames()[1]), "y");
+
+    ASSERT_EQ(view->functionCount(), 1);
+    auto function = view->function(0);
+    EXPECT_EQ(function.id(), "test::add");
+    EXPECT_EQ(function.localVars().size(), 4);
+    auto code = function.code();
+    ASSERT_EQ(code.instructions().size(), 3);
+    // Instructions are read straight out of the serialized bytes
+    EXPECT_GE((const std::byte*)code.instructions().data(), bytes.data());
+    EXPECT_LT((const std::byte*)code.instructions().data(), bytes.data() + bytes.size());
+    EXPECT_EQ(std::get<std::string>(code.callTarget(0)), "other");
+    EXPECT_EQ(std::get<int32_t>(code.callTarget(1)), -1);
+
+    ASSERT_EQ(view->pipelineCount(), 1);
+    auto pipeline = view->pipeline(0);
+    ASSERT_TRUE(pipeline.hasStages());
+    ASSERT_EQ(pipeline.stageCount(), 1);
+    EXPECT_EQ(pipeline.stage(0).code().instructions()[0].constF32(), 1.5f);
+    EXPECT_EQ(pipeline.stage(0).outputs().size(), 1);
+
+    ASSERT_EQ(view->importCount(), 1);
+    EXPECT_EQ(view->import(0), "other::mul");
+}
+
+TEST(ModuleFormat, RoundTrip)
+{
+    auto module = sampleModule();
+    auto bytes = serializeModule(module);
+    auto view = ModuleView::open(bytes);
+    ASSERT_TRUE(view) << view.error();
+    auto copy = view->toModule();
+    EXPECT_EQ(serializeModule(copy), bytes);
+
+    auto path = std::filesystem::temp_directory_path() / "bsModuleFormatTest.bsm";
+    ASSERT_TRUE(writeModuleFile(path, module));
+    {
+        auto mapped = MappedFile::open(path);
+        ASSERT_TRUE(mapped) << mapped.error();
+        EXPECT_TRUE(std::ranges::equal(mapped->data(), bytes));
+        auto mappedView = ModuleView::open(mapped->data());
+        ASSERT_TRUE(mappedView) << mappedView.error();
+        EXPECT_EQ(mappedView->function(0).id(), "test::add");
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(ModuleFormat, RejectsCorruptFiles)
+{
+    auto bytes = serializeModule(sampleModule());
+    auto truncated = std::span(bytes).first(bytes.size() - 1);
+    EXPECT_FALSE(ModuleView::open(truncated));
+    EXPECT_FALSE(ModuleView::open(std::span(bytes).first(sizeof(ModuleFormat::Header) - 1)));
+
+    auto badMagic = bytes;
+    badMagic[0] = std::byte{'X'};
+    EXPECT_FALSE(ModuleView::open(badMagic));
+
+    auto badVersion = bytes;
+    reinterpret_cast<ModuleFormat::Header*>(badVersion.data())->versionMajor += 1;
+    EXPECT_FALSE(ModuleView::open(badVersion));
+
+    auto badSection = bytes;
+    reinterpret_cast<ModuleFormat::Header*>(badSection.data())
+        ->sections[(size_t)ModuleFormat::Section::Functions]
+        .size += 1 << 20;
+    EXPECT_FALSE(ModuleView::open(badSection));
+
+    // Every entry is validated when the view is opened, so flipping any byte past the header either fails to open or
+    // opens a module whose accessors stay in bounds
+    for(size_t i = sizeof(ModuleFormat::Header); i < bytes.size(); ++i)
+    {
+        auto corrupt = bytes;
+        corrupt[i] ^= std::byte{0xff};
+        auto view = ModuleView::open(corrupt);
+        if(view)
+            (void)view->toModule();
+    }
+}
+
+TEST(ModuleFormat, TableValidationCanBeDeferred)
+{
+    auto bytes = serializeModule(sampleModule());
+    auto corrupt = bytes;
+    auto& header = *reinterpret_cast<ModuleFormat::Header*>(corrupt.data());
+    auto& functions = header.sections[(size_t)ModuleFormat::Section::Functions];
+    reinterpret_cast<ModuleFormat::FunctionEntry*>(corrupt.data() + functions.offset)->id = 1 << 20;
+
+    auto eager = ModuleView::open(corrupt);
+    ASSERT_FALSE(eager);
+    EXPECT_EQ(eager.error(), "Module function table is corrupt");
+
+    auto deferred = ModuleView::open(corrupt, {.validateTables = false});
+    ASSERT_TRUE(deferred) << deferred.error();
+    auto valid = deferred->validate();
+    ASSERT_FALSE(valid);
+    EXPECT_EQ(valid.error(), eager.error());
+
+    auto trusted = ModuleView::open(bytes, {.validateTables = false});
+    ASSERT_TRUE(trusted) << trusted.error();
+    EXPECT_TRUE(trusted->validate());
+    EXPECT_EQ(serializeModule(trusted->toModule()), bytes);
+
+    // The header and section table are checked either way
+    auto badSection = bytes;
+    reinterpret_cast<ModuleFormat::Header*>(badSection.data())
+        ->sections[(size_t)ModuleFormat::Section::Functions]
+        .size += 1 << 20;
+    EXPECT_FALSE(ModuleView::open(badSection, {.validateTables = false}));
+}
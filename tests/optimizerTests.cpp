@@ -0,0 +1,568 @@
+#include "testing.h"
+
+#include <algorithm>
+#include "optimizer/passes.h"
+#include "optimizer/slotAllocator.h"
+
+using namespace BraneScript;
+using namespace BraneScript::Testing;
+
+namespace
+{
+    constexpr TypeId I32 = TypeTable::base(BSBaseType::I32);
+
+    CodeBody functionBody(BSFunction& function)
+    {
+        uint32_t inputCount = (uint32_t)function.inputs.size();
+        CodeBody body{function.localVars, function.operations, inputCount, {}, true};
+        for(uint32_t i = 0; i < function.outputs.size(); ++i)
+            body.outputs.push_back({inputCount + i});
+        return body;
+    }
+
+    size_t countOps(const InstructionList& code, OpCode op)
+    {
+        return std::ranges::count_if(code, [&](const Instruction& inst) { return inst.op == op; });
+    }
+
+    int32_t run(const BSModule& module, std::string_view function, std::vector<int32_t> inputs)
+    {
+        auto program = loadProgram(std::span(&module, 1));
+        if(!program)
+            return 0;
+        VM vm(program);
+        return callI32(vm, function, std::move(inputs));
+    }
+
+    int32_t runPipeline(const BSModule& module, int32_t input)
+    {
+        auto program = loadProgram(std::span(&module, 1));
+        if(!program)
+            return 0;
+        VM vm(program);
+        Register inputs[] = {Register::of(input)};
+        Register outputs[1];
+        auto result = vm.runPipeline(0, inputs, outputs);
+        EXPECT_TRUE(result) << result.error();
+        return outputs[0].as<int32_t>();
+    }
+
+    /// Allocates the slots of a function's body, checking that every referenced value got a slot of its own type
+    SlotAssignment allocate(BSFunction& function)
+    {
+        auto body = functionBody(function);
+        auto assignment = allocateSlots(body);
+        for(size_t value = 0; value < function.localVars.size(); ++value)
+        {
+            uint32_t slot = assignment.valueSlots[value];
+            if(slot == UINT32_MAX)
+                continue;
+            EXPECT_LT(slot, assignment.slotTypes.size());
+            if(slot < assignment.slotTypes.size())
+            {
+                EXPECT_EQ(assignment.slotTypes[slot], function.localVars[value]) << "value " << value;
+            }
+        }
+        return assignment;
+    }
+
+    /// Rewrites f to its slots, checking that it still returns the same results, and returns its frame size
+    size_t assignSlotsPreservingResults(std::shared_ptr<BSFunction> function, std::vector<std::vector<int32_t>> inputs)
+    {
+        BSModule module;
+        module.name = "test";
+        module.functions = {function};
+        BSModule assigned = module;
+        assigned.functions = {std::make_shared<BSFunction>(*function)};
+        auto body = functionBody(*assigned.functions[0]);
+        assignSlots(body);
+        for(auto& args : inputs)
+            EXPECT_EQ(run(assigned, "f", args), run(module, "f", args)) << args[0];
+        return assigned.functions[0]->localVars.size();
+    }
+
+    /// p(x) = twice(x + 10) * x over three stages, the second of which calls target
+    BSModule stagedModule(std::string target = "twice")
+    {
+        BSModule module;
+        module.name = "test";
+        auto twice = makeFunction("twice", {I32}, {I32});
+        twice->operations.binary(OpCode::Add, IRValue{0}, IRValue{0}, IRValue{1});
+        module.functions = {twice};
+
+        auto pipeline = makePipeline("p", {I32}, {I32});
+        auto& first = pipeline->stages->front();
+        IRValue ten = addLocal(first.localVars, I32);
+        IRValue sum = addLocal(first.localVars, I32);
+        first.operations.constI32(10, ten);
+        first.operations.binary(OpCode::Add, IRValue{0}, ten, sum);
+        first.outputs = {sum, IRValue{0}};
+
+        auto& second = pipeline->stages->emplace_back();
+        second.localVars = {I32, I32, I32};
+        IRValue inputs[] = {IRValue{0}};
+        IRValue outputs[] = {IRValue{2}};
+        second.operations.call(target, inputs, outputs);
+        second.outputs = {IRValue{2}, IRValue{1}};
+
+        auto& third = pipeline->stages->emplace_back();
+        third.localVars = {I32, I32, I32};
+        third.operations.binary(OpCode::Mul, IRValue{0}, IRValue{1}, IRValue{2});
+        third.outputs = {IRValue{2}};
+        module.pipelines = {pipeline};
+        return module;
+    }
+} // namespace
+
+TEST(Optimizer, ConstantFoldingEvaluatesConstants)
+{
+    auto function = makeFunction("f", {I32}, {I32});
+    IRValue two = addLocal(function->localVars, I32);
+    IRValue three = addLocal(function->localVars, I32);
+    IRValue sum = addLocal(function->localVars, I32);
+    IRValue zero = addLocal(function->localVars, I32);
+    IRValue plusZero = addLocal(function->localVars, I32);
+    function->operations.constI32(2, two);
+    function->operations.constI32(3, three);
+    function->operations.binary(OpCode::Add, two, three, sum);
+    function->operations.constI32(0, zero);
+    function->operations.binary(OpCode::Add, IRValue{0}, zero, plusZero);
+    function->operations.binary(OpCode::Mul, plusZero, sum, IRValue{1});
+
+    auto body = functionBody(*function);
+    EXPECT_TRUE(ConstantFolding().run(body));
+    DeadCodeElimination().run(body);
+    EXPECT_EQ(countOps(function->operations, OpCode::Add), 0);
+    ASSERT_EQ(countOps(function->operations, OpCode::Mul), 1);
+    auto constant = std::ranges::find(function->operations, OpCode::ConstI32, &Instruction::op);
+    ASSERT_NE(constant, function->operations.end());
+    EXPECT_EQ(constant->constI32(), 5);
+}
+
+TEST(Optimizer, ConstantFoldingLeavesTraps)
+{
+    auto function = makeFunction("f", {}, {I32});
+    IRValue one = addLocal(function->localVars, I32);
+    IRValue zero = addLocal(function->localVars, I32);
+    function->operations.constI32(1, one);
+    function->operations.constI32(0, zero);
+    function->operations.binary(OpCode::Div, one, zero, IRValue{0});
+
+    auto body = functionBody(*function);
+    ConstantFolding().run(body);
+    EXPECT_EQ(countOps(function->operations, OpCode::Div), 1);
+}
+
+TEST(Optimizer, CommonSubexpressionElimination)
+{
+    auto function = makeFunction("f", {I32, I32}, {I32});
+    IRValue first = addLocal(function->localVars, I32);
+    IRValue second = addLocal(function->localVars, I32);
+    function->operations.binary(OpCode::Mul, IRValue{0}, IRValue{1}, first);
+    function->operations.binary(OpCode::Mul, IRValue{0}, IRValue{1}, second);
+    function->operations.binary(OpCode::Add, first, second, IRValue{2});
+
+    auto body = functionBody(*function);
+    EXPECT_TRUE(CommonSubexpressionElimination().run(body));
+    CopyPropagation().run(body);
+    DeadCodeElimination().run(body);
+    EXPECT_EQ(countOps(function->operations, OpCode::Mul), 1);
+}
+
+TEST(Optimizer, CopyPropagationRemovesCopyChains)
+{
+    auto function = makeFunction("f", {I32}, {I32});
+    IRValue value{0};
+    for(int i = 0; i < 8; ++i)
+    {
+        IRValue copy = addLocal(function->localVars, I32);
+        function->operations.mov(value, copy);
+        value = copy;
+    }
+    function->operations.binary(OpCode::Add, value, value, IRValue{1});
+
+    auto body = functionBody(*function);
+    EXPECT_TRUE(CopyPropagation().run(body));
+    DeadCodeElimination().run(body);
+    ASSERT_EQ(function->operations.size(), 1);
+    EXPECT_EQ(function->operations.instructions[0].a, 0);
+    EXPECT_EQ(function->operations.instructions[0].c, 1);
+}
+
+TEST(Optimizer, DeadCodeEliminationKeepsSideEffects)
+{
+    auto function = makeFunction("f", {I32}, {I32});
+    IRValue unused = addLocal(function->localVars, I32);
+    IRValue offset = addLocal(function->localVars, TypeTable::base(BSBaseType::U32));
+    IRValue callResult = addLocal(function->localVars, I32);
+    function->operations.binary(OpCode::Mul, IRValue{0}, IRValue{0}, unused);
+    function->operations.constU32(0, offset);
+    function->operations.store(ConstU32{0}, IRValue{0}, offset);
+    IRValue inputs[] = {IRValue{0}};
+    IRValue outputs[] = {callResult};
+    function->operations.call(std::string("g"), inputs, outputs);
+    function->operations.mov(IRValue{0}, IRValue{1});
+
+    // Unused results of operations that may trap are kept, the trap is what the program observes
+    IRValue two = addLocal(function->localVars, I32);
+    IRValue minusOne = addLocal(function->localVars, I32);
+    IRValue loaded = addLocal(function->localVars, I32);
+    function->operations.constI32(2, two);
+    function->operations.constI32(-1, minusOne);
+    function->operations.binary(OpCode::Div, IRValue{0}, IRValue{0}, addLocal(function->localVars, I32));
+    function->operations.binary(OpCode::Mod, IRValue{0}, minusOne, addLocal(function->localVars, I32));
+    function->operations.binary(OpCode::Div, IRValue{0}, two, addLocal(function->localVars, I32));
+    function->operations.load(ConstU32{0}, offset, loaded);
+
+    auto body = functionBody(*function);
+    EXPECT_TRUE(DeadCodeElimination().run(body));
+    EXPECT_EQ(countOps(function->operations, OpCode::Mul), 0);
+    EXPECT_EQ(countOps(function->operations, OpCode::Store), 1);
+    EXPECT_EQ(countOps(function->operations, OpCode::Call), 1);
+    EXPECT_EQ(countOps(function->operations, OpCode::Div), 1);
+    EXPECT_EQ(countOps(function->operations, OpCode::Mod), 1);
+    EXPECT_EQ(countOps(function->operations, OpCode::Load), 1);
+    EXPECT_EQ(countOps(function->operations, OpCode::ConstI32), 1);
+}
+
+TEST(Optimizer, BuildSSARenamesRewrittenValues)
+{
+    auto function = makeFunction("f", {I32}, {I32});
+    IRValue temp = addLocal(function->localVars, I32);
+    function->operations.binary(OpCode::Add, IRValue{0}, IRValue{0}, temp);
+    function->operations.binary(OpCode::Mul, temp, temp, temp);
+    function->operations.mov(temp, IRValue{1});
+
+    auto body = functionBody(*function);
+    EXPECT_TRUE(buildSSA(body));
+    std::vector<int> writes(function->localVars.size());
+    for(auto& inst : function->operations)
+        function->operations.forEachDef(inst, [&](uint32_t& value) { ++writes[value]; });
+    EXPECT_TRUE(std::ranges::all_of(writes, [](int count) { return count <= 1; }));
+}
+
+TEST(Optimizer, InlinesSmallFunctions)
+{
+    BSModule module;
+    module.name = "test";
+    auto square = makeFunction("square", {I32}, {I32});
+    square->operations.binary(OpCode::Mul, IRValue{0}, IRValue{0}, IRValue{1});
+    auto caller = makeFunction("caller", {I32}, {I32});
+    IRValue squared = addLocal(caller->localVars, I32);
+    IRValue inputs[] = {IRValue{0}};
+    IRValue outputs[] = {squared};
+    caller->operations.call(std::string("square"), inputs, outputs);
+    caller->operations.binary(OpCode::Add, squared, IRValue{0}, IRValue{1});
+    module.functions = {square, caller};
+
+    EXPECT_TRUE(inlineCalls(std::span(&module, 1)));
+    EXPECT_EQ(countOps(caller->operations, OpCode::Call), 0);
+    EXPECT_EQ(run(module, "caller", {6}), 42);
+}
+
+TEST(Optimizer, RecursiveFunctionsAreNotInlined)
+{
+    BSModule module;
+    module.name = "test";
+    auto callSelf = [](BSFunction& function, std::string target)
+    {
+        IRValue inputs[] = {IRValue{0}};
+        IRValue outputs[] = {IRValue{1}};
+        function.operations.call(std::move(target), inputs, outputs);
+    };
+    auto self = makeFunction("self", {I32}, {I32});
+    callSelf(*self, "self");
+    auto ping = makeFunction("ping", {I32}, {I32});
+    callSelf(*ping, "pong");
+    auto pong = makeFunction("pong", {I32}, {I32});
+    callSelf(*pong, "ping");
+    auto caller = makeFunction("caller", {I32}, {I32});
+    IRValue first = addLocal(caller->localVars, I32);
+    IRValue inputs[] = {IRValue{0}};
+    IRValue outputs[] = {first};
+    caller->operations.call(std::string("self"), inputs, outputs);
+    IRValue inputs2[] = {first};
+    IRValue outputs2[] = {IRValue{1}};
+    caller->operations.call(std::string("ping"), inputs2, outputs2);
+    module.functions = {self, ping, pong, caller};
+
+    EXPECT_FALSE(inlineCalls(std::span(&module, 1)));
+    for(auto& function : module.functions)
+        EXPECT_EQ(countOps(function->operations, OpCode::Call), function == caller ? 2 : 1) << function->id;
+}
+
+TEST(Optimizer, CalleesAboveTheThresholdAreNotInlined)
+{
+    // times31(x) adds x to itself 30 times, while the default model inlines calls with one argument and one result
+    // into callees of up to 16 + 8 + 2 instructions
+    BSModule module;
+    module.name = "test";
+    auto times31 = makeFunction("times31", {I32}, {I32});
+    IRValue sum = IRValue{0};
+    for(int i = 0; i < 30; ++i)
+    {
+        IRValue next = i == 29 ? IRValue{1} : addLocal(times31->localVars, I32);
+        times31->operations.binary(OpCode::Add, sum, IRValue{0}, next);
+        sum = next;
+    }
+    auto caller = makeFunction("caller", {I32}, {I32});
+    IRValue inputs[] = {IRValue{0}};
+    IRValue outputs[] = {IRValue{1}};
+    caller->operations.call(std::string("times31"), inputs, outputs);
+    module.functions = {times31, caller};
+
+    InlineOptions options;
+    ASSERT_EQ(inlineSize(times31->operations), 30);
+    EXPECT_FALSE(inlineCalls(std::span(&module, 1), options));
+    EXPECT_EQ(countOps(caller->operations, OpCode::Call), 1);
+    EXPECT_EQ(run(module, "caller", {3}), 93);
+
+    options.threshold = 20;
+    EXPECT_TRUE(inlineCalls(std::span(&module, 1), options));
+    EXPECT_EQ(countOps(caller->operations, OpCode::Call), 0);
+    EXPECT_EQ(run(module, "caller", {3}), 93);
+}
+
+TEST(Optimizer, InlinesStructTypesAcrossModules)
+{
+    std::array<BSModule, 2> modules;
+    auto& lib = modules[0];
+    lib.name = "lib";
+    auto vec = std::make_shared<BSStruct>();
+    vec->id = "Vec";
+    vec->members = {I32, I32};
+    lib.structs = {vec};
+    // The callee refers to its struct by index, which means something else in the caller's module
+    auto length = makeFunction("lib::length", {I32}, {I32});
+    TypeId local = lib.types.structType(int32_t{1});
+    addLocal(length->localVars, local);
+    addLocal(length->localVars, lib.types.ref(local, false));
+    length->operations.binary(OpCode::Add, IRValue{0}, IRValue{0}, IRValue{1});
+    lib.functions = {length};
+
+    auto& app = modules[1];
+    app.name = "app";
+    auto other = std::make_shared<BSStruct>();
+    other->id = "Other";
+    other->members = {I32};
+    app.structs = {other};
+    auto caller = makeFunction("app::caller", {I32}, {I32});
+    IRValue inputs[] = {IRValue{0}};
+    IRValue outputs[] = {IRValue{1}};
+    caller->operations.call(std::string("lib::length"), inputs, outputs);
+    app.functions = {caller};
+
+    EXPECT_TRUE(inlineCalls(modules));
+    EXPECT_EQ(countOps(caller->operations, OpCode::Call), 0);
+    auto structName = [&](const BSType& type)
+    {
+        auto* structType = std::get_if<IRNode<BSStructType>>(&type);
+        auto* name = structType ? std::get_if<std::string>(&(*structType)->structId) : nullptr;
+        return name ? *name : std::string();
+    };
+    size_t structs = 0;
+    size_t refs = 0;
+    for(auto type : caller->localVars)
+    {
+        auto& bsType = app.types.type(type);
+        if(app.types.isStruct(type))
+        {
+            EXPECT_EQ(structName(bsType), "Vec");
+            ++structs;
+        }
+        else if(app.types.isRef(type))
+        {
+            EXPECT_EQ(structName(app.types.type(app.types.dereferenced(type))), "Vec");
+            EXPECT_FALSE(app.types.isMutableRef(type));
+            ++refs;
+        }
+    }
+    EXPECT_EQ(structs, 1);
+    EXPECT_EQ(refs, 1);
+}
+
+TEST(Optimizer, InlinesCallsFromPipelineStages)
+{
+    auto module = stagedModule();
+    std::vector<int32_t> expected;
+    for(int32_t x : {0, 3, -25, 1000})
+        expected.push_back(runPipeline(module, x));
+
+    EXPECT_TRUE(inlineCalls(std::span(&module, 1)));
+    for(auto& stage : *module.pipelines[0]->stages)
+        EXPECT_EQ(countOps(stage.operations, OpCode::Call), 0);
+    size_t i = 0;
+    for(int32_t x : {0, 3, -25, 1000})
+        EXPECT_EQ(runPipeline(module, x), expected[i++]) << x;
+}
+
+TEST(Optimizer, FusesStages)
+{
+    auto module = stagedModule();
+    std::vector<int32_t> expected;
+    for(int32_t x : {0, 3, -25, 1000})
+        expected.push_back(runPipeline(module, x));
+
+    auto& pipeline = *module.pipelines[0];
+    EXPECT_TRUE(fuseStages(pipeline, &module));
+    EXPECT_EQ(pipeline.stages->size(), 1);
+    size_t i = 0;
+    for(int32_t x : {0, 3, -25, 1000})
+        EXPECT_EQ(runPipeline(module, x), expected[i++]) << x;
+    EXPECT_FALSE(fuseStages(pipeline, &module));
+}
+
+TEST(Optimizer, StagesAreNotFusedAcrossAsyncOpsOrExternalCalls)
+{
+    // The async call completes between the first two stages, the last two may still be fused
+    auto async = stagedModule();
+    auto& asyncStages = *async.pipelines[0]->stages;
+    asyncStages[0].asyncOps.push_back(BSAsyncCall{"host::log", {IRValue{0}}, {}});
+    EXPECT_TRUE(fuseStages(*async.pipelines[0], &async));
+    ASSERT_EQ(asyncStages.size(), 2);
+    EXPECT_EQ(asyncStages[0].asyncOps.size(), 1);
+    EXPECT_EQ(asyncStages[0].operations.size(), 2);
+
+    // A function outside of the module returns at a stage boundary, so the stage calling it stays on its own
+    auto external = stagedModule("host::twice");
+    EXPECT_FALSE(fuseStages(*external.pipelines[0], &external));
+    EXPECT_EQ(external.pipelines[0]->stages->size(), 3);
+
+    // Without a module every call by name is external
+    auto unknown = stagedModule();
+    EXPECT_FALSE(fuseStages(*unknown.pipelines[0], nullptr));
+    EXPECT_EQ(unknown.pipelines[0]->stages->size(), 3);
+}
+
+TEST(Optimizer, DefaultPipelinePreservesResults)
+{
+    BSModule module;
+    module.name = "test";
+    auto function = makeFunction("f", {I32, I32}, {I32});
+    IRValue four = addLocal(function->localVars, I32);
+    IRValue scaled = addLocal(function->localVars, I32);
+    IRValue again = addLocal(function->localVars, I32);
+    IRValue copy = addLocal(function->localVars, I32);
+    IRValue mixed = addLocal(function->localVars, I32);
+    IRValue unused = addLocal(function->localVars, I32);
+    function->operations.constI32(4, four);
+    function->operations.binary(OpCode::Mul, IRValue{0}, four, scaled);
+    function->operations.binary(OpCode::Mul, IRValue{0}, four, again);
+    function->operations.mov(again, copy);
+    function->operations.binary(OpCode::BitXor, scaled, IRValue{1}, mixed);
+    function->operations.binary(OpCode::Sub, mixed, copy, unused);
+    function->operations.binary(OpCode::Sub, mixed, copy, IRValue{2});
+    module.functions = {function};
+
+    BSModule optimized = module;
+    optimized.functions = {std::make_shared<BSFunction>(*function)};
+    EXPECT_TRUE(PassManager::defaultPipeline().run(optimized));
+    EXPECT_LT(optimized.functions[0]->operations.size(), function->operations.size());
+    for(auto [a, b] : {std::pair{3, 5}, {-7, 100}, {0, 0}, {123456, -1}})
+        EXPECT_EQ(run(optimized, "f", {a, b}), run(module, "f", {a, b}));
+}
+
+TEST(SlotAllocator, ShrinksFrames)
+{
+    // Each temporary dies where the next one is written, so one slot holds all of them
+    auto function = makeFunction("f", {I32}, {I32});
+    IRValue value{0};
+    std::vector<IRValue> temps;
+    for(int i = 0; i < 6; ++i)
+    {
+        temps.push_back(addLocal(function->localVars, I32));
+        function->operations.binary(i % 2 ? OpCode::Mul : OpCode::Add, value, IRValue{0}, temps.back());
+        value = temps.back();
+    }
+    function->operations.binary(OpCode::Sub, value, IRValue{0}, IRValue{1});
+
+    auto assignment = allocate(*function);
+    EXPECT_EQ(assignment.slotTypes.size(), 3);
+    for(auto temp : temps)
+        EXPECT_EQ(assignment.valueSlots[temp.id], 2);
+    EXPECT_EQ(assignSlotsPreservingResults(function, {{0}, {3}, {-5}, {77}}), 3);
+}
+
+TEST(SlotAllocator, ValuesOfDifferentTypesNeverShareASlot)
+{
+    auto function = makeFunction("f", {I32}, {I32});
+    IRValue doubled = addLocal(function->localVars, I32);
+    IRValue asFloat = addLocal(function->localVars, TypeTable::base(BSBaseType::F32));
+    IRValue asInt = addLocal(function->localVars, I32);
+    function->operations.binary(OpCode::Add, IRValue{0}, IRValue{0}, doubled);
+    function->operations.unary(OpCode::I32ToF32, doubled, asFloat);
+    function->operations.unary(OpCode::F32ToI32, asFloat, asInt);
+    function->operations.binary(OpCode::Add, asInt, IRValue{0}, IRValue{1});
+
+    // doubled dies as asFloat is written, and asFloat as asInt is, but only asInt has the type to take a slot over
+    auto assignment = allocate(*function);
+    EXPECT_NE(assignment.valueSlots[asFloat.id], assignment.valueSlots[doubled.id]);
+    EXPECT_EQ(assignment.valueSlots[asInt.id], assignment.valueSlots[doubled.id]);
+    EXPECT_EQ(assignment.slotTypes.size(), 4);
+    EXPECT_EQ(assignSlotsPreservingResults(function, {{0}, {7}, {-300}}), 4);
+}
+
+TEST(SlotAllocator, PinnedOutputsStayReserved)
+{
+    // The output is only written by the last instruction, its slot is still never lent to the temporaries before it
+    auto function = makeFunction("f", {I32}, {I32});
+    IRValue first = addLocal(function->localVars, I32);
+    IRValue second = addLocal(function->localVars, I32);
+    function->operations.binary(OpCode::Add, IRValue{0}, IRValue{0}, first);
+    function->operations.binary(OpCode::Mul, first, first, second);
+    function->operations.binary(OpCode::Add, second, IRValue{0}, IRValue{1});
+
+    auto assignment = allocate(*function);
+    EXPECT_EQ(assignment.valueSlots[1], 1);
+    EXPECT_NE(assignment.valueSlots[first.id], 1);
+    EXPECT_NE(assignment.valueSlots[second.id], 1);
+    EXPECT_EQ(assignSlotsPreservingResults(function, {{0}, {4}, {-9}}), 3);
+
+    // Stage outputs aren't pinned, so their values are allocated like any other
+    auto body = functionBody(*function);
+    body.outputsPinned = false;
+    auto unpinned = allocateSlots(body);
+    EXPECT_EQ(unpinned.slotTypes.size(), 2);
+}
+
+TEST(SlotAllocator, DeadInputsAreReused)
+{
+    auto function = makeFunction("f", {I32, I32}, {I32});
+    IRValue square = addLocal(function->localVars, I32);
+    IRValue sum = addLocal(function->localVars, I32);
+    function->operations.binary(OpCode::Mul, IRValue{0}, IRValue{0}, square);
+    function->operations.binary(OpCode::Add, square, IRValue{1}, sum);
+    function->operations.binary(OpCode::Add, sum, sum, IRValue{2});
+
+    // The first input is dead once square is written, and both inputs are once sum is
+    auto assignment = allocate(*function);
+    EXPECT_EQ(assignment.valueSlots[0], 0);
+    EXPECT_EQ(assignment.valueSlots[1], 1);
+    EXPECT_EQ(assignment.valueSlots[square.id], 0);
+    EXPECT_LT(assignment.valueSlots[sum.id], 2);
+    EXPECT_EQ(assignment.slotTypes.size(), 3);
+
+    auto body = functionBody(*function);
+    auto intervals = computeLiveIntervals(body);
+    ASSERT_EQ(intervals.size(), 5);
+    EXPECT_EQ(intervals[0].value, 0);
+    EXPECT_EQ(intervals[0].start, entryPoint());
+    EXPECT_EQ(intervals[0].end, usePoint(0));
+}
+
+TEST(SlotAllocator, ResultsMayReuseAnOperandsSlot)
+{
+    // x is dead once the instruction reading it has read it, so the result written by that same instruction can
+    // take its slot. This is only correct because executors read every operand before writing results.
+    auto function = makeFunction("f", {I32, I32}, {I32});
+    IRValue x = addLocal(function->localVars, I32);
+    IRValue y = addLocal(function->localVars, I32);
+    function->operations.binary(OpCode::Sub, IRValue{0}, IRValue{1}, x);
+    function->operations.binary(OpCode::Mul, x, x, y);
+    function->operations.binary(OpCode::Add, y, IRValue{1}, IRValue{2});
+
+    auto assignment = allocate(*function);
+    EXPECT_EQ(assignment.valueSlots[x.id], 0);
+    EXPECT_EQ(assignment.valueSlots[y.id], assignment.valueSlots[x.id]);
+    EXPECT_EQ(assignSlotsPreservingResults(function, {{3, 4}, {10, -2}, {0, 0}, {-8, 5}}), 3);
+}
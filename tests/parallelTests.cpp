@@ -0,0 +1,131 @@
+#include "testing.h"
+
+#include "optimizer/passManager.h"
+#include "runtime/parallel.h"
+
+using namespace BraneScript;
+using namespace BraneScript::Testing;
+
+namespace
+{
+    constexpr TypeId I32 = TypeTable::base(BSBaseType::I32);
+
+    /// Pipeline "batched" can run on the batch executor, "called" calls a function so it has to run on the VM
+    BSModule sampleModule()
+    {
+        BSModule module;
+        module.name = "test";
+        auto triple = makeFunction("triple", {I32}, {I32});
+        IRValue three = addLocal(triple->localVars, I32);
+        triple->operations.constI32(3, three);
+        triple->operations.binary(OpCode::Mul, IRValue{0}, three, IRValue{1});
+        module.functions = {triple};
+
+        for(bool call : {false, true})
+        {
+            auto pipeline = makePipeline(call ? "called" : "batched", {I32, I32}, {I32});
+            auto& first = pipeline->stages->front();
+            IRValue quotient = addLocal(first.localVars, I32);
+            IRValue seven = addLocal(first.localVars, I32);
+            IRValue sum = addLocal(first.localVars, I32);
+            first.operations.binary(OpCode::Div, IRValue{0}, IRValue{1}, quotient);
+            first.operations.constI32(7, seven);
+            first.operations.binary(OpCode::Add, quotient, seven, sum);
+            first.outputs = {sum};
+            auto& second = pipeline->stages->emplace_back();
+            second.localVars = {I32, I32};
+            if(call)
+            {
+                IRValue inputs[] = {IRValue{0}};
+                IRValue outputs[] = {IRValue{1}};
+                second.operations.call(std::string("triple"), inputs, outputs);
+            }
+            else
+                second.operations.binary(OpCode::Mul, IRValue{0}, IRValue{0}, IRValue{1});
+            second.outputs = {IRValue{1}};
+            module.pipelines.push_back(pipeline);
+        }
+        PassManager::defaultPipeline().run(module);
+        return module;
+    }
+
+    class ParallelMatchesVM : public testing::TestWithParam<size_t>
+    {
+      protected:
+        static constexpr size_t count = 100003;
+        BSModule _module = sampleModule();
+        std::shared_ptr<const Program> _program;
+        std::vector<int32_t> _a, _b, _out;
+
+        void SetUp() override
+        {
+            _program = loadProgram(std::span(&_module, 1));
+            ASSERT_TRUE(_program);
+            _a.resize(count);
+            _b.resize(count);
+            _out.resize(count);
+            for(size_t i = 0; i < count; ++i)
+            {
+                _a[i] = (int32_t)(i * 7919 % 100000) - 50000;
+                _b[i] = (int32_t)(i % 13) + 1;
+            }
+        }
+
+        std::vector<int32_t> expected(uint32_t pipeline)
+        {
+            VM vm(_program);
+            std::vector<int32_t> results(count);
+            for(size_t i = 0; i < count; ++i)
+            {
+                Register inputs[] = {Register::of(_a[i]), Register::of(_b[i])};
+                Register output[1];
+                EXPECT_TRUE(vm.runPipeline(pipeline, inputs, output));
+                results[i] = output[0].as<int32_t>();
+            }
+            return results;
+        }
+
+        std::expected<void, std::string> run(ParallelExecutor& executor, uint32_t pipeline)
+        {
+            const void* inputs[] = {_a.data(), _b.data()};
+            void* outputs[] = {_out.data()};
+            return executor.runPipeline(pipeline, inputs, outputs, count);
+        }
+    };
+} // namespace
+
+TEST_P(ParallelMatchesVM, Results)
+{
+    TaskScheduler scheduler(GetParam());
+    ParallelExecutor executor(_program, scheduler, 1000);
+    for(uint32_t pipeline = 0; pipeline < _program->pipelines().size(); ++pipeline)
+    {
+        SCOPED_TRACE(_program->pipelines()[pipeline].id);
+        auto result = run(executor, pipeline);
+        ASSERT_TRUE(result) << result.error();
+        EXPECT_EQ(_out, expected(pipeline));
+    }
+}
+
+TEST_P(ParallelMatchesVM, FirstChunkTrapIsReported)
+{
+    TaskScheduler scheduler(GetParam());
+    ParallelExecutor executor(_program, scheduler, 1000);
+    _b[count - 5] = 0;
+    _b[50000] = 0;
+    for(uint32_t pipeline = 0; pipeline < _program->pipelines().size(); ++pipeline)
+    {
+        std::optional<std::string> error;
+        // The reported error must not depend on which chunk happened to finish first
+        for(int attempt = 0; attempt < 4; ++attempt)
+        {
+            auto result = run(executor, pipeline);
+            ASSERT_FALSE(result);
+            if(!error)
+                error = result.error();
+            EXPECT_EQ(result.error(), *error);
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(Workers, ParallelMatchesVM, testing::Values(0, 1, 3));
@@ -0,0 +1,88 @@
+#include "testing.h"
+
+#include "ir/profileData.h"
+
+using namespace BraneScript;
+
+namespace
+{
+    ProfileData sampleProfile()
+    {
+        ProfileData profile;
+        profile.functions["math::twice"] = {120, 4800, 0};
+        profile.functions["math::divide"] = {7, 300, 2};
+        profile.stages["p[0]"] = {50, 9000, 1};
+        profile.stages["p[1]"] = {49, 7000, 0};
+        profile.callSites.push_back({"p[0]", 0, "math::twice", {50, 2000, 0}});
+        profile.callSites.push_back({"math::divide", 3, "math::twice", {70, 2800, 0}});
+        return profile;
+    }
+
+    void expectSameCounters(const ProfileCounters& a, const ProfileCounters& b)
+    {
+        EXPECT_EQ(a.invocations, b.invocations);
+        EXPECT_EQ(a.cycles, b.cycles);
+        EXPECT_EQ(a.traps, b.traps);
+    }
+} // namespace
+
+TEST(ProfileData, SerializeRoundTrips)
+{
+    auto profile = sampleProfile();
+    auto parsed = ProfileData::parse(profile.serialize());
+    ASSERT_TRUE(parsed) << parsed.error();
+
+    ASSERT_EQ(parsed->functions.size(), profile.functions.size());
+    for(auto& [id, counters] : profile.functions)
+        expectSameCounters(parsed->functions.at(id), counters);
+    ASSERT_EQ(parsed->stages.size(), profile.stages.size());
+    for(auto& [id, counters] : profile.stages)
+        expectSameCounters(parsed->stages.at(id), counters);
+    ASSERT_EQ(parsed->callSites.size(), profile.callSites.size());
+    for(size_t i = 0; i < profile.callSites.size(); ++i)
+    {
+        EXPECT_EQ(parsed->callSites[i].caller, profile.callSites[i].caller);
+        EXPECT_EQ(parsed->callSites[i].site, profile.callSites[i].site);
+        EXPECT_EQ(parsed->callSites[i].callee, profile.callSites[i].callee);
+        expectSameCounters(parsed->callSites[i].counters, profile.callSites[i].counters);
+    }
+
+    EXPECT_EQ(parsed->callCount("math::divide", "math::twice"), 70);
+    EXPECT_EQ(parsed->pipelineCallCount("p", "math::twice"), 50);
+    EXPECT_EQ(parsed->pipelineInvocations("p"), 50);
+    EXPECT_EQ(parsed->totalCalls(), 120);
+}
+
+TEST(ProfileData, ParseSkipsCommentsAndMergesRepeatedRecords)
+{
+    auto parsed = ProfileData::parse("# recorded by two threads\n"
+                                     "\n"
+                                     "BraneScriptProfile 1\n"
+                                     "function f 1 10 0\r\n"
+                                     "  function   f 2 20 1\n"
+                                     "# trailing comment\n");
+    ASSERT_TRUE(parsed) << parsed.error();
+    ASSERT_EQ(parsed->functions.size(), 1);
+    expectSameCounters(parsed->functions.at("f"), {3, 30, 1});
+}
+
+TEST(ProfileData, ParseRejectsMalformedInput)
+{
+    auto expectError = [](std::string_view text, std::string_view message)
+    {
+        auto parsed = ProfileData::parse(text);
+        ASSERT_FALSE(parsed) << text;
+        EXPECT_NE(parsed.error().find(message), std::string::npos) << parsed.error();
+    };
+    expectError("", "Not a BraneScript profile");
+    expectError("function f 1 2 3\n", "Not a BraneScript profile");
+    expectError("BraneScriptProfile 2\n", "Unsupported profile version 2");
+    expectError("BraneScriptProfile 1\nfunction f 1 2\n", "line 2");
+    expectError("BraneScriptProfile 1\nfunction f 1 2 3 4\n", "line 2");
+    expectError("BraneScriptProfile 1\nstage p[0] 1 -2 3\n", "line 2");
+    expectError("BraneScriptProfile 1\nstage p[0] 1 2x 3\n", "line 2");
+    expectError("BraneScriptProfile 1\n\ncall f g 1 2 3\n", "line 3");
+    expectError("BraneScriptProfile 1\ncall f\n", "line 2");
+    expectError("BraneScriptProfile 1\nblock f 1 2 3\n", "line 2");
+    expectError("BraneScriptProfile 1\nfunction f 99999999999999999999 0 0\n", "line 2");
+}
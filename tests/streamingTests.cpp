@@ -0,0 +1,185 @@
+#include "testing.h"
+
+#include <thread>
+#include "runtime/streaming.h"
+#include "util/spscRing.h"
+
+using namespace BraneScript;
+using namespace BraneScript::Testing;
+
+namespace
+{
+    constexpr TypeId I32 = TypeTable::base(BSBaseType::I32);
+
+    /// (a / b + 7) * b over three stages, so that b is carried through every stage
+    std::shared_ptr<const Program> threeStageProgram()
+    {
+        BSModule module;
+        module.name = "test";
+        auto pipeline = makePipeline("p", {I32, I32}, {I32});
+        auto& divide = pipeline->stages->front();
+        IRValue quotient = addLocal(divide.localVars, I32);
+        divide.operations.binary(OpCode::Div, IRValue{0}, IRValue{1}, quotient);
+        divide.outputs = {quotient, IRValue{1}};
+
+        auto& add = pipeline->stages->emplace_back();
+        add.localVars = {I32, I32, I32, I32};
+        add.operations.constI32(7, IRValue{2});
+        add.operations.binary(OpCode::Add, IRValue{0}, IRValue{2}, IRValue{3});
+        add.outputs = {IRValue{3}, IRValue{1}};
+
+        auto& multiply = pipeline->stages->emplace_back();
+        multiply.localVars = {I32, I32, I32};
+        multiply.operations.binary(OpCode::Mul, IRValue{0}, IRValue{1}, IRValue{2});
+        multiply.outputs = {IRValue{2}};
+        module.pipelines = {pipeline};
+        return loadProgram(std::span(&module, 1));
+    }
+} // namespace
+
+TEST(SpscRing, TransfersEveryRecordInOrder)
+{
+    constexpr int64_t count = 1000000;
+    SpscRing<int64_t> ring(4, 2);
+    int64_t mismatches = 0;
+    int64_t received = 0;
+    std::thread consumer(
+        [&]
+        {
+            int64_t record[2];
+            while(true)
+            {
+                if(!ring.tryPop(record))
+                {
+                    if(!ring.closed())
+                    {
+                        ring.waitForData();
+                        continue;
+                    }
+                    // Records pushed right before closing are still there
+                    if(!ring.tryPop(record))
+                        break;
+                }
+                mismatches += record[0] != received || record[1] != -received;
+                ++received;
+            }
+        });
+    for(int64_t i = 0; i < count; ++i)
+    {
+        int64_t record[] = {i, -i};
+        while(!ring.tryPush(record))
+            ring.waitForSpace();
+    }
+    ring.close();
+    consumer.join();
+    EXPECT_EQ(received, count);
+    EXPECT_EQ(mismatches, 0);
+}
+
+TEST(SpscRing, AbandonWakesProducer)
+{
+    SpscRing<int> ring(2, 1);
+    int value = 0;
+    EXPECT_TRUE(ring.tryPush(std::span(&value, 1)));
+    EXPECT_TRUE(ring.tryPush(std::span(&value, 1)));
+    EXPECT_FALSE(ring.tryPush(std::span(&value, 1)));
+    std::thread consumer([&] { ring.abandon(); });
+    ring.waitForSpace();
+    consumer.join();
+    EXPECT_TRUE(ring.abandoned());
+}
+
+TEST(StreamingPipeline, OutputsMatchVM)
+{
+    constexpr int count = 200000;
+    auto program = threeStageProgram();
+    ASSERT_TRUE(program);
+    auto stream = StreamingPipeline::start(program, 0, 64);
+    ASSERT_TRUE(stream) << stream.error();
+    auto& pipeline = **stream;
+    EXPECT_EQ(pipeline.stageCount(), 3);
+
+    std::thread producer(
+        [&]
+        {
+            for(int i = 0; i < count; ++i)
+            {
+                Register inputs[] = {Register::of(i * 3), Register::of(i % 5 + 1)};
+                if(!pipeline.push(inputs))
+                    break;
+            }
+            pipeline.close();
+        });
+
+    VM vm(program);
+    int popped = 0;
+    int mismatches = 0;
+    Register output[1];
+    while(true)
+    {
+        auto result = pipeline.pop(output);
+        ASSERT_TRUE(result) << result.error();
+        if(!*result)
+            break;
+        Register inputs[] = {Register::of(popped * 3), Register::of(popped % 5 + 1)};
+        Register expected[1];
+        ASSERT_TRUE(vm.runPipeline(0, inputs, expected));
+        mismatches += expected[0].bits != output[0].bits;
+        ++popped;
+    }
+    producer.join();
+    EXPECT_EQ(popped, count);
+    EXPECT_EQ(mismatches, 0);
+
+    auto metrics = pipeline.metrics();
+    ASSERT_EQ(metrics.size(), 3);
+    for(auto& stage : metrics)
+    {
+        EXPECT_EQ(stage.processed, (uint64_t)count);
+        EXPECT_EQ(stage.queueCapacity, 64);
+        EXPECT_LE(stage.maxQueueDepth, stage.queueCapacity);
+    }
+}
+
+TEST(StreamingPipeline, TrapFailsTheStream)
+{
+    auto program = threeStageProgram();
+    ASSERT_TRUE(program);
+    auto stream = StreamingPipeline::start(program, 0, 16);
+    ASSERT_TRUE(stream) << stream.error();
+    auto& pipeline = **stream;
+
+    std::thread producer(
+        [&]
+        {
+            for(int i = 0; i < 100000; ++i)
+            {
+                Register inputs[] = {Register::of(i), Register::of(i == 1000 ? 0 : 1)};
+                if(!pipeline.push(inputs))
+                    break;
+            }
+            pipeline.close();
+        });
+
+    int popped = 0;
+    Register output[1];
+    std::expected<bool, std::string> result;
+    while((result = pipeline.pop(output)) && *result)
+        ++popped;
+    producer.join();
+    EXPECT_FALSE(result);
+    EXPECT_LE(popped, 1000);
+}
+
+TEST(StreamingPipeline, DestroyWithoutPopping)
+{
+    auto program = threeStageProgram();
+    ASSERT_TRUE(program);
+    auto stream = StreamingPipeline::start(program, 0, 16);
+    ASSERT_TRUE(stream) << stream.error();
+    Register inputs[] = {Register::of(1), Register::of(1)};
+    // Less than the capacity of every queue combined, so pushing can't block on the unread outputs
+    for(int i = 0; i < 40; ++i)
+        ASSERT_TRUE((*stream)->push(inputs));
+    stream->reset();
+}
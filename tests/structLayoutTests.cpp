@@ -0,0 +1,109 @@
+#include "testing.h"
+
+#include "ir/structLayout.h"
+
+using namespace BraneScript;
+
+namespace
+{
+    constexpr TypeId U8 = TypeTable::base(BSBaseType::U8);
+    constexpr TypeId U16 = TypeTable::base(BSBaseType::U16);
+    constexpr TypeId I32 = TypeTable::base(BSBaseType::I32);
+    constexpr TypeId F64 = TypeTable::base(BSBaseType::F64);
+
+    std::shared_ptr<BSStruct> makeStruct(std::string id, std::vector<TypeId> members, bool packed = false)
+    {
+        auto result = std::make_shared<BSStruct>();
+        result->id = std::move(id);
+        result->members = std::move(members);
+        result->packed = packed;
+        return result;
+    }
+
+    /// Declares a u8, an f64, a u16, an i32 and another u8, so declaration order would need 11 bytes of padding
+    BSModule mixedModule(bool packed)
+    {
+        BSModule module;
+        module.name = "test";
+        module.structs = {makeStruct("Mixed", {U8, F64, U16, I32, U8}, packed)};
+        return module;
+    }
+
+    /// The same members in the order StructLayouts lays them out in
+    struct SortedMixed
+    {
+        double b;
+        int32_t d;
+        uint16_t c;
+        uint8_t a;
+        uint8_t e;
+    };
+} // namespace
+
+TEST(StructLayout, OrdersMembersToMinimizePadding)
+{
+    auto module = mixedModule(false);
+    auto layouts = StructLayouts::compute(std::span(&module, 1));
+    ASSERT_TRUE(layouts) << layouts.error();
+    auto* mixed = layouts->find("Mixed");
+    ASSERT_NE(mixed, nullptr);
+
+    EXPECT_EQ(mixed->type, (TypeLayout{16, 8}));
+    EXPECT_EQ(mixed->order, (std::vector<uint32_t>{1, 3, 2, 0, 4}));
+    EXPECT_EQ(mixed->offsets,
+              (std::vector<uint64_t>{offsetof(SortedMixed, a),
+                                     offsetof(SortedMixed, b),
+                                     offsetof(SortedMixed, c),
+                                     offsetof(SortedMixed, d),
+                                     offsetof(SortedMixed, e)}));
+    EXPECT_TRUE(layouts->checkHostType<SortedMixed>("Mixed"));
+    EXPECT_FALSE(layouts->checkHostType<int64_t>("Mixed"));
+}
+
+TEST(StructLayout, PackedStructsKeepDeclarationOrder)
+{
+    auto module = mixedModule(true);
+    auto layouts = StructLayouts::compute(std::span(&module, 1));
+    ASSERT_TRUE(layouts) << layouts.error();
+    auto* mixed = layouts->find("Mixed");
+    ASSERT_NE(mixed, nullptr);
+
+    EXPECT_EQ(mixed->type, (TypeLayout{16, 1}));
+    EXPECT_EQ(mixed->order, (std::vector<uint32_t>{0, 1, 2, 3, 4}));
+    EXPECT_EQ(mixed->offsets, (std::vector<uint64_t>{0, 1, 9, 11, 15}));
+}
+
+TEST(StructLayout, NestedStructsAndReferences)
+{
+    BSModule module;
+    module.name = "test";
+    auto inner = module.types.structType(std::string("Mixed"));
+    auto self = module.types.ref(module.types.structType(std::string("Outer")), false);
+    module.structs = {makeStruct("Outer", {U8, inner, self}), makeStruct("Mixed", {U8, F64, U16, I32, U8})};
+    auto layouts = StructLayouts::compute(std::span(&module, 1));
+    ASSERT_TRUE(layouts) << layouts.error();
+    auto* outer = layouts->find("Outer");
+    ASSERT_NE(outer, nullptr);
+
+    // A reference to the struct itself is a pointer, only holding it by value is rejected
+    EXPECT_EQ(outer->type, (TypeLayout{32, 8}));
+    EXPECT_EQ(outer->offsets, (std::vector<uint64_t>{24, 0, 16}));
+}
+
+TEST(StructLayout, RejectsStructsContainingThemselves)
+{
+    BSModule module;
+    module.name = "test";
+    module.structs = {makeStruct("Node", {I32, module.types.structType(std::string("Node"))})};
+    auto layouts = StructLayouts::compute(std::span(&module, 1));
+    ASSERT_FALSE(layouts);
+    EXPECT_NE(layouts.error().find("Node contains itself by value"), std::string::npos) << layouts.error();
+
+    BSModule cycle;
+    cycle.name = "test";
+    cycle.structs = {makeStruct("A", {I32, cycle.types.structType(std::string("B"))}),
+                     makeStruct("B", {cycle.types.structType(std::string("A"))})};
+    layouts = StructLayouts::compute(std::span(&cycle, 1));
+    ASSERT_FALSE(layouts);
+    EXPECT_NE(layouts.error().find("contains itself by value"), std::string::npos) << layouts.error();
+}
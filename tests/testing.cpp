@@ -4,5 +4,59 @@
 
 #include "testing.h"
 
+namespace BraneScript::Testing
+{
+    std::shared_ptr<BSFunction>
+    makeFunction(std::string id, std::vector<TypeId> inputs, std::vector<TypeId> outputs)
+    {
+        auto function = std::make_shared<BSFunction>();
+        function->id = std::move(id);
+        function->localVars = inputs;
+        function->localVars.insert(function->localVars.end(), outputs.begin(), outputs.end());
+        function->inputs = std::move(inputs);
+        function->outputs = std::move(outputs);
+        return function;
+    }
 
+    IRValue addLocal(std::vector<TypeId>& localVars, TypeId type)
+    {
+        localVars.push_back(type);
+        return IRValue{(uint32_t)localVars.size() - 1};
+    }
 
+    std::shared_ptr<BSPipeline>
+    makePipeline(std::string id, std::vector<TypeId> inputs, std::vector<TypeId> outputs)
+    {
+        auto pipeline = std::make_shared<BSPipeline>();
+        pipeline->id = std::move(id);
+        pipeline->inputs = inputs;
+        pipeline->outputs = std::move(outputs);
+        pipeline->stages.emplace(1);
+        pipeline->stages->front().localVars = std::move(inputs);
+        return pipeline;
+    }
+
+    std::shared_ptr<const Program> loadProgram(std::span<const BSModule> modules)
+    {
+        auto program = Program::load(modules);
+        EXPECT_TRUE(program) << program.error();
+        if(!program)
+            return nullptr;
+        return std::make_shared<const Program>(std::move(*program));
+    }
+
+    int32_t callI32(VM& vm, std::string_view function, std::vector<int32_t> inputs)
+    {
+        auto index = vm.program().function(function);
+        EXPECT_TRUE(index) << function << " is not defined";
+        if(!index)
+            return 0;
+        std::vector<Register> registers;
+        for(int32_t input : inputs)
+            registers.push_back(Register::of(input));
+        std::vector<Register> outputs(vm.program().functions()[*index].outputCount);
+        auto result = vm.call(*index, registers, outputs);
+        EXPECT_TRUE(result) << result.error();
+        return outputs.empty() ? 0 : outputs.front().as<int32_t>();
+    }
+} // namespace BraneScript::Testing
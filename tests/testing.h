@@ -6,6 +6,31 @@
 #define BRANESCRIPT_TESTING_H
 
 #include <gtest/gtest.h>
-#include "analyzer.h"
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+#include "ir/ir.h"
+#include "runtime/vm.h"
 
-#endif
\ No newline at end of file
+namespace BraneScript::Testing
+{
+    /// Function whose first local vars are its inputs followed by its outputs
+    std::shared_ptr<BSFunction>
+    makeFunction(std::string id, std::vector<TypeId> inputs, std::vector<TypeId> outputs);
+
+    /// Adds a local var to a function or stage body
+    IRValue addLocal(std::vector<TypeId>& localVars, TypeId type);
+
+    /// Single stage pipeline, the stage's first local vars are the pipeline's inputs
+    std::shared_ptr<BSPipeline>
+    makePipeline(std::string id, std::vector<TypeId> inputs, std::vector<TypeId> outputs);
+
+    /// Loads modules, failing the current test if they don't load
+    std::shared_ptr<const Program> loadProgram(std::span<const BSModule> modules);
+
+    /// Calls a function by name with 32 bit integer arguments and returns its first output
+    int32_t callI32(VM& vm, std::string_view function, std::vector<int32_t> inputs);
+} // namespace BraneScript::Testing
+
+#endif
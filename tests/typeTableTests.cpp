@@ -0,0 +1,74 @@
+#include "testing.h"
+
+#include "ir/typeTable.h"
+
+using namespace BraneScript;
+
+namespace
+{
+    constexpr size_t baseTypeCount = (size_t)BSBaseType::I128 + 1;
+
+    BSType namedStruct(std::string name) { return std::make_shared<BSStructType>(BSStructType{std::move(name)}); }
+
+    BSType refTo(BSType contained, bool valueMutable)
+    {
+        return std::make_shared<BSRefType>(BSRefType{std::move(contained), valueMutable});
+    }
+} // namespace
+
+TEST(TypeTable, EqualTypesShareAnId)
+{
+    TypeTable types;
+    EXPECT_EQ(types.size(), baseTypeCount);
+    EXPECT_EQ(types.intern(BSBaseType::F32), TypeTable::base(BSBaseType::F32));
+
+    // Separately allocated but structurally equal types intern to the id of the first one
+    TypeId vec = types.intern(namedStruct("Vec"));
+    EXPECT_EQ(types.intern(namedStruct("Vec")), vec);
+    EXPECT_EQ(types.structType(std::string("Vec")), vec);
+    TypeId indexed = types.structType(int32_t{1});
+    EXPECT_EQ(types.intern(std::make_shared<BSStructType>(BSStructType{int32_t{1}})), indexed);
+
+    TypeId vecRef = types.intern(refTo(namedStruct("Vec"), true));
+    EXPECT_EQ(types.ref(vec, true), vecRef);
+    EXPECT_EQ(types.intern(refTo(refTo(BSBaseType::I32, false), true)),
+              types.ref(types.ref(TypeTable::base(BSBaseType::I32), false), true));
+    EXPECT_EQ(types.dereferenced(vecRef), vec);
+    EXPECT_EQ(types.dereferenced(vec), vec);
+
+    // Interning another table's types gives this table's ids for them
+    TypeTable other;
+    TypeId otherRef = other.ref(other.structType(std::string("Vec")), true);
+    EXPECT_NE(otherRef, vecRef);
+    EXPECT_EQ(types.intern(other, otherRef), vecRef);
+    EXPECT_EQ(types.intern(other, TypeTable::base(BSBaseType::U8)), TypeTable::base(BSBaseType::U8));
+    EXPECT_EQ(types.size(), baseTypeCount + 5);
+}
+
+TEST(TypeTable, DistinctTypesGetDistinctIds)
+{
+    TypeTable types;
+    std::vector<TypeId> ids = {TypeTable::base(BSBaseType::I32),
+                               TypeTable::base(BSBaseType::U32),
+                               types.structType(std::string("Vec")),
+                               types.structType(std::string("Mat")),
+                               types.structType(int32_t{1}),
+                               types.structType(int32_t{2}),
+                               types.structType(int32_t{-1}),
+                               types.ref(TypeTable::base(BSBaseType::I32), false),
+                               types.ref(TypeTable::base(BSBaseType::I32), true),
+                               types.ref(TypeTable::base(BSBaseType::U32), false),
+                               types.ref(types.structType(std::string("Vec")), false),
+                               types.ref(types.structType(int32_t{1}), false)};
+    for(size_t i = 0; i < ids.size(); ++i)
+    {
+        for(size_t j = i + 1; j < ids.size(); ++j)
+            EXPECT_NE(ids[i], ids[j]) << i << " " << j;
+    }
+    EXPECT_EQ(types.size(), baseTypeCount + ids.size() - 2);
+    EXPECT_TRUE(types.isStruct(ids[2]));
+    EXPECT_FALSE(types.isRef(ids[2]));
+    EXPECT_TRUE(types.isRef(ids[7]));
+    EXPECT_FALSE(types.isMutableRef(ids[7]));
+    EXPECT_TRUE(types.isMutableRef(ids[8]));
+}
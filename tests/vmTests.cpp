@@ -0,0 +1,390 @@
+#include "testing.h"
+
+#include <chrono>
+#include <cstring>
+#include "optimizer/passManager.h"
+
+using namespace BraneScript;
+using namespace BraneScript::Testing;
+
+namespace
+{
+    constexpr TypeId I32 = TypeTable::base(BSBaseType::I32);
+    constexpr TypeId U32 = TypeTable::base(BSBaseType::U32);
+    constexpr TypeId I64 = TypeTable::base(BSBaseType::I64);
+    constexpr TypeId F32 = TypeTable::base(BSBaseType::F32);
+
+    /// x = ((x * a + b) ^ x) repeated rounds times, every instruction depends on the one before it
+    std::shared_ptr<BSFunction> dependentChain(int rounds)
+    {
+        auto function = makeFunction("chain", {I32, I32, I32}, {I32});
+        IRValue x{0};
+        for(int i = 0; i < rounds; ++i)
+        {
+            IRValue product = addLocal(function->localVars, I32);
+            IRValue sum = addLocal(function->localVars, I32);
+            IRValue mixed = addLocal(function->localVars, I32);
+            function->operations.binary(OpCode::Mul, x, IRValue{1}, product);
+            function->operations.binary(OpCode::Add, product, IRValue{2}, sum);
+            function->operations.binary(OpCode::BitXor, sum, x, mixed);
+            x = mixed;
+        }
+        function->operations.mov(x, IRValue{3});
+        return function;
+    }
+
+    int32_t chainReference(int32_t x, int32_t a, int32_t b, int rounds)
+    {
+        for(int i = 0; i < rounds; ++i)
+            x = (int32_t)((uint32_t)x * (uint32_t)a + (uint32_t)b) ^ x;
+        return x;
+    }
+} // namespace
+
+TEST(VM, ArithmeticAndCalls)
+{
+    BSModule module;
+    module.name = "test";
+    auto triple = makeFunction("triple", {I32}, {I32});
+    IRValue three = addLocal(triple->localVars, I32);
+    triple->operations.constI32(3, three);
+    triple->operations.binary(OpCode::Mul, IRValue{0}, three, IRValue{1});
+
+    auto f = makeFunction("f", {I32, I32}, {I32});
+    IRValue product = addLocal(f->localVars, I32);
+    IRValue sum = addLocal(f->localVars, I32);
+    IRValue seven = addLocal(f->localVars, I32);
+    IRValue rem = addLocal(f->localVars, I32);
+    f->operations.binary(OpCode::Mul, IRValue{0}, IRValue{1}, product);
+    f->operations.binary(OpCode::Add, product, IRValue{0}, sum);
+    f->operations.constI32(7, seven);
+    f->operations.binary(OpCode::Mod, sum, seven, rem);
+    IRValue callInputs[] = {rem};
+    IRValue callOutputs[] = {IRValue{2}};
+    f->operations.call(std::string("triple"), callInputs, callOutputs);
+    module.functions = {triple, f};
+
+    auto program = loadProgram(std::span(&module, 1));
+    ASSERT_TRUE(program);
+    VM vm(program);
+    EXPECT_EQ(callI32(vm, "f", {5, 6}), ((5 * 6 + 5) % 7) * 3);
+    EXPECT_EQ(callI32(vm, "f", {-4, 9}), ((-4 * 9 - 4) % 7) * 3);
+}
+
+TEST(VM, OptimizedMatchesUnoptimized)
+{
+    BSModule module;
+    module.name = "test";
+    module.functions = {dependentChain(16)};
+    BSModule optimized = module;
+    optimized.functions = {std::make_shared<BSFunction>(*module.functions.front())};
+    PassManager::defaultPipeline().run(optimized);
+
+    auto program = loadProgram(std::span(&module, 1));
+    auto optimizedProgram = loadProgram(std::span(&optimized, 1));
+    ASSERT_TRUE(program && optimizedProgram);
+    VM vm(program);
+    VM optimizedVm(optimizedProgram);
+    for(int32_t x : {0, 1, -17, 12345, INT32_MAX})
+    {
+        int32_t expected = chainReference(x, 3, 7, 16);
+        EXPECT_EQ(callI32(vm, "chain", {x, 3, 7}), expected);
+        EXPECT_EQ(callI32(optimizedVm, "chain", {x, 3, 7}), expected);
+    }
+}
+
+TEST(VM, AccumulatorKeepsOperandOrder)
+{
+    // The result of one instruction is cached for the next, make sure operands are never swapped for ops where order
+    // matters, and that swapped commutative ops still read the right values
+    BSModule module;
+    module.name = "test";
+    auto sub = makeFunction("sub", {I32, I32, I32}, {I32});
+    IRValue product = addLocal(sub->localVars, I32);
+    sub->operations.binary(OpCode::Mul, IRValue{1}, IRValue{2}, product);
+    sub->operations.binary(OpCode::Sub, IRValue{0}, product, IRValue{3});
+
+    auto add = makeFunction("add", {I32, I32, I32}, {I32});
+    product = addLocal(add->localVars, I32);
+    add->operations.binary(OpCode::Mul, IRValue{1}, IRValue{2}, product);
+    add->operations.binary(OpCode::Add, IRValue{0}, product, IRValue{3});
+
+    auto greater = makeFunction("greater", {I32, I32, I32}, {I32});
+    IRValue sum = addLocal(greater->localVars, I32);
+    greater->operations.binary(OpCode::Add, IRValue{1}, IRValue{2}, sum);
+    greater->operations.binary(OpCode::Gt, IRValue{0}, sum, IRValue{3});
+
+    auto divide = makeFunction("divide", {F32, F32}, {F32});
+    IRValue square = addLocal(divide->localVars, F32);
+    divide->operations.binary(OpCode::Mul, IRValue{1}, IRValue{1}, square);
+    divide->operations.binary(OpCode::Div, IRValue{0}, square, IRValue{2});
+    module.functions = {sub, add, greater, divide};
+
+    auto program = loadProgram(std::span(&module, 1));
+    ASSERT_TRUE(program);
+    VM vm(program);
+    EXPECT_EQ(callI32(vm, "sub", {100, 3, 4}), 88);
+    EXPECT_EQ(callI32(vm, "add", {100, 3, 4}), 112);
+    EXPECT_EQ(callI32(vm, "greater", {100, 3, 4}), 1);
+    EXPECT_EQ(callI32(vm, "greater", {5, 3, 4}), 0);
+
+    Register inputs[] = {Register::of(9.0f), Register::of(2.0f)};
+    Register output[1];
+    ASSERT_TRUE(vm.call(*program->function("divide"), inputs, output));
+    EXPECT_FLOAT_EQ(output[0].as<float>(), 2.25f);
+}
+
+TEST(VM, MemoryRegions)
+{
+    BSModule module;
+    module.name = "test";
+    auto mem = makeFunction("mem", {I32}, {I32});
+    IRValue storeOffset = addLocal(mem->localVars, U32);
+    IRValue loadOffset = addLocal(mem->localVars, U32);
+    IRValue doubled = addLocal(mem->localVars, I32);
+    mem->operations.constU32(4, storeOffset);
+    mem->operations.constU32(0, loadOffset);
+    mem->operations.binary(OpCode::Add, IRValue{0}, IRValue{0}, doubled);
+    mem->operations.store(ConstU32{0}, doubled, storeOffset);
+    mem->operations.load(ConstU32{0}, loadOffset, IRValue{1});
+    module.functions = {mem};
+
+    auto program = loadProgram(std::span(&module, 1));
+    ASSERT_TRUE(program);
+    VM vm(program);
+
+    std::byte buffer[8] = {};
+    int32_t initial = 5;
+    std::memcpy(buffer, &initial, sizeof(initial));
+    MemoryRegion region{buffer, sizeof(buffer), true};
+    Register input[] = {Register::of(21)};
+    Register output[1];
+    ASSERT_TRUE(vm.call(0, input, output, std::span(&region, 1)));
+    EXPECT_EQ(output[0].as<int32_t>(), 5);
+    int32_t stored;
+    std::memcpy(&stored, buffer + 4, sizeof(stored));
+    EXPECT_EQ(stored, 42);
+
+    MemoryRegion tooSmall{buffer, 6, true};
+    EXPECT_FALSE(vm.call(0, input, output, std::span(&tooSmall, 1)));
+    MemoryRegion readOnly{buffer, sizeof(buffer), false};
+    EXPECT_FALSE(vm.call(0, input, output, std::span(&readOnly, 1)));
+    EXPECT_FALSE(vm.call(0, input, output));
+}
+
+TEST(VM, Traps)
+{
+    BSModule module;
+    module.name = "test";
+    auto divide = makeFunction("divide", {I32, I32}, {I32});
+    divide->operations.binary(OpCode::Div, IRValue{0}, IRValue{1}, IRValue{2});
+    auto recurse = makeFunction("recurse", {I32}, {I32});
+    IRValue inputs[] = {IRValue{0}};
+    IRValue outputs[] = {IRValue{1}};
+    recurse->operations.call(std::string("recurse"), inputs, outputs);
+    module.functions = {divide, recurse};
+
+    auto program = loadProgram(std::span(&module, 1));
+    ASSERT_TRUE(program);
+    VM vm(program);
+    Register byZero[] = {Register::of(1), Register::of(0)};
+    Register output[1];
+    EXPECT_FALSE(vm.call(0, byZero, output));
+    Register overflow[] = {Register::of(INT32_MIN), Register::of(-1)};
+    EXPECT_FALSE(vm.call(0, overflow, output));
+
+    Register input[] = {Register::of(1)};
+    EXPECT_FALSE(vm.call(1, input, output));
+    // A trap must leave the VM usable
+    EXPECT_EQ(callI32(vm, "divide", {9, 3}), 3);
+}
+
+TEST(VM, OperandTypesAreChecked)
+{
+    auto lowered = [](std::shared_ptr<BSFunction> function)
+    {
+        BSModule module;
+        module.name = "test";
+        module.functions = {function};
+        return Program::load(std::span(&module, 1));
+    };
+    auto expectRejected = [&](std::shared_ptr<BSFunction> function, std::string_view message)
+    {
+        auto program = lowered(function);
+        ASSERT_FALSE(program) << function->id;
+        EXPECT_NE(program.error().find(message), std::string::npos) << program.error();
+    };
+
+    auto mixed = makeFunction("mixed", {I32, F32}, {I32});
+    mixed->operations.binary(OpCode::Add, IRValue{0}, IRValue{1}, IRValue{2});
+    expectRejected(mixed, "operands have different types");
+
+    auto widened = makeFunction("widened", {I32, I32}, {F32});
+    widened->operations.binary(OpCode::Add, IRValue{0}, IRValue{1}, IRValue{2});
+    expectRejected(widened, "result type does not match the operand type");
+
+    // A 32 bit -1 written zero extended would read as 4294967295
+    auto constant = makeFunction("constant", {}, {I64});
+    constant->operations.constI32(-1, IRValue{0});
+    expectRejected(constant, "constant does not match the type of its destination");
+
+    auto conversion = makeFunction("conversion", {U32}, {F32});
+    conversion->operations.unary(OpCode::I32ToF32, IRValue{0}, IRValue{1});
+    expectRejected(conversion, "conversion operands have the wrong types");
+
+    auto truncated = makeFunction("truncated", {F32}, {I64});
+    truncated->operations.unary(OpCode::F32ToI32, IRValue{0}, IRValue{1});
+    expectRejected(truncated, "conversion operands have the wrong types");
+
+    auto moved = makeFunction("moved", {I32}, {F32});
+    moved->operations.mov(IRValue{0}, IRValue{1});
+    expectRejected(moved, "move between values of different types");
+
+    // Comparisons write 0 or 1 in whatever type their result has
+    auto compared = makeFunction("compared", {I32, I32}, {F32});
+    compared->operations.binary(OpCode::Gt, IRValue{0}, IRValue{1}, IRValue{2});
+    EXPECT_TRUE(lowered(compared));
+}
+
+TEST(VM, PipelineStages)
+{
+    BSModule module;
+    module.name = "test";
+    auto pipeline = makePipeline("p", {I32}, {I32});
+    auto& first = pipeline->stages->front();
+    IRValue ten = addLocal(first.localVars, I32);
+    IRValue sum = addLocal(first.localVars, I32);
+    first.operations.constI32(10, ten);
+    first.operations.binary(OpCode::Add, IRValue{0}, ten, sum);
+    first.outputs = {sum, IRValue{0}};
+    auto& second = pipeline->stages->emplace_back();
+    second.localVars = {I32, I32, I32};
+    second.operations.binary(OpCode::Mul, IRValue{0}, IRValue{1}, IRValue{2});
+    second.outputs = {IRValue{2}};
+    module.pipelines = {pipeline};
+
+    auto program = loadProgram(std::span(&module, 1));
+    ASSERT_TRUE(program);
+    VM vm(program);
+    Register input[] = {Register::of(21)};
+    Register output[1];
+    ASSERT_TRUE(vm.runPipeline(0, input, output));
+    EXPECT_EQ(output[0].as<int32_t>(), 31 * 21);
+}
+
+#ifdef NDEBUG
+namespace
+{
+    /// Walks the pointer based Operation form with dynamically typed values, the way the runtime worked before
+    /// bytecode was introduced
+    struct OperationWalker
+    {
+        using Value = std::variant<int32_t, uint32_t, int64_t, uint64_t, float, double>;
+        std::vector<Value> locals;
+
+        template<class F>
+        void binary(const BinaryOp& op, F f)
+        {
+            locals[op.out.id] = std::visit(
+                [&](auto left) -> Value
+                {
+                    using T = decltype(left);
+                    return f(left, std::get<T>(locals[op.right.id]));
+                },
+                locals[op.left.id]);
+        }
+
+        void run(const std::vector<Operation>& operations)
+        {
+            for(auto& op : operations)
+            {
+                std::visit(
+                    [&]<class T>(const IRNode<T>& node)
+                    {
+                        if constexpr(std::is_same_v<T, AddOp>)
+                            binary(*node, [](auto a, auto b) -> decltype(a) { return a + b; });
+                        else if constexpr(std::is_same_v<T, MulOp>)
+                            binary(*node, [](auto a, auto b) -> decltype(a) { return a * b; });
+                        else if constexpr(std::is_same_v<T, BitXorOp>)
+                            binary(*node,
+                                   [](auto a, auto b) -> decltype(a)
+                                   {
+                                       if constexpr(std::is_integral_v<decltype(a)>)
+                                           return a ^ b;
+                                       return a;
+                                   });
+                        else if constexpr(std::is_same_v<T, MovOp>)
+                            locals[node->dest.id] = locals[node->src.id];
+                    },
+                    op);
+            }
+        }
+    };
+} // namespace
+
+TEST(VM, FasterThanWalkingOperations)
+{
+    constexpr int rounds = 64;
+    BSModule module;
+    module.name = "test";
+    module.functions = {dependentChain(rounds)};
+    auto& chain = *module.functions.front();
+
+    std::vector<Operation> operations;
+    for(auto& inst : chain.operations)
+    {
+        BinaryOp binary{IRValue{inst.a}, IRValue{inst.b}, IRValue{inst.c}};
+        switch(inst.op)
+        {
+            case OpCode::Mul:
+                operations.emplace_back(std::make_shared<MulOp>(MulOp{binary}));
+                break;
+            case OpCode::Add:
+                operations.emplace_back(std::make_shared<AddOp>(AddOp{binary}));
+                break;
+            case OpCode::BitXor:
+                operations.emplace_back(std::make_shared<BitXorOp>(BitXorOp{binary}));
+                break;
+            default:
+                operations.emplace_back(std::make_shared<MovOp>(MovOp{IRValue{inst.a}, IRValue{inst.c}}));
+                break;
+        }
+    }
+
+    auto program = loadProgram(std::span(&module, 1));
+    ASSERT_TRUE(program);
+    VM vm(program);
+
+    using Clock = std::chrono::steady_clock;
+    constexpr int iterations = 200000;
+    int64_t vmSum = 0;
+    Register output[1];
+    auto start = Clock::now();
+    for(int i = 0; i < iterations; ++i)
+    {
+        Register inputs[] = {Register::of(i), Register::of(3), Register::of(7)};
+        (void)vm.call(0, inputs, output);
+        vmSum += output[0].as<int32_t>();
+    }
+    auto vmTime = Clock::now() - start;
+
+    OperationWalker walker;
+    int64_t walkerSum = 0;
+    start = Clock::now();
+    for(int i = 0; i < iterations; ++i)
+    {
+        walker.locals.assign(chain.localVars.size(), int32_t(0));
+        walker.locals[0] = int32_t(i);
+        walker.locals[1] = int32_t(3);
+        walker.locals[2] = int32_t(7);
+        walker.run(operations);
+        walkerSum += std::get<int32_t>(walker.locals[3]);
+    }
+    auto walkerTime = Clock::now() - start;
+
+    EXPECT_EQ(vmSum, walkerSum);
+    double speedup = std::chrono::duration<double>(walkerTime) / std::chrono::duration<double>(vmTime);
+    RecordProperty("speedup", std::to_string(speedup));
+    EXPECT_GE(speedup, 10.0);
+}
+#endif